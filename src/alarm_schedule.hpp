@@ -0,0 +1,432 @@
+#pragma once
+#ifndef _INCLUDE_ALARM_SCHEDULE_HPP_
+#define _INCLUDE_ALARM_SCHEDULE_HPP_
+
+// コンパイルエラーを防ぐため， Arduino.h で定義されているマクロをundef
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "time_of_day.hpp"
+
+namespace sugar {
+
+/// 曜日の集合。 bit0 が日曜日、 bit6 が土曜日。
+enum Weekdays : uint8_t {
+  SUNDAY = 1 << 0,
+  MONDAY = 1 << 1,
+  TUESDAY = 1 << 2,
+  WEDNESDAY = 1 << 3,
+  THURSDAY = 1 << 4,
+  FRIDAY = 1 << 5,
+  SATURDAY = 1 << 6,
+  EVERY_DAY = 0x7F,
+  WORKDAYS = MONDAY | TUESDAY | WEDNESDAY | THURSDAY | FRIDAY,
+  WEEKENDS = SATURDAY | SUNDAY,
+};
+
+/// アラームの規則。
+///
+/// 毎週決まった曜日に鳴らすか、決まった日に1回だけ鳴らす。
+struct AlarmRule {
+  /// `date` がこの値なら、次にその時刻になったときに1回だけ鳴らす。
+  static constexpr int32_t NEXT_OCCURRENCE = INT32_MIN;
+
+  /// 鳴らす時刻 (ローカル時刻)。
+  TimeOfDay time;
+  /// 繰り返す曜日 (`Weekdays` の組み合わせ)。 0 なら `date` の1回だけ。
+  uint8_t weekdays;
+  /// 1回だけ鳴らす日 (1970-01-01 からの日数)。
+  int32_t date;
+
+  /// 毎週 `weekdays` の `time` に鳴らす。
+  static constexpr AlarmRule weekly(TimeOfDay time, uint8_t weekdays) {
+    return AlarmRule{time, static_cast<uint8_t>(weekdays & EVERY_DAY), 0};
+  }
+  /// `date` の `time` に1回だけ鳴らす。
+  static constexpr AlarmRule once(TimeOfDay time, int32_t date) {
+    return AlarmRule{time, 0, date};
+  }
+  /// 次に `time` になったときに1回だけ鳴らす。
+  static constexpr AlarmRule nextOnce(TimeOfDay time) {
+    return AlarmRule{time, 0, NEXT_OCCURRENCE};
+  }
+
+  /// 繰り返すかどうかを返す。
+  constexpr bool repeats() const { return weekdays != 0; }
+};
+static_assert(std::is_trivially_copyable<AlarmRule>::value,
+              "AlarmRule must be trivially copyable");
+
+/// アラームの予定表。
+///
+/// 予定は固定長の配列に持ち、次に鳴る時刻の最小ヒープで索引する。
+/// 次の期限は `nextDeadline()` で O(1) で得られ、予定の追加・削除や鳴動後の
+/// 再計算は変更のあった予定だけを O(log n) で並べ直す。
+/// ヒープ確保は発生しない。
+///
+/// 時刻はすべてローカル時刻の 1970-01-01 00:00 からのミリ秒で表す。
+/// 予定表自体は排他制御をしないので、1つのタスクからのみ操作すること。
+class AlarmSchedule {
+public:
+  /// ローカル時刻の 1970-01-01 00:00 からのミリ秒。
+  using Millis = int64_t;
+  /// 予定の番号。
+  using AlarmId = uint8_t;
+
+  /// 予定の最大数。
+  static constexpr size_t MAX_ALARMS = 16;
+  /// 鳴らさない日の最大数。
+  static constexpr size_t MAX_SKIP_DATES = 16;
+  /// 無効な予定の番号。
+  static constexpr AlarmId INVALID_ID = 0xFF;
+  /// 次に鳴る時刻がないことを表す。
+  static constexpr Millis NEVER = INT64_MAX;
+  /// 1日のミリ秒数。
+  static constexpr Millis MILLIS_PER_DAY = 24LL * 60 * 60 * 1000;
+
+  /// 鳴動。
+  struct Firing {
+    /// 鳴った予定の番号。
+    AlarmId id;
+    /// 鳴るはずだった時刻。
+    Millis deadline;
+  };
+
+  /// `t` を含む日 (1970-01-01 からの日数) を返す。
+  static constexpr int32_t dayOf(Millis t) {
+    return static_cast<int32_t>(t >= 0 ? t / MILLIS_PER_DAY
+                                       : -((-t + MILLIS_PER_DAY - 1) /
+                                           MILLIS_PER_DAY));
+  }
+  /// `day` の曜日を返す。 0 が日曜日。
+  static constexpr int weekdayOf(int32_t day) {
+    // 1970-01-01 は木曜日
+    return ((day % 7) + 7 + 4) % 7;
+  }
+  /// 協定世界時を日本標準時のミリ秒へ変換する。
+  template <typename Clock, typename Duration>
+  static Millis fromUtcToJst(std::chrono::time_point<Clock, Duration> utc) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               utc.time_since_epoch() + std::chrono::hours(9))
+        .count();
+  }
+
+private:
+  /// 予定の枠。
+  struct Slot {
+    AlarmRule rule;
+    /// 次に鳴る時刻。ヒープに入っていなければ `NEVER`。
+    Millis deadline;
+    /// ヒープ上の位置。ヒープに入っていなければ `MAX_ALARMS`。
+    uint8_t heapIndex;
+    /// 使用中か否か。
+    bool used;
+  };
+
+  Slot m_slots[MAX_ALARMS];
+  /// 次に鳴る時刻の最小ヒープ。要素は予定の番号。
+  AlarmId m_heap[MAX_ALARMS];
+  size_t m_heapSize = 0;
+  /// 鳴らさない日。
+  int32_t m_skipDates[MAX_SKIP_DATES];
+  size_t m_skipCount = 0;
+
+public:
+  AlarmSchedule() { clear(); }
+
+  /// 予定をすべて消す。
+  void clear() {
+    for (auto &slot : m_slots) {
+      slot.used = false;
+      slot.deadline = NEVER;
+      slot.heapIndex = MAX_ALARMS;
+    }
+    m_heapSize = 0;
+    m_skipCount = 0;
+  }
+
+  /// 空いている枠に予定を追加し、その番号を返す。
+  ///
+  /// 空きがなければ `INVALID_ID` を返す。
+  AlarmId add(const AlarmRule &rule, Millis now) {
+    for (size_t i = 0; i < MAX_ALARMS; ++i) {
+      if (!m_slots[i].used) {
+        set(static_cast<AlarmId>(i), rule, now);
+        return static_cast<AlarmId>(i);
+      }
+    }
+    return INVALID_ID;
+  }
+
+  /// 番号 `id` の予定を設定 (或いは置き換え) する。
+  bool set(AlarmId id, AlarmRule rule, Millis now) {
+    if (id >= MAX_ALARMS) {
+      return false;
+    }
+    if (!rule.repeats() && rule.date == AlarmRule::NEXT_OCCURRENCE) {
+      // 今日のその時刻が過ぎていれば明日にする
+      const int32_t today = dayOf(now);
+      const Millis todays =
+          today * MILLIS_PER_DAY + rule.time.millisSinceMidnight();
+      rule.date = todays >= now ? today : today + 1;
+    }
+    m_slots[id].rule = rule;
+    m_slots[id].used = true;
+    reschedule(id, now);
+    return true;
+  }
+
+  /// 番号 `id` の予定を消す。
+  bool remove(AlarmId id) {
+    if (id >= MAX_ALARMS || !m_slots[id].used) {
+      return false;
+    }
+    unschedule(id);
+    m_slots[id].used = false;
+    return true;
+  }
+
+  /// `day` には繰り返しの予定を鳴らさない。
+  bool skip(int32_t day, Millis now) {
+    if (isSkipped(day)) {
+      return true;
+    }
+    pruneSkipDates(now);
+    if (m_skipCount >= MAX_SKIP_DATES) {
+      return false;
+    }
+    m_skipDates[m_skipCount++] = day;
+    // その日に鳴る予定だけを再計算すればよい
+    for (size_t i = 0; i < MAX_ALARMS; ++i) {
+      const Slot &slot = m_slots[i];
+      if (slot.used && slot.rule.repeats() && slot.deadline != NEVER &&
+          dayOf(slot.deadline) == day) {
+        reschedule(static_cast<AlarmId>(i), now);
+      }
+    }
+    return true;
+  }
+
+  /// `day` を鳴らさない日から外す。
+  bool unskip(int32_t day, Millis now) {
+    for (size_t i = 0; i < m_skipCount; ++i) {
+      if (m_skipDates[i] == day) {
+        m_skipDates[i] = m_skipDates[--m_skipCount];
+        // その日が次の鳴動日になるかもしれないので繰り返しの予定を再計算する
+        for (size_t j = 0; j < MAX_ALARMS; ++j) {
+          if (m_slots[j].used && m_slots[j].rule.repeats()) {
+            reschedule(static_cast<AlarmId>(j), now);
+          }
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// すべての予定の次の時刻を `now` から計算し直す。
+  ///
+  /// 時計が大きく飛んだときに使う。
+  void rebase(Millis now) {
+    for (size_t i = 0; i < MAX_ALARMS; ++i) {
+      if (m_slots[i].used) {
+        reschedule(static_cast<AlarmId>(i), now);
+      }
+    }
+  }
+
+  /// `now` が次の期限を過ぎていれば、その予定を取り出して `firing` に入れる。
+  ///
+  /// 繰り返しの予定は次回を予約し、1回だけの予定は消す。
+  /// 鳴動の遅れが何日分あっても、次回は `now` 以降になる。
+  bool pop(Millis now, Firing &firing) {
+    if (m_heapSize == 0 || now < m_slots[m_heap[0]].deadline) {
+      return false;
+    }
+    const AlarmId id = m_heap[0];
+    firing = Firing{id, m_slots[id].deadline};
+    pruneSkipDates(now);
+    if (m_slots[id].rule.repeats()) {
+      const Millis from = firing.deadline + 1 > now ? firing.deadline + 1 : now;
+      reschedule(id, from);
+    } else {
+      remove(id);
+    }
+    return true;
+  }
+
+  /// 予約されている予定がなければ `true` を返す。
+  bool empty() const { return m_heapSize == 0; }
+  /// 予約されている予定の数を返す。
+  size_t size() const { return m_heapSize; }
+  /// 次に鳴る時刻を返す。なければ `NEVER`。
+  Millis nextDeadline() const {
+    if (m_heapSize == 0) {
+      return NEVER;
+    }
+    return m_slots[m_heap[0]].deadline;
+  }
+  /// 次に鳴る予定の番号を返す。なければ `INVALID_ID`。
+  AlarmId nextId() const {
+    if (m_heapSize == 0) {
+      return INVALID_ID;
+    }
+    return m_heap[0];
+  }
+  /// 番号 `id` の予定を返す。なければ `nullptr`。
+  const AlarmRule *rule(AlarmId id) const {
+    return id < MAX_ALARMS && m_slots[id].used ? &m_slots[id].rule : nullptr;
+  }
+  /// 番号 `id` の予定が次に鳴る時刻を返す。なければ `NEVER`。
+  Millis deadline(AlarmId id) const {
+    if (id >= MAX_ALARMS || !m_slots[id].used) {
+      return NEVER;
+    }
+    return m_slots[id].deadline;
+  }
+
+  /// `day` が鳴らさない日かどうかを返す。
+  bool isSkipped(int32_t day) const {
+    for (size_t i = 0; i < m_skipCount; ++i) {
+      if (m_skipDates[i] == day) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// `rule` が `from` 以降で最初に鳴る時刻を返す。なければ `NEVER`。
+  Millis nextOccurrence(const AlarmRule &rule, Millis from) const {
+    const Millis timeOfDay = rule.time.millisSinceMidnight();
+    if (!rule.repeats()) {
+      const Millis t = rule.date * MILLIS_PER_DAY + timeOfDay;
+      if (t < from) {
+        return NEVER;
+      }
+      return t;
+    }
+    // 鳴らさない日1つにつき候補は高々1つしか減らないので、
+    // この日数だけ探せば必ず見つかる
+    constexpr int32_t SEARCH_DAYS = 7 * (MAX_SKIP_DATES + 2);
+    int32_t day = dayOf(from);
+    for (int32_t i = 0; i < SEARCH_DAYS; ++i, ++day) {
+      if (!(rule.weekdays & (1 << weekdayOf(day))) || isSkipped(day)) {
+        continue;
+      }
+      const Millis t = day * MILLIS_PER_DAY + timeOfDay;
+      if (t >= from) {
+        return t;
+      }
+    }
+    return NEVER;
+  }
+
+private:
+  /// `now` を含む日より前の鳴らさない日を消す。
+  ///
+  /// 過ぎた日は二度と参照されないが、残すと枠を使い切って `skip()` が
+  /// 失敗し続け、 RTC メモリにも残り続ける。
+  void pruneSkipDates(Millis now) {
+    const int32_t today = dayOf(now);
+    for (size_t i = 0; i < m_skipCount;) {
+      if (m_skipDates[i] < today) {
+        m_skipDates[i] = m_skipDates[--m_skipCount];
+      } else {
+        ++i;
+      }
+    }
+  }
+
+  /// 予定 `id` の次の時刻を `from` から計算し、ヒープ上の位置を直す。
+  void reschedule(AlarmId id, Millis from) {
+    Slot &slot = m_slots[id];
+    slot.deadline = nextOccurrence(slot.rule, from);
+    if (slot.deadline == NEVER) {
+      unschedule(id);
+      return;
+    }
+    if (slot.heapIndex >= m_heapSize) {
+      slot.heapIndex = static_cast<uint8_t>(m_heapSize);
+      m_heap[m_heapSize++] = id;
+    }
+    siftDown(siftUp(slot.heapIndex));
+  }
+
+  /// 予定 `id` をヒープから外す。
+  void unschedule(AlarmId id) {
+    Slot &slot = m_slots[id];
+    const size_t index = slot.heapIndex;
+    slot.deadline = NEVER;
+    slot.heapIndex = MAX_ALARMS;
+    if (index >= m_heapSize) {
+      return;
+    }
+    --m_heapSize;
+    if (index == m_heapSize) {
+      return;
+    }
+    // 末尾の要素を空いた位置へ移して並べ直す
+    place(index, m_heap[m_heapSize]);
+    siftDown(siftUp(index));
+  }
+
+  /// ヒープの `index` に予定 `id` を置く。
+  void place(size_t index, AlarmId id) {
+    m_heap[index] = id;
+    m_slots[id].heapIndex = static_cast<uint8_t>(index);
+  }
+
+  bool less(size_t a, size_t b) const {
+    return m_slots[m_heap[a]].deadline < m_slots[m_heap[b]].deadline;
+  }
+
+  size_t siftUp(size_t index) {
+    while (index > 0) {
+      const size_t parent = (index - 1) / 2;
+      if (!less(index, parent)) {
+        break;
+      }
+      const AlarmId tmp = m_heap[parent];
+      place(parent, m_heap[index]);
+      place(index, tmp);
+      index = parent;
+    }
+    return index;
+  }
+
+  void siftDown(size_t index) {
+    while (true) {
+      const size_t left = index * 2 + 1;
+      if (left >= m_heapSize) {
+        break;
+      }
+      const size_t right = left + 1;
+      const size_t child =
+          right < m_heapSize && less(right, left) ? right : left;
+      if (!less(child, index)) {
+        break;
+      }
+      const AlarmId tmp = m_heap[child];
+      place(child, m_heap[index]);
+      place(index, tmp);
+      index = child;
+    }
+  }
+};
+static_assert(AlarmSchedule::dayOf(0) == 0, "");
+static_assert(AlarmSchedule::dayOf(-1) == -1, "");
+static_assert(AlarmSchedule::dayOf(AlarmSchedule::MILLIS_PER_DAY) == 1, "");
+static_assert(AlarmSchedule::weekdayOf(0) == 4, "1970-01-01 was a Thursday");
+static_assert(AlarmSchedule::weekdayOf(-4) == 0, "1969-12-28 was a Sunday");
+static_assert(AlarmSchedule::MAX_ALARMS < AlarmSchedule::INVALID_ID, "");
+} // namespace sugar
+#endif
@@ -0,0 +1,20 @@
+/**
+ * @file accel_sample.hpp
+ * @brief 加速度の1サンプルを表す型を持つ
+ */
+#pragma once
+#ifndef _INCLUDE_ACCEL_SAMPLE_HPP_
+#define _INCLUDE_ACCEL_SAMPLE_HPP_
+
+namespace hardware {
+/// 加速度の1サンプル [g]。
+///
+/// ホストでも使うので、 Arduino のヘッダには依存しない。
+struct AccelSample {
+  float x;
+  float y;
+  float z;
+};
+} // namespace hardware
+
+#endif
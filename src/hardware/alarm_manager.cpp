@@ -1,13 +1,41 @@
+#include <cstring>
+#include <type_traits>
+
+#include <esp_attr.h>
+
 #include "alarm_manager.hpp"
-#include "hardware.h"
 
 namespace hardware {
+namespace {
+/// RTC メモリに残す予定表。
+struct AlarmRtcImage {
+  /// 有効な内容であることを示す値。
+  uint32_t magic;
+  /// `sugar::AlarmSchedule` のバイト列。
+  alignas(sugar::AlarmSchedule) uint8_t schedule[sizeof(sugar::AlarmSchedule)];
+};
+static_assert(std::is_trivially_copyable<sugar::AlarmSchedule>::value,
+              "AlarmSchedule is copied into RTC memory byte by byte");
+/// 予定表の大きさが変わったファームウェアでは読み込まない。
+constexpr uint32_t ALARM_RTC_MAGIC =
+    0x414C0000 ^ static_cast<uint32_t>(sizeof(sugar::AlarmSchedule));
+
+// deep sleep 中も保持される
+// 静的初期化で消えないよう、コンストラクタを持たない型にする
+RTC_DATA_ATTR AlarmRtcImage s_alarmRtcImage;
+} // namespace
 
-bool AlarmTimeSetter::setAlarmTime(const sugar::TimeOfDay &time) {
-  Hardware::setAlarmEnabled(true);
-  Hardware::setAlarmTimeCache(time);
-  auto obj = std::make_unique<sugar::TimeOfDay>(time);
-  sugar::TimeOfDay *ptr = obj.release();
-  return xQueueSendToBack(m_queue, &ptr, 0) == pdTRUE;
+void AlarmManager::persistSchedule() {
+  std::memcpy(s_alarmRtcImage.schedule, &m_schedule, sizeof(m_schedule));
+  s_alarmRtcImage.magic = ALARM_RTC_MAGIC;
 }
+
+bool AlarmManager::restoreSchedule() {
+  if (s_alarmRtcImage.magic != ALARM_RTC_MAGIC) {
+    return false;
+  }
+  std::memcpy(&m_schedule, s_alarmRtcImage.schedule, sizeof(m_schedule));
+  return true;
+}
+
 } // namespace hardware
@@ -10,25 +10,62 @@
 #undef max
 #endif
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <functional>
-#include <memory>
-#include <utility>
 
 #include <esp32-hal-log.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 #include <freertos/task.h>
 
+#include "../alarm_schedule.hpp"
+#include "../task_registry.hpp"
 #include "../time_of_day.hpp"
+#include "alarm_state.hpp"
+#include "alarm_timekeeper.hpp"
 
 namespace hardware {
+/// アラームの予定表を変更するコマンド。
+struct AlarmCommand {
+  /// 操作の種類。
+  enum class Op : uint8_t {
+    /// 予定 `id` を `rule` で設定する。
+    Set,
+    /// 予定 `id` を消す。
+    Remove,
+    /// `date` には繰り返しの予定を鳴らさない。
+    Skip,
+    /// `date` を鳴らさない日から外す。
+    Unskip,
+    /// 何も変えずに、現在時刻と次の期限を比べ直す。
+    ///
+    /// 期限のタイマーが満了したときに送られる。
+    Check,
+  };
+
+  Op op;
+  sugar::AlarmSchedule::AlarmId id;
+  sugar::AlarmRule rule;
+  int32_t date;
+};
+
 /// アラーム時刻設定機構。
 class AlarmTimeSetter {
 private:
   QueueHandle_t m_queue;
+  SharedAlarmState *m_state;
 
 public:
-  AlarmTimeSetter(QueueHandle_t q) : m_queue(q) {}
+  /// 画面から設定するアラームの予定番号。
+  ///
+  /// この予定は `SharedAlarmState` を通して設定するので、 `setAlarm()` や
+  /// `removeAlarm()` で直接操作しないこと。
+  static constexpr sugar::AlarmSchedule::AlarmId PRIMARY_ALARM = 0;
+
+  AlarmTimeSetter(QueueHandle_t q, SharedAlarmState *state)
+      : m_queue(q), m_state(state) {}
   AlarmTimeSetter(const AlarmTimeSetter &) = default;
   AlarmTimeSetter(AlarmTimeSetter &&) = default;
   AlarmTimeSetter &operator=(const AlarmTimeSetter &) = default;
@@ -36,30 +73,107 @@ public:
 
   /// 時刻を設定する。
   ///
-  /// 正しく設定コマンドが送信されたとき `true` を返す。
+  /// `weekdays` が 0 なら次にその時刻になったときに1回だけ、そうでなければ
+  /// 毎週その曜日に鳴らす。画面から設定するアラームを置き換える。
   ///
-  /// ついでに `Hardware::alarmStateCache` も更新する。
-  bool setAlarmTime(const sugar::TimeOfDay &time);
+  /// 共有のアラーム状態を書き換えるだけなので、どのタスクからも直ちに
+  /// 新しい状態が読める。 `AlarmManager` は次の確認で予定表へ反映する。
+  bool setAlarmTime(const sugar::TimeOfDay &time, uint8_t weekdays = 0) {
+    m_state->store(true, time, weekdays);
+    return check();
+  }
+
+  /// 画面から設定したアラームを止める。
+  bool clearAlarmTime() {
+    const AlarmSnapshot current = m_state->load();
+    m_state->store(false, current.time, 0);
+    return check();
+  }
+
+  /// 予定 `id` を設定する。
+  bool setAlarm(sugar::AlarmSchedule::AlarmId id,
+                const sugar::AlarmRule &rule) {
+    return send(AlarmCommand{AlarmCommand::Op::Set, id, rule, 0});
+  }
+  /// 予定 `id` を消す。
+  bool removeAlarm(sugar::AlarmSchedule::AlarmId id) {
+    return send(AlarmCommand{AlarmCommand::Op::Remove, id, {}, 0});
+  }
+  /// `date` (1970-01-01 からの日数) には繰り返しの予定を鳴らさない。
+  bool skipDate(int32_t date) {
+    return send(AlarmCommand{AlarmCommand::Op::Skip, 0, {}, date});
+  }
+  /// `date` を鳴らさない日から外す。
+  bool unskipDate(int32_t date) {
+    return send(AlarmCommand{AlarmCommand::Op::Unskip, 0, {}, date});
+  }
+  /// 現在時刻と次の期限を比べ直させる。
+  bool check() {
+    return send(AlarmCommand{AlarmCommand::Op::Check, 0, {}, 0});
+  }
+
+private:
+  bool send(const AlarmCommand &cmd) {
+    return xQueueSendToBack(m_queue, &cmd, 0) == pdTRUE;
+  }
+};
+
+/// アラームの鳴動の統計情報。
+struct AlarmFiringStats {
+  /// 鳴らした回数。
+  uint32_t fired;
+  /// 遅れすぎて鳴らさなかった回数。
+  uint32_t missed;
+  /// 壁時計の飛びを検出した回数。
+  uint32_t clockJumps;
+  /// 直前の鳴動の、期限からの遅れ [us]。
+  int32_t lastErrorMicros;
+  /// 期限からの遅れの最大値 [us]。
+  int32_t maxErrorMicros;
 };
 
 /// アラームイベント発生を担当するクラス。
+///
+/// 複数のアラームを `sugar::AlarmSchedule` で管理する。
+/// 次の期限までの時間を計算して単発の高分解能タイマー (`esp_timer`) を
+/// 仕掛け、それまでタスクは眠る。予定が変わったときと、壁時計の飛び
+/// (NTP による補正など) を検出したときはタイマーを仕掛け直す。
+/// 期限と時計の飛びの計算は `AlarmTimekeeper` が受け持つ。
 class AlarmManager {
 public:
   /// アラームイベントのコールバック関数型。
   typedef std::function<void()> EventCallback;
 
 private:
-  /// アラームが有効化されているか否か。
-  std::atomic_bool m_alarmIsSet;
-  /// アラーム設定時刻。
-  sugar::TimeOfDay m_alarmTime;
+  /// 予約されているアラームがあるか否か。
+  std::atomic_bool m_alarmIsSet{false};
+  /// アラームの予定表。 `task()` からのみ操作する。
+  sugar::AlarmSchedule m_schedule;
+  /// 画面から設定するアラームの状態。
+  SharedAlarmState m_state;
+  /// 予定表へ反映済みの `m_state` の世代番号。
+  uint32_t m_appliedGeneration = 0;
   /// コールバック関数。
   EventCallback eventCallback = nullptr;
   /// アラーム時刻設定用キュー。
   QueueHandle_t m_timeSetterQueue;
+  /// 次の期限に満了するタイマー。
+  esp_timer_handle_t m_deadlineTimer = nullptr;
+  /// 期限と壁時計の飛びの計算。
+  AlarmTimekeeper m_timekeeper;
+  /// 鳴動の統計情報。
+  std::atomic<uint32_t> m_fired{0};
+  std::atomic<uint32_t> m_missed{0};
+  std::atomic<uint32_t> m_clockJumps{0};
+  // 鳴らした遅れは `AlarmTimekeeper::MISSED_ALARM_TOLERANCE_MILLIS` 以下
+  // なので 32 ビットに収まる
+  std::atomic<int32_t> m_lastErrorMicros{0};
+  std::atomic<int32_t> m_maxErrorMicros{0};
+  /// 次の期限 (日本標準時の 1970-01-01 からの秒数)。なければ 0。
+  ///
+  /// 他のタスクから読むための写し。
+  std::atomic<uint32_t> m_nextDeadlineSeconds{0};
 
-  /// Tick 周期。
-  static constexpr int PeriodMillis = 100;
   /// キューのサイズ。
   static constexpr int TIME_SETTER_QUEUE_SIZE = 16;
 
@@ -71,59 +185,239 @@ public:
 
   /// イベント待機を開始する
   void begin() {
+    // deep sleep やリセットの前の予定が RTC メモリに残っていれば引き継ぐ
+    if (restoreSchedule()) {
+      log_i("AlarmManager: restored %u alarms from RTC memory",
+            static_cast<unsigned>(m_schedule.size()));
+      // 画面から設定したアラームの状態も復元する
+      const sugar::AlarmRule *primary =
+          m_schedule.rule(AlarmTimeSetter::PRIMARY_ALARM);
+      if (primary) {
+        m_appliedGeneration =
+            m_state.store(true, primary->time, primary->weekdays);
+      }
+      m_alarmIsSet = !m_schedule.empty();
+      publishNextDeadline();
+    }
+    m_timeSetterQueue = xQueueCreate(TIME_SETTER_QUEUE_SIZE, sizeof(AlarmCommand));
+    // 期限のタイマーは満了をキューへ知らせるだけ
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = [](void *this_obj) {
+      static_cast<AlarmManager *>(this_obj)->alarmTimeSetter().check();
+    };
+    timerArgs.arg = this;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "AlarmDeadline";
+    esp_timer_create(&timerArgs, &m_deadlineTimer);
     // FreeRTOS により task() をバックグラウンドで実行
-    const uint16_t stackSize = 4096;
+    // 計測したサイズを使うビルドでは既定値は使われない
+    const uint32_t stackSize = 4096;
     // タスクの優先度
     constexpr UBaseType_t uxPriority = 0;
-    xTaskCreate(
+    sugar::TaskRegistry::instance().create(
         [](void *this_obj) { static_cast<AlarmManager *>(this_obj)->task(); },
-        "AlarmManagre", stackSize, this, uxPriority, NULL);
-    m_timeSetterQueue =
-        xQueueCreate(TIME_SETTER_QUEUE_SIZE, sizeof(sugar::TimeOfDay *));
+        "AlarmManager", stackSize, this, uxPriority);
   }
 
   /// アラームが設定されているかどうかを返す。
   bool isAlarmSet() const { return m_alarmIsSet; }
 
+  /// 画面から設定したアラームの状態を返す。どのタスクから読んでもよい。
+  const SharedAlarmState &state() const { return m_state; }
+
+  /// 次のアラームまでの時間 [ms] を返す。なければ負の値を返す。
+  ///
+  /// 秒単位に切り捨てた期限から計算するので、最大 1 秒早めに見積もる。
+  int64_t millisUntilNextAlarm() const {
+    const uint32_t deadline = m_nextDeadlineSeconds;
+    if (deadline == 0) {
+      return -1;
+    }
+    const int64_t remaining = int64_t(deadline) * 1000 - nowMicros() / 1000;
+    return remaining < 0 ? 0 : remaining;
+  }
+
+  /// 鳴動の統計情報を返す。
+  AlarmFiringStats firingStats() const {
+    return AlarmFiringStats{m_fired, m_missed, m_clockJumps, m_lastErrorMicros,
+                            m_maxErrorMicros};
+  }
+
   /// アラーム設定用オブジェクトを返す。
   // 時刻は別スレッドから設定されることがありうるため、競合を起こさないように
   // する必要がある。
   AlarmTimeSetter alarmTimeSetter() {
-    return AlarmTimeSetter(m_timeSetterQueue);
+    return AlarmTimeSetter(m_timeSetterQueue, &m_state);
   }
 
 private:
+  /// 現在の壁時計 (日本標準時) [us]。
+  static int64_t nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch() +
+               std::chrono::hours(9))
+        .count();
+  }
+
   // FreeRTOS によって実行される関数
   void task() {
-    portTickType xLastWakeTime = xTaskGetTickCount();
+    const TickType_t checkPeriod =
+        AlarmTimekeeper::CLOCK_CHECK_PERIOD_MILLIS / portTICK_PERIOD_MS;
+    const int64_t start = nowMicros();
+    m_timekeeper.start(start, esp_timer_get_time());
+    // RTC メモリから復元した予定の期限は、最初のコマンドを待たずに仕掛ける
+    // (deep sleep からは期限の少し前に起きるので、確認周期まで待つと遅れる)
+    armTimer(start);
     while (1) {
-      // 定期実行
-      vTaskDelayUntil(&xLastWakeTime, PeriodMillis / portTICK_RATE_MS);
-
-      // アラーム時刻変更コマンドを処理
-      {
-        sugar::TimeOfDay *qi;
-        while (xQueueReceive(m_timeSetterQueue, &qi, 0) == pdTRUE) {
-          auto time =
-              std::unique_ptr<sugar::TimeOfDay>{std::exchange(qi, nullptr)};
-          log_i("AlarmManager::task(): Alarm time updated: %02d:%02d:%02d",
-                time->hour(), time->minute(), time->second());
-          m_alarmTime = std::move(*time);
-          m_alarmIsSet = true;
-        }
+      // コマンドかタイマーの満了か、時計の確認周期まで眠る
+      AlarmCommand cmd;
+      bool received =
+          xQueueReceive(m_timeSetterQueue, &cmd, checkPeriod) == pdTRUE;
+
+      const int64_t now = nowMicros();
+      detectClockJump(now);
+
+      // 予定表の変更コマンドを処理
+      while (received) {
+        apply(cmd, now / 1000);
+        received = xQueueReceive(m_timeSetterQueue, &cmd, 0) == pdTRUE;
+      }
+
+      // 画面から設定したアラームの変更を反映する
+      syncPrimaryAlarm(now / 1000);
+
+      // コールバックが設定されていれば、期限を過ぎた予定を鳴らす
+      if (eventCallback) {
+        fireDueAlarms(now);
+        retirePrimaryAlarm();
       }
+      m_alarmIsSet = !m_schedule.empty();
+      publishNextDeadline();
+      persistSchedule();
 
-      // アラームとコールバックがともに設定されていれば、時刻を確認
-      if (isAlarmSet() && eventCallback) {
-        auto current =
-            sugar::TimeOfDay::fromUtcToJst(std::chrono::system_clock::now());
-        // 設定された時間以降 990 ミリ秒以内であればイベント発火
-        if (current.isAfter(m_alarmTime, std::chrono::milliseconds(990))) {
+      // 期限のタイマーを仕掛け直す
+      // 起きるのは予定の変更、タイマーの満了、時計の確認のときだけなので、
+      // 毎回その時点の壁時計から計算し直せば時計の飛びにも追従する
+      armTimer(now);
+    }
+  }
+
+  /// 共有のアラーム状態が変わっていれば予定表へ反映する。
+  void syncPrimaryAlarm(sugar::AlarmSchedule::Millis now) {
+    const AlarmSnapshot snapshot = m_state.load();
+    if (snapshot.generation == m_appliedGeneration) {
+      return;
+    }
+    m_appliedGeneration = snapshot.generation;
+    if (!snapshot.enabled) {
+      log_i("AlarmManager::task(): primary alarm cleared");
+      m_schedule.remove(AlarmTimeSetter::PRIMARY_ALARM);
+      return;
+    }
+    const auto rule =
+        snapshot.weekdays == 0
+            ? sugar::AlarmRule::nextOnce(snapshot.time)
+            : sugar::AlarmRule::weekly(snapshot.time, snapshot.weekdays);
+    apply(AlarmCommand{AlarmCommand::Op::Set, AlarmTimeSetter::PRIMARY_ALARM,
+                       rule, 0},
+          now);
+  }
+
+  /// 1回だけの画面のアラームが鳴り終わったら、共有の状態も無効にする。
+  ///
+  /// その間に画面から新しく設定されていれば、そちらを優先する。
+  void retirePrimaryAlarm() {
+    if (m_schedule.rule(AlarmTimeSetter::PRIMARY_ALARM)) {
+      return;
+    }
+    const AlarmSnapshot snapshot = m_state.load();
+    if (snapshot.enabled &&
+        m_state.compareAndStore(m_appliedGeneration, false, snapshot.time, 0)) {
+      m_appliedGeneration++;
+    }
+  }
+
+  /// 次の期限を他のタスクから読めるようにする。
+  void publishNextDeadline() {
+    m_nextDeadlineSeconds =
+        m_schedule.empty()
+            ? 0
+            : static_cast<uint32_t>(m_schedule.nextDeadline() / 1000);
+  }
+
+  /// 予定表を RTC メモリへ書き出す。
+  void persistSchedule();
+  /// 予定表を RTC メモリから読み込む。有効な内容がなければ `false` を返す。
+  bool restoreSchedule();
+
+  /// 壁時計の飛びを検出して記録する。
+  bool detectClockJump(int64_t now) {
+    if (!m_timekeeper.detectClockJump(now, esp_timer_get_time())) {
+      return false;
+    }
+    m_clockJumps++;
+    log_i("AlarmManager::task(): wall clock jumped by %lld ms",
+          static_cast<long long>(m_timekeeper.lastDriftMicros() / 1000));
+    return true;
+  }
+
+  /// 期限を過ぎた予定を鳴らす。
+  void fireDueAlarms(int64_t now) {
+    AlarmTimekeeper::fireDue(
+        m_schedule, now,
+        [this](const sugar::AlarmSchedule::Firing &firing, int64_t late,
+               bool missed) {
+          if (missed) {
+            m_missed++;
+            log_w("AlarmManager::task(): alarm %d missed by %lld ms",
+                  firing.id, static_cast<long long>(late / 1000));
+            return;
+          }
+          m_fired++;
+          m_lastErrorMicros = static_cast<int32_t>(late);
+          if (late > m_maxErrorMicros) {
+            m_maxErrorMicros = static_cast<int32_t>(late);
+          }
+          log_i("AlarmManager::task(): alarm %d fired %lld.%03lld ms late",
+                firing.id, static_cast<long long>(late / 1000),
+                static_cast<long long>(late % 1000));
           eventCallback();
-          // Unset alarm.
-          m_alarmIsSet = false;
-        }
+        });
+  }
+
+  /// 次の期限に満了するようタイマーを仕掛ける。
+  void armTimer(int64_t now) {
+    esp_timer_stop(m_deadlineTimer);
+    const int64_t delay = AlarmTimekeeper::timerDelayMicros(m_schedule, now);
+    if (delay > 0) {
+      esp_timer_start_once(m_deadlineTimer, static_cast<uint64_t>(delay));
+    }
+  }
+
+  /// 予定表の変更コマンドを適用する。
+  void apply(const AlarmCommand &cmd, sugar::AlarmSchedule::Millis now) {
+    switch (cmd.op) {
+    case AlarmCommand::Op::Set: {
+      const auto t = cmd.rule.time.hms();
+      log_i("AlarmManager::task(): Alarm %d set: %02d:%02d:%02d "
+            "(weekdays 0x%02x)",
+            cmd.id, t.hour, t.minute, t.second, cmd.rule.weekdays);
+      m_schedule.set(cmd.id, cmd.rule, now);
+    } break;
+    case AlarmCommand::Op::Remove:
+      log_i("AlarmManager::task(): Alarm %d removed", cmd.id);
+      m_schedule.remove(cmd.id);
+      break;
+    case AlarmCommand::Op::Skip:
+      if (!m_schedule.skip(cmd.date, now)) {
+        log_e("AlarmManager::task(): too many skip dates");
       }
+      break;
+    case AlarmCommand::Op::Unskip:
+      m_schedule.unskip(cmd.date, now);
+      break;
+    case AlarmCommand::Op::Check:
+      break;
     }
   }
 };
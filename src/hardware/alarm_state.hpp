@@ -0,0 +1,107 @@
+/**
+ * @file alarm_state.hpp
+ * @brief どのタスクからもロックなしで読めるアラームの状態を持つ
+ */
+#pragma once
+#ifndef _INCLUDE_ALARM_STATE_HPP_
+#define _INCLUDE_ALARM_STATE_HPP_
+
+#include <atomic>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+
+#include "../time_of_day.hpp"
+
+namespace hardware {
+/// アラームの状態の写し。
+struct AlarmSnapshot {
+  /// アラームが有効か否か。
+  bool enabled;
+  /// アラーム時刻。
+  sugar::TimeOfDay time;
+  /// 繰り返す曜日 (`sugar::Weekdays` の組み合わせ)。 0 なら1回だけ。
+  uint8_t weekdays;
+  /// 書き込みのたびに増える世代番号。
+  uint32_t generation;
+};
+
+/// 画面から設定するアラームの状態。
+///
+/// シーケンスロックで守るので、読み出しはどのタスクからでもロックも
+/// ヒープ確保もなしに行え、途中まで書き換えられた値を読むことはない。
+/// 書き込みはクリティカルセクションで直列化するので、書き込み中に
+/// 同じコアの読み手へ切り替わって待ち続けることもない。
+class SharedAlarmState {
+private:
+  /// 書き込み中は奇数になる。 2 で割ったものが世代番号。
+  std::atomic<uint32_t> m_sequence{0};
+  /// アラーム時刻 (深夜からのミリ秒)。
+  std::atomic<uint32_t> m_time{0};
+  /// bit 0-6: 曜日、 bit 8: 有効か否か。
+  std::atomic<uint32_t> m_flags{0};
+  /// 書き手どうしの排他。
+  portMUX_TYPE m_writeLock = portMUX_INITIALIZER_UNLOCKED;
+
+  static constexpr uint32_t ENABLED_BIT = 1 << 8;
+
+public:
+  /// 状態を書き込み、新しい世代番号を返す。
+  uint32_t store(bool enabled, sugar::TimeOfDay time, uint8_t weekdays) {
+    portENTER_CRITICAL(&m_writeLock);
+    const uint32_t generation = write(enabled, time, weekdays);
+    portEXIT_CRITICAL(&m_writeLock);
+    return generation;
+  }
+
+  /// 世代番号が `expected` のままなら状態を書き込む。
+  ///
+  /// 他の書き手の変更を上書きしないために使う。
+  bool compareAndStore(uint32_t expected, bool enabled, sugar::TimeOfDay time,
+                       uint8_t weekdays) {
+    portENTER_CRITICAL(&m_writeLock);
+    const bool matched = (m_sequence.load(std::memory_order_relaxed) >> 1) ==
+                         expected;
+    if (matched) {
+      write(enabled, time, weekdays);
+    }
+    portEXIT_CRITICAL(&m_writeLock);
+    return matched;
+  }
+
+  /// 状態を読み出す。
+  AlarmSnapshot load() const {
+    uint32_t before, after, time, flags;
+    do {
+      before = m_sequence.load(std::memory_order_acquire);
+      time = m_time.load(std::memory_order_relaxed);
+      flags = m_flags.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = m_sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+    return AlarmSnapshot{(flags & ENABLED_BIT) != 0,
+                         sugar::TimeOfDay(std::chrono::milliseconds(time)),
+                         static_cast<uint8_t>(flags & 0x7F), before >> 1};
+  }
+
+  /// 現在の世代番号を返す。
+  uint32_t generation() const {
+    return m_sequence.load(std::memory_order_acquire) >> 1;
+  }
+
+private:
+  /// 書き手の排他を取った状態で書き込む。
+  uint32_t write(bool enabled, sugar::TimeOfDay time, uint8_t weekdays) {
+    const uint32_t seq = m_sequence.load(std::memory_order_relaxed);
+    m_sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_time.store(time.millisSinceMidnight(), std::memory_order_relaxed);
+    m_flags.store((enabled ? ENABLED_BIT : 0) | (weekdays & 0x7F),
+                  std::memory_order_relaxed);
+    m_sequence.store(seq + 2, std::memory_order_release);
+    return (seq + 2) >> 1;
+  }
+};
+} // namespace hardware
+
+#endif
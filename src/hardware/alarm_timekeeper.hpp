@@ -0,0 +1,85 @@
+/**
+ * @file alarm_timekeeper.hpp
+ * @brief アラームの期限と壁時計の飛びを扱う、ハードウェアに依存しない計時
+ */
+#pragma once
+#ifndef _INCLUDE_ALARM_TIMEKEEPER_HPP_
+#define _INCLUDE_ALARM_TIMEKEEPER_HPP_
+
+#include <cstdint>
+
+#include "../alarm_schedule.hpp"
+
+namespace hardware {
+/// アラームの期限の計時。
+///
+/// 壁時計 (日本標準時) と単調増加時計の値を呼び出し側が渡すので、
+/// 実機の時計やタイマーなしに動かせる。
+/// 期限を過ぎた予定を鳴らすか読み飛ばすかを決め、次の期限まで単発の
+/// タイマーを仕掛ける時間を求める。タイマーは単調増加時計で数えるので、
+/// 壁時計の飛びを検出したら呼び出し側が仕掛け直す。
+class AlarmTimekeeper {
+public:
+  /// これ以上遅れたアラームは鳴らさずに読み飛ばす [ms]。
+  ///
+  /// 時計が大きく進んだときに、過去の予定をまとめて鳴らさないため。
+  static constexpr int64_t MISSED_ALARM_TOLERANCE_MILLIS = 60 * 1000;
+  /// 壁時計の飛びを確認する周期 [ms]。
+  ///
+  /// 飛びは高々この周期の遅れで検出され、タイマーが仕掛け直される。
+  static constexpr uint32_t CLOCK_CHECK_PERIOD_MILLIS = 10 * 1000;
+  /// これ以上壁時計と単調増加時計の差が変わったら飛びとみなす [us]。
+  static constexpr int64_t CLOCK_JUMP_THRESHOLD_MICROS = 100 * 1000;
+
+  /// 壁時計と単調増加時計の差を覚え直す。計時を始めるときに呼ぶ。
+  void start(int64_t wallMicros, int64_t monotonicMicros) {
+    m_wallOffsetMicros = wallMicros - monotonicMicros;
+    m_lastDriftMicros = 0;
+  }
+
+  /// 前回から壁時計が飛んだかどうかを返す。
+  bool detectClockJump(int64_t wallMicros, int64_t monotonicMicros) {
+    const int64_t offset = wallMicros - monotonicMicros;
+    m_lastDriftMicros = offset - m_wallOffsetMicros;
+    m_wallOffsetMicros = offset;
+    return m_lastDriftMicros >= CLOCK_JUMP_THRESHOLD_MICROS ||
+           m_lastDriftMicros <= -CLOCK_JUMP_THRESHOLD_MICROS;
+  }
+
+  /// 直前の `detectClockJump()` で観測した差の変化 [us]。
+  int64_t lastDriftMicros() const { return m_lastDriftMicros; }
+
+  /// 期限を過ぎた予定をすべて取り出し、期限の順に `onFiring` に渡す。
+  ///
+  /// `onFiring(const sugar::AlarmSchedule::Firing &, int64_t lateMicros,
+  /// bool missed)` の `missed` は、遅れすぎて鳴らすべきでないことを表す。
+  template <typename F>
+  static void fireDue(sugar::AlarmSchedule &schedule, int64_t wallMicros,
+                      F onFiring) {
+    sugar::AlarmSchedule::Firing firing;
+    while (schedule.pop(wallMicros / 1000, firing)) {
+      const int64_t late = wallMicros - firing.deadline * 1000;
+      onFiring(firing, late, late > MISSED_ALARM_TOLERANCE_MILLIS * 1000);
+    }
+  }
+
+  /// 次の期限に満了させるタイマーの時間 [us] を返す。予定がなければ負の値。
+  ///
+  /// 期限を過ぎていても、すぐに満了するよう正の値を返す。
+  static int64_t timerDelayMicros(const sugar::AlarmSchedule &schedule,
+                                  int64_t wallMicros) {
+    if (schedule.empty()) {
+      return -1;
+    }
+    const int64_t remaining = schedule.nextDeadline() * 1000 - wallMicros;
+    return remaining < 1 ? 1 : remaining;
+  }
+
+private:
+  /// 直前に確認した、壁時計と単調増加時計の差 [us]。
+  int64_t m_wallOffsetMicros = 0;
+  int64_t m_lastDriftMicros = 0;
+};
+} // namespace hardware
+
+#endif
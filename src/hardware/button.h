@@ -1,10 +1,18 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 namespace hardware {
 
 /// ボタンの種類
 enum class Button { A, B, C };
 
+/// ボタンの種類の数
+constexpr size_t BUTTON_COUNT = 3;
+static_assert(static_cast<size_t>(Button::C) + 1 == BUTTON_COUNT,
+              "BUTTON_COUNT must match the definition of Button");
+
 /// ボタンの押され方
 enum class ButtonEventKind {
   /// Pressed.
@@ -12,17 +20,33 @@ enum class ButtonEventKind {
   /// Released.
   Released,
   /// Being pressed for a while.
+  ///
+  /// `ButtonEvent::count` holds the number of steps to advance.
   Repeated,
+  /// Held down longer than the long-press threshold (once per press).
+  LongPress,
+  /// Pressed again shortly after a short press.
+  DoublePress,
 };
 
+/// ボタンの押され方の種類の数
+constexpr size_t BUTTON_EVENT_KIND_COUNT = 5;
+static_assert(static_cast<size_t>(ButtonEventKind::DoublePress) + 1 ==
+                  BUTTON_EVENT_KIND_COUNT,
+              "BUTTON_EVENT_KIND_COUNT must match the definition of "
+              "ButtonEventKind");
+
 /// ボタンのイベント
 struct ButtonEvent {
   /// ボタン
   Button button;
   /// ボタンの押され方
   ButtonEventKind kind;
+  /// 回数。 Repeated なら進める歩数、それ以外は 1
+  uint16_t count;
 
-  ButtonEvent(Button b, ButtonEventKind k) : button(b), kind(k) {}
+  ButtonEvent(Button b, ButtonEventKind k, uint16_t n = 1)
+      : button(b), kind(k), count(n) {}
 };
 
 }; // namespace hardware
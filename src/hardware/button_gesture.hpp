@@ -0,0 +1,168 @@
+/**
+ * @file button_gesture.hpp
+ * @brief ボタンの押下と解放からジェスチャを認識するクラスを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_BUTTON_GESTURE_HPP_
+#define _INCLUDE_BUTTON_GESTURE_HPP_
+
+#include <cstdint>
+
+#include "button.h"
+
+namespace hardware {
+/// ジェスチャ認識の時間設定。
+struct GestureConfig {
+  /// 押してから最初の Repeated までの時間 [ms]
+  uint32_t repeatDelayMillis = 500;
+  /// 最初の Repeated の間隔 [ms]
+  uint32_t repeatIntervalMillis = 200;
+  /// Repeated の間隔の下限 [ms]
+  ///
+  /// これより速くするときは間隔を縮めずに1回あたりの歩数を増やす。
+  uint32_t minRepeatIntervalMillis = 100;
+  /// 下限に達してから歩数を倍にするまでの Repeated の回数
+  uint16_t repeatsPerDoubling = 8;
+  /// 1回の Repeated の歩数の上限
+  uint16_t maxRepeatSteps = 8;
+  /// LongPress とみなす押下時間 [ms]
+  uint32_t longPressMillis = 1000;
+  /// 解放からこの時間内に押されたら DoublePress [ms]
+  uint32_t doublePressMillis = 300;
+};
+
+/// 1つのボタンの押下・解放の時刻列からジェスチャを認識する。
+///
+/// 時刻はすべて呼び出し側が渡すので、実機のタイマーなしに動かせる。
+/// Pressed は遅らせずにすぐ出し、2回目の Pressed の直後に DoublePress を
+/// 続けて出す。押し続けると LongPress を1回、 Repeated を加速しながら出す。
+/// Repeated の `count` には、その1回で進めるべき歩数が入る。
+class GestureRecognizer {
+public:
+  GestureRecognizer() = default;
+  explicit GestureRecognizer(const GestureConfig &config) : m_config(config) {}
+
+  void setConfig(const GestureConfig &config) { m_config = config; }
+
+  bool isPressed() const { return m_pressed; }
+
+  /// 押されたときに呼ぶ。
+  template <typename Emit> void press(uint32_t now, Emit emit) {
+    if (m_pressed) {
+      return;
+    }
+    m_pressed = true;
+    emit(ButtonEventKind::Pressed, 1);
+    // 3回連続で押しても DoublePress は1回だけ
+    if (m_clickPending && now - m_releasedAt <= m_config.doublePressMillis) {
+      m_clickPending = false;
+      emit(ButtonEventKind::DoublePress, 1);
+    } else {
+      m_clickPending = true;
+    }
+    m_longPending = true;
+    m_longAt = now + m_config.longPressMillis;
+    m_repeatPending = true;
+    m_repeatAt = now + m_config.repeatDelayMillis;
+    m_interval = m_config.repeatIntervalMillis;
+    m_steps = 1;
+    m_repeatsAtFloor = 0;
+  }
+
+  /// 起動時から押されていたとみなす。
+  ///
+  /// イベントは出さず、 LongPress と Repeated も待たない。離されたときに
+  /// Released だけを出す。
+  void assumePressed() {
+    m_pressed = true;
+    m_clickPending = m_longPending = m_repeatPending = false;
+  }
+
+  /// 離されたときに呼ぶ。
+  template <typename Emit> void release(uint32_t now, Emit emit) {
+    if (!m_pressed) {
+      return;
+    }
+    // 長押しの後は `expire()` で m_clickPending が落ちているので、
+    // DoublePress の1回目には数えない
+    m_pressed = false;
+    m_longPending = m_repeatPending = false;
+    m_releasedAt = now;
+    emit(ButtonEventKind::Released, 1);
+  }
+
+  /// 期限の来た LongPress と Repeated を出す。
+  template <typename Emit> void expire(uint32_t now, Emit emit) {
+    if (m_longPending && reached(now, m_longAt)) {
+      m_longPending = false;
+      m_clickPending = false;
+      emit(ButtonEventKind::LongPress, 1);
+    }
+    if (m_repeatPending && reached(now, m_repeatAt)) {
+      m_clickPending = false;
+      emit(ButtonEventKind::Repeated, m_steps);
+      advanceRepeat(now);
+    }
+  }
+
+  /// 次に `expire()` を呼ぶべき時刻を `deadline` に入れる。
+  ///
+  /// 待つものがなければ `false` を返す。
+  bool nextDeadline(uint32_t &deadline) const {
+    if (m_longPending && m_repeatPending) {
+      deadline = reached(m_repeatAt, m_longAt) ? m_longAt : m_repeatAt;
+      return true;
+    }
+    if (m_longPending) {
+      deadline = m_longAt;
+      return true;
+    }
+    if (m_repeatPending) {
+      deadline = m_repeatAt;
+      return true;
+    }
+    return false;
+  }
+
+private:
+  GestureConfig m_config;
+  bool m_pressed = false;
+  /// 直前が短い押下で、 DoublePress の1回目になりうるか否か
+  bool m_clickPending = false;
+  uint32_t m_releasedAt = 0;
+  bool m_longPending = false;
+  uint32_t m_longAt = 0;
+  bool m_repeatPending = false;
+  uint32_t m_repeatAt = 0;
+  uint32_t m_interval = 0;
+  uint16_t m_steps = 1;
+  uint16_t m_repeatsAtFloor = 0;
+
+  /// ミリ秒カウンタの桁あふれを考慮して `now` が `t` に達したか調べる。
+  static bool reached(uint32_t now, uint32_t t) {
+    return static_cast<int32_t>(now - t) >= 0;
+  }
+
+  /// 次の Repeated の時刻と歩数を決める。
+  void advanceRepeat(uint32_t now) {
+    // 処理が遅れても溜めずに、今から1間隔後にする
+    m_repeatAt += m_interval;
+    if (reached(now, m_repeatAt)) {
+      m_repeatAt = now + m_interval;
+    }
+    // 次からは間隔を 3/4 ずつ縮め、下限に達したら歩数を倍々にする
+    if (m_interval > m_config.minRepeatIntervalMillis) {
+      m_interval = m_interval * 3 / 4;
+      if (m_interval < m_config.minRepeatIntervalMillis) {
+        m_interval = m_config.minRepeatIntervalMillis;
+      }
+    } else if (++m_repeatsAtFloor >= m_config.repeatsPerDoubling) {
+      m_repeatsAtFloor = 0;
+      m_steps = m_steps * 2 < m_config.maxRepeatSteps ? m_steps * 2
+                                                      : m_config.maxRepeatSteps;
+    }
+  }
+};
+} // namespace hardware
+
+#endif
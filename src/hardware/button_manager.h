@@ -6,17 +6,27 @@
  */
 #pragma once
 
-// for xTaskCreate() etc.
+#include <atomic>
+#include <functional>
+
 #include <freertos/FreeRTOS.h>
-#include <freertos/task.h>
+#include <freertos/timers.h>
 
 #include "button.h"
-
-// for M5.Btn*
-#include <M5Stack.h>
+#include "button_gesture.hpp"
+#include "button_port.hpp"
+#include "timer_service.hpp"
 
 namespace hardware {
 
+/// ボタンの監視方式
+enum class ButtonInputMode {
+  /// 一定周期でピンを読む。割り込みが使えないときの予備
+  Polling,
+  /// GPIO のエッジ割り込みと、チャタリング除去用のタイマー
+  Interrupt,
+};
+
 /// M5Stack のボタンを監視してイベントを発生させるクラス
 class ButtonManager {
 public:
@@ -27,74 +37,181 @@ public:
   }
   /// ボタンの押され方の表示用
   static const char *c_str(ButtonEventKind e) {
-    static const char *names[] = {"Pressed", "Released"};
+    static const char *names[] = {"Pressed", "Released", "Repeated",
+                                  "LongPress", "DoublePress"};
     return names[static_cast<size_t>(e)];
   }
   /// ボタンイベントのコールバック関数型
-  typedef std::function<void(Button, ButtonEventKind)> EventCallback;
+  typedef std::function<void(const ButtonEvent &)> EventCallback;
 
-  bool isPressed(Button button) {
-    switch (button) {
-    case Button::A:
-      return M5.BtnA.isPressed();
-    case Button::B:
-      return M5.BtnB.isPressed();
-    case Button::C:
-      return M5.BtnC.isPressed();
+  ButtonManager(ButtonPort &port, TimerService &timers)
+      : m_port(port), m_timers(timers) {
+    for (size_t i = 0; i < BUTTON_COUNT; ++i) {
+      m_channels[i].manager = this;
+      m_channels[i].button = static_cast<Button>(i);
     }
   }
+
+  /// チャタリングを除いた押下状態を返す
+  bool isPressed(Button button) const {
+    return m_channels[static_cast<size_t>(button)].stable;
+  }
+  /// 実際に使われている監視方式
+  ButtonInputMode mode() const { return m_mode; }
   // イベントコールバックの登録
   void onEvent(EventCallback eventCallback = nullptr) {
     this->eventCallback = eventCallback;
   }
+  /// ジェスチャ認識の時間設定。 begin() の前に呼ぶ
+  void setGestureConfig(const GestureConfig &config) {
+    for (auto &ch : m_channels) {
+      ch.gesture.setConfig(config);
+    }
+  }
   // イベント待機を開始する
-  void begin() {
-    // FreeRTOS により task() をバックグラウンドで実行
-    const uint16_t stackSize = 4096;
-    UBaseType_t uxPriority = 0;
-    xTaskCreate(
-        [](void *this_obj) { static_cast<ButtonManager *>(this_obj)->task(); },
-        "ButtonManager", stackSize, this, uxPriority, NULL);
+  void begin() { begin(ButtonInputMode::Interrupt); }
+  void begin(ButtonInputMode mode) {
+    m_port.begin();
+    // 起動時に押されていたボタンは、離されたときにだけ通知する
+    for (auto &ch : m_channels) {
+      ch.stable = ch.sampled = m_port.isPressed(ch.button);
+      if (ch.stable)
+        ch.gesture.assumePressed();
+    }
+    if (mode == ButtonInputMode::Interrupt && beginInterrupts()) {
+      return;
+    }
+    m_mode = ButtonInputMode::Polling;
+    // 専用のタスクは持たず、タイマーサービスで定期実行する
+    m_timers.startPeriodic(m_pollJob, PeriodMillis);
   }
 
 private:
+  /// ボタン1つ分の状態
+  struct Channel {
+    ButtonManager *manager = nullptr;
+    Button button = Button::A;
+    /// チャタリング除去用のワンショットタイマー
+    TimerHandle_t timer = NULL;
+    /// 確定した押下状態
+    std::atomic<bool> stable{false};
+    /// ポーリングで前回読んだ値
+    bool sampled = false;
+    /// 長押しと連打の認識
+    GestureRecognizer gesture;
+    /// 長押しの期限を待つワンショットタイマー
+    TimerHandle_t holdTimer = NULL;
+  };
+
   // サンプリング周期
   static constexpr int PeriodMillis = 10;
+  // 最後のエッジからピンを読むまでの時間
+  static constexpr int DebounceMillis = 20;
+  ButtonPort &m_port;
+  TimerService &m_timers;
+  TimerJob m_pollJob{"ButtonPoll", [this]() { handleEvent(); }};
+  Channel m_channels[BUTTON_COUNT];
+  ButtonInputMode m_mode = ButtonInputMode::Polling;
   // コールバック関数のポインタ
   EventCallback eventCallback = nullptr;
 
-  // FreeRTOS によって実行される関数
-  void task() {
-    // handleEvent の定期実行
-    portTickType xLastWakeTime = xTaskGetTickCount();
-    while (1) {
-      vTaskDelayUntil(&xLastWakeTime, PeriodMillis / portTICK_RATE_MS);
-      handleEvent();
+  // タイマーを作って割り込みを登録する。失敗したら false
+  bool beginInterrupts() {
+    for (auto &ch : m_channels) {
+      if (ch.timer == NULL) {
+        ch.timer = xTimerCreate("Button", DebounceMillis / portTICK_PERIOD_MS,
+                                pdFALSE, &ch, onDebounced);
+      }
+      if (ch.holdTimer == NULL) {
+        // 周期は armHoldTimer() で毎回設定し直す
+        ch.holdTimer = xTimerCreate("ButtonHold", 1, pdFALSE, &ch, onHold);
+      }
+      if (ch.timer == NULL || ch.holdTimer == NULL) {
+        log_e("Failed to create the debounce timer; falling back to polling");
+        return false;
+      }
+    }
+    // 割り込みが来る前に方式を確定させておく
+    m_mode = ButtonInputMode::Interrupt;
+    for (auto &ch : m_channels) {
+      m_port.attachEdgeInterrupt(ch.button, onEdge, &ch);
     }
-    vTaskDelete(NULL);
+    return true;
   }
-  // イベントの確認 & コールバック関数の実行
+  // エッジ割り込み
+  static void IRAM_ATTR onEdge(void *arg) {
+    // 跳ねている間はタイマーを延ばし続け、静かになってから読む。
+    // GPIO 39 に乗るごく短いパルスもここで吸収される
+    Channel *ch = static_cast<Channel *>(arg);
+    BaseType_t woken = pdFALSE;
+    xTimerResetFromISR(ch->timer, &woken);
+    if (woken == pdTRUE)
+      portYIELD_FROM_ISR();
+  }
+  // タイマーサービスタスクから呼ばれる
+  static void onDebounced(TimerHandle_t timer) {
+    Channel *ch = static_cast<Channel *>(pvTimerGetTimerID(timer));
+    ch->manager->settle(*ch, ch->manager->m_port.isPressed(ch->button));
+  }
+  // 長押しの期限。タイマーサービスタスクから呼ばれる
+  static void onHold(TimerHandle_t timer) {
+    Channel *ch = static_cast<Channel *>(pvTimerGetTimerID(timer));
+    ch->manager->expire(*ch);
+  }
+  // 状態の更新 & コールバック関数の実行
   void handleEvent() {
-    // 状態の更新
-    M5.BtnA.read();
-    M5.BtnB.read();
-    M5.BtnC.read();
+    for (auto &ch : m_channels) {
+      bool pressed = m_port.isPressed(ch.button);
+      // 2回続けて同じ値を読んだら確定する
+      if (pressed == ch.sampled)
+        settle(ch, pressed);
+      ch.sampled = pressed;
+      // ポーリングではタイマーを使わず、毎周期期限を確かめる
+      expire(ch);
+    }
+  }
+  // 確定した状態が変わっていればイベントを発生させる
+  void settle(Channel &ch, bool pressed) {
+    if (pressed == ch.stable)
+      return;
+    ch.stable = pressed;
+    const uint32_t now = millis();
+    auto emit = [this, &ch](ButtonEventKind kind, uint16_t count) {
+      this->emit(ButtonEvent{ch.button, kind, count});
+    };
+    if (pressed)
+      ch.gesture.press(now, emit);
+    else
+      ch.gesture.release(now, emit);
+    armHoldTimer(ch, now);
+  }
+  // 期限の来たジェスチャのイベントを発生させる
+  void expire(Channel &ch) {
+    const uint32_t now = millis();
+    ch.gesture.expire(now, [this, &ch](ButtonEventKind kind, uint16_t count) {
+      emit(ButtonEvent{ch.button, kind, count});
+    });
+    armHoldTimer(ch, now);
+  }
+  // 次の期限にタイマーを合わせる
+  void armHoldTimer(Channel &ch, uint32_t now) {
+    if (m_mode != ButtonInputMode::Interrupt)
+      return;
+    uint32_t deadline;
+    if (!ch.gesture.nextDeadline(deadline)) {
+      xTimerStop(ch.holdTimer, 0);
+      return;
+    }
+    const int32_t wait = static_cast<int32_t>(deadline - now);
+    const TickType_t ticks = wait > 0 ? wait / portTICK_PERIOD_MS : 0;
+    // 周期の変更はタイマーの開始も兼ねる。周期 0 は許されない
+    xTimerChangePeriod(ch.holdTimer, ticks > 0 ? ticks : 1, 0);
+  }
+  void emit(const ButtonEvent &event) {
     // コールバック関数が登録されているか確認
     if (eventCallback == nullptr)
       return;
-    // イベントの確認 & コールバック関数の実行
-    if (M5.BtnA.wasPressed())
-      eventCallback(Button::A, ButtonEventKind::Pressed);
-    if (M5.BtnA.wasReleased())
-      eventCallback(Button::A, ButtonEventKind::Released);
-    if (M5.BtnB.wasPressed())
-      eventCallback(Button::B, ButtonEventKind::Pressed);
-    if (M5.BtnB.wasReleased())
-      eventCallback(Button::B, ButtonEventKind::Released);
-    if (M5.BtnC.wasPressed())
-      eventCallback(Button::C, ButtonEventKind::Pressed);
-    if (M5.BtnC.wasReleased())
-      eventCallback(Button::C, ButtonEventKind::Released);
+    eventCallback(event);
   }
 };
 
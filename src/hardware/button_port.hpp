@@ -0,0 +1,81 @@
+/**
+ * @file button_port.hpp
+ * @brief ボタンの GPIO を抽象化したインターフェースを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_BUTTON_PORT_HPP_
+#define _INCLUDE_BUTTON_PORT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <M5Stack.h>
+
+#include "button.h"
+
+namespace hardware {
+/// ボタンの GPIO の操作。
+///
+/// ボタンの監視をピンの読み方から切り離すためのインターフェース。
+class ButtonPort {
+public:
+  /// エッジ割り込みのハンドラ型。 ISR から呼ばれる。
+  typedef void (*EdgeHandler)(void *arg);
+
+  virtual ~ButtonPort() = default;
+
+  /// ピンを入力として設定する。
+  virtual void begin() = 0;
+
+  /// ボタンが押されているなら `true` を返す。
+  virtual bool isPressed(Button button) = 0;
+
+  /// 両エッジの割り込みを登録する。
+  virtual void attachEdgeInterrupt(Button button, EdgeHandler handler,
+                                   void *arg) = 0;
+
+  /// 割り込みを解除する。
+  virtual void detachEdgeInterrupt(Button button) = 0;
+};
+
+/// M5Stack のボタンの GPIO。
+///
+/// ボタンは外付けのプルアップで、押すと LOW になる。
+class M5ButtonPort final : public ButtonPort {
+public:
+  virtual void begin() override {
+    // GPIO 37-39 は入力専用で内部プルアップを持たない
+    for (size_t i = 0; i < BUTTON_COUNT; ++i) {
+      pinMode(pin(static_cast<Button>(i)), INPUT);
+    }
+  }
+
+  virtual bool isPressed(Button button) override {
+    return digitalRead(pin(button)) == LOW;
+  }
+
+  virtual void attachEdgeInterrupt(Button button, EdgeHandler handler,
+                                   void *arg) override {
+    attachInterruptArg(pin(button), handler, arg, CHANGE);
+  }
+
+  virtual void detachEdgeInterrupt(Button button) override {
+    detachInterrupt(pin(button));
+  }
+
+private:
+  static uint8_t pin(Button button) {
+    switch (button) {
+    case Button::A:
+      return BUTTON_A_PIN;
+    case Button::B:
+      return BUTTON_B_PIN;
+    case Button::C:
+      return BUTTON_C_PIN;
+    }
+    return BUTTON_A_PIN;
+  }
+};
+} // namespace hardware
+
+#endif
@@ -18,11 +18,18 @@
 #include <utility>
 
 #include "../time_of_day.hpp"
+#include "../ui/display.hpp"
 #include "alarm_manager.hpp"
 #include "button_manager.h"
+#include "button_port.hpp"
+#include "imu_port.hpp"
+#include "night_mode.hpp"
+#include "shake_trace_recorder.hpp"
 #include "shaking_manager.hpp"
+#include "sleep_port.hpp"
 #include "speaker_manager.h"
 #include "ticker.h"
+#include "timer_service.hpp"
 #include "tweet_manager.h"
 
 #include <M5Stack.h>
@@ -31,40 +38,59 @@ namespace hardware {
 
 class Hardware {
 private:
+  /// 周期処理を引き受けるタスク。各マネージャより先に構築する
+  TimerService m_timers;
   AlarmManager m_alarm;
-  ButtonManager m_button;
-  SpeakerManager m_speaker;
-  Ticker m_ticker;
-  ShakingManager m_shaking;
+  M5ButtonPort m_buttonPort;
+  ButtonManager m_button{m_buttonPort, m_timers};
+  SpeakerManager m_speaker{m_timers};
+  Ticker m_ticker{m_timers};
+  /// 標準の M5Stack では INT がつながっていないので、動き検知は使わない
+  Mpu9250Port m_imuPort;
+  ShakingManager m_shaking{m_imuPort, m_timers};
+#ifdef SHAKE_TRACE
+  /// 振動検知の調整用に、加速度を SD カードへ記録する
+  ShakeTraceRecorder m_shakeTrace;
+#endif
   TweetManager m_tweet;
-
-public:
-  /// Thread-local alarm state cache.
-  ///
-  /// This can be accessed in thread-safe way because it is not shared among
-  /// threads.
-  thread_local static bool m_alarmIsEnabled;
-  /// Thread-local alarm time cache.
-  ///
-  /// This can be accessed in thread-safe way because it is not shared among
-  /// threads.
-  thread_local static sugar::TimeOfDay m_alarmTimeCache;
+  ui::Display m_display;
+  Esp32SleepPort m_sleepPort;
+  NightMode m_nightMode{m_sleepPort};
 
 public:
   void begin() {
+    // deep sleep からの復帰かどうかを最初に調べる
+    m_nightMode.begin();
     // M5Stack includes LCD, SD, M5.Btn, M5.Speaker,...
     M5.begin();
+    // 時計用フォントのグリフアトラスと LCD のオフスクリーンバッファ
+    // WiFi などのためにヒープを残しておきたいので、バッファは画面の半分までにとどめる
+    m_display.begin(120);
     // Wire
     Wire.begin();
+    // Timer service
+    // ボタンのポーリング、 Tick 、スピーカー、 IMU のサンプリングを受け持つ
+    m_timers.begin();
     // Alarm
     m_alarm.begin();
     // Speaker
     m_speaker.begin();
     // Button
-    m_button.begin();
+    // 割り込みで監視する。ポーリングに戻すには ButtonInputMode::Polling を渡す
+    m_button.begin(ButtonInputMode::Interrupt);
     // Shaking
     // IMUの初期化とWireの初期化．振動検知タスクの開始
-    m_shaking.begin();
+    // INT を配線したら Mpu9250Port にピンを渡し、 wakeOnMotion を有効にする
+    ShakingConfig shakingConfig;
+#ifdef SHAKE_TRACE
+    // SD カードは M5.begin() でマウントされている
+    if (m_shakeTrace.begin(SD)) {
+      m_shaking.setTraceRecorder(&m_shakeTrace);
+    }
+    // 誤検知を調べるため、数えていない間も読んで記録する
+    shakingConfig.sleepWhenStopped = false;
+#endif
+    m_shaking.begin(shakingConfig);
     // Ticker
     m_ticker.begin();
     // Tweet
@@ -90,21 +116,18 @@ public:
   Ticker &ticker() { return m_ticker; }
   /// Shaking manager.
   ShakingManager &shaking() { return m_shaking; }
+#ifdef SHAKE_TRACE
+  /// Accelerometer trace on the SD card.
+  ShakeTraceRecorder &shakeTrace() { return m_shakeTrace; }
+#endif
   /// Tweet manager.
   TweetManager &tweet() { return m_tweet; }
-
-  // Workaround for GCC-5 bug
-  // <https://gcc.gnu.org/bugzilla/show_bug.cgi?id=66971>.
-  static void setAlarmEnabled(bool v);
-  // Workaround for GCC-5 bug
-  // <https://gcc.gnu.org/bugzilla/show_bug.cgi?id=66971>.
-  static bool isAlarmEnabled();
-  // Workaround for GCC-5 bug
-  // <https://gcc.gnu.org/bugzilla/show_bug.cgi?id=66971>.
-  static void setAlarmTimeCache(sugar::TimeOfDay v);
-  // Workaround for GCC-5 bug
-  // <https://gcc.gnu.org/bugzilla/show_bug.cgi?id=66971>.
-  static const sugar::TimeOfDay &alarmTimeCache();
+  /// Shared task for periodic and one-shot jobs.
+  TimerService &timers() { return m_timers; }
+  /// Night mode (deep sleep until the next alarm).
+  NightMode &nightMode() { return m_nightMode; }
+  /// LCD, its frame buffer and the render task.
+  ui::Display &display() { return m_display; }
 
 private:
 };
@@ -0,0 +1,148 @@
+// コンパイルエラーを防ぐため， Arduino.h で定義されているマクロをundef
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+
+#include <M5Stack.h>
+
+#include "imu_port.hpp"
+
+namespace hardware {
+namespace {
+// MPU9250 のレジスタ。ライブラリのマクロと名前がぶつからないよう接頭辞を付ける
+constexpr uint8_t REG_ACCEL_CONFIG2 = 0x1D;
+constexpr uint8_t REG_LP_ACCEL_ODR = 0x1E;
+constexpr uint8_t REG_WOM_THR = 0x1F;
+constexpr uint8_t REG_INT_ENABLE = 0x38;
+constexpr uint8_t REG_INT_STATUS = 0x3A;
+constexpr uint8_t REG_MOT_DETECT_CTRL = 0x69;
+constexpr uint8_t REG_PWR_MGMT_1 = 0x6B;
+constexpr uint8_t REG_PWR_MGMT_2 = 0x6C;
+/// AK8963 は MPU9250 の I2C バイパスの先にある
+constexpr uint8_t AK8963_I2C_ADDRESS = 0x0C;
+constexpr uint8_t REG_AK8963_CNTL1 = 0x0A;
+
+/// initMPU9250() と同じく、クロックは PLL を自動で選ぶ
+constexpr uint8_t PWR_MGMT_1_AUTO_CLOCK = 0x01;
+/// 加速度を間欠的に測る低消費電力モード
+constexpr uint8_t PWR_MGMT_1_CYCLE = 0x20;
+/// すべてのセンサを止める
+constexpr uint8_t PWR_MGMT_1_SLEEP = 0x40;
+constexpr uint8_t PWR_MGMT_2_DISABLE_GYRO = 0x07;
+/// initMPU9250() と同じく、加速度の帯域は 41 Hz
+constexpr uint8_t ACCEL_CONFIG2_DEFAULT = 0x03;
+/// 動き検知のときの加速度の設定 (ACCEL_FCHOICE_B = 1)
+constexpr uint8_t ACCEL_CONFIG2_WOM = 0x09;
+/// initMPU9250() と同じく、データ準備完了の割り込み
+constexpr uint8_t INT_ENABLE_RAW_READY = 0x01;
+constexpr uint8_t INT_STATUS_RAW_READY = 0x01;
+constexpr uint8_t INT_ENABLE_WOM = 0x40;
+/// 動き検知を有効にし、直前のサンプルと比べる
+constexpr uint8_t MOT_DETECT_CTRL_ENABLE = 0xC0;
+/// 低消費電力モードで測る周期。 7 は 31.25 Hz
+constexpr uint8_t LP_ACCEL_ODR_31HZ = 7;
+/// 動き検知の閾値の刻み [mg]
+constexpr uint16_t WOM_THR_LSB_MILLI_G = 4;
+/// 磁気センサの電源を切る
+constexpr uint8_t AK8963_CNTL1_POWER_DOWN = 0x00;
+} // namespace
+
+void Mpu9250Port::begin() {
+  IMU.calibrateMPU9250(IMU.gyroBias, IMU.accelBias);
+  IMU.initMPU9250();
+  IMU.initAK8963(IMU.magCalibration);
+  // 較正値を読むために起こした磁気センサは、使わないので止める
+  IMU.writeByte(AK8963_I2C_ADDRESS, REG_AK8963_CNTL1,
+                AK8963_CNTL1_POWER_DOWN);
+}
+
+void Mpu9250Port::sleep() {
+  stopFifo();
+  IMU.writeByte(MPU9250_ADDRESS, REG_INT_ENABLE, 0);
+  IMU.writeByte(MPU9250_ADDRESS, REG_MOT_DETECT_CTRL, 0);
+  IMU.writeByte(MPU9250_ADDRESS, REG_PWR_MGMT_1, PWR_MGMT_1_SLEEP);
+}
+
+uint16_t Mpu9250Port::startFifo(uint16_t odrHz) {
+  wakeAccel();
+  m_fifo.begin(odrHz);
+  m_fifoRunning = true;
+  return m_fifo.odrHz();
+}
+
+void Mpu9250Port::startRegisters() {
+  stopFifo();
+  wakeAccel();
+}
+
+bool Mpu9250Port::read(AccelSample &out) {
+  // ジャイロと磁気センサは止めているので、加速度だけを読む
+  if (!(IMU.readByte(MPU9250_ADDRESS, REG_INT_STATUS) &
+        INT_STATUS_RAW_READY)) {
+    return false;
+  }
+  IMU.readAccelData(IMU.accelCount);
+  IMU.getAres();
+  IMU.ax = (float)IMU.accelCount[0] * IMU.aRes;
+  IMU.ay = (float)IMU.accelCount[1] * IMU.aRes;
+  IMU.az = (float)IMU.accelCount[2] * IMU.aRes;
+  out = AccelSample{IMU.ax, IMU.ay, IMU.az};
+  return true;
+}
+
+void Mpu9250Port::watchMotion(uint16_t thresholdMilliG) {
+  stopFifo();
+  uint16_t threshold = thresholdMilliG / WOM_THR_LSB_MILLI_G;
+  if (threshold > 0xFF) {
+    threshold = 0xFF;
+  }
+  // データシートの手順: 加速度だけを起こし、閾値と周期を設定してから
+  // 間欠動作に入る
+  IMU.writeByte(MPU9250_ADDRESS, REG_PWR_MGMT_1, 0);
+  IMU.writeByte(MPU9250_ADDRESS, REG_PWR_MGMT_2, PWR_MGMT_2_DISABLE_GYRO);
+  IMU.writeByte(MPU9250_ADDRESS, REG_ACCEL_CONFIG2, ACCEL_CONFIG2_WOM);
+  IMU.writeByte(MPU9250_ADDRESS, REG_INT_ENABLE, INT_ENABLE_WOM);
+  IMU.writeByte(MPU9250_ADDRESS, REG_MOT_DETECT_CTRL, MOT_DETECT_CTRL_ENABLE);
+  IMU.writeByte(MPU9250_ADDRESS, REG_WOM_THR, static_cast<uint8_t>(threshold));
+  IMU.writeByte(MPU9250_ADDRESS, REG_LP_ACCEL_ODR, LP_ACCEL_ODR_31HZ);
+  // INT はラッチされるので、読んで下げておかないと次のエッジが来ない
+  IMU.readByte(MPU9250_ADDRESS, REG_INT_STATUS);
+  IMU.writeByte(MPU9250_ADDRESS, REG_PWR_MGMT_1, PWR_MGMT_1_CYCLE);
+}
+
+bool Mpu9250Port::attachMotionInterrupt(MotionHandler handler, void *arg) {
+  if (m_motionPin < 0) {
+    return false;
+  }
+  // initMPU9250() の設定で INT はアクティブ High のラッチ出力
+  pinMode(m_motionPin, INPUT);
+  attachInterruptArg(m_motionPin, handler, arg, RISING);
+  return true;
+}
+
+void Mpu9250Port::detachMotionInterrupt() {
+  if (m_motionPin >= 0) {
+    detachInterrupt(m_motionPin);
+  }
+}
+
+void Mpu9250Port::wakeAccel() {
+  IMU.writeByte(MPU9250_ADDRESS, REG_PWR_MGMT_1, PWR_MGMT_1_AUTO_CLOCK);
+  IMU.writeByte(MPU9250_ADDRESS, REG_MOT_DETECT_CTRL, 0);
+  IMU.writeByte(MPU9250_ADDRESS, REG_INT_ENABLE, INT_ENABLE_RAW_READY);
+  IMU.writeByte(MPU9250_ADDRESS, REG_PWR_MGMT_2, PWR_MGMT_2_DISABLE_GYRO);
+  IMU.writeByte(MPU9250_ADDRESS, REG_ACCEL_CONFIG2, ACCEL_CONFIG2_DEFAULT);
+}
+
+void Mpu9250Port::stopFifo() {
+  if (m_fifoRunning) {
+    // end() はジャイロを起こすので、この後で必ず電源の設定をし直す
+    m_fifo.end();
+    m_fifoRunning = false;
+  }
+}
+
+} // namespace hardware
@@ -0,0 +1,111 @@
+/**
+ * @file imu_port.hpp
+ * @brief IMU のレジスタ操作を抽象化したインターフェースを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_IMU_PORT_HPP_
+#define _INCLUDE_IMU_PORT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility/MPU9250.h>
+
+#include "mpu9250_fifo.hpp"
+
+namespace hardware {
+/// IMU の電源の状態。
+enum class ImuPower : uint8_t {
+  /// すべてのセンサが眠っている
+  Sleep,
+  /// 加速度だけが低消費電力で間欠的に動き、動きを待っている
+  MotionWatch,
+  /// 加速度だけが動いている。ジャイロと磁気センサは止まっている
+  Accel,
+};
+/// `ImuPower` の種類の数。
+constexpr size_t IMU_POWER_COUNT = 3;
+
+/// IMU の操作。
+///
+/// 振動検知の状態遷移をレジスタの操作から切り離すためのインターフェース。
+/// 割り込みのハンドラ以外は、1つのタスクからだけ呼ぶこと。
+class ImuPort {
+public:
+  /// 動き検知の割り込みのハンドラ型。 ISR から呼ばれる。
+  typedef void (*MotionHandler)(void *arg);
+
+  virtual ~ImuPort() = default;
+
+  /// 較正して初期化する。時間がかかるので起動時に呼ぶ。
+  ///
+  /// 使わない磁気センサは止める。
+  virtual void begin() = 0;
+
+  /// すべてのセンサを眠らせる。次の `startFifo()` などで起きる。
+  virtual void sleep() = 0;
+
+  /// 加速度だけを `odrHz` で FIFO に溜め始め、実際の出力レートを返す。
+  virtual uint16_t startFifo(uint16_t odrHz) = 0;
+
+  /// FIFO に溜まったサンプルを古い順に取り出し、個数を返す。
+  virtual size_t drain(AccelSample *out, size_t capacity) = 0;
+
+  /// 加速度だけを通常の設定で動かし、レジスタを直接読めるようにする。
+  virtual void startRegisters() = 0;
+
+  /// 新しい値があればレジスタから加速度を読んで `true` を返す。
+  virtual bool read(AccelSample &out) = 0;
+
+  /// 低消費電力で動きを待つ。
+  ///
+  /// 直前のサンプルとの差が `thresholdMilliG` を超えると割り込みが上がる。
+  /// 上がったままの割り込みは解除するので、待ち直すときにも呼ぶ。
+  virtual void watchMotion(uint16_t thresholdMilliG) = 0;
+
+  /// 動き検知の割り込みを登録する。割り込みピンがなければ `false` を返す。
+  virtual bool attachMotionInterrupt(MotionHandler handler, void *arg) = 0;
+
+  /// 割り込みを解除する。
+  virtual void detachMotionInterrupt() = 0;
+};
+
+/// M5Stack の MPU9250。
+///
+/// 標準の M5Stack では MPU9250 の INT は GPIO につながっていないので、
+/// 動き検知を使うには配線してそのピンを渡す。
+class Mpu9250Port final : public ImuPort {
+public:
+  /// `motionPin` は INT をつないだ GPIO 。負ならつながっていない。
+  explicit Mpu9250Port(int8_t motionPin = -1) : m_motionPin(motionPin) {}
+
+  virtual void begin() override;
+  virtual void sleep() override;
+  virtual uint16_t startFifo(uint16_t odrHz) override;
+  virtual size_t drain(AccelSample *out, size_t capacity) override {
+    return m_fifo.drain(out, capacity);
+  }
+  virtual void startRegisters() override;
+  virtual bool read(AccelSample &out) override;
+  virtual void watchMotion(uint16_t thresholdMilliG) override;
+  virtual bool attachMotionInterrupt(MotionHandler handler,
+                                     void *arg) override;
+  virtual void detachMotionInterrupt() override;
+
+  /// FIFO が溢れて捨てた回数。
+  uint32_t fifoOverflows() const { return m_fifo.overflows(); }
+
+private:
+  MPU9250 IMU; // 9 axis Sensor
+  Mpu9250Fifo m_fifo{IMU};
+  int8_t m_motionPin;
+  bool m_fifoRunning = false;
+
+  /// 眠りや動き検知を解き、加速度だけを動かす。
+  void wakeAccel();
+  /// FIFO を止めていれば何もしない。
+  void stopFifo();
+};
+} // namespace hardware
+
+#endif
@@ -0,0 +1,125 @@
+// コンパイルエラーを防ぐため， Arduino.h で定義されているマクロをundef
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+
+#include <M5Stack.h>
+
+#include "mpu9250_fifo.hpp"
+
+namespace hardware {
+namespace {
+// MPU9250 のレジスタ。ライブラリのマクロと名前がぶつからないよう接頭辞を付ける
+constexpr uint8_t REG_SMPLRT_DIV = 0x19;
+constexpr uint8_t REG_CONFIG = 0x1A;
+constexpr uint8_t REG_ACCEL_CONFIG2 = 0x1D;
+constexpr uint8_t REG_FIFO_EN = 0x23;
+constexpr uint8_t REG_USER_CTRL = 0x6A;
+constexpr uint8_t REG_PWR_MGMT_2 = 0x6C;
+constexpr uint8_t REG_FIFO_COUNTH = 0x72;
+constexpr uint8_t REG_FIFO_R_W = 0x74;
+
+constexpr uint8_t FIFO_EN_ACCEL = 0x08;
+constexpr uint8_t USER_CTRL_FIFO_EN = 0x40;
+constexpr uint8_t USER_CTRL_FIFO_RST = 0x04;
+constexpr uint8_t PWR_MGMT_2_DISABLE_GYRO = 0x07;
+/// 内部のサンプリング周波数 [Hz]。 DLPF を使うと 1 kHz になる。
+constexpr uint16_t INTERNAL_RATE_HZ = 1000;
+/// FIFO の大きさ [byte]。
+constexpr uint16_t FIFO_SIZE = 512;
+/// 1サンプルの大きさ [byte]。
+constexpr uint8_t SAMPLE_BYTES = 6;
+/// 1回のバースト読み出しで読むサンプル数。
+///
+/// ESP32 の Wire のバッファ (128 byte) に収まるようにする。
+constexpr size_t BURST_SAMPLES = 20;
+
+/// 出力レートの半分を超えない最も広い加速度の DLPF の設定を返す。
+uint8_t accelDlpfFor(uint16_t odrHz) {
+  // A_DLPF_CFG = 1..6 の帯域幅 [Hz]
+  static const uint16_t bandwidths[] = {218, 99, 45, 21, 10, 5};
+  for (uint8_t i = 0; i < 6; ++i) {
+    if (bandwidths[i] * 2 <= odrHz) {
+      return i + 1;
+    }
+  }
+  return 6;
+}
+
+int16_t bigEndian(const uint8_t *p) {
+  return static_cast<int16_t>((uint16_t(p[0]) << 8) | p[1]);
+}
+} // namespace
+
+void Mpu9250Fifo::begin(uint16_t odrHz) {
+  if (odrHz < 4) {
+    odrHz = 4;
+  }
+  if (odrHz > INTERNAL_RATE_HZ) {
+    odrHz = INTERNAL_RATE_HZ;
+  }
+  const uint8_t divider = INTERNAL_RATE_HZ / odrHz - 1;
+  m_odrHz = INTERNAL_RATE_HZ / (divider + 1);
+  // ジャイロを止めて加速度だけにする
+  m_imu.writeByte(MPU9250_ADDRESS, REG_PWR_MGMT_2, PWR_MGMT_2_DISABLE_GYRO);
+  // 分周器は DLPF が有効なときだけ効くので、 CONFIG の DLPF は
+  // initMPU9250() の設定のまま残す
+  m_imu.writeByte(MPU9250_ADDRESS, REG_SMPLRT_DIV, divider);
+  // 折り返しを防ぐため、帯域を出力レートの半分以下に絞る
+  m_imu.writeByte(MPU9250_ADDRESS, REG_ACCEL_CONFIG2, accelDlpfFor(m_odrHz));
+  // 満杯になったら古いものから上書きする (CONFIG の FIFO_MODE = 0)
+  const uint8_t config = m_imu.readByte(MPU9250_ADDRESS, REG_CONFIG);
+  m_imu.writeByte(MPU9250_ADDRESS, REG_CONFIG, config & ~0x40);
+  m_imu.getAres();
+  reset();
+}
+
+void Mpu9250Fifo::end() {
+  m_imu.writeByte(MPU9250_ADDRESS, REG_FIFO_EN, 0);
+  m_imu.writeByte(MPU9250_ADDRESS, REG_USER_CTRL, 0);
+  m_imu.writeByte(MPU9250_ADDRESS, REG_PWR_MGMT_2, 0);
+  m_odrHz = 0;
+}
+
+void Mpu9250Fifo::reset() {
+  m_imu.writeByte(MPU9250_ADDRESS, REG_FIFO_EN, 0);
+  m_imu.writeByte(MPU9250_ADDRESS, REG_USER_CTRL, USER_CTRL_FIFO_RST);
+  m_imu.writeByte(MPU9250_ADDRESS, REG_USER_CTRL, USER_CTRL_FIFO_EN);
+  m_imu.writeByte(MPU9250_ADDRESS, REG_FIFO_EN, FIFO_EN_ACCEL);
+}
+
+size_t Mpu9250Fifo::drain(AccelSample *out, size_t capacity) {
+  uint8_t countBytes[2];
+  m_imu.readBytes(MPU9250_ADDRESS, REG_FIFO_COUNTH, 2, countBytes);
+  const uint16_t count = ((uint16_t(countBytes[0]) & 0x1F) << 8) | countBytes[1];
+  // 満杯なら上書きで途中から読むことになり、境界がずれるので捨てる
+  if (count >= FIFO_SIZE - SAMPLE_BYTES + 1) {
+    m_overflows++;
+    log_w("Mpu9250Fifo: FIFO overflowed at %u Hz, samples dropped", m_odrHz);
+    reset();
+    return 0;
+  }
+  size_t n = count / SAMPLE_BYTES;
+  if (n > capacity) {
+    n = capacity;
+  }
+  uint8_t buf[BURST_SAMPLES * SAMPLE_BYTES];
+  size_t done = 0;
+  while (done < n) {
+    const size_t burst = n - done < BURST_SAMPLES ? n - done : BURST_SAMPLES;
+    m_imu.readBytes(MPU9250_ADDRESS, REG_FIFO_R_W,
+                    static_cast<uint8_t>(burst * SAMPLE_BYTES), buf);
+    for (size_t i = 0; i < burst; ++i) {
+      const uint8_t *p = buf + i * SAMPLE_BYTES;
+      out[done + i] = AccelSample{bigEndian(p) * m_imu.aRes,
+                                  bigEndian(p + 2) * m_imu.aRes,
+                                  bigEndian(p + 4) * m_imu.aRes};
+    }
+    done += burst;
+  }
+  return done;
+}
+} // namespace hardware
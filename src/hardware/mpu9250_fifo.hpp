@@ -0,0 +1,58 @@
+/**
+ * @file mpu9250_fifo.hpp
+ * @brief MPU9250 の FIFO に加速度だけを溜めてまとめて読むクラスを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_MPU9250_FIFO_HPP_
+#define _INCLUDE_MPU9250_FIFO_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility/MPU9250.h>
+
+#include "accel_sample.hpp"
+
+namespace hardware {
+/// MPU9250 の FIFO を使った加速度だけのサンプリング。
+///
+/// ジャイロを止め、指定した出力レートで加速度だけを FIFO に溜める。
+/// `drain()` は溜まった分を数回のバースト読み出しでまとめて取り出す。
+/// 512 byte の FIFO には 85 サンプル溜まるので、 200 Hz なら 400 ms 以内に
+/// 読めば溢れない。
+class Mpu9250Fifo {
+public:
+  /// FIFO に溜まるサンプル数の上限。
+  static constexpr size_t CAPACITY = 512 / 6;
+
+  explicit Mpu9250Fifo(MPU9250 &imu) : m_imu(imu) {}
+
+  /// 加速度だけを `odrHz` で FIFO に溜め始める。
+  ///
+  /// `initMPU9250()` の後に呼ぶ。 ODR は 4 Hz から 1000 Hz まで。
+  void begin(uint16_t odrHz);
+
+  /// FIFO を止め、ジャイロを含む通常のサンプリングに戻す。
+  void end();
+
+  /// 溜まったサンプルを古い順に `out` へ取り出し、個数を返す。
+  ///
+  /// 溢れていたら FIFO を空にして 0 を返す。
+  size_t drain(AccelSample *out, size_t capacity);
+
+  /// 溢れて捨てた回数。
+  uint32_t overflows() const { return m_overflows; }
+  /// 実際に設定した出力レート [Hz]。
+  uint16_t odrHz() const { return m_odrHz; }
+
+private:
+  MPU9250 &m_imu;
+  uint32_t m_overflows = 0;
+  uint16_t m_odrHz = 0;
+
+  /// FIFO を空にして溜め直す。
+  void reset();
+};
+} // namespace hardware
+
+#endif
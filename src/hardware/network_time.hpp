@@ -0,0 +1,25 @@
+/**
+ * @file network_time.hpp
+ * @brief WiFi に接続して NTP で時計を合わせ始める関数を持つ
+ */
+#pragma once
+#ifndef _INCLUDE_NETWORK_TIME_HPP_
+#define _INCLUDE_NETWORK_TIME_HPP_
+
+#include <WiFi.h>
+
+namespace hardware {
+/// WiFi への接続と、 SNTP による時計の補正を始める。
+///
+/// 待たずに戻る。接続できれば SNTP が定期的に時計を合わせ続けるので、
+/// 起動時だけでなく deep sleep からの復帰時にも呼ぶ。
+inline void beginNetworkTime() {
+  WiFi.begin();
+  const char *ntpServer = "ntp.jst.mfeed.ad.jp"; //日本のNTPサーバー選択
+  const long gmtOffset_sec = 9 * 3600; // 9時間の時差を入れる
+  const int daylightOffset_sec = 0;    //夏時間はないのでゼロ
+  configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
+}
+} // namespace hardware
+
+#endif
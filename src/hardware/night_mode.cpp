@@ -0,0 +1,11 @@
+#include <esp_attr.h>
+
+#include "night_mode.hpp"
+
+namespace hardware {
+// deep sleep 中も保持される
+// 静的初期化で消えないよう、コンストラクタを持たない型にする
+RTC_DATA_ATTR static NightModeRtcState s_nightModeRtcState;
+
+NightModeRtcState &NightMode::rtcState() { return s_nightModeRtcState; }
+} // namespace hardware
@@ -0,0 +1,154 @@
+/**
+ * @file night_mode.hpp
+ * @brief アラームまでの間 deep sleep する夜間モードを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_NIGHT_MODE_HPP_
+#define _INCLUDE_NIGHT_MODE_HPP_
+
+#include <atomic>
+#include <cstdint>
+
+#include <esp32-hal-log.h>
+#include <esp_timer.h>
+
+#include "sleep_port.hpp"
+
+namespace hardware {
+/// 夜間モードの設定。
+struct NightModeConfig {
+  /// 最後の操作からこの時間が経てば眠る [ms]。
+  uint32_t idleMillis = 10 * 60 * 1000;
+  /// アラームのこの時間前に復帰する [ms]。
+  ///
+  /// 復帰から時計の表示までにかかる時間より長くすること。
+  uint32_t wakeLeadMillis = 5 * 1000;
+  /// 眠れる時間がこれより短ければ眠らない [ms]。
+  uint32_t minSleepMillis = 60 * 1000;
+  /// 次のアラームがこれより先なら眠らない [ms]。
+  ///
+  /// 眠るのは、これから来る夜のアラームが設定されているときだけにする。
+  /// 朝のアラームの直後は次のアラームが丸1日先なので、時計を出したままにする。
+  uint32_t maxSleepAheadMillis = 12 * 60 * 60 * 1000;
+};
+
+/// 夜間モードで眠るかどうかと、眠る時間を決める。
+///
+/// ハードウェアに依存しない。
+class NightModePlanner {
+private:
+  NightModeConfig m_config;
+
+public:
+  NightModePlanner() = default;
+  explicit NightModePlanner(const NightModeConfig &config)
+      : m_config(config) {}
+
+  const NightModeConfig &config() const { return m_config; }
+
+  /// 眠るべきなら眠る時間 [us] を、そうでなければ 0 を返す。
+  ///
+  /// `idleMillis` は最後の操作からの時間、 `millisUntilAlarm` は次の
+  /// アラームまでの時間 (アラームがなければ負の値)。
+  /// アラームがないときは、朝に起こせないので眠らない。
+  /// アラームが `maxSleepAheadMillis` より先のときも眠らない。
+  uint64_t sleepMicros(uint32_t idleMillis, int64_t millisUntilAlarm) const {
+    const int64_t ahead = m_config.maxSleepAheadMillis;
+    if (idleMillis < m_config.idleMillis || millisUntilAlarm < 0 ||
+        millisUntilAlarm > ahead) {
+      return 0;
+    }
+    const int64_t sleepMillis = millisUntilAlarm - m_config.wakeLeadMillis;
+    if (sleepMillis < static_cast<int64_t>(m_config.minSleepMillis)) {
+      return 0;
+    }
+    return static_cast<uint64_t>(sleepMillis) * 1000;
+  }
+};
+
+/// deep sleep を挟んで RTC メモリに残す夜間モードの状態。
+struct NightModeRtcState {
+  /// 有効な内容であることを示す値。
+  uint32_t magic;
+  /// 眠ったときのシーン。値の意味は呼び出し側が決める。
+  uint8_t scene;
+};
+
+/// 夜間モード。
+///
+/// 夜のアラームが設定された状態で操作がないまま一定時間が経つと、
+/// アラームの少し前に復帰するよう deep sleep に入る。途中でボタンを押しても
+/// 復帰する。アラームの予定は `AlarmManager` が RTC メモリに残すので、
+/// 復帰後は WiFi や NTP を待たずに時計とアラームを再開できる。
+class NightMode {
+private:
+  SleepPort &m_port;
+  NightModePlanner m_planner;
+  /// 最後に操作された時刻 [ms] (単調増加時計)。
+  std::atomic<uint32_t> m_lastActivityMillis{0};
+  /// deep sleep から復帰したか否か。
+  bool m_resumed = false;
+  /// 復帰したときのシーン。
+  uint8_t m_resumedScene = 0;
+  /// 今回の起動の要因。
+  WakeCause m_wakeCause = WakeCause::PowerOn;
+
+  /// RTC メモリ上の状態。
+  static NightModeRtcState &rtcState();
+  static constexpr uint32_t RTC_MAGIC = 0x4E494748; //< "NIGH"
+
+public:
+  explicit NightMode(SleepPort &port) : m_port(port) {}
+
+  /// 起動の要因を調べる。
+  void begin(const NightModeConfig &config = NightModeConfig()) {
+    m_planner = NightModePlanner(config);
+    NightModeRtcState &rtc = rtcState();
+    m_wakeCause = m_port.wakeCause();
+    m_resumed = m_wakeCause != WakeCause::PowerOn && rtc.magic == RTC_MAGIC;
+    m_resumedScene = rtc.scene;
+    // 次に眠るまで、 RTC メモリの状態は使わない
+    rtc.magic = 0;
+    if (m_resumed) {
+      log_i("NightMode: resumed from deep sleep");
+    }
+    notifyActivity();
+  }
+
+  /// deep sleep から復帰したかどうかを返す。
+  bool resumedFromSleep() const { return m_resumed; }
+  /// 復帰したときのシーンを返す。
+  uint8_t resumedScene() const { return m_resumedScene; }
+  /// 今回の起動の要因を返す。
+  WakeCause wakeCause() const { return m_wakeCause; }
+
+  /// 操作があったことを知らせる。
+  void notifyActivity() { m_lastActivityMillis = nowMillis(); }
+
+  /// 条件を満たせば deep sleep に入る。
+  ///
+  /// `millisUntilAlarm` は次のアラームまでの時間 (なければ負の値)、
+  /// `scene` は復帰時に `resumedScene()` で返す値。
+  /// 眠った場合は戻らない。
+  void poll(int64_t millisUntilAlarm, uint8_t scene) {
+    const uint32_t idle = nowMillis() - m_lastActivityMillis;
+    const uint64_t micros = m_planner.sleepMicros(idle, millisUntilAlarm);
+    if (micros == 0) {
+      return;
+    }
+    NightModeRtcState &rtc = rtcState();
+    rtc.scene = scene;
+    rtc.magic = RTC_MAGIC;
+    log_i("NightMode: sleeping for %u s",
+          static_cast<unsigned>(micros / 1000000));
+    m_port.deepSleep(micros);
+  }
+
+private:
+  static uint32_t nowMillis() {
+    return static_cast<uint32_t>(esp_timer_get_time() / 1000);
+  }
+};
+} // namespace hardware
+
+#endif
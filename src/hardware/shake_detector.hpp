@@ -0,0 +1,188 @@
+/**
+ * @file shake_detector.hpp
+ * @brief 加速度のサンプル列から振った回数と強さを求めるクラスを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_SHAKE_DETECTOR_HPP_
+#define _INCLUDE_SHAKE_DETECTOR_HPP_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "accel_sample.hpp"
+
+namespace hardware {
+/// 振動検知の閾値と時定数。
+struct ShakeDetectorConfig {
+  /// 重力を取り除く高域通過フィルタの遮断周波数 [Hz]
+  float cutoffHz = 0.5f;
+  /// 動きの加速度の大きさがこれを超えたら1回の振りの始まり [g]
+  float triggerG = 1.0f;
+  /// これを下回ったら振りの終わり [g]
+  float releaseG = 0.5f;
+  /// 振りの始まりから次の振りを受け付けるまでの時間 [ms]
+  ///
+  /// 振り終わりの揺り戻しを数えないため。 6 Hz で振った往復の片道
+  /// (83 ms) より短くする。
+  uint32_t refractoryMillis = 60;
+  /// 往復とみなす2回の振りの間隔の上限 [ms]
+  uint32_t pairWindowMillis = 1000;
+};
+
+/// 加速度のサンプル列から振った回数と強さを求める。
+///
+/// 1. 各軸の低域通過フィルタで重力を推定して差し引く (高域通過)。
+/// 2. 残った動きの加速度の大きさを求める。
+/// 3. ヒステリシス付きの閾値で1回の振り (ピーク) を切り出し、
+///    始まってから不応期の間は次の振りを受け付けない。
+/// 4. 向きが逆の振りが続いたら、往復1回として数える。
+///
+/// 向きによらず重力の影響を受けない。状態は固定長で、ヒープ確保はしない。
+class ShakeDetector {
+public:
+  ShakeDetector() { configure(ShakeDetectorConfig{}, 100); }
+
+  /// 設定とサンプリング周波数 [Hz] を与え、状態を初期化する。
+  void configure(const ShakeDetectorConfig &config, float sampleRateHz) {
+    const float dt = 1.0f / sampleRateHz;
+    const float rc = 1.0f / (2.0f * 3.14159265f * config.cutoffHz);
+    m_alpha = dt / (rc + dt);
+    m_trigger2 = config.triggerG * config.triggerG;
+    m_release2 = config.releaseG * config.releaseG;
+    m_refractorySamples =
+        static_cast<uint32_t>(config.refractoryMillis * sampleRateHz / 1000);
+    m_pairSamples =
+        static_cast<uint32_t>(config.pairWindowMillis * sampleRateHz / 1000);
+    reset();
+  }
+
+  /// 回数と重力の推定を消す。
+  void reset() {
+    restart();
+    m_count = 0;
+    m_lastIntensity = 0;
+  }
+
+  /// 回数は残し、重力の推定と振りの途中の状態を消す。
+  ///
+  /// サンプルが途切れた後、次のサンプルから測り直すときに呼ぶ。
+  void restart() {
+    m_primed = false;
+    m_inPeak = false;
+    m_hasStroke = false;
+    m_quiet = 0;
+    m_sinceStart = 0;
+  }
+
+  /// 古い順に並んだサンプルを処理する。
+  void process(const AccelSample *samples, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      process(samples[i]);
+    }
+  }
+
+  /// 往復の回数。
+  uint32_t count() const { return m_count; }
+  /// 直近の往復の強さ (動きの加速度の大きさの最大値) [g]。
+  float lastIntensity() const { return m_lastIntensity; }
+  /// 直前の振りが終わってからのサンプル数。振りの途中なら 0 。
+  uint32_t samplesSinceStroke() const { return m_inPeak ? 0 : m_quiet; }
+
+private:
+  float m_alpha;
+  float m_trigger2;
+  float m_release2;
+  uint32_t m_refractorySamples;
+  uint32_t m_pairSamples;
+
+  /// 重力の推定値。
+  float m_gx = 0, m_gy = 0, m_gz = 0;
+  bool m_primed;
+  /// 振りの途中か否か。
+  bool m_inPeak;
+  /// 振りの間で最も大きかった動きの加速度。
+  float m_peakX = 0, m_peakY = 0, m_peakZ = 0, m_peak2 = 0;
+  /// 往復の片道目の振りがあるか否か。
+  bool m_hasStroke;
+  float m_strokeX = 0, m_strokeY = 0, m_strokeZ = 0, m_stroke2 = 0;
+  /// 直前の振りが終わってからのサンプル数。
+  uint32_t m_quiet;
+  /// 直前の振りが始まってからのサンプル数。
+  uint32_t m_sinceStart;
+  uint32_t m_count;
+  float m_lastIntensity;
+
+  void process(const AccelSample &s) {
+    if (!m_primed) {
+      // 最初のサンプルを重力とみなし、起動時の段差を振りと誤らない
+      m_gx = s.x;
+      m_gy = s.y;
+      m_gz = s.z;
+      m_primed = true;
+    }
+    m_gx += m_alpha * (s.x - m_gx);
+    m_gy += m_alpha * (s.y - m_gy);
+    m_gz += m_alpha * (s.z - m_gz);
+    const float dx = s.x - m_gx;
+    const float dy = s.y - m_gy;
+    const float dz = s.z - m_gz;
+    // 平方根は強さを報告するときだけ取る
+    const float mag2 = dx * dx + dy * dy + dz * dz;
+    if (m_sinceStart < UINT32_MAX) {
+      m_sinceStart++;
+    }
+
+    if (m_inPeak) {
+      if (mag2 > m_peak2) {
+        m_peakX = dx;
+        m_peakY = dy;
+        m_peakZ = dz;
+        m_peak2 = mag2;
+      }
+      if (mag2 < m_release2) {
+        m_inPeak = false;
+        m_quiet = 0;
+        finishStroke();
+      }
+      return;
+    }
+    if (m_quiet < UINT32_MAX) {
+      m_quiet++;
+    }
+    // 片道目から間が空きすぎたら、往復とはみなさない
+    if (m_hasStroke && m_quiet > m_pairSamples) {
+      m_hasStroke = false;
+    }
+    if (mag2 > m_trigger2 && m_sinceStart > m_refractorySamples) {
+      m_inPeak = true;
+      m_sinceStart = 0;
+      m_peakX = dx;
+      m_peakY = dy;
+      m_peakZ = dz;
+      m_peak2 = mag2;
+    }
+  }
+
+  /// 振りが終わったときに、往復になったかを調べる。
+  void finishStroke() {
+    if (m_hasStroke && m_peakX * m_strokeX + m_peakY * m_strokeY +
+                               m_peakZ * m_strokeZ <
+                           0) {
+      m_count++;
+      m_lastIntensity =
+          std::sqrt(m_peak2 > m_stroke2 ? m_peak2 : m_stroke2);
+      m_hasStroke = false;
+      return;
+    }
+    // 同じ向きが続いたら、新しい方を片道目とする
+    m_hasStroke = true;
+    m_strokeX = m_peakX;
+    m_strokeY = m_peakY;
+    m_strokeZ = m_peakZ;
+    m_stroke2 = m_peak2;
+  }
+};
+} // namespace hardware
+
+#endif
@@ -0,0 +1,185 @@
+/**
+ * @file shake_trace_format.hpp
+ * @brief 加速度の記録ファイルの形式を持つ
+ *
+ * 実機の記録とホストの再生ツールで共有するので、 Arduino のヘッダには
+ * 依存しない。
+ */
+#pragma once
+#ifndef _INCLUDE_SHAKE_TRACE_FORMAT_HPP_
+#define _INCLUDE_SHAKE_TRACE_FORMAT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "accel_sample.hpp"
+
+namespace hardware {
+/// 記録ファイルの先頭に置くヘッダ。
+///
+/// ファイルはヘッダの後に `capacity` 個のレコードを並べたリングで、
+/// `head` 番目 (`capacity` で割った余り) に次のレコードを書く。
+/// 値はすべてリトルエンディアン。
+struct ShakeTraceHeader {
+  /// `SHAKE_TRACE_MAGIC`
+  uint32_t magic;
+  /// `SHAKE_TRACE_VERSION`
+  uint16_t version;
+  /// レコードの大きさ [byte]
+  uint16_t recordSize;
+  /// リングに入るレコード数
+  uint32_t capacity;
+  /// これまでに書いたレコード数
+  uint32_t head;
+  /// 最後に記録したときの FIFO の出力レート [Hz]。 0 はレジスタ読み
+  uint16_t odrHz;
+  uint16_t reserved[5];
+};
+static_assert(sizeof(ShakeTraceHeader) == 28, "unexpected header layout");
+
+constexpr uint32_t SHAKE_TRACE_MAGIC = 0x544B4853; // "SHKT"
+constexpr uint16_t SHAKE_TRACE_VERSION = 1;
+
+/// 記録の1レコード。
+///
+/// `tag` の最上位ビットが 0 ならサンプルで、 `x, y, z` は加速度 [mg] 、
+/// `tag` は直前のサンプルからの時間 [0.1 ms] 。
+/// 1 ならイベントで、下位ビットが `ShakeTraceEvent` 。
+struct ShakeTraceRecord {
+  int16_t x;
+  int16_t y;
+  int16_t z;
+  uint16_t tag;
+};
+static_assert(sizeof(ShakeTraceRecord) == 8, "unexpected record layout");
+
+/// イベントの種類。
+///
+/// イベントはどれも `x, y, z` に起動からの時間 [0.1 ms] を下位から順に
+/// 16 bit ずつ持つ。
+enum class ShakeTraceEvent : uint16_t {
+  /// 次のサンプルの時刻。バッチごとに置くので、リングが一周した後も
+  /// 最初の時刻から読み直せる。
+  Time = 0,
+  /// `ShakingManager::startCount()`
+  StartCount = 1,
+  /// `ShakingManager::stopCount()`
+  StopCount = 2,
+  /// `ShakingManager::resetCount()`
+  ResetCount = 3,
+};
+
+constexpr uint16_t SHAKE_TRACE_EVENT_BIT = 0x8000;
+/// サンプルの間隔の上限 [0.1 ms] 。超えたら時刻のイベントを挟む。
+constexpr uint16_t SHAKE_TRACE_MAX_DELTA = 0x7FFF;
+
+/// 加速度 [g] を記録の値 [mg] にする。
+inline int16_t toTraceMilliG(float g) {
+  const float mg = g * 1000.0f;
+  if (mg >= 32767.0f) {
+    return 32767;
+  }
+  if (mg <= -32768.0f) {
+    return -32768;
+  }
+  return static_cast<int16_t>(mg < 0 ? mg - 0.5f : mg + 0.5f);
+}
+
+/// 記録の値をサンプルに戻す。
+inline AccelSample fromTraceRecord(const ShakeTraceRecord &r) {
+  return AccelSample{r.x / 1000.0f, r.y / 1000.0f, r.z / 1000.0f};
+}
+
+/// イベントのレコードを作る。
+inline ShakeTraceRecord makeTraceEvent(ShakeTraceEvent event,
+                                       uint64_t time = 0) {
+  return ShakeTraceRecord{static_cast<int16_t>(time & 0xFFFF),
+                          static_cast<int16_t>((time >> 16) & 0xFFFF),
+                          static_cast<int16_t>((time >> 32) & 0xFFFF),
+                          static_cast<uint16_t>(SHAKE_TRACE_EVENT_BIT |
+                                                uint16_t(event))};
+}
+
+/// イベントから時刻 [0.1 ms] を取り出す。
+inline uint64_t traceEventTime(const ShakeTraceRecord &r) {
+  return uint64_t(uint16_t(r.x)) | uint64_t(uint16_t(r.y)) << 16 |
+         uint64_t(uint16_t(r.z)) << 32;
+}
+
+/// 古い順に並んだ1バッチのサンプルを、時刻のイベントに続けて `push` する。
+///
+/// 最後のサンプルを `end` [0.1 ms] とし、それ以前は `odrHz` の間隔で並べる。
+/// `push` は `n + 1` 回呼ばれる。
+template <typename Push>
+void encodeTraceBatch(const AccelSample *samples, size_t n, uint16_t odrHz,
+                      uint64_t end, Push push) {
+  const uint32_t interval = odrHz > 0 ? 10000 / odrHz : 0;
+  const uint64_t span = n > 0 ? uint64_t(interval) * (n - 1) : 0;
+  push(makeTraceEvent(ShakeTraceEvent::Time, end > span ? end - span : 0));
+  for (size_t i = 0; i < n; ++i) {
+    push(ShakeTraceRecord{toTraceMilliG(samples[i].x),
+                          toTraceMilliG(samples[i].y),
+                          toTraceMilliG(samples[i].z),
+                          static_cast<uint16_t>(i == 0 ? 0 : interval)});
+  }
+}
+
+/// リングに残っているレコード数。
+inline uint32_t traceRingCount(const ShakeTraceHeader &header) {
+  return header.head > header.capacity ? header.capacity : header.head;
+}
+
+/// リングで最も古いレコードの位置。一周していれば `head` の位置。
+inline uint32_t traceRingFirst(const ShakeTraceHeader &header) {
+  return header.head > header.capacity ? header.head % header.capacity : 0;
+}
+
+/// 記録から読み出した1項目。
+struct ShakeTraceItem {
+  /// 起動からの時間 [0.1 ms]
+  uint64_t time;
+  /// サンプルなら `true` 。そうでなければ `event` が有効
+  bool isSample;
+  ShakeTraceEvent event;
+  AccelSample sample;
+};
+
+/// 古い順に与えたレコードを、時刻の付いた項目に戻す。
+///
+/// サンプルの時刻は直前の時刻のイベントから数えるので、リングが一周して
+/// 途中から読み始めたときは、最初の時刻のイベントまでのサンプルを捨てる。
+class ShakeTraceDecoder {
+public:
+  /// 1レコードを読む。項目になれば `item` に入れて `true` を返す。
+  bool decode(const ShakeTraceRecord &r, ShakeTraceItem &item) {
+    if (r.tag & SHAKE_TRACE_EVENT_BIT) {
+      const auto event =
+          static_cast<ShakeTraceEvent>(r.tag & ~SHAKE_TRACE_EVENT_BIT);
+      if (event == ShakeTraceEvent::Time) {
+        m_time = traceEventTime(r);
+        m_synced = true;
+        return false;
+      }
+      item = ShakeTraceItem{traceEventTime(r), false, event, {}};
+      return true;
+    }
+    if (!m_synced) {
+      return false;
+    }
+    m_time += r.tag;
+    item = ShakeTraceItem{m_time, true, ShakeTraceEvent::Time,
+                          fromTraceRecord(r)};
+    return true;
+  }
+
+  /// 時刻のイベントを読んだか否か。
+  bool synced() const { return m_synced; }
+
+private:
+  bool m_synced = false;
+  /// 直前のサンプルの時刻 [0.1 ms]
+  uint64_t m_time = 0;
+};
+} // namespace hardware
+
+#endif
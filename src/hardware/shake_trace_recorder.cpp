@@ -0,0 +1,155 @@
+// コンパイルエラーを防ぐため， Arduino.h で定義されているマクロをundef
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "../task_registry.hpp"
+#include "shake_trace_recorder.hpp"
+
+namespace hardware {
+namespace {
+/// SD に書く周期 [ms]
+constexpr uint32_t FLUSH_MILLIS = 1000;
+} // namespace
+
+bool ShakeTraceRecorder::begin(fs::FS &fs, const char *path,
+                               uint32_t capacity) {
+  // 同じ形式と大きさの記録があれば、続きから書く
+  if (fs.exists(path)) {
+    m_file = fs.open(path, "r+");
+    if (m_file &&
+        m_file.read(reinterpret_cast<uint8_t *>(&m_header),
+                    sizeof(m_header)) == sizeof(m_header) &&
+        m_header.magic == SHAKE_TRACE_MAGIC &&
+        m_header.version == SHAKE_TRACE_VERSION &&
+        m_header.recordSize == sizeof(ShakeTraceRecord) &&
+        m_header.capacity == capacity) {
+      log_i("ShakeTraceRecorder: appending to %s at record %u", path,
+            m_header.head);
+    } else {
+      m_file.close();
+    }
+  }
+  if (!m_file) {
+    m_file = fs.open(path, "w+");
+    if (!m_file) {
+      log_e("ShakeTraceRecorder: failed to open %s", path);
+      return false;
+    }
+    m_header = ShakeTraceHeader{};
+    m_header.magic = SHAKE_TRACE_MAGIC;
+    m_header.version = SHAKE_TRACE_VERSION;
+    m_header.recordSize = sizeof(ShakeTraceRecord);
+    m_header.capacity = capacity;
+    m_file.write(reinterpret_cast<const uint8_t *>(&m_header),
+                 sizeof(m_header));
+    m_file.flush();
+    log_i("ShakeTraceRecorder: created %s (%u records)", path, capacity);
+  }
+  // SD への書き込みは遅いので、ほかの処理より低い優先度で行う
+  sugar::TaskRegistry::instance().create(
+      [](void *this_obj) {
+        static_cast<ShakeTraceRecorder *>(this_obj)->task();
+      },
+      "ShakeTrace", 4096, this, 1, &m_task);
+  return true;
+}
+
+void ShakeTraceRecorder::recordSamples(const AccelSample *samples, size_t n,
+                                       uint16_t odrHz) {
+  if (n == 0) {
+    return;
+  }
+  const uint64_t end = now();
+  portENTER_CRITICAL(&m_lock);
+  // 時刻が途切れないよう、バッチは丸ごと積むか捨てるかにする
+  if (BUFFER_RECORDS - m_size < n + 1) {
+    portEXIT_CRITICAL(&m_lock);
+    m_dropped += n + 1;
+    wakeWriterIfFull();
+    return;
+  }
+  encodeTraceBatch(samples, n, odrHz, end,
+                   [this](const ShakeTraceRecord &r) { push(r); });
+  m_header.odrHz = odrHz;
+  portEXIT_CRITICAL(&m_lock);
+  wakeWriterIfFull();
+}
+
+void ShakeTraceRecorder::recordEvent(ShakeTraceEvent event) {
+  const ShakeTraceRecord record = makeTraceEvent(event, now());
+  portENTER_CRITICAL(&m_lock);
+  const bool full = m_size == BUFFER_RECORDS;
+  if (!full) {
+    push(record);
+  }
+  portEXIT_CRITICAL(&m_lock);
+  if (full) {
+    m_dropped++;
+  }
+}
+
+uint64_t ShakeTraceRecorder::now() { return esp_timer_get_time() / 100; }
+
+void ShakeTraceRecorder::wakeWriterIfFull() {
+  if (m_task != NULL && m_size >= BUFFER_RECORDS / 2) {
+    xTaskNotifyGive(m_task);
+  }
+}
+
+void ShakeTraceRecorder::flush() {
+  const uint32_t head = m_header.head;
+  while (1) {
+    // 積む側は空きにしか書かないので、ロックは位置を読むときだけ取る
+    portENTER_CRITICAL(&m_lock);
+    const size_t begin = m_begin;
+    size_t n = m_size;
+    portEXIT_CRITICAL(&m_lock);
+    if (n == 0) {
+      break;
+    }
+    // RAM のリングの終わりとファイルのリングの終わりで区切って書く
+    const uint32_t slot = m_header.head % m_header.capacity;
+    if (n > BUFFER_RECORDS - begin) {
+      n = BUFFER_RECORDS - begin;
+    }
+    if (n > m_header.capacity - slot) {
+      n = m_header.capacity - slot;
+    }
+    m_file.seek(sizeof(ShakeTraceHeader) + slot * sizeof(ShakeTraceRecord));
+    m_file.write(reinterpret_cast<const uint8_t *>(&m_buffer[begin]),
+                 n * sizeof(ShakeTraceRecord));
+    m_header.head += n;
+    m_written += n;
+    portENTER_CRITICAL(&m_lock);
+    m_begin = (m_begin + n) % BUFFER_RECORDS;
+    m_size -= n;
+    portEXIT_CRITICAL(&m_lock);
+  }
+  if (m_header.head == head) {
+    return;
+  }
+  // 書いた位置を残し、電源が切れても続きから読めるようにする。
+  // 出力レートは積む側が書き換えるので、ロックを取って写してから書く
+  portENTER_CRITICAL(&m_lock);
+  const ShakeTraceHeader header = m_header;
+  portEXIT_CRITICAL(&m_lock);
+  m_file.seek(0);
+  m_file.write(reinterpret_cast<const uint8_t *>(&header), sizeof(header));
+  m_file.flush();
+}
+
+void ShakeTraceRecorder::task() {
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, FLUSH_MILLIS / portTICK_PERIOD_MS);
+    flush();
+  }
+  vTaskDelete(NULL);
+}
+} // namespace hardware
@@ -0,0 +1,80 @@
+/**
+ * @file shake_trace_recorder.hpp
+ * @brief 加速度のサンプルを SD カードのリングファイルに記録するクラスを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_SHAKE_TRACE_RECORDER_HPP_
+#define _INCLUDE_SHAKE_TRACE_RECORDER_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <FS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "shake_trace_format.hpp"
+
+namespace hardware {
+/// 加速度のサンプルとカウントの操作を SD カードに記録する。
+///
+/// 記録は RAM のリングに溜め、優先度の低いタスクがまとめてファイルへ書く。
+/// サンプリングの周期を SD の書き込みで乱さないため、溜まりきったときは
+/// バッチごと捨てて数える。ファイルの形式は `shake_trace_format.hpp` 。
+/// `tools/shake_replay.cpp` で再生できる。
+class ShakeTraceRecorder {
+public:
+  /// RAM に溜めるレコード数。 200 Hz で 2.5 秒分。
+  static constexpr size_t BUFFER_RECORDS = 512;
+  /// ファイルに入るレコード数の既定値。 1 MiB で、 200 Hz で 80 分余り。
+  static constexpr uint32_t DEFAULT_CAPACITY = 131072;
+
+  /// `path` のファイルを開いて書き出しタスクを起動する。
+  ///
+  /// 同じ大きさの記録があれば続きから書く。開けなければ `false` を返す。
+  bool begin(fs::FS &fs, const char *path = "/shake.trc",
+             uint32_t capacity = DEFAULT_CAPACITY);
+
+  /// 古い順に並んだ1バッチのサンプルを記録する。
+  ///
+  /// 最後のサンプルを今の時刻とし、それ以前は `odrHz` の間隔で並べる。
+  void recordSamples(const AccelSample *samples, size_t n, uint16_t odrHz);
+
+  /// 今の時刻でイベントを記録する。
+  void recordEvent(ShakeTraceEvent event);
+
+  /// ファイルに書いたレコード数。
+  uint32_t written() const { return m_written; }
+  /// 溜まりきって捨てたレコード数。
+  uint32_t dropped() const { return m_dropped; }
+
+private:
+  fs::File m_file;
+  ShakeTraceHeader m_header = {};
+  ShakeTraceRecord m_buffer[BUFFER_RECORDS];
+  /// 最も古いレコードの位置と個数。書き出しタスクだけが減らす
+  size_t m_begin = 0;
+  size_t m_size = 0;
+  portMUX_TYPE m_lock = portMUX_INITIALIZER_UNLOCKED;
+  TaskHandle_t m_task = NULL;
+  std::atomic<uint32_t> m_written{0};
+  std::atomic<uint32_t> m_dropped{0};
+
+  /// 今の時刻 [0.1 ms] 。
+  static uint64_t now();
+  /// ロックを取ってから、空きがあることを確かめて1つ積む。
+  void push(const ShakeTraceRecord &record) {
+    m_buffer[(m_begin + m_size) % BUFFER_RECORDS] = record;
+    m_size++;
+  }
+  /// 半分以上溜まったら書き出しタスクを起こす。
+  void wakeWriterIfFull();
+  /// 溜まったレコードをファイルへ書く。
+  void flush();
+  /// FreeRTOS によって実行される関数
+  void task();
+};
+} // namespace hardware
+
+#endif
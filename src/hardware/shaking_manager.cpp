@@ -9,117 +9,181 @@
 #include <M5Stack.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <esp_timer.h>
+#include <freertos/timers.h>
 
 #include "shaking_manager.hpp"
 
 namespace hardware {
 
-// From Sample Program
-void ShakingManager::updateMeasurement() {
-  static bool initialized = false;
-  if (!initialized) {
-    initialized = true;
-    IMU.calibrateMPU9250(IMU.gyroBias, IMU.accelBias);
-    IMU.initMPU9250();
-    IMU.initAK8963(IMU.magCalibration);
+void ShakingManager::begin(const ShakingConfig &config) {
+  m_config = config;
+  // 較正には1秒ほどかかるので、タイマーサービスを止めないよう
+  // 起動時にここで済ませておく
+  m_imu.begin();
+  if (m_config.wakeOnMotion && !m_imu.attachMotionInterrupt(onMotion, this)) {
+    log_w("ShakingManager: no IMU interrupt pin, sampling continuously");
+    m_config.wakeOnMotion = false;
   }
-  // If intPin goes high, all data registers have new data
-  // On interrupt, check if data ready interrupt
-  if (IMU.readByte(MPU9250_ADDRESS, INT_STATUS) & 0x01) {
-    IMU.readAccelData(IMU.accelCount); // Read the x/y/z adc values
-    IMU.getAres();
-
-    // Now we'll calculate the accleration value into actual g's
-    // This depends on scale being set
-    IMU.ax = (float)IMU.accelCount[0] * IMU.aRes; // - accelBias[0];
-    IMU.ay = (float)IMU.accelCount[1] * IMU.aRes; // - accelBias[1];
-    IMU.az = (float)IMU.accelCount[2] * IMU.aRes; // - accelBias[2];
-
-    IMU.readGyroData(IMU.gyroCount); // Read the x/y/z adc values
-    IMU.getGres();
-
-    // Calculate the gyro value into actual degrees per second
-    // This depends on scale being set
-    IMU.gx = (float)IMU.gyroCount[0] * IMU.gRes;
-    IMU.gy = (float)IMU.gyroCount[1] * IMU.gRes;
-    IMU.gz = (float)IMU.gyroCount[2] * IMU.gRes;
-
-    IMU.readMagData(IMU.magCount); // Read the x/y/z adc values
-    IMU.getMres();
-    // User environmental x-axis correction in milliGauss, should be
-    // automatically calculated
-    IMU.magbias[0] = +470.;
-    // User environmental x-axis correction in milliGauss TODO axis??
-    IMU.magbias[1] = +120.;
-    // User environmental x-axis correction in milliGauss
-    IMU.magbias[2] = +125.;
-
-    // Calculate the magnetometer values in milliGauss
-    // Include factory calibration per data sheet and user environmental
-    // corrections
-    // Get actual magnetometer value, this depends on scale being set
-    IMU.mx = (float)IMU.magCount[0] * IMU.mRes * IMU.magCalibration[0] -
-             IMU.magbias[0];
-    IMU.my = (float)IMU.magCount[1] * IMU.mRes * IMU.magCalibration[1] -
-             IMU.magbias[1];
-    IMU.mz = (float)IMU.magCount[2] * IMU.mRes * IMU.magCalibration[2] -
-             IMU.magbias[2];
+  float sampleRateHz = 1000.0f / m_config.periodMillis;
+  if (m_config.sampling == ImuSampling::Fifo) {
+    m_odrHz = m_imu.startFifo(m_config.odrHz);
+    sampleRateHz = m_odrHz;
+    log_i("ShakingManager: accel FIFO at %u Hz, read every %u ms",
+          static_cast<unsigned>(sampleRateHz), m_config.periodMillis);
   }
+  m_detector.configure(m_config.detector, sampleRateHz);
+  m_idleSamples =
+      static_cast<uint32_t>(m_config.idleMillis * sampleRateHz / 1000);
+  portENTER_CRITICAL(&m_powerLock);
+  m_powerSince = esp_timer_get_time();
+  portEXIT_CRITICAL(&m_powerLock);
+  // 較正で起きたセンサをいったん眠らせてから、状態に合わせて起こす。
+  // タイマーサービスはまだ IMU に触らないので、ここで切り替えてよい
+  enterSleep();
+  applyMode();
 }
 
-void ShakingManager::updateCount() {
+ImuPowerStats ShakingManager::powerStats() const {
+  ImuPowerStats stats;
+  portENTER_CRITICAL(&m_powerLock);
+  stats.state = m_power;
+  for (size_t i = 0; i < IMU_POWER_COUNT; ++i) {
+    stats.millis[i] = m_powerMicros[i] / 1000;
+  }
+  // 今の状態には、なってから今までの時間を足す
+  stats.millis[static_cast<size_t>(stats.state)] +=
+      (esp_timer_get_time() - m_powerSince) / 1000;
+  stats.transitions = m_powerTransitions;
+  portEXIT_CRITICAL(&m_powerLock);
+  return stats;
+}
 
-  //とりあえずx方向の角速度のみを使って検知
-  auto swing_angle_velocity_x = IMU.ax;
-  auto swing_angle_velocity_y = IMU.ay;
-  auto swing_angle_velocity_z = IMU.az;
+void ShakingManager::applyMode() {
+  ImuPower wanted = ImuPower::Sleep;
+  if (shaking_state == ShakingState::Counting || !m_config.sleepWhenStopped) {
+    wanted = !m_config.wakeOnMotion || m_motion ? ImuPower::Accel
+                                                : ImuPower::MotionWatch;
+  }
+  switch (wanted) {
+  case ImuPower::Accel:
+    if (m_power != ImuPower::Accel) {
+      startSampling();
+    }
+    break;
+  case ImuPower::MotionWatch:
+    // 待ち直すときも、上がったままの割り込みを下げるために設定し直す
+    startWatching();
+    break;
+  case ImuPower::Sleep:
+    if (m_power != ImuPower::Sleep) {
+      enterSleep();
+    }
+    break;
+  }
+}
 
-  switch (shaking_state) {
+void ShakingManager::startSampling() {
+  if (m_config.sampling == ImuSampling::Fifo) {
+    m_imu.startFifo(m_config.odrHz);
+  } else {
+    m_imu.startRegisters();
+  }
+  // 途切れている間に向きが変わったかもしれないので、重力を測り直す
+  m_detector.restart();
+  setPower(ImuPower::Accel);
+  m_timers.startPeriodic(m_job, m_config.periodMillis);
+}
 
-  case ShakingState::Counting:
+void ShakingManager::startWatching() {
+  m_timers.stop(m_job);
+  m_imu.watchMotion(m_config.motionThresholdMilliG);
+  setPower(ImuPower::MotionWatch);
+}
 
-    dir_x_state = dirStateChange(swing_angle_velocity_x, dir_x_state);
-    dir_y_state = dirStateChange(swing_angle_velocity_y, dir_y_state);
-    dir_z_state = dirStateChange(swing_angle_velocity_z, dir_z_state);
+void ShakingManager::enterSleep() {
+  // 読む処理の登録を解くので、眠っている間はタイマーサービスも起きない
+  m_timers.stop(m_job);
+  m_imu.sleep();
+  setPower(ImuPower::Sleep);
+}
 
-    count = std::max(count.load(), dir_x_state.count);
-    count = std::max(count.load(), dir_y_state.count);
-    count = std::max(count.load(), dir_z_state.count);
+void ShakingManager::setPower(ImuPower power) {
+  static const char *names[] = {"sleep", "motion watch", "accel"};
+  const int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&m_powerLock);
+  const ImuPower previous = m_power;
+  if (previous != power) {
+    m_powerMicros[static_cast<size_t>(previous)] += now - m_powerSince;
+    m_powerSince = now;
+    m_power = power;
+    m_powerTransitions++;
+  }
+  portEXIT_CRITICAL(&m_powerLock);
+  if (previous != power) {
+    log_d("ShakingManager: IMU %s -> %s",
+          names[static_cast<size_t>(previous)],
+          names[static_cast<size_t>(power)]);
+  }
+}
 
-    dir_x_state.count = count;
-    dir_y_state.count = count;
-    dir_z_state.count = count;
+void IRAM_ATTR ShakingManager::onMotion(void *arg) {
+  // ISR では I2C に触れないので、タイマーデーモンに任せる
+  BaseType_t woken = pdFALSE;
+  xTimerPendFunctionCallFromISR(onMotionDeferred, arg, 0, &woken);
+  if (woken == pdTRUE)
+    portYIELD_FROM_ISR();
+}
 
-    break;
+void ShakingManager::onMotionDeferred(void *arg, uint32_t) {
+  auto *self = static_cast<ShakingManager *>(arg);
+  if (self->shaking_state != ShakingState::Counting) {
+    return;
+  }
+  self->m_motion = true;
+  self->m_timers.startOnce(self->m_modeJob, 0);
+}
 
-  case ShakingState::Stop:
-    break;
+void ShakingManager::sample() {
+  size_t n = 0;
+  if (m_config.sampling == ImuSampling::Fifo) {
+    // 溜まった分を数回のバースト読み出しでまとめて取り出す
+    n = m_imu.drain(m_batch, Mpu9250Fifo::CAPACITY);
+  } else if (m_imu.read(m_batch[0])) {
+    n = 1;
+  }
+  updateCount(m_batch, n);
+  // しばらく振られていなければ、動き検知で待つ
+  if (m_config.wakeOnMotion &&
+      m_detector.samplesSinceStroke() > m_idleSamples) {
+    m_motion = false;
+    startWatching();
   }
 }
 
-ShakingManager::OneDirectionState
-ShakingManager::dirStateChange(float swing_axis, OneDirectionState dir_state) {
-  OneDirectionState next_state = dir_state;
-  const float threshold_swing_angle_axis = 1.6;
-  switch (dir_state.state) {
-
-  case OneDirection::UpperSwing:
-    if (swing_axis > threshold_swing_angle_axis) {
-      next_state.count++;
-      log_d("up");
-      next_state.state = OneDirection::LowerSwing;
+void ShakingManager::updateCount(const AccelSample *samples, size_t n) {
+  // 数えていない間も記録し、誤検知の調べに使う
+  if (m_trace != nullptr) {
+    m_trace->recordSamples(samples, n, m_odrHz);
+  }
+  m_detector.process(samples, n);
+  const uint32_t detected = m_detector.count();
+  const int added = static_cast<int>(detected - m_detected);
+  m_detected = detected;
+  switch (shaking_state) {
+
+  case ShakingState::Counting:
+    if (added > 0) {
+      count += added;
+      intensity_milli_g =
+          static_cast<int>(m_detector.lastIntensity() * 1000.0f);
+      log_d("shake %d (%d mg)", count.load(), intensity_milli_g.load());
     }
     break;
 
-  case OneDirection::LowerSwing:
-    if (swing_axis < -threshold_swing_angle_axis) {
-      log_d("down");
-      next_state.state = OneDirection::UpperSwing;
-    }
+  case ShakingState::Stop:
     break;
   }
-
-  return next_state;
 }
 
 }; // namespace hardware
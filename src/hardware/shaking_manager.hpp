@@ -8,72 +8,160 @@
 #endif
 
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
 
-#include <utility/MPU9250.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/timers.h>
+
+#include "imu_port.hpp"
+#include "mpu9250_fifo.hpp"
+#include "shake_detector.hpp"
+#include "shake_trace_recorder.hpp"
+#include "timer_service.hpp"
 
 namespace hardware {
 
+/// IMU の読み方
+enum class ImuSampling {
+  /// 周期ごとに全センサのレジスタを1回ずつ読む (従来の方式)
+  Registers,
+  /// 加速度だけを FIFO に溜め、周期ごとにまとめて読む
+  Fifo,
+};
+
+/// 振動検知の設定
+struct ShakingConfig {
+  /// IMU の読み方
+  ImuSampling sampling = ImuSampling::Fifo;
+  /// FIFO に溜める加速度の出力レート [Hz]
+  uint16_t odrHz = 200;
+  /// IMU を読む周期 [ms]
+  uint32_t periodMillis = 100;
+  /// 振った回数を数える閾値と時定数
+  ShakeDetectorConfig detector;
+  /// 数えている間も、 IMU の動き検知で待ってから読み始める
+  ///
+  /// IMU の割り込みピンがなければ、数えている間は読み続ける。
+  bool wakeOnMotion = false;
+  /// 動きとみなす加速度の変化 [mg]。 4 mg 刻みで 1020 mg まで
+  uint16_t motionThresholdMilliG = 200;
+  /// 振りが途切れてから動き検知に戻るまでの時間 [ms]
+  uint32_t idleMillis = 5000;
+  /// 数えていない間は IMU を眠らせ、読むのもやめる
+  ///
+  /// 誤検知を調べるために数えていない間も読むときは `false` にする。
+  bool sleepWhenStopped = true;
+};
+
+/// IMU の電源の状態と、それぞれの状態にいた時間。
+struct ImuPowerStats {
+  /// 今の状態
+  ImuPower state;
+  /// `begin()` からそれぞれの状態にいた時間 [ms]。添字は `ImuPower`
+  uint64_t millis[IMU_POWER_COUNT];
+  /// 状態が変わった回数
+  uint32_t transitions;
+};
+
 class ShakingManager {
 
 public:
+  ShakingManager(ImuPort &imu, TimerService &timers)
+      : m_imu(imu), m_timers(timers) {}
+
   //カウント値リセット
   void resetCount() {
     count = 0;
-    dir_x_state.count = 0;
-    dir_y_state.count = 0;
-    dir_z_state.count = 0;
+    intensity_milli_g = 0;
+    recordEvent(ShakeTraceEvent::ResetCount);
   }
-  void stopCount() { shaking_state = ShakingState::Stop; } //カウント再開/開始
+  //カウント一時停止
+  void stopCount() {
+    shaking_state = ShakingState::Stop;
+    recordEvent(ShakeTraceEvent::StopCount);
+    requestMode();
+  }
+  //カウント再開/開始
   void startCount() {
+    // 止まっている間の動きでは読み始めない
+    m_motion = false;
     shaking_state = ShakingState::Counting;
-  }                                 //カウント一次停止
+    recordEvent(ShakeTraceEvent::StartCount);
+    requestMode();
+  }
   int getCount() { return count; }; //現在のカウント数
+  /// 直近の1往復の強さ [mg]。まだ数えていなければ 0
+  int getIntensity() { return intensity_milli_g; }
 
   // イベント待機を開始する
-  void begin() {
-    // FreeRTOS により task() をバックグラウンドで実行
-    const uint16_t stackSize = 4096;
-    UBaseType_t uxPriority = 10;
-    xTaskCreate(
-        [](void *this_obj) { static_cast<ShakingManager *>(this_obj)->task(); },
-        "ShakingManager", stackSize, this, uxPriority, NULL);
-  }
+  void begin() { begin(ShakingConfig{}); }
+  void begin(const ShakingConfig &config);
+
+  /// 読んだサンプルとカウントの操作を記録する。 `begin()` の前に呼ぶ
+  void setTraceRecorder(ShakeTraceRecorder *recorder) { m_trace = recorder; }
+
+  /// IMU の電源の今の状態
+  ImuPower imuPower() const { return m_power; }
+  /// IMU の電源の状態と、それぞれの状態にいた時間
+  ImuPowerStats powerStats() const;
 
 protected:
   enum class ShakingState { Counting, Stop };
 
-  // X,Y,Z三方向の振動状態
-  enum class OneDirection { UpperSwing, LowerSwing };
-  struct OneDirectionState {
-    int count = 0;
-    OneDirection state = OneDirection::UpperSwing;
-  };
-
-  MPU9250 IMU; // 9 axis Sensor
-
-  std::atomic_int count{0};                        //現在のカウント数
-  const int sampling_period = 100;                 //[ms]
-  ShakingState shaking_state = ShakingState::Stop; //カウント計測の状態
-  OneDirectionState dir_x_state;
-  OneDirectionState dir_y_state;
-  OneDirectionState dir_z_state;
-
-  void updateMeasurement(); // IMU値の更新
-  void updateCount();       //振った回数の更新
-  OneDirectionState dirStateChange(float swing_axis,
-                                   OneDirectionState dir_state);
-
-  // FreeRTOS によって実行される関数
-  void task() {
-    // handleEvent の定期実行
-    portTickType xLastWakeTime = xTaskGetTickCount();
-    while (1) {
-      updateMeasurement();
-      updateCount();
-      vTaskDelayUntil(&xLastWakeTime, sampling_period / portTICK_RATE_MS);
+  ImuPort &m_imu;
+  ShakingConfig m_config;
+  TimerService &m_timers;
+  // サンプリングはタイマーサービスで定期実行する
+  TimerJob m_job{"Shaking", [this]() { sample(); }};
+  // IMU の操作を1つのタスクにまとめるため、モードの切り替えもタイマーサービスで行う
+  TimerJob m_modeJob{"ShakingMode", [this]() { applyMode(); }};
+  // 1周期分のサンプル
+  AccelSample m_batch[Mpu9250Fifo::CAPACITY];
+  // 振った回数を数える。読み始めるたびに重力を測り直す
+  ShakeDetector m_detector;
+  // 実際の出力レート [Hz] 。レジスタを読むときは 0
+  uint16_t m_odrHz = 0;
+  // 調整用の記録。なければ nullptr
+  ShakeTraceRecorder *m_trace = nullptr;
+  // 前の周期までに検知器が数えた回数
+  uint32_t m_detected = 0;
+  // 振りが途切れたとみなすサンプル数
+  uint32_t m_idleSamples = 0;
+  // IMU の電源の状態。変えるのはタイマーサービスのタスクだけ
+  std::atomic<ImuPower> m_power{ImuPower::Sleep};
+  // 状態ごとの時間 [us] と、今の状態になった時刻 [us]
+  uint64_t m_powerMicros[IMU_POWER_COUNT] = {};
+  int64_t m_powerSince = 0;
+  uint32_t m_powerTransitions = 0;
+  mutable portMUX_TYPE m_powerLock = portMUX_INITIALIZER_UNLOCKED;
+  // 数えている間に動きを検知したか否か
+  std::atomic_bool m_motion{false};
+
+  std::atomic_int count{0};             //現在のカウント数
+  std::atomic_int intensity_milli_g{0}; //直近の1往復の強さ
+  std::atomic<ShakingState> shaking_state{ShakingState::Stop}; //カウント計測の状態
+
+  void sample(); // 1周期分のサンプルを読んで数える
+  //振った回数の更新。サンプルは古い順に並べる
+  void updateCount(const AccelSample *samples, size_t n);
+  // 状態に合わせて IMU を眠らせるか、読み始めるか、動き検知で待つ
+  void requestMode() { m_timers.startOnce(m_modeJob, 0); }
+  void applyMode();
+  void recordEvent(ShakeTraceEvent event) {
+    if (m_trace != nullptr) {
+      m_trace->recordEvent(event);
     }
-    vTaskDelete(NULL);
   }
+  void startSampling();
+  void startWatching();
+  void enterSleep();
+  // 電源の状態を変え、前の状態にいた時間を足す
+  void setPower(ImuPower power);
+  // 動き検知の割り込み。 ISR から呼ばれる
+  static void onMotion(void *arg);
+  // 動き検知をタイマーデーモンで受け取る
+  static void onMotionDeferred(void *arg, uint32_t);
 };
 
 } // namespace hardware
@@ -0,0 +1,36 @@
+// コンパイルエラーを防ぐため， Arduino.h で定義されているマクロをundef
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+
+#include <M5Stack.h>
+#include <esp_sleep.h>
+
+#include "sleep_port.hpp"
+
+namespace hardware {
+WakeCause Esp32SleepPort::wakeCause() {
+  switch (esp_sleep_get_wakeup_cause()) {
+  case ESP_SLEEP_WAKEUP_TIMER:
+    return WakeCause::Timer;
+  case ESP_SLEEP_WAKEUP_EXT0:
+    return WakeCause::Button;
+  default:
+    return WakeCause::PowerOn;
+  }
+}
+
+void Esp32SleepPort::deepSleep(uint64_t micros) {
+  // 消灯してから眠る
+  M5.Lcd.setBrightness(0);
+  M5.Lcd.sleep();
+  esp_sleep_enable_timer_wakeup(micros);
+  // ボタンは外付けのプルアップで、押すと LOW になる。
+  // GPIO 39 は RTC GPIO なので deep sleep 中も見られる
+  esp_sleep_enable_ext0_wakeup(static_cast<gpio_num_t>(BUTTON_A_PIN), 0);
+  esp_deep_sleep_start();
+}
+} // namespace hardware
@@ -0,0 +1,48 @@
+/**
+ * @file sleep_port.hpp
+ * @brief deep sleep と復帰要因を抽象化したインターフェースを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_SLEEP_PORT_HPP_
+#define _INCLUDE_SLEEP_PORT_HPP_
+
+#include <cstdint>
+
+namespace hardware {
+/// 起動の要因。
+enum class WakeCause {
+  /// 電源投入やリセット。
+  PowerOn,
+  /// deep sleep からのタイマーによる復帰。
+  Timer,
+  /// deep sleep からのボタンによる復帰。
+  Button,
+};
+
+/// deep sleep の操作。
+///
+/// 夜間モードの判断をハードウェアから切り離すためのインターフェース。
+class SleepPort {
+public:
+  virtual ~SleepPort() = default;
+
+  /// 今回の起動の要因を返す。
+  virtual WakeCause wakeCause() = 0;
+
+  /// `micros` 後のタイマーか、ボタンで復帰するよう deep sleep に入る。
+  ///
+  /// 実機では戻らず、復帰はリセットとして `setup()` からやり直しになる。
+  virtual void deepSleep(uint64_t micros) = 0;
+};
+
+/// ESP32 の deep sleep。
+///
+/// ボタン A (GPIO 39) を押すと復帰する。 ext0 で見られるピンは1本だけ。
+class Esp32SleepPort final : public SleepPort {
+public:
+  virtual WakeCause wakeCause() override;
+  virtual void deepSleep(uint64_t micros) override;
+};
+} // namespace hardware
+
+#endif
@@ -1,18 +1,16 @@
 /**
  * @file speaker.h
  * @author Ryotaro Onuki (kerikun11@gmail.com)
- * @brief キューに詰めるとバックグラウンドで音楽を鳴らすSpeakerクラスを持つ
+ * @brief バックグラウンドで音楽を鳴らすSpeakerクラスを持つ
  * @date 2018-11-29
  */
 #pragma once
 
 #include <M5Stack.h>
 
-#include <memory>
+#include <atomic>
 
-#include <freertos/FreeRTOS.h>
-#include <freertos/queue.h>
-#include <freertos/task.h>
+#include "timer_service.hpp"
 
 namespace hardware {
 
@@ -22,74 +20,53 @@ public:
   enum class Music {
     Alarm,
   };
-  /// 音楽をキュー
+
+  explicit SpeakerManager(TimerService &timers) : m_timers(timers) {}
+
+  /// 音楽を鳴らし始める
   void play(Music m = Music::Alarm) {
-    auto qi = new QueueItem;
-    qi->e = Event::Play;
-    qi->m = m;
-    xQueueSendToBack(eventQueue, &qi, 0);
+    // 鳴らしている途中なら、そのまま続ける
+    if (m_playing.exchange(true))
+      return;
+    // スピーカーの操作はタイマーサービスのタスクで行う
+    m_timers.startOnce(m_job, 0);
   }
   void stop() {
-    auto qi = new QueueItem;
-    qi->e = Event::Stop;
-    xQueueSendToBack(eventQueue, &qi, 0);
+    m_playing = false;
+    m_timers.startOnce(m_job, 0);
   }
   void begin() {
-    // キューを初期化
-    const int uxQueueLength = 10;
-    eventQueue = xQueueCreate(uxQueueLength, sizeof(void *));
-    // FreeRTOS により task() をバックグラウンドで実行
-    const uint16_t stackSize = 4096;
-    UBaseType_t uxPriority = 0;
-    xTaskCreate(
-        [](void *this_obj) { static_cast<SpeakerManager *>(this_obj)->task(); },
-        "SpeakerManager", stackSize, this, uxPriority, NULL);
+    // 専用のタスクは持たず、鳴らしている間だけタイマーサービスで動く
   }
 
 private:
-  QueueHandle_t eventQueue;
-  // サンプリング周期
-  static constexpr int PeriodMillis = 100;
-
-  enum class Event {
-    Play,
-    Stop,
-  };
-  struct QueueItem {
-    Event e;
-    Music m;
-  };
+  // 鳴らす時間と止める時間
+  static constexpr uint32_t BeepMillis = 50;
+  static constexpr uint32_t MuteMillis = 950;
 
-  Event state = Event::Stop; //< 再生状態
+  TimerService &m_timers;
+  TimerJob m_job{"Speaker", [this]() { step(); }};
+  /// 再生を求められているか否か
+  std::atomic_bool m_playing{false};
+  /// 音が出ているか否か。タイマーサービスのタスクからのみ操作する
+  bool m_beeping = false;
 
-  // FreeRTOS によって実行される関数
-  void task() {
-    while (1) {
-      // 点滅した音を鳴らす
-      // waitの間はイベント待ちなので，イベントを取り損ねることはない．
-      if (state == Event::Play)
-        M5.Speaker.beep();
-      waitWithHandleQueueEvent(50);
-      if (state == Event::Play)
-        M5.Speaker.mute();
-      waitWithHandleQueueEvent(950);
-    }
-    vTaskDelete(NULL);
-  }
-  void waitWithHandleQueueEvent(int wait_ms) {
-    QueueItem *qi;
-    if (pdTRUE != xQueueReceive(eventQueue, &qi, wait_ms / portTICK_PERIOD_MS))
+  // 点滅した音を鳴らす
+  void step() {
+    if (!m_playing) {
+      if (m_beeping)
+        log_d("Stop");
+      m_beeping = false;
+      M5.Speaker.mute();
       return;
-    auto item = std::unique_ptr<QueueItem>{qi};
-    state = item->e;
-    switch (item->e) {
-    case Event::Play:
-      log_d("Play");
-      break;
-    case Event::Stop:
-      log_d("Stop");
+    }
+    m_beeping = !m_beeping;
+    if (m_beeping) {
+      M5.Speaker.beep();
+      m_timers.startOnce(m_job, BeepMillis);
+    } else {
       M5.Speaker.mute();
-      break;
+      m_timers.startOnce(m_job, MuteMillis);
     }
   }
 };
@@ -9,46 +9,38 @@
 
 #include <functional>
 
-#include <freertos/FreeRTOS.h>
-#include <freertos/task.h>
+#include "timer_service.hpp"
 
 namespace hardware {
 
-/// M5Stack のボタンを監視してイベントを発生させるクラス
+/// 一定周期でイベントを発生させるクラス
 class Ticker {
 public:
-  /// ボタンイベントのコールバック関数型
+  /// Tick イベントのコールバック関数型
   typedef std::function<void()> EventCallback;
 
+  explicit Ticker(TimerService &timers) : m_timers(timers) {}
+
   // イベントコールバックの登録
   void onEvent(EventCallback eventCallback = nullptr) {
     this->eventCallback = eventCallback;
   }
   // イベント待機を開始する
   void begin() {
-    // FreeRTOS により task() をバックグラウンドで実行
-    const uint16_t stackSize = 4096;
-    UBaseType_t uxPriority = 0;
-    xTaskCreate([](void *this_obj) { static_cast<Ticker *>(this_obj)->task(); },
-                "Ticker", stackSize, this, uxPriority, NULL);
+    // 専用のタスクは持たず、タイマーサービスで定期実行する
+    m_timers.startPeriodic(m_job, PeriodMillis);
   }
 
 private:
   // Tick 周期
   static constexpr int PeriodMillis = 100;
+  TimerService &m_timers;
+  TimerJob m_job{"Ticker", [this]() {
+                   if (eventCallback != nullptr)
+                     eventCallback();
+                 }};
   // コールバック関数のポインタ
   EventCallback eventCallback = nullptr;
-
-  // FreeRTOS によって実行される関数
-  void task() {
-    portTickType xLastWakeTime = xTaskGetTickCount();
-    while (1) {
-      // 定期実行
-      vTaskDelayUntil(&xLastWakeTime, PeriodMillis / portTICK_RATE_MS);
-      if (eventCallback != nullptr)
-        eventCallback();
-    }
-  }
 };
 
 }; // namespace hardware
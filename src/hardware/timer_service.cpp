@@ -0,0 +1,221 @@
+#include <esp_timer.h>
+
+#include "../task_registry.hpp"
+#include "timer_service.hpp"
+
+namespace hardware {
+
+void TimerService::begin(const TaskConfig &config) {
+  // ホイールの時刻はここで数え直さない。起動までに過ぎた刻みはタスクが
+  // 最初にまとめて飛ばすので、起動前に登録した処理も登録した時点から数える
+  // FreeRTOS により task() をバックグラウンドで実行
+  sugar::TaskRegistry::instance().create(
+      [](void *this_obj) { static_cast<TimerService *>(this_obj)->task(); },
+      "TimerService", config.stackSize, this, config.priority, &m_task);
+}
+
+void TimerService::start(TimerJob &job, uint32_t delayMillis,
+                         uint32_t period) {
+  portENTER_CRITICAL(&m_lock);
+  if (job.m_list != nullptr) {
+    unlink(job);
+  } else {
+    m_activeJobs++;
+  }
+  job.m_period = period;
+  const uint32_t now = currentStep();
+  job.m_expiry = now + toTicks(delayMillis);
+  if (period != 0) {
+    // 周期の倍数の時刻にそろえ、同じ周期の処理を1回の起床でまとめて実行する
+    job.m_expiry = (now / period + 1) * period;
+  }
+  link(job);
+  portEXIT_CRITICAL(&m_lock);
+  // 眠っているサービスに起きる時刻を計算し直させる
+  if (m_task != NULL && xTaskGetCurrentTaskHandle() != m_task) {
+    xTaskNotifyGive(m_task);
+  }
+}
+
+void TimerService::stop(TimerJob &job) {
+  portENTER_CRITICAL(&m_lock);
+  if (job.m_list != nullptr) {
+    unlink(job);
+    m_activeJobs--;
+  }
+  portEXIT_CRITICAL(&m_lock);
+}
+
+void TimerService::link(TimerJob &job) {
+  // 期限と現在時刻の上位ビットが揃う最も下の段に置く。
+  // 期限は必ず現在より後なので、スロットは現在の位置より先になる
+  const uint32_t diff = job.m_expiry ^ m_now;
+  TimerJob **list = &m_overflow;
+  for (size_t level = 0; level < LEVEL_COUNT; ++level) {
+    const uint32_t shift = SLOT_BITS * level;
+    if ((diff >> (shift + SLOT_BITS)) == 0) {
+      list = &m_wheel[level][(job.m_expiry >> shift) & SLOT_MASK];
+      break;
+    }
+  }
+  job.m_prev = nullptr;
+  job.m_next = *list;
+  if (*list != nullptr) {
+    (*list)->m_prev = &job;
+  }
+  *list = &job;
+  job.m_list = list;
+}
+
+void TimerService::unlink(TimerJob &job) {
+  if (job.m_prev != nullptr) {
+    job.m_prev->m_next = job.m_next;
+  } else {
+    *job.m_list = job.m_next;
+  }
+  if (job.m_next != nullptr) {
+    job.m_next->m_prev = job.m_prev;
+  }
+  job.m_prev = job.m_next = nullptr;
+  job.m_list = nullptr;
+}
+
+void TimerService::cascade(TimerJob *&list) {
+  TimerJob *job = list;
+  list = nullptr;
+  while (job != nullptr) {
+    TimerJob *next = job->m_next;
+    job->m_list = nullptr;
+    link(*job);
+    job = next;
+  }
+}
+
+bool TimerService::nextWake(uint32_t &step, bool exact) {
+  // 各段で現在位置より先にある最初のスロットを探す。
+  // 上の段のスロットは、そこへ移し替える境界で下の段へ移る
+  for (size_t level = 0; level < LEVEL_COUNT; ++level) {
+    const uint32_t shift = SLOT_BITS * level;
+    const uint32_t current = (m_now >> shift) & SLOT_MASK;
+    for (uint32_t i = current + 1; i < SLOT_COUNT; ++i) {
+      if (m_wheel[level][i] != nullptr) {
+        const uint32_t base = m_now >> (shift + SLOT_BITS)
+                                           << (shift + SLOT_BITS);
+        step = base + (i << shift);
+        if (exact && level > 0) {
+          step = earliestExpiry(m_wheel[level][i]);
+        }
+        return true;
+      }
+    }
+  }
+  if (m_overflow != nullptr) {
+    const uint32_t shift = SLOT_BITS * LEVEL_COUNT;
+    step = exact ? earliestExpiry(m_overflow)
+                 : ((m_now >> shift) + 1) << shift;
+    return true;
+  }
+  return false;
+}
+
+uint32_t TimerService::earliestExpiry(const TimerJob *list) const {
+  uint32_t earliest = list->m_expiry;
+  for (const TimerJob *job = list->m_next; job != nullptr; job = job->m_next) {
+    if (job->m_expiry - m_now < earliest - m_now) {
+      earliest = job->m_expiry;
+    }
+  }
+  return earliest;
+}
+
+void TimerService::advance() {
+  portENTER_CRITICAL(&m_lock);
+  m_now++;
+  m_nowTick += osTicksPerStep();
+  // 段の境界では上の段から順に下の段へ移し替える
+  if ((m_now & SLOT_MASK) == 0) {
+    if (((m_now >> SLOT_BITS) & SLOT_MASK) == 0) {
+      if (((m_now >> (2 * SLOT_BITS)) & SLOT_MASK) == 0) {
+        cascade(m_overflow);
+      }
+      cascade(m_wheel[2][(m_now >> (2 * SLOT_BITS)) & SLOT_MASK]);
+    }
+    cascade(m_wheel[1][(m_now >> SLOT_BITS) & SLOT_MASK]);
+  }
+  TimerJob *&slot = m_wheel[0][m_now & SLOT_MASK];
+  while (slot != nullptr) {
+    TimerJob *job = slot;
+    unlink(*job);
+    if (job->m_period != 0) {
+      // 実行前に次の期限へつなぎ直すので、処理の中から止めてもよい。
+      // 遅れた周期は溜めずに読み飛ばす
+      do {
+        job->m_expiry += job->m_period;
+      } while (static_cast<int32_t>(job->m_expiry - m_now) <= 0);
+      link(*job);
+    } else {
+      m_activeJobs--;
+    }
+    portEXIT_CRITICAL(&m_lock);
+    const int64_t start = esp_timer_get_time();
+    job->m_callback();
+    const uint32_t elapsed =
+        static_cast<uint32_t>(esp_timer_get_time() - start);
+    job->m_runs++;
+    if (elapsed > job->m_maxRunMicros) {
+      job->m_maxRunMicros = elapsed;
+    }
+    m_runs++;
+    portENTER_CRITICAL(&m_lock);
+  }
+  portEXIT_CRITICAL(&m_lock);
+}
+
+void TimerService::task() {
+  const uint32_t perStep = osTicksPerStep();
+  while (1) {
+    // 次に処理のある時刻まで眠る。登録が変われば通知で起こされる。
+    // 上の段の移し替えのためだけには起きない
+    portENTER_CRITICAL(&m_lock);
+    uint32_t wake;
+    const bool scheduled = nextWake(wake, true);
+    const uint64_t untilWake = uint64_t(wake - m_now) * perStep;
+    const TickType_t nowTick = m_nowTick;
+    portEXIT_CRITICAL(&m_lock);
+    // tick カウントの差が折り返さないよう、処理がなくても半周ごとには起きる。
+    // 期限までの tick 数は半周を超えることがあるので 64 bit で比べる
+    TickType_t wait = MAX_SLEEP_TICKS;
+    if (scheduled) {
+      const TickType_t elapsed = xTaskGetTickCount() - nowTick;
+      if (untilWake <= elapsed) {
+        wait = 0;
+      } else if (untilWake - elapsed < wait) {
+        wait = static_cast<TickType_t>(untilWake - elapsed);
+      }
+    }
+    if (wait != 0) {
+      ulTaskNotifyTake(pdTRUE, wait);
+      m_wakeups++;
+    }
+
+    // 眠っている間に過ぎた刻みを処理する
+    const uint32_t target = currentStep();
+    while (m_now != target) {
+      portENTER_CRITICAL(&m_lock);
+      uint32_t next = target;
+      if (nextWake(wake, false) &&
+          static_cast<int32_t>(wake - target) < 0) {
+        next = wake;
+      }
+      // 間のスロットと境界には何もないので、まとめて飛ばしてよい
+      const uint32_t skip = next - 1 - m_now;
+      m_now += skip;
+      m_nowTick += skip * perStep;
+      portEXIT_CRITICAL(&m_lock);
+      advance();
+    }
+  }
+  vTaskDelete(NULL);
+}
+
+} // namespace hardware
@@ -0,0 +1,196 @@
+/**
+ * @file timer_service.hpp
+ * @brief 周期処理と単発処理を1つのタスクで実行する階層型タイマーホイールを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_TIMER_SERVICE_HPP_
+#define _INCLUDE_TIMER_SERVICE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+namespace hardware {
+class TimerService;
+
+/// タイマーサービスで実行する処理。
+///
+/// 実体は各マネージャが持ち、サービスは連結リストでつなぐだけなので
+/// 登録にヒープ確保は発生しない。
+class TimerJob {
+public:
+  /// 期限に呼ばれる関数の型。サービスのタスクから呼ばれる。
+  typedef std::function<void()> Callback;
+
+  TimerJob(const char *name, Callback callback)
+      : m_name(name), m_callback(callback) {}
+  TimerJob(const TimerJob &) = delete;
+  TimerJob &operator=(const TimerJob &) = delete;
+
+  /// 表示用の名前。
+  const char *name() const { return m_name; }
+  /// 実行された回数。
+  uint32_t runs() const { return m_runs; }
+  /// 1回の実行にかかった時間の最大値 [us]。
+  uint32_t maxRunMicros() const { return m_maxRunMicros; }
+
+private:
+  friend class TimerService;
+
+  const char *m_name;
+  Callback m_callback;
+  /// 周期 [ホイールの刻み]。 0 なら単発。
+  uint32_t m_period = 0;
+  /// 期限 [ホイールの刻み]。
+  uint32_t m_expiry = 0;
+  /// 同じスロットにつながる前後の処理。
+  TimerJob *m_prev = nullptr;
+  TimerJob *m_next = nullptr;
+  /// つながっているリストの先頭。 nullptr なら停止中。
+  TimerJob **m_list = nullptr;
+  std::atomic<uint32_t> m_runs{0};
+  std::atomic<uint32_t> m_maxRunMicros{0};
+};
+
+/// タイマーサービスの統計情報。
+struct TimerServiceStats {
+  /// タスクが起きた回数。
+  uint32_t wakeups;
+  /// 処理を実行した回数。
+  uint32_t runs;
+  /// 登録中の処理の数。
+  uint32_t activeJobs;
+};
+
+/// 周期処理と単発処理を1つの FreeRTOS タスクで実行する。
+///
+/// 期限は 64 スロット × 3 段の階層型タイマーホイールで管理する。
+/// 1段目は `RESOLUTION_MILLIS` 刻みで 640 ms 先まで、2段目は 41 秒先まで、
+/// 3段目は 43 分先までを受け持ち、それより先の期限は溢れリストに置く。
+/// 段の境界を越えるときに上の段のスロットを下の段へ移し替える。
+/// タスクは次に処理のあるスロットの時刻まで眠るので、処理がなければ起きない。
+///
+/// 処理はサービスのタスクで順に実行されるので、長く止まるものは登録しないこと。
+class TimerService {
+public:
+  /// ホイールの刻み [ms]。
+  static constexpr uint32_t RESOLUTION_MILLIS = 10;
+
+  /// タスクの設定。
+  struct TaskConfig {
+    /// タスクの優先度。
+    ///
+    /// IMU のサンプリングを乱さないよう、もとの振動検知タスクに合わせる。
+    UBaseType_t priority = 10;
+    /// スタックサイズ [byte]。
+    uint32_t stackSize = 4096;
+  };
+
+  TimerService() {
+    for (auto &level : m_wheel) {
+      for (auto &slot : level) {
+        slot = nullptr;
+      }
+    }
+  }
+
+  /// サービスのタスクを起動する。
+  ///
+  /// 起動前に登録した処理も、登録した時点から数える。
+  void begin() { begin(TaskConfig{}); }
+  void begin(const TaskConfig &config);
+
+  /// `periodMillis` ごとに処理を実行する。
+  ///
+  /// 実行時刻は周期の倍数にそろえるので、最初の実行は1周期以内に来る。
+  ///
+  /// 登録済みなら周期を変えて数え直す。どのタスクから呼んでもよい。
+  void startPeriodic(TimerJob &job, uint32_t periodMillis) {
+    start(job, periodMillis, toTicks(periodMillis));
+  }
+
+  /// `delayMillis` 後に1回だけ処理を実行する。
+  ///
+  /// 登録済みなら期限を置き換える。どのタスクから呼んでもよい。
+  void startOnce(TimerJob &job, uint32_t delayMillis) {
+    start(job, delayMillis, 0);
+  }
+
+  /// 処理の登録を解除する。実行中の処理は止まらない。
+  void stop(TimerJob &job);
+
+  /// 統計情報を返す。
+  TimerServiceStats stats() const {
+    return TimerServiceStats{m_wakeups, m_runs, m_activeJobs};
+  }
+
+private:
+  /// 1段のスロット数を表すビット数。
+  static constexpr uint32_t SLOT_BITS = 6;
+  static constexpr size_t SLOT_COUNT = size_t(1) << SLOT_BITS;
+  static constexpr uint32_t SLOT_MASK = SLOT_COUNT - 1;
+  /// 段数。
+  static constexpr size_t LEVEL_COUNT = 3;
+  /// 一度に眠る最長の時間 [tick]。 tick カウントの半周。
+  static constexpr TickType_t MAX_SLEEP_TICKS = 0x7fffffff;
+
+  /// 各段のスロットにつながる処理のリストの先頭。
+  TimerJob *m_wheel[LEVEL_COUNT][SLOT_COUNT];
+  /// 最上段より先の期限を持つ処理。
+  TimerJob *m_overflow = nullptr;
+  /// ホイールが処理を終えた時刻 [刻み]。サービスのタスクだけが進める。
+  uint32_t m_now = 0;
+  /// `m_now` に対応する FreeRTOS の tick カウント。
+  ///
+  /// どちらも 0 から始めるので、起動前でも `currentStep()` は tick カウントの
+  /// 0 からの刻みを返す。
+  TickType_t m_nowTick = 0;
+  /// ホイールを操作するときに取るロック。
+  portMUX_TYPE m_lock = portMUX_INITIALIZER_UNLOCKED;
+  TaskHandle_t m_task = NULL;
+  std::atomic<uint32_t> m_wakeups{0};
+  std::atomic<uint32_t> m_runs{0};
+  std::atomic<uint32_t> m_activeJobs{0};
+
+  /// 刻みに換算する。 0 は次の刻みに切り上げる。
+  static uint32_t toTicks(uint32_t millis) {
+    const uint32_t ticks =
+        (millis + RESOLUTION_MILLIS - 1) / RESOLUTION_MILLIS;
+    return ticks > 0 ? ticks : 1;
+  }
+  /// FreeRTOS の tick カウントを刻みに換算する。
+  static uint32_t osTicksPerStep() {
+    const uint32_t ticks = RESOLUTION_MILLIS / portTICK_PERIOD_MS;
+    return ticks > 0 ? ticks : 1;
+  }
+
+  void start(TimerJob &job, uint32_t delayMillis, uint32_t period);
+  /// 現在時刻 [刻み] を返す。ホイールの処理が追いついていなくても進む。
+  uint32_t currentStep() const {
+    return m_now + (xTaskGetTickCount() - m_nowTick) / osTicksPerStep();
+  }
+  /// 期限に応じたスロットへつなぐ。ロックを取ってから呼ぶ。
+  void link(TimerJob &job);
+  /// スロットから外す。ロックを取ってから呼ぶ。
+  void unlink(TimerJob &job);
+  /// 1刻み進め、その刻みに期限のある処理を実行する。
+  void advance();
+  /// 上の段のスロットの処理を、期限に応じてつなぎ直す。ロックを取ってから呼ぶ。
+  void cascade(TimerJob *&list);
+  /// 次に起きるべき時刻 [刻み] を求める。なければ `false` を返す。
+  ///
+  /// `exact` なら処理の期限を、そうでなければ上の段を移し替える境界を返す。
+  /// ロックを取ってから呼ぶ。
+  bool nextWake(uint32_t &step, bool exact);
+  /// リストの中で最も早い期限を返す。
+  uint32_t earliestExpiry(const TimerJob *list) const;
+  /// FreeRTOS によって実行される関数
+  void task();
+};
+} // namespace hardware
+
+#endif
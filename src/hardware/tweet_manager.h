@@ -15,6 +15,8 @@
 #include <freertos/task.h>
 #include <string>
 
+#include "../task_registry.hpp"
+
 namespace hardware {
 
 class TweetManager {
@@ -33,11 +35,12 @@ public:
     const int uxQueueLength = 10;
     eventQueue = xQueueCreate(uxQueueLength, sizeof(void *));
     // FreeRTOS により task() をバックグラウンドで実行
-    const uint16_t stackSize = 4096;
+    // WiFiClient と HTTP の処理を抱えるので、最初に計測しておきたいタスク
+    const uint32_t stackSize = 4096;
     UBaseType_t uxPriority = 0;
-    xTaskCreate(
+    sugar::TaskRegistry::instance().create(
         [](void *this_obj) { static_cast<TweetManager *>(this_obj)->task(); },
-        "TweetManager", stackSize, this, uxPriority, NULL);
+        "TweetManager", stackSize, this, uxPriority);
   }
 
 private:
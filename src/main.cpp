@@ -7,12 +7,27 @@
 #include <esp32-hal-log.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
+#include <freertos/task.h>
 
 #include "hardware/button.h"
 #include "hardware/hardware.h"
+#include "hardware/network_time.hpp"
 #include "scene/event.hpp"
-#include "scene/scene_boot.hpp"
 #include "scene/scene_manager.hpp"
+#include "task_registry.hpp"
+
+/// シーン管理機構を専用タスクで動かすかどうか。
+///
+/// `false` にすると従来通り `loop()` からシーン管理機構をポーリングする。
+constexpr bool SCENE_MANAGER_RUNS_AS_TASK = true;
+
+/// LCD への描画を専用の描画タスクで行うかどうか。
+///
+/// `false` にするとシーンのイベント処理の中で直接描画する。
+constexpr bool DISPLAY_RUNS_RENDER_TASK = true;
+
+/// 操作がなければ次のアラームまで deep sleep するかどうか。
+constexpr bool NIGHT_MODE_ENABLED = true;
 
 /// グローバル変数
 std::shared_ptr<hardware::Hardware> hw;
@@ -27,26 +42,117 @@ void setup() {
   hw = std::make_shared<hardware::Hardware>();
   hw->begin();
 
+  // 描画タスクを起動。シーンが描画を始める前に起動しておく。
+  if (DISPLAY_RUNS_RENDER_TASK) {
+    hw->display().beginRenderTask();
+  }
+
   // シーン管理機構を初期化。
-  constexpr int EVENT_QUEUE_LENGTH = 128;
-  log_i("Scene manager event queue size = %d", EVENT_QUEUE_LENGTH);
-  // シーンイベントキューハンドラを作成
-  QueueHandle_t queueToSceneManager =
-      xQueueCreate(EVENT_QUEUE_LENGTH, sizeof(scene::Event *));
-  auto initial_scene = std::unique_ptr<scene::Scene>(new scene::SceneBoot(hw));
-  scene_manager.initialize(hw, queueToSceneManager, std::move(initial_scene));
-  sceneEventSender = scene::SceneEventSender{queueToSceneManager};
+  // イベントレーンはシーン管理機構が自前で作成する。
+  // 夜間モードから (タイマーかボタンで) 復帰したときは、時計は RTC が
+  // 保っているので WiFi や NTP を待たずに眠る前のシーンから再開する。
+  // アラームは RTC メモリから復元した予定どおりに鳴る。
+  scene::SceneId initialScene = scene::SceneId::Boot;
+  if (hw->nightMode().resumedFromSleep() &&
+      hw->nightMode().resumedScene() ==
+          static_cast<uint8_t>(scene::SceneId::Clock)) {
+    initialScene = scene::SceneId::Clock;
+    // RTC の時計は眠っている間にずれるので、 NTP での補正も始めておく。
+    // ツイートにも接続を使う
+    hardware::beginNetworkTime();
+  }
+  scene_manager.initialize(hw, initialScene);
+  sceneEventSender = scene_manager.eventSender();
 
   // ハードウェア関係の設定。
   hw->onTickEvent([=]() { sceneEventSender.tick(); });
-  hw->onButtonEvent([=](hardware::Button bt, hardware::ButtonEventKind btk) {
-    sceneEventSender.button(ButtonEvent{bt, btk});
+  hw->onButtonEvent([=](const hardware::ButtonEvent &bte) {
+    hw->nightMode().notifyActivity();
+    sceneEventSender.button(bte);
   });
   hw->onAlarmEvent([=]() { sceneEventSender.alarm(); });
+
+  // シーン管理機構をイベント駆動のタスクとして起動
+  if (SCENE_MANAGER_RUNS_AS_TASK) {
+    scene_manager.beginTask();
+  }
 }
 
 void loop() {
   // put your main code here, to run repeatedly:
+  // シリアルからのコマンド
+  // 'p': シーンのハンドラの処理時間を出力する
+  // 'r': 出力してから記録を消す
+  // 's': タスクのスタック使用量と推奨サイズの表を出力する
+  // 't': 加速度の記録の件数を出力する (SHAKE_TRACE のとき)
+  while (Serial.available() > 0) {
+    int c = Serial.read();
+    if (c == 'p' || c == 'r') {
+      scene_manager.requestProfileDump(c == 'r');
+    }
+    if (c == 's') {
+      sugar::TaskRegistry::instance().dump();
+    }
+#ifdef SHAKE_TRACE
+    if (c == 't') {
+      log_i("shake trace: %u records written, %u dropped",
+            hw->shakeTrace().written(), hw->shakeTrace().dropped());
+    }
+#endif
+  }
+  // 夜のアラームが設定された時計の表示中に操作がなければ、アラームまで眠る。
+  // ボタン A でも起きる
+  if (NIGHT_MODE_ENABLED &&
+      scene_manager.currentScene() == scene::SceneId::Clock) {
+    hw->nightMode().poll(hw->alarm().millisUntilNextAlarm(),
+                         static_cast<uint8_t>(scene::SceneId::Clock));
+  }
+  if (SCENE_MANAGER_RUNS_AS_TASK) {
+    // シーン管理機構は専用タスクで動いているので、ここでは統計を出すだけ
+    static uint32_t lastStatsMillis = 0;
+    vTaskDelay(100 / portTICK_PERIOD_MS);
+    if (millis() - lastStatsMillis < 10000) {
+      return;
+    }
+    lastStatsMillis = millis();
+    // スタックの最高水位を記録しておく
+    sugar::TaskRegistry::instance().sample();
+    log_i("SceneManager idle: %u.%u %%", scene_manager.idlePermille() / 10,
+          scene_manager.idlePermille() % 10);
+    const char *laneNames[] = {"Alarm", "Button", "Tick"};
+    for (size_t i = 0; i < scene::EVENT_LANE_COUNT; ++i) {
+      auto st = scene_manager.laneStats(static_cast<scene::EventLane>(i));
+      log_i("Lane %-6s: received=%u dropped=%u maxDepth=%u "
+            "latency(last/max)=%u/%u us",
+            laneNames[i], st.received, st.dropped, st.maxDepth,
+            st.lastLatencyMicros, st.maxLatencyMicros);
+    }
+    auto render = hw->display().stats();
+    log_i("Render: commands=%u depth=%u maxDepth=%u stalls=%u "
+          "batch(last/max)=%u/%u us",
+          render.commands, render.queueDepth, render.maxQueueDepth,
+          render.stalls, render.lastBatchMicros, render.maxBatchMicros);
+    auto alarm = hw->alarm().firingStats();
+    log_i("Alarm: fired=%u missed=%u clockJumps=%u "
+          "error(last/max)=%d.%03d/%d.%03d ms",
+          alarm.fired, alarm.missed, alarm.clockJumps,
+          alarm.lastErrorMicros / 1000, alarm.lastErrorMicros % 1000,
+          alarm.maxErrorMicros / 1000, alarm.maxErrorMicros % 1000);
+    auto timers = hw->timers().stats();
+    log_i("TimerService: wakeups=%u runs=%u jobs=%u", timers.wakeups,
+          timers.runs, timers.activeJobs);
+    auto imu = hw->shaking().powerStats();
+    const char *powerNames[] = {"sleep", "watch", "accel"};
+    log_i("IMU: %s, sleep/watch/accel=%u/%u/%u s transitions=%u",
+          powerNames[static_cast<size_t>(imu.state)],
+          static_cast<uint32_t>(imu.millis[0] / 1000),
+          static_cast<uint32_t>(imu.millis[1] / 1000),
+          static_cast<uint32_t>(imu.millis[2] / 1000), imu.transitions);
+    auto frame = hw->display().lastFrame();
+    log_i("FrameBuffer last frame: %u bytes in %u us", frame.bytesPushed,
+          frame.transferMicros);
+    return;
+  }
   size_t numEventsProcessed = scene_manager.processExternalEvents();
   if (numEventsProcessed != 0) {
     log_i("Processed %zd external events by scene manager", numEventsProcessed);
@@ -2,9 +2,8 @@
 #ifndef _INCLUDE_EVENT_HPP_
 #define _INCLUDE_EVENT_HPP_
 
-#include <utility>
-
-#include <esp32-hal-log.h>
+#include <cstddef>
+#include <type_traits>
 
 #include "../hardware/button.h"
 
@@ -17,42 +16,75 @@ enum class EventKind {
   Tick,
   /// ボタン関連イベント。
   ///
-  /// データ部に `std::unique_ptr<ButtonEvent>` を持つ。
+  /// データ部に `ButtonEvent` を持つ。
   Button,
   /// アラームイベント。
   Alarm,
 };
 
 /// シーンに対するイベント。
+///
+/// 補助データを値として内包する固定長の型であり、 FreeRTOS のキューへ
+/// そのままコピーして送受信できる。
+/// イベント経路でヒープ確保が発生しないよう、ポインタは持たせないこと。
 class Event {
 private:
   /// イベントの種類。
   EventKind m_kind;
   /// 補助データ。
   ///
-  /// ポインタの型は `kind` ごとに異なる。
-  /// 補助データが不要なら nullptr を使う。
-  void *m_data;
+  /// 有効なメンバは `kind` ごとに異なる。
+  union Data {
+    /// 補助データなし。
+    char none;
+    /// `EventKind::Button` の補助データ。
+    hardware::ButtonEvent button;
+
+    Data() : none{} {}
+    Data(hardware::ButtonEvent bte) : button{bte} {}
+  } m_data;
 
 public:
-  Event(EventKind kind) : m_kind{kind}, m_data{} {}
-  Event(EventKind kind, void *data) : m_kind{kind}, m_data{data} {}
-  Event(const Event &) = delete;
-  Event(Event &&) = default;
-  ~Event() {
-    if (m_data) {
-      log_w("Memory leak detected: the additional data of a scene event was "
-            "not released!");
-    }
-  }
+  explicit Event(EventKind kind) : m_kind{kind}, m_data{} {}
+  explicit Event(hardware::ButtonEvent bte)
+      : m_kind{EventKind::Button}, m_data{bte} {}
 
   EventKind kind() const { return m_kind; }
 
-  std::unique_ptr<hardware::ButtonEvent> buttonData() {
-    return std::unique_ptr<hardware::ButtonEvent>(
-        static_cast<hardware::ButtonEvent *>(std::exchange(m_data, nullptr)));
-  }
+  /// ボタンイベントの補助データを返す。
+  ///
+  /// `kind() == EventKind::Button` のときのみ有効。
+  hardware::ButtonEvent buttonData() const { return m_data.button; }
 };
+// キューへ `memcpy` で詰められるようにする。
+static_assert(std::is_trivially_copyable<Event>::value,
+              "scene::Event must be trivially copyable");
+
+/// シーンの種類。
+///
+/// シーンの遷移先はこの値で指定し、実体はシーン管理機構が構築する。
+enum class SceneId {
+  /// 起動画面。
+  Boot,
+  /// 現在時刻の表示。
+  Clock,
+  /// アラーム時刻の設定。
+  ConfigureAlarm,
+  /// アラーム鳴動中。
+  Alarming,
+};
+/// シーンの種類の数。
+constexpr size_t SCENE_ID_COUNT = 4;
+static_assert(static_cast<size_t>(SceneId::Alarming) + 1 == SCENE_ID_COUNT,
+              "SCENE_ID_COUNT must match SceneId");
+
+/// シーンの種類の名前を返す。
+constexpr const char *sceneIdName(SceneId id) {
+  return id == SceneId::Boot             ? "Boot"
+         : id == SceneId::Clock          ? "Clock"
+         : id == SceneId::ConfigureAlarm ? "ConfigureAlarm"
+                                         : "Alarming";
+}
 
 /// イベント処理結果の種類。
 enum class EventResultKind {
@@ -64,11 +96,11 @@ enum class EventResultKind {
   Finish,
   /// シーンを追加する。
   ///
-  /// データ部に `std::unique_ptr<Scene>` を持つ。
+  /// 追加するシーンの種類を `scene` に持つ。
   PushScene,
   /// 現在のシーンを入れ替える。
   ///
-  /// データ部に `std::unique_ptr<Scene>` を持つ。
+  /// 入れ替え先のシーンの種類を `scene` に持つ。
   ReplaceScene,
 };
 
@@ -76,14 +108,13 @@ enum class EventResultKind {
 struct EventResult {
   /// イベント処理結果の種類。
   EventResultKind kind;
-  /// 補助データ。
+  /// 遷移先のシーンの種類。
   ///
-  /// ポインタの型は `kind` ごとに異なる。
-  /// 補助データが不要なら nullptr を使う。
-  void *data;
+  /// `kind` が `PushScene` か `ReplaceScene` のときのみ有効。
+  SceneId scene;
 
-  EventResult(EventResultKind kind) : kind(kind), data(nullptr) {}
-  EventResult(EventResultKind kind, void *data) : kind(kind), data(data) {}
+  EventResult(EventResultKind kind) : kind(kind), scene(SceneId::Boot) {}
+  EventResult(EventResultKind kind, SceneId scene) : kind(kind), scene(scene) {}
 };
 } // namespace scene
 
@@ -0,0 +1,218 @@
+#pragma once
+#ifndef _INCLUDE_EVENT_LANES_HPP_
+#define _INCLUDE_EVENT_LANES_HPP_
+
+// コンパイルエラーを防ぐため， Arduino.h で定義されているマクロをundef
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+#include "event.hpp"
+
+namespace scene {
+/// イベントレーン。
+///
+/// 値が小さいほど優先度が高い。
+enum class EventLane {
+  /// アラームイベント。
+  Alarm = 0,
+  /// ボタンイベント。
+  Button = 1,
+  /// Tick イベント。
+  Tick = 2,
+};
+
+/// レーンの個数。
+constexpr size_t EVENT_LANE_COUNT = 3;
+
+/// イベントの種類に対応するレーンを返す。
+inline EventLane laneOf(EventKind kind) {
+  switch (kind) {
+  case EventKind::Alarm:
+    return EventLane::Alarm;
+  case EventKind::Button:
+    return EventLane::Button;
+  case EventKind::Tick:
+  default:
+    return EventLane::Tick;
+  }
+}
+
+/// Tick イベントを合流させる機構。
+///
+/// キューに積まれる Tick イベントを高々1つに保ち、それが取り出されるまでに
+/// 経過した Tick 周期の数を数える。
+/// シーンの処理が遅れてもキューが古い Tick で溢れることはない。
+class TickCoalescer {
+private:
+  /// 未処理の Tick 周期の数。
+  std::atomic<uint32_t> m_periods{0};
+  /// Tick イベントがキューに積まれているか否か。
+  std::atomic_bool m_queued{false};
+
+public:
+  /// Tick 周期を1つ数える。
+  ///
+  /// 新たに Tick イベントをキューへ積むべきとき `true` を返す。
+  bool post() {
+    m_periods++;
+    return !m_queued.exchange(true);
+  }
+
+  /// Tick イベントをキューへ積むのに失敗したときに呼ぶ。
+  void cancel() { m_queued = false; }
+
+  /// キューから Tick イベントを取り出したときに呼ぶ。
+  ///
+  /// 未処理の Tick 周期の数を返す。
+  uint32_t take() {
+    m_queued = false;
+    return m_periods.exchange(0);
+  }
+};
+
+/// レーンごとの統計情報のスナップショット。
+struct EventLaneStats {
+  /// 受信したイベントの数。
+  uint32_t received;
+  /// キューが一杯で捨てられたイベントの数。
+  uint32_t dropped;
+  /// 受信時に観測したキュー深さの最大値。
+  uint32_t maxDepth;
+  /// 直近のイベントの送信から受信までの遅延 [us]。
+  uint32_t lastLatencyMicros;
+  /// 送信から受信までの遅延の最大値 [us]。
+  uint32_t maxLatencyMicros;
+};
+
+/// 優先度付きのイベントレーン群。
+///
+/// レーンごとに独立したキューを持ち、受信側は常に最も優先度の高い
+/// 空でないレーンからイベントを取り出す。
+/// 全レーン共通の計数セマフォ (ドアベル) でイベントの到着を待つので、
+/// 受信側はどのレーンに届いたかを問わず一か所でブロックできる。
+class EventLanes {
+private:
+  /// キューに積まれるイベント。
+  struct Item {
+    /// イベント本体。
+    Event event;
+    /// 送信時刻 [us]。
+    int64_t sentAtMicros;
+  };
+
+  /// レーンごとの統計情報。
+  struct Stats {
+    std::atomic<uint32_t> received{0};
+    std::atomic<uint32_t> dropped{0};
+    std::atomic<uint32_t> maxDepth{0};
+    std::atomic<uint32_t> lastLatencyMicros{0};
+    std::atomic<uint32_t> maxLatencyMicros{0};
+  };
+
+  /// レーンごとのキュー。
+  QueueHandle_t m_queues[EVENT_LANE_COUNT] = {};
+  /// イベント到着を知らせる計数セマフォ。
+  ///
+  /// 値は常に全レーンのイベント数以下に保たれる。
+  SemaphoreHandle_t m_doorbell = nullptr;
+  /// Tick イベントの合流機構。
+  TickCoalescer m_tickCoalescer;
+  /// レーンごとの統計情報。
+  Stats m_stats[EVENT_LANE_COUNT];
+
+public:
+  /// キューを作成する。
+  void begin() {
+    // 各レーンのキューの長さ。
+    // Tick は合流されるので高々1つしか積まれない。
+    const UBaseType_t laneLengths[EVENT_LANE_COUNT] = {4, 32, 1};
+    UBaseType_t total = 0;
+    for (size_t i = 0; i < EVENT_LANE_COUNT; ++i) {
+      m_queues[i] = xQueueCreate(laneLengths[i], sizeof(Item));
+      total += laneLengths[i];
+    }
+    m_doorbell = xSemaphoreCreateCounting(total, 0);
+  }
+
+  /// Tick イベントの合流機構を返す。
+  TickCoalescer &tickCoalescer() { return m_tickCoalescer; }
+
+  /// イベントを対応するレーンへ送信する。
+  ///
+  /// キューが一杯なら捨てて `false` を返す。
+  bool send(const Event &ev) {
+    size_t lane = static_cast<size_t>(laneOf(ev.kind()));
+    Item item{ev, esp_timer_get_time()};
+    if (xQueueSendToBack(m_queues[lane], &item, 0) != pdTRUE) {
+      m_stats[lane].dropped++;
+      return false;
+    }
+    // イベントを積んでからドアベルを鳴らす
+    xSemaphoreGive(m_doorbell);
+    return true;
+  }
+
+  /// いずれかのレーンにイベントが届くまで最大 `timeout` だけ待つ。
+  ///
+  /// 成功したら、続けて `receive()` を1回呼ばなければならない。
+  bool wait(TickType_t timeout) {
+    return xSemaphoreTake(m_doorbell, timeout) == pdTRUE;
+  }
+
+  /// 待たずに受信できるイベントの数を返す。
+  size_t pending() const { return uxSemaphoreGetCount(m_doorbell); }
+
+  /// 最も優先度の高いレーンからイベントを1つ取り出す。
+  ///
+  /// `wait()` が成功した直後にのみ呼ぶこと。
+  Event receive() {
+    Item item{Event{EventKind::Tick}, 0};
+    for (size_t lane = 0; lane < EVENT_LANE_COUNT; ++lane) {
+      UBaseType_t depth = uxQueueMessagesWaiting(m_queues[lane]);
+      if (depth == 0 || xQueueReceive(m_queues[lane], &item, 0) != pdTRUE) {
+        continue;
+      }
+      record(lane, depth, esp_timer_get_time() - item.sentAtMicros);
+      break;
+    }
+    return item.event;
+  }
+
+  /// レーンの統計情報を返す。
+  EventLaneStats stats(EventLane lane) const {
+    const Stats &s = m_stats[static_cast<size_t>(lane)];
+    return EventLaneStats{s.received, s.dropped, s.maxDepth,
+                          s.lastLatencyMicros, s.maxLatencyMicros};
+  }
+
+private:
+  /// 受信時の統計情報を記録する。
+  void record(size_t lane, uint32_t depth, int64_t latencyMicros) {
+    Stats &s = m_stats[lane];
+    uint32_t latency = static_cast<uint32_t>(latencyMicros);
+    s.received++;
+    s.lastLatencyMicros = latency;
+    // 書き込むのは受信側の1タスクだけなので比較と代入は分けてよい
+    if (depth > s.maxDepth) {
+      s.maxDepth = depth;
+    }
+    if (latency > s.maxLatencyMicros) {
+      s.maxLatencyMicros = latency;
+    }
+  }
+};
+} // namespace scene
+
+#endif
@@ -2,6 +2,9 @@
 #ifndef _INCLUDE_SCENE_HPP_
 #define _INCLUDE_SCENE_HPP_
 
+#include <cstddef>
+#include <cstdint>
+
 #include "../hardware/button.h"
 #include "event.hpp"
 
@@ -16,65 +19,60 @@ public:
   virtual ~Scene() = default;
 
   /// 定期的に (タイマーイベントごとに) 呼ばれる。
-  virtual EventResult tick() { return EventResultKind::Continue; }
+  ///
+  /// 処理が遅れて Tick が合流された場合、 `periods` には前回の呼び出しから
+  /// 経過した Tick 周期の数 (1 以上) が入る。
+  virtual EventResult tick(uint32_t periods) {
+    return EventResultKind::Continue;
+  }
 
   /// シーンがスタックのトップに来たとき呼ばれる。
   virtual EventResult activated() { return EventResultKind::Continue; }
 
+  /// ボタン関連のイベントの処理関数の型。
+  using ButtonHandler = EventResult (Scene::*)();
+  /// Repeated の処理関数の型。引数は進める歩数。
+  using ButtonRepeatHandler = EventResult (Scene::*)(uint16_t steps);
+
   /// ボタン関連のイベントが来たとき呼ばれる。
   ///
   /// デフォルト実装では、ここから `buttonAPressed()` などに
   /// 処理が盥回しされる。
-  virtual EventResult buttonEventReceived(Button button,
-                                          ButtonEventKind event) {
-    int button_n = 0;
-    switch (button) {
-    case Button::A:
-      button_n = 1;
-      break;
-    case Button::B:
-      button_n = 2;
-      break;
-    case Button::C:
-      button_n = 3;
-      break;
-    }
-    int event_n = 0;
-    switch (event) {
-    case ButtonEventKind::Pressed:
-      event_n = 1;
-      break;
-    case ButtonEventKind::Released:
-      event_n = 2;
-      break;
-    case ButtonEventKind::Repeated:
-      event_n = 3;
-      break;
-    }
-    int n = (event_n << 4) | button_n;
-    switch (n) {
-    case 0x11:
-      return buttonAPressed();
-    case 0x21:
-      return buttonAReleased();
-    case 0x31:
-      return buttonARepeated();
-    case 0x12:
-      return buttonBPressed();
-    case 0x22:
-      return buttonBReleased();
-    case 0x32:
-      return buttonBRepeated();
-    case 0x13:
-      return buttonCPressed();
-    case 0x23:
-      return buttonCReleased();
-    case 0x33:
-      return buttonCRepeated();
-    default:
+  virtual EventResult buttonEventReceived(const hardware::ButtonEvent &event) {
+    // (ボタン, 押され方) から処理関数を引く表。
+    // 行は `Button` 、列は `ButtonEventKind` の定義順に並べること。
+    // ボタンを増やしたら行を1つ、押され方を増やしたら
+    // `SCENE_BUTTON_HANDLERS` に列を1つ足せばよい。
+    // Repeated は歩数を受け取るので別の表で引く。
+#define SCENE_BUTTON_HANDLERS(B)                                               \
+  {                                                                            \
+    &Scene::button##B##Pressed, &Scene::button##B##Released, nullptr,          \
+        &Scene::button##B##LongPressed, &Scene::button##B##DoublePressed       \
+  }
+    static constexpr ButtonHandler
+        handlers[hardware::BUTTON_COUNT][hardware::BUTTON_EVENT_KIND_COUNT] = {
+            SCENE_BUTTON_HANDLERS(A),
+            SCENE_BUTTON_HANDLERS(B),
+            SCENE_BUTTON_HANDLERS(C),
+        };
+#undef SCENE_BUTTON_HANDLERS
+    static constexpr ButtonRepeatHandler
+        repeatHandlers[hardware::BUTTON_COUNT] = {
+            &Scene::buttonARepeated,
+            &Scene::buttonBRepeated,
+            &Scene::buttonCRepeated,
+        };
+    const auto b = static_cast<size_t>(event.button);
+    const auto e = static_cast<size_t>(event.kind);
+    if (b >= hardware::BUTTON_COUNT ||
+        e >= hardware::BUTTON_EVENT_KIND_COUNT) {
       // Should never come here.
       return EventResultKind::Continue;
     }
+    if (event.kind == ButtonEventKind::Repeated) {
+      return (this->*repeatHandlers[b])(event.count);
+    }
+    return (this->*handlers[b][e])();
   }
 
   /// ボタンAが押されたとき呼ばれる。
@@ -83,8 +81,23 @@ public:
   /// ボタンAが離されたとき呼ばれる。
   virtual EventResult buttonAReleased() { return EventResultKind::Continue; }
 
-  /// ボタンAが長押しされたとき、定期的に呼ばれる。
-  virtual EventResult buttonARepeated() { return buttonAPressed(); }
+  /// ボタンAが押し続けられているとき、加速しながら定期的に呼ばれる。
+  ///
+  /// `steps` は今回進めるべき歩数。長押しで動いて困るシーンがあるので、
+  /// 使うシーンだけが上書きする。
+  virtual EventResult buttonARepeated(uint16_t steps) {
+    return EventResultKind::Continue;
+  }
+
+  /// ボタンAが長押しされたとき、1回だけ呼ばれる。
+  virtual EventResult buttonALongPressed() {
+    return EventResultKind::Continue;
+  }
+
+  /// ボタンAが素早く2回押されたとき、2回目の押下の後に呼ばれる。
+  virtual EventResult buttonADoublePressed() {
+    return EventResultKind::Continue;
+  }
 
   /// ボタンBが押されたとき呼ばれる。
   virtual EventResult buttonBPressed() { return EventResultKind::Continue; }
@@ -92,8 +105,23 @@ public:
   /// ボタンBが離されたとき呼ばれる。
   virtual EventResult buttonBReleased() { return EventResultKind::Continue; }
 
-  /// ボタンBが長押しされたとき、定期的に呼ばれる。
-  virtual EventResult buttonBRepeated() { return buttonBPressed(); }
+  /// ボタンBが押し続けられているとき、加速しながら定期的に呼ばれる。
+  ///
+  /// `steps` は今回進めるべき歩数。長押しで動いて困るシーンがあるので、
+  /// 使うシーンだけが上書きする。
+  virtual EventResult buttonBRepeated(uint16_t steps) {
+    return EventResultKind::Continue;
+  }
+
+  /// ボタンBが長押しされたとき、1回だけ呼ばれる。
+  virtual EventResult buttonBLongPressed() {
+    return EventResultKind::Continue;
+  }
+
+  /// ボタンBが素早く2回押されたとき、2回目の押下の後に呼ばれる。
+  virtual EventResult buttonBDoublePressed() {
+    return EventResultKind::Continue;
+  }
 
   /// ボタンCが押されたとき呼ばれる。
   virtual EventResult buttonCPressed() { return EventResultKind::Continue; }
@@ -101,8 +129,23 @@ public:
   /// ボタンCが離されたとき呼ばれる。
   virtual EventResult buttonCReleased() { return EventResultKind::Continue; }
 
-  /// ボタンCが長押しされたとき、定期的に呼ばれる。
-  virtual EventResult buttonCRepeated() { return buttonCPressed(); }
+  /// ボタンCが押し続けられているとき、加速しながら定期的に呼ばれる。
+  ///
+  /// `steps` は今回進めるべき歩数。長押しで動いて困るシーンがあるので、
+  /// 使うシーンだけが上書きする。
+  virtual EventResult buttonCRepeated(uint16_t steps) {
+    return EventResultKind::Continue;
+  }
+
+  /// ボタンCが長押しされたとき、1回だけ呼ばれる。
+  virtual EventResult buttonCLongPressed() {
+    return EventResultKind::Continue;
+  }
+
+  /// ボタンCが素早く2回押されたとき、2回目の押下の後に呼ばれる。
+  virtual EventResult buttonCDoublePressed() {
+    return EventResultKind::Continue;
+  }
 
   /// アラーム時刻になったとき呼ばれる。
   // アラーム画面を強制的に有効化するのは、各シーンでなくマネージャの
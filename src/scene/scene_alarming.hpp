@@ -10,7 +10,9 @@
 #include "hardware/hardware.h"
 #include "scene/event.hpp"
 #include "scene/scene.hpp"
+#include "ui/widget.hpp"
 
+#include <cstdio>
 #include <cstdlib>
 
 // コンパイルエラーを防ぐため， Arduino.h で定義されているマクロをundef
@@ -25,22 +27,30 @@
 namespace scene {
 
 // アラーム設定時刻になった後，アラーム音が鳴り続けている最中のScene
-class SceneAlarming : public Scene {
+class SceneAlarming final : public Scene {
 public:
+  /// シーンの種類。
+  static constexpr SceneId ID = SceneId::Alarming;
+
   // コンストラクタ，必要なものがあれば受け取る仕様にする
   SceneAlarming(std::shared_ptr<hardware::Hardware> &m_hardware)
-      : m_hardware(m_hardware) {}
+      : m_hardware(m_hardware) {
+    m_screen.add(m_shakeLabel);
+    m_screen.add(m_countLabel);
+    m_screen.add(m_contactLabel);
+  }
 
   /// シーンがスタックのトップに来たとき呼ばれる。
   virtual EventResult activated() override {
     log_i("SceneAlarming activated()");
 
     // LCDのクリア
-    M5.Lcd.clear();
-    //文字色設定
-    M5.Lcd.setTextColor(TFT_YELLOW, TFT_BLACK);
+    display().clear();
+    m_screen.invalidateAll();
     // 描画
-    drawShakingCount(max_count, true);
+    m_shakeLabel.setText("Shake to Stop!");
+    drawShakingCount(max_count);
+    display().render(m_screen);
 
     //アラーム音の再生を開始
     m_hardware->speaker().play(hardware::SpeakerManager::Music::Alarm);
@@ -56,7 +66,7 @@ public:
   }
 
   /// 定期的に (タイマーイベントごとに) 呼ばれる。
-  virtual EventResult tick() override {
+  virtual EventResult tick(uint32_t periods) override {
 
     auto now_count = m_hardware->shaking().getCount();
 
@@ -110,50 +120,39 @@ protected:
   std::chrono::system_clock::time_point m_timelimit_to_stop =
       std::chrono::system_clock::now();
 
+  /// 描画先の画面。
+  ui::Display &display() { return m_hardware->display(); }
+  // 文字は白で表示
+  ui::Label m_shakeLabel{160, 75 - 24, 4, ui::Align::Centre, TFT_WHITE};
+  // ふる回数は黄色で表示
+  ui::Label m_countLabel{160, 75 - 24 + 54, 8, ui::Align::Centre,
+                         TFT_YELLOW};
+  // 右下の残り時間
+  ui::Label m_contactLabel{300, 220, 2, ui::Align::Right, TFT_WHITE};
+  ui::Screen<3> m_screen;
+
 private:
-  void updateLcd(int remain_count, int sec, bool clean = false) const {
+  void updateLcd(int remain_count, int sec) {
     // 中央のふる回数の表示
-    drawShakingCount(remain_count, clean);
+    drawShakingCount(remain_count);
     // 右下の残り時間の表示
-    DrawContactAfter(sec, clean);
+    DrawContactAfter(sec);
+    //変更のあった部分だけを描画
+    display().render(m_screen);
   }
 
-  void drawShakingCount(int remain_count, bool clean) const {
-    static int prev_count = 0;
-    if (!clean && remain_count == prev_count)
-      return;
-    prev_count = remain_count;
-    //描画位置
-    int xpos = 160;
-    int ypos = 75 - 24; // Top left corner ot clock text, about half way down
-
-    //描画処理
-    // 文字は白で表示
-    M5.Lcd.setTextColor(TFT_WHITE, TFT_BLACK);
-    M5.Lcd.drawCentreString("Shake to Stop!", xpos, ypos, 4); // Draw hours
-    ypos += 54;
-    // ふる回数は黄色で表示
-    M5.Lcd.setTextColor(TFT_YELLOW, TFT_BLACK);
-    M5.Lcd.drawCentreString(String(remain_count, DEC), xpos, ypos, 8);
+  void drawShakingCount(int remain_count) {
+    char c[12];
+    sprintf(c, "%d", remain_count);
+    m_countLabel.setText(c);
   }
 
-  // 右下の描画をする
-  void DrawContactAfter(int sec, bool clean) const {
-    static int prev_count = 0;
-    if (!clean && sec == prev_count)
-      return;
-    prev_count = sec;
-    M5.Lcd.setTextColor(TFT_WHITE, TFT_BLACK);
-    // 描画文字列str。文字列がずれる時の対策として先頭に半角スペースを数個追加する
-    std::string str = " Send a Message After ";
-    // sprintfで秒数を格納する
-    char c[10];
-    // str+=std::to_string(30);//< コンパイル通らないんやが
-    sprintf(c, "%d", sec);
-    str += c;
-    str += " [s]";
-    // 描画
-    M5.Lcd.drawRightString(str.c_str(), 300, 220, 2);
+  // 右下の表示を更新する
+  void DrawContactAfter(int sec) {
+    // 描画文字列。文字列がずれる時の対策として先頭に半角スペースを数個追加する
+    char str[40];
+    sprintf(str, " Send a Message After %d [s]", sec);
+    m_contactLabel.setText(str);
   }
 
   void stopAlarm() {
@@ -163,8 +162,7 @@ private:
     m_hardware->shaking().stopCount();
     m_hardware->shaking().resetCount();
 
-    // スレッドローカルなアラーム状態キャッシュを更新
-    hardware::Hardware::setAlarmEnabled(false);
+    // 1回だけのアラームなら、共有のアラーム状態は AlarmManager が無効にする
   }
 };
 
@@ -9,15 +9,19 @@
 #include <WiFi.h>
 
 #include "../hardware/hardware.h"
+#include "../hardware/network_time.hpp"
 #include "scene/event.hpp"
 #include "scene/scene.hpp"
-#include "scene/scene_clock.hpp"
+#include "ui/widget.hpp"
 
 namespace scene {
 
 // アラーム設定時刻になった後，アラーム音が鳴り続けている最中のScene
-class SceneBoot : public Scene {
+class SceneBoot final : public Scene {
 public:
+  /// シーンの種類。
+  static constexpr SceneId ID = SceneId::Boot;
+
   // コンストラクタ，必要なものがあれば受け取る仕様にする
   SceneBoot(std::shared_ptr<hardware::Hardware> &m_hardware)
       : m_hardware(m_hardware) {}
@@ -25,32 +29,26 @@ public:
   /// シーンがスタックのトップに来たとき呼ばれる。
   virtual EventResult activated() override {
     // LCDのクリア
-    M5.Lcd.clear();
-    M5.Lcd.setTextColor(TFT_WHITE, TFT_BLACK);
-    // WiFi接続
+    display().clear();
+    m_status.invalidate();
+    // WiFi接続と SNTP の初期化
     isConnected = false;
-    WiFi.begin();
-    M5.Lcd.drawCentreString("WiFi connecting...", 160, 120 - 12, 4);
-    // SNTP の初期化
-    const char *ntpServer = "ntp.jst.mfeed.ad.jp"; //日本のNTPサーバー選択
-    const long gmtOffset_sec = 9 * 3600; // 9時間の時差を入れる
-    const int daylightOffset_sec = 0;    //夏時間はないのでゼロ
-    configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
+    hardware::beginNetworkTime();
+    showStatus("WiFi connecting...");
     return EventResultKind::Continue;
   }
 
   /// 定期的に (タイマーイベントごとに) 呼ばれる。
-  virtual EventResult tick() override {
+  virtual EventResult tick(uint32_t periods) override {
     // WiFi接続が完了したら表示を更新
     if (isConnected == false && WiFi.isConnected()) {
       isConnected = true;
-      M5.Lcd.drawCentreString("Getting Time via NTP...", 160, 120 - 12, 4);
+      showStatus("Getting Time via NTP...");
     }
     // 時間を取得し終わったら次のシーンへ
     if (time(NULL) > 30 * 365 * 24 * 60 * 60) {
       // WiFi.mode(WIFI_OFF);
-      return EventResult(EventResultKind::ReplaceScene,
-                         static_cast<void *>(new SceneClock(m_hardware)));
+      return EventResult(EventResultKind::ReplaceScene, SceneId::Clock);
     }
     return EventResultKind::Continue;
   }
@@ -58,14 +56,13 @@ public:
   /// ボタン
   virtual EventResult buttonAPressed() override {
     // WiFi あきらめ
-    return EventResult(EventResultKind::ReplaceScene,
-                       static_cast<void *>(new SceneClock(m_hardware)));
+    return EventResult(EventResultKind::ReplaceScene, SceneId::Clock);
   }
 
   /// ボタンC
   virtual EventResult buttonCPressed() override {
     // WiFi SmartConfig
-    M5.Lcd.drawCentreString("WiFi SmartConfig Start!", 160, 120 - 12, 4);
+    showStatus("WiFi SmartConfig Start!");
     WiFi.mode(WIFI_AP_STA);
     WiFi.beginSmartConfig();
     return EventResultKind::Continue;
@@ -74,6 +71,17 @@ public:
 protected:
   std::shared_ptr<hardware::Hardware> m_hardware;
   bool isConnected;
+
+  /// 描画先の画面。
+  ui::Display &display() { return m_hardware->display(); }
+  /// 状態表示。
+  ui::Label m_status{160, 120 - 12, 4, ui::Align::Centre, TFT_WHITE};
+
+  /// 状態表示を更新する。
+  void showStatus(const char *text) {
+    m_status.setText(text);
+    display().render(m_status);
+  }
 };
 
 }; // namespace scene
@@ -16,37 +16,57 @@
 #endif
 #include <chrono>
 #include <cstdio>
-#include <string>
 
 #include "hardware/hardware.h"
 #include "scene/event.hpp"
 #include "scene/scene.hpp"
-#include "scene/scene_alarming.hpp"
-#include "scene/scene_configure_alarm.hpp"
+#include "time_of_day.hpp"
+#include "ui/widget.hpp"
 
 namespace scene {
 
 // 現在時刻を表示する Scene
-class SceneClock : public Scene {
+class SceneClock final : public Scene {
 public:
+  /// シーンの種類。
+  static constexpr SceneId ID = SceneId::Clock;
+
   // コンストラクタ，必要なものがあれば受け取る仕様にする
   SceneClock(std::shared_ptr<hardware::Hardware> &m_hardware)
-      : m_hardware(m_hardware) {}
+      : m_hardware(m_hardware) {
+    m_screen.add(m_title);
+    m_screen.add(m_alarmTime);
+    m_screen.add(m_hours);
+    m_screen.add(m_colonHm);
+    m_screen.add(m_minutes);
+    m_screen.add(m_colonMs);
+    m_screen.add(m_seconds);
+    m_setScreen.add(m_setLabel);
+  }
 
   /// 定期的に (タイマーイベントごとに) 呼ばれる。
-  virtual EventResult tick() override {
-    // TODO: 時刻が変わったときだけ更新
-    updateDisplayClock();
+  virtual EventResult tick(uint32_t periods) override {
+    // アラームが設定・解除されていれば表示し直す
+    if (m_hardware->alarm().state().generation() != m_alarmGeneration) {
+      updateAlarmTime();
+    }
+    // 変更のあったウィジェットだけが描き直される
+    updateDisplayClock(periods);
     return EventResultKind::Continue;
   }
 
   /// シーンがスタックのトップに来たとき呼ばれる。
   virtual EventResult activated() override {
-    // ごみを消去
-    updateDisplayClock(true); //< 完全再描画
-    if (hardware::Hardware::isAlarmEnabled()) {
-      DrawAlarmTime(hardware::Hardware::alarmTimeCache());
-    }
+    // ごみを消去して完全再描画
+    display().clear();
+    layoutClock();
+    m_screen.invalidateAll();
+    m_setScreen.invalidateAll();
+    // 跳ねる "SET" はちらつかないようにバッファへ描く
+    m_setBuffered =
+        USE_FRAME_BUFFER && display().acquireBuffer(SET_BAND);
+    updateAlarmTime();
+    updateDisplayClock(0);
     log_i("SceneClock activated()");
     return EventResultKind::Continue;
   }
@@ -54,32 +74,81 @@ public:
   /// ボタン
   virtual EventResult buttonBPressed() override {
     /// アラーム設定へ
-    return EventResult(EventResultKind::PushScene,
-                       static_cast<void *>(new SceneConfigureAlarm(
-                           m_hardware->alarm().alarmTimeSetter(), m_hardware)));
+    return EventResult(EventResultKind::PushScene, SceneId::ConfigureAlarm);
   }
 
 protected:
   std::shared_ptr<hardware::Hardware> m_hardware;
 
-  void updateDisplayClock(bool clean = false) {
-    //アニメーションのための数値
-    static uint8_t frame = 0;
-    frame++;
+  /// 時刻表示の上端。
+  static constexpr int16_t CLOCK_Y = 85;
+  /// 秒表示の上端。
+  static constexpr int16_t SECONDS_Y = CLOCK_Y + 24;
+  /// ":" の暗い色。
+  static constexpr uint16_t DIM_COLOR = 0x39C4;
+  /// "SET" をオフスクリーンバッファに描くか否か。
+  static constexpr bool USE_FRAME_BUFFER = true;
+  /// "SET" が跳ねる範囲。
+  const ui::Bounds SET_BAND{0, 196, 320, 40};
+
+  /// 描画先の画面。
+  ui::Display &display() { return m_hardware->display(); }
+  ui::Label m_title{160, 0, 8, ui::Align::Centre, TFT_YELLOW};
+  ui::Label m_alarmTime{160, 14, 4, ui::Align::Centre, TFT_YELLOW};
+  ui::NumberField m_hours{0, CLOCK_Y, 2, 8, TFT_YELLOW};
+  ui::Label m_colonHm{0, CLOCK_Y - 8, 8, ui::Align::Left, TFT_YELLOW};
+  ui::NumberField m_minutes{0, CLOCK_Y, 2, 8, TFT_YELLOW};
+  ui::Label m_colonMs{0, SECONDS_Y, 6, ui::Align::Left, TFT_YELLOW};
+  ui::NumberField m_seconds{0, SECONDS_Y, 2, 6, TFT_YELLOW};
+  ui::Label m_setLabel{160, 200, 4, ui::Align::Centre, TFT_PINK};
+  ui::Screen<7> m_screen;
+  /// "SET" だけを受け持つ画面。
+  ui::Screen<1> m_setScreen;
+  /// "SET" をバッファへ描いているか否か。
+  bool m_setBuffered = false;
+  /// 表示中のアラーム状態の世代番号。
+  uint32_t m_alarmGeneration = 0;
+
+  /// アニメーションのための数値。
+  uint8_t m_frame = 0;
+
+  /// 時刻表示の各部品を横に並べる。
+  void layoutClock() {
+    m_title.setText("Alarm Clock");
+    m_colonHm.setText(":");
+    m_colonMs.setText(":");
+    m_setLabel.setText("SET");
+    int16_t xpos = 0;
+    m_hours.setPosition(xpos, CLOCK_Y);
+    xpos += m_hours.width(display().canvas());
+    m_colonHm.setPosition(xpos, CLOCK_Y - 8);
+    xpos += display().canvas().textWidth(":", 8);
+    m_minutes.setPosition(xpos, CLOCK_Y);
+    xpos += m_minutes.width(display().canvas());
+    m_colonMs.setPosition(xpos, SECONDS_Y);
+    xpos += display().canvas().textWidth(":", 6);
+    m_seconds.setPosition(xpos, SECONDS_Y);
+  }
+
+  void updateDisplayClock(uint32_t periods) {
+    //処理が遅れた場合も、経過した周期の分だけ一度に進める
+    m_frame += periods;
     // 現在時刻の取得
-    auto now = std::chrono::system_clock::now().time_since_epoch() +
-               std::chrono::hours(9); //< 日本時間: +9h
-    int hh = std::chrono::duration_cast<std::chrono::hours>(now).count() % 24;
-    int mm = std::chrono::duration_cast<std::chrono::minutes>(now).count() % 60;
-    int ss = std::chrono::duration_cast<std::chrono::seconds>(now).count() % 60;
-    int ms =
-        std::chrono::duration_cast<std::chrono::milliseconds>(now).count() %
-        1000;
-    //時刻描画
-    displayClock(clean, hh, mm, ss, ms);
-    //ボタン説明の描画
+    const auto now =
+        sugar::TimeOfDay::fromUtcToJst(std::chrono::system_clock::now())
+            .hms();
+    //時刻の更新
+    m_hours.setValue(now.hour);
+    m_minutes.setValue(now.minute);
+    m_seconds.setValue(now.second);
+    // ":" は 500ms ごとに明暗を切り替える
+    const uint16_t colonColor =
+        now.millisecond < 500 ? TFT_YELLOW : DIM_COLOR;
+    m_colonHm.setColor(colonColor);
+    m_colonMs.setColor(colonColor);
+    //ボタン説明の更新
     const int tMax = 10, height = 3, topY = 200;
-    const int t = frame % tMax;
+    const int t = m_frame % tMax;
     int y; //アニメーションのためのy方向変位
     if (t < tMax / 2) {
       y = topY - t * (t - tMax / 2) / (tMax * tMax / 16 / height) + height;
@@ -87,91 +156,32 @@ protected:
       y = topY + (t - tMax / 2) * (t - tMax) / (tMax * tMax / 16 / height) +
           height;
     }
-    M5.Lcd.setTextColor(TFT_PINK, TFT_BLACK);
-    M5.Lcd.fillRect(42, topY, 160, y - topY, TFT_BLACK); //文字を消す
-    M5.Lcd.drawCentreString(
-        "SET", 160, y,
-        4); //フォントサイズ4で3文字の描画を左ボタンの上にするなら、(42,205)に描画
+    //フォントサイズ4で3文字の描画を左ボタンの上にするなら、(42,205)に描画
+    m_setLabel.setPosition(160, y);
+    //変更のあった部分だけを描画
+    display().render(m_screen);
+    display().render(m_setScreen, m_setBuffered);
   }
 
-  void displayClock(bool clean, int hh, int mm, int ss, int ms) const {
-    //直前に描画を行った分・秒の値。これが現在時刻と異なっていたら描画する。分・秒が絶対に取りえない値で初期化することで、初めてのdrawClock()では描画処理が必ず発生するようにする
-    static byte omm = 99;
-    static byte xcolon = 0, xsecs = 0;
-    // 明るく描画するか
-    static bool lightColon = true; // 500msごとに切り替える
-
-    //文字色設定
-    M5.Lcd.setTextColor(TFT_YELLOW, TFT_BLACK);
-    //描画準備
-    if (clean) {
-      M5.Lcd.clear();
-      M5.Lcd.drawCentreString("Alarm Clock", 160, 0, 8);
-    }
-    //描画位置
-    int xpos = 0;
-    int ypos = 85; // Top left corner ot clock text, about half way down
-    int ysecs = ypos + 24;
-
-    //描画処理
-    //毎分の時間・分の描画（分が変更していれば、時間は変わっていなくても時間を描画しなおす）
-    if (clean || omm != mm) {
-      // ommの更新をし、分の値が変わらないうちは描画処理を行わないようにする
-      omm = mm;
-      //時間の描画、0でいいので2桁目を描画する
-      if (hh < 10) {
-        xpos += M5.Lcd.drawChar('0', xpos, ypos,
-                                8); // Add hours leading zero for 24 hr clock
-      }
-      xpos += M5.Lcd.drawNumber(hh, xpos, ypos, 8); // Draw hours
-      xcolon = xpos; //秒の描画において":"を描画するのに用いる
-      //時間と分の間の":"の描画
-      xpos +=
-          M5.Lcd.drawChar(':', xpos, ypos - 8, 8); //どうせ暗く塗りつぶされる
-      //分の描画、0でいいので2桁目を描画する
-      if (mm < 10) {
-        xpos += M5.Lcd.drawChar('0', xpos, ypos, 8); // Add minutes leading zero
-      }
-      xpos += M5.Lcd.drawNumber(mm, xpos, ypos, 8); // Draw minutes
-      xsecs = xpos; // Sae seconds 'x' position for later display updates
-    }
-    //毎秒の秒の描画
-    if (clean || lightColon != (ms < 500)) {
-      // ossの更新をし、秒の値が変わっていないうちは描画処理を行わないようにする
-      xpos = xsecs;
-      lightColon = (ms < 500);
-      //":"の描画
-      if (!lightColon) {
-        // lightColonを見て：の明るさの描画を決める
-        M5.Lcd.setTextColor(0x39C4, TFT_BLACK); //文字色を暗くする
-        M5.Lcd.drawChar(
-            ':', xcolon, ypos - 8,
-            8); //時間と分の間の":"を暗く描画（分の描画で黄色く描画してても暗い":"で上書きしてしまう）
-        xpos += M5.Lcd.drawChar(':', xsecs, ysecs, 6); //分と秒の間の":"を描画
-        M5.Lcd.setTextColor(TFT_YELLOW, TFT_BLACK); //文字色を黄色に戻す
-      } else {
-        M5.Lcd.drawChar(':', xcolon, ypos - 8,
-                        8); //時間と分の間の":"を明るく描画
-        xpos += M5.Lcd.drawChar(':', xsecs, ysecs, 6); //分と秒の間の":"を描画
-      }
-      //秒の描画、0でいいので2桁目を描画する
-      if (ss < 10) {
-        xpos += M5.Lcd.drawChar('0', xpos, ysecs, 6); // Add leading zero
-      }
-      M5.Lcd.drawNumber(ss, xpos, ysecs, 6); // Draw seconds
+  /// 共有のアラーム状態を読んで表示する。
+  void updateAlarmTime() {
+    const hardware::AlarmSnapshot alarm = m_hardware->alarm().state().load();
+    m_alarmGeneration = alarm.generation;
+    if (alarm.enabled) {
+      DrawAlarmTime(alarm.time);
+    } else {
+      m_alarmTime.setText("");
     }
   }
 
-  // 画面上部にアラーム時刻を描画する関数
-  void DrawAlarmTime(sugar::TimeOfDay time) const {
-    char buf[9] = {'\0'};
+  // 画面上部にアラーム時刻を表示する
+  void DrawAlarmTime(sugar::TimeOfDay time) {
+    char buf[24] = {'\0'};
+    const auto t = time.hms();
     // C++14 なのに `std::snprintf` がない処理系は何をやっても駄目
-    std::sprintf(buf, "%02d:%02d:%02d", time.hour(), time.minute(),
-                 time.second());
-    std::string str = "Alarm Time ";
-    str += buf;
-    // strを描画
-    M5.Lcd.drawCentreString(str.c_str(), 160, 14, 4);
+    std::sprintf(buf, "Alarm Time %02d:%02d:%02d", t.hour, t.minute,
+                 t.second);
+    m_alarmTime.setText(buf);
   }
 };
 
@@ -8,9 +8,11 @@
 
 #pragma once
 
+#include "../alarm_schedule.hpp"
 #include "../hardware/alarm_manager.hpp"
 #include "../hardware/hardware.h"
 #include "../time_of_day.hpp"
+#include "../ui/widget.hpp"
 #include "scene.hpp"
 
 #include <cstdlib>
@@ -28,7 +30,11 @@
 namespace scene {
 
 /// Scene を継承する
-class SceneConfigureAlarm : public Scene {
+class SceneConfigureAlarm final : public Scene {
+public:
+  /// シーンの種類。
+  static constexpr SceneId ID = SceneId::ConfigureAlarm;
+
 private:
   /// カーソル位置。
   enum class Cursor : int {
@@ -38,40 +44,135 @@ private:
     Minute = 1,
     /// 秒
     Second = 2,
+    /// 繰り返し
+    Repeat = 3,
+  };
+  /// カーソル位置の数。
+  static constexpr int CURSOR_COUNT = 4;
+
+  /// 繰り返しの選択肢。
+  struct RepeatOption {
+    /// 鳴らす曜日。 0 なら1回だけ。
+    uint8_t weekdays;
+    /// 表示名。
+    const char *label;
   };
+  static const RepeatOption *repeatOptions() {
+    static const RepeatOption options[] = {
+        {0, "Once"},
+        {sugar::EVERY_DAY, "Every day"},
+        {sugar::WORKDAYS, "Weekdays"},
+        {sugar::WEEKENDS, "Weekends"},
+    };
+    return options;
+  }
+  /// 繰り返しの選択肢の数。
+  static constexpr size_t REPEAT_OPTION_COUNT = 4;
 
   /// アラーム時刻。
   sugar::TimeOfDay m_alarmTime;
   /// カーソル位置。
   Cursor m_cursor;
+  /// 選択中の繰り返しの選択肢。
+  size_t m_repeat = 0;
   /// 時刻設定機構。
   hardware::AlarmTimeSetter m_alarmTimeSetter;
   std::shared_ptr<hardware::Hardware> m_hardware;
 
+  /// 時刻表示の上端。
+  static constexpr int16_t CLOCK_Y = 85;
+  /// 秒表示の上端。
+  static constexpr int16_t SECONDS_Y = CLOCK_Y + 24;
+  /// ボタン上の UI の配置。
+  static constexpr int16_t RECT_Y = 212;
+  static constexpr int16_t RECT_WIDTH = 20;
+  static constexpr int16_t RECT_HEIGHT = 6;
+  static constexpr int16_t LEFT_X = 56;
+  static constexpr int16_t RIGHT_X = 245;
+  /// カーソルと時刻をオフスクリーンバッファに描くか否か。
+  static constexpr bool USE_FRAME_BUFFER = true;
+  /// カーソルと時刻の範囲。
+  const ui::Bounds CLOCK_BAND{0, 66, 320, 120};
+  /// カーソル位置ごとの三角形の配置。 `Cursor` の定義順に並べる。
+  static const ui::TriangleCursor::Slot *cursorSlots() {
+    static const ui::TriangleCursor::Slot slots[] = {
+        {51, 75, 175}, {187, 75, 175}, {285, 100, 155}};
+    return slots;
+  }
+
+  /// 描画先の画面。
+  ui::Display &display() { return m_hardware->display(); }
+  // 一番左は"-"を描画（長方形の描画を用いる）
+  // M5.Lcd.drawChar('-',53,200,6); は正しく表示されるが、なんとなく見づらい
+  ui::FilledRect m_minus{
+      ui::Bounds(LEFT_X, RECT_Y, RECT_WIDTH, RECT_HEIGHT), TFT_PINK};
+  // 中央は"NEXT"を描画
+  ui::Label m_next{130, 205, 4, ui::Align::Left, TFT_PINK};
+  // 一番右は"+"を描画（長方形の描画を用いる）
+  // サイズ6だと+が表示されない、意味わからん……
+  ui::FilledRect m_plusH{
+      ui::Bounds(RIGHT_X, RECT_Y, RECT_WIDTH, RECT_HEIGHT), TFT_PINK};
+  // 上部に繰り返しの設定を描画。選択中は黄色にする
+  ui::Label m_repeatLabel{160, 30, 4, ui::Align::Centre, TFT_PINK};
+  ui::FilledRect m_plusV{
+      ui::Bounds(RIGHT_X + (RECT_WIDTH - RECT_HEIGHT) / 2,
+                 RECT_Y + (RECT_HEIGHT - RECT_WIDTH) / 2, RECT_HEIGHT,
+                 RECT_WIDTH),
+      TFT_PINK};
+  // 今指し示しているものがわかるように、数字の上下に三角形を描画
+  ui::TriangleCursor m_cursorMarker{cursorSlots(), 3, TFT_YELLOW};
+  ui::NumberField m_hours{0, CLOCK_Y, 2, 8, TFT_YELLOW};
+  ui::Label m_colonHm{0, CLOCK_Y - 8, 8, ui::Align::Left, TFT_YELLOW};
+  ui::NumberField m_minutes{0, CLOCK_Y, 2, 8, TFT_YELLOW};
+  ui::Label m_colonMs{0, SECONDS_Y, 6, ui::Align::Left, TFT_YELLOW};
+  ui::NumberField m_seconds{0, SECONDS_Y, 2, 6, TFT_YELLOW};
+  ui::Screen<5> m_screen;
+  /// カーソルと時刻を受け持つ画面。
+  ui::Screen<6> m_clockScreen;
+  /// カーソルと時刻をバッファへ描いているか否か。
+  bool m_clockBuffered = false;
+
 public:
-  SceneConfigureAlarm(hardware::AlarmTimeSetter timeSetter,
-                      std::shared_ptr<hardware::Hardware> &m_hardware)
-      : m_alarmTime{}, m_cursor{Cursor::Hour}, m_alarmTimeSetter{timeSetter},
-        m_hardware{m_hardware} {}
+  SceneConfigureAlarm(std::shared_ptr<hardware::Hardware> &m_hardware)
+      : m_alarmTime{}, m_cursor{Cursor::Hour},
+        m_alarmTimeSetter{m_hardware->alarm().alarmTimeSetter()},
+        m_hardware{m_hardware} {
+    m_screen.add(m_minus);
+    m_screen.add(m_next);
+    m_screen.add(m_plusH);
+    m_screen.add(m_plusV);
+    m_screen.add(m_repeatLabel);
+    m_clockScreen.add(m_cursorMarker);
+    m_clockScreen.add(m_hours);
+    m_clockScreen.add(m_colonHm);
+    m_clockScreen.add(m_minutes);
+    m_clockScreen.add(m_colonMs);
+    m_clockScreen.add(m_seconds);
+  }
 
   /// シーンがスタックのトップに来たとき呼ばれる。
   virtual EventResult activated() override {
     log_i("SceneSetAlarm activated()");
-    // LCDのクリア
-    M5.Lcd.clear();
     // 現在時刻で初期化
     m_alarmTime =
         sugar::TimeOfDay::fromUtcToJst(std::chrono::system_clock::now());
     //その他の初期化
     m_cursor = Cursor::Hour;
-    // ごみを消去
-    M5.Lcd.clear();
+    // ごみを消去して完全再描画
+    display().clear();
+    layoutClock();
+    m_screen.invalidateAll();
+    m_clockScreen.invalidateAll();
+    // カーソルの消去と描画がちらつかないようにバッファへ描く
+    m_clockBuffered =
+        USE_FRAME_BUFFER && display().acquireBuffer(CLOCK_BAND);
+    updateDisplay();
     return EventResultKind::Continue;
   }
 
   /// 定期的に (タイマーイベントごとに) 呼ばれる。
-  virtual EventResult tick() override {
-    // TODO: 時刻が変わったときだけ更新
+  virtual EventResult tick(uint32_t periods) override {
+    // 変更のあったウィジェットだけが描き直される
     updateDisplay();
     return EventResultKind::Continue;
   }
@@ -88,11 +189,12 @@ public:
     // カーソル位置が一周したということなので時刻設定を完了する
     if (m_cursor == Cursor::Hour) {
       // 設定した時間を送信する。
-      m_alarmTimeSetter.setAlarmTime(m_alarmTime);
+      const uint8_t weekdays = repeatOptions()[m_repeat].weekdays;
+      m_alarmTimeSetter.setAlarmTime(m_alarmTime, weekdays);
 
       // TimeOfDay => string変換
       char char_h[3], char_m[3], char_s[3];
-      std::string time_str = "明日は ";
+      std::string time_str = weekdays == 0 ? "明日は " : "これからは ";
       sprintf(char_h, "%d", m_alarmTime.hour());
       sprintf(char_m, "%d", m_alarmTime.minute());
       sprintf(char_s, "%d", m_alarmTime.second());
@@ -115,137 +217,92 @@ public:
     updateDisplay();
     return EventResultKind::Continue;
   }
+  /// 押し続けると加速しながら数値を変える。描画は歩数によらず1回
+  virtual EventResult buttonARepeated(uint16_t steps) override {
+    decrement(steps);
+    updateDisplay();
+    return EventResultKind::Continue;
+  }
+  virtual EventResult buttonCRepeated(uint16_t steps) override {
+    increment(steps);
+    updateDisplay();
+    return EventResultKind::Continue;
+  }
 
 private:
   void moveCursorNext() {
     // 編集箇所を次に進める
-    m_cursor = static_cast<Cursor>((static_cast<int>(m_cursor) + 1) % 3);
+    m_cursor = static_cast<Cursor>((static_cast<int>(m_cursor) + 1) %
+                                   CURSOR_COUNT);
   }
 
-  void increment() {
-    // カーソル位置の桁をインクリメント
+  void increment(uint16_t steps = 1) {
+    // カーソル位置の桁を steps だけインクリメント
     switch (m_cursor) {
     case Cursor::Hour:
-      m_alarmTime += std::chrono::hours(1);
+      m_alarmTime += std::chrono::hours(steps);
       break;
     case Cursor::Minute:
-      m_alarmTime += std::chrono::minutes(1);
+      m_alarmTime += std::chrono::minutes(steps);
       break;
     case Cursor::Second:
-      m_alarmTime += std::chrono::seconds(1);
+      m_alarmTime += std::chrono::seconds(steps);
+      break;
+    case Cursor::Repeat:
+      m_repeat = (m_repeat + steps) % REPEAT_OPTION_COUNT;
       break;
     }
   }
-  void decrement() {
-    //数値をデクリメント
+  void decrement(uint16_t steps = 1) {
+    //数値を steps だけデクリメント
     switch (m_cursor) {
     case Cursor::Hour:
-      m_alarmTime -= std::chrono::hours(1);
+      m_alarmTime -= std::chrono::hours(steps);
       break;
     case Cursor::Minute:
-      m_alarmTime -= std::chrono::minutes(1);
+      m_alarmTime -= std::chrono::minutes(steps);
       break;
     case Cursor::Second:
-      m_alarmTime -= std::chrono::seconds(1);
+      m_alarmTime -= std::chrono::seconds(steps);
       break;
-    }
-  }
-
-  // 画面を更新する
-  void updateDisplay() const {
-    // ボタン上のUIの描画
-    const int32_t rectY = 212;
-    const int32_t width = 20;
-    const int32_t height = 6;
-    const int32_t leftX = 56;
-    const int32_t rightX = 245;
-    // 一番左は"-"を描画（長方形の描画を用いる）
-    M5.Lcd.setTextColor(TFT_PINK, TFT_BLACK);
-    // M5.Lcd.drawChar('-',53,200,6);//<
-    // これは正しく表示されるが、なんとなく見づらい
-    M5.Lcd.fillRect(leftX, rectY, width, height, TFT_PINK);
-    // 中央は"->"を右方向にアニメーションして描画
-    M5.Lcd.setTextColor(TFT_PINK, TFT_BLACK);
-    M5.Lcd.drawString("NEXT", 130, 205, 4);
-    // 一番右は"+"を描画（長方形の描画を用いる）
-    M5.Lcd.setTextColor(TFT_PINK, TFT_BLACK);
-    // M5.Lcd.drawChar('+',250,200,6);//<
-    // サイズ6だと+が表示されない、意味わからん……
-    M5.Lcd.fillRect(rightX, rectY, width, height, TFT_PINK);
-    M5.Lcd.fillRect(rightX + (width - height) / 2, rectY + (height - width) / 2,
-                    height, width, TFT_PINK);
-    // 今指し示しているものがわかるように、数字の上下に三角形の描画
-    static Cursor beforeCursor = Cursor::Second;
-    if (beforeCursor != m_cursor) {
-      // 前フレームで描画していた三角形の描画削除
-      DrawProcessTriangle(beforeCursor, TFT_BLACK);
-      // 今フレームで描画する三角形の描画
-      DrawProcessTriangle(m_cursor, TFT_YELLOW);
-      beforeCursor = m_cursor;
-    }
-
-    // 時刻部分の更新
-    updateDisplayClock();
-  }
-
-  // 現在設定している部分の描画
-  void DrawProcessTriangle(Cursor cursor, uint16_t color) const {
-    // 描画位置の決定
-    int x = -100, y1 = -100, y2 = -100;
-    const int v1x = 5, v1y = 7;
-    const int v2x = 10, v2y = 0;
-    switch (cursor) {
-    case (Cursor::Hour):
-      x = 51;
-      y1 = 75;
-      y2 = 175;
-      break;
-    case (Cursor::Minute):
-      x = 187;
-      y1 = 75;
-      y2 = 175;
-      break;
-    case (Cursor::Second):
-      x = 285;
-      y1 = 100;
-      y2 = 155;
+    case Cursor::Repeat:
+      m_repeat = (m_repeat + REPEAT_OPTION_COUNT - steps % REPEAT_OPTION_COUNT) %
+                 REPEAT_OPTION_COUNT;
       break;
     }
-    //描画
-    M5.Lcd.fillTriangle(x, y1, x + v1x, y1 - v1y, x + v2x, y1 - v2y, color);
-    M5.Lcd.fillTriangle(x, y2, x + v1x, y2 + v1y, x + v2x, y2 + v2y, color);
   }
 
-  // 画面のうち時刻部分を更新する
-  void updateDisplayClock() const {
-    //描画準備
-    //文字色設定
-    M5.Lcd.setTextColor(TFT_YELLOW, TFT_BLACK);
-    //描画位置
-    int xpos = 0;
-    int ypos = 85; // Top left corner ot clock text, about half way down
-    int ysecs = ypos + 24;
-
-    //描画処理
-    //時間の描画、0でいいので2桁目を描画する
-    xpos += drawNumber2Char(m_alarmTime.hour(), xpos, ypos, 8);
-    //時間と分の間の":"の描画
-    xpos += M5.Lcd.drawChar(':', xpos, ypos - 8, 8);
-    //分の描画、0でいいので2桁目を描画する
-    xpos += drawNumber2Char(m_alarmTime.minute(), xpos, ypos, 8);
-    //分と秒の間の":"の描画
-    xpos += M5.Lcd.drawChar(':', xpos, ysecs, 6);
-    //秒の描画、0でいいので2桁目を描画する
-    xpos += drawNumber2Char(m_alarmTime.second(), xpos, ysecs, 6);
+  /// 時刻表示の各部品を横に並べる。
+  void layoutClock() {
+    m_next.setText("NEXT");
+    m_colonHm.setText(":");
+    m_colonMs.setText(":");
+    int16_t xpos = 0;
+    m_hours.setPosition(xpos, CLOCK_Y);
+    xpos += m_hours.width(display().canvas());
+    m_colonHm.setPosition(xpos, CLOCK_Y - 8);
+    xpos += display().canvas().textWidth(":", 8);
+    m_minutes.setPosition(xpos, CLOCK_Y);
+    xpos += m_minutes.width(display().canvas());
+    m_colonMs.setPosition(xpos, SECONDS_Y);
+    xpos += display().canvas().textWidth(":", 6);
+    m_seconds.setPosition(xpos, SECONDS_Y);
   }
-  int drawNumber2Char(uint8_t pal, int x, int y, int font) const {
-    // 2文字で数字の描画(1桁は先頭に0をつけて描画する)
-    int dx = 0; //文字列描画の横幅
-    if (pal < 10) {
-      dx += M5.Lcd.drawChar('0', x, y, font);
-    }
-    dx += M5.Lcd.drawNumber(pal, x + dx, y, font);
-    return dx;
+
+  // 画面を更新する
+  void updateDisplay() {
+    // 繰り返しの選択中は三角形を消し、文字色で示す
+    m_cursorMarker.select(static_cast<size_t>(m_cursor));
+    m_repeatLabel.setText(repeatOptions()[m_repeat].label);
+    m_repeatLabel.setColor(m_cursor == Cursor::Repeat ? TFT_YELLOW
+                                                       : TFT_PINK);
+    const auto t = m_alarmTime.hms();
+    m_hours.setValue(t.hour);
+    m_minutes.setValue(t.minute);
+    m_seconds.setValue(t.second);
+    //変更のあった部分だけを描画
+    display().render(m_screen);
+    display().render(m_clockScreen, m_clockBuffered);
   }
 };
 
@@ -0,0 +1,83 @@
+/**
+ * @file scene_graph.hpp
+ * @brief シーンの一覧と許可された遷移をコンパイル時に宣言する
+ */
+#pragma once
+#ifndef _INCLUDE_SCENE_GRAPH_HPP_
+#define _INCLUDE_SCENE_GRAPH_HPP_
+
+#include <cstddef>
+
+#include "event.hpp"
+#include "scene_alarming.hpp"
+#include "scene_boot.hpp"
+#include "scene_clock.hpp"
+#include "scene_configure_alarm.hpp"
+#include "scene_stack.hpp"
+
+namespace scene {
+/// シーンスタックの最大の深さ。
+///
+/// 時計 → アラーム設定 → アラーム鳴動 の3段に、設定中のアラーム再発火の
+/// 余裕を1段加えたもの。
+constexpr size_t SCENE_STACK_DEPTH = 4;
+
+/// シーンスタックの実装。
+///
+/// 既定ではシーンを静的な領域に直接構築する。
+/// `SCENE_USE_DYNAMIC_STACK` を定義すると従来通りヒープ上に生成する。
+#ifdef SCENE_USE_DYNAMIC_STACK
+using SceneStack = DynamicSceneStack<SceneBoot, SceneClock,
+                                     SceneConfigureAlarm, SceneAlarming>;
+#else
+using SceneStack = StaticSceneStack<SCENE_STACK_DEPTH, SceneBoot, SceneClock,
+                                    SceneConfigureAlarm, SceneAlarming>;
+#endif
+
+/// シーン遷移。
+struct SceneTransition {
+  /// 遷移元のシーン。
+  SceneId from;
+  /// 遷移の種類。
+  EventResultKind kind;
+  /// 遷移先のシーン。
+  SceneId to;
+};
+
+/// 許可されたシーン遷移の一覧。
+///
+/// `Finish` はどのシーンからも許可されるのでここには書かない。
+/// アラーム発火時の `SceneAlarming` への遷移はマネージャが強制するもの
+/// なので、どのシーンからも許可される。
+constexpr SceneTransition SCENE_TRANSITIONS[] = {
+    {SceneId::Boot, EventResultKind::ReplaceScene, SceneId::Clock},
+    {SceneId::Clock, EventResultKind::PushScene, SceneId::ConfigureAlarm},
+};
+
+/// シーン遷移が許可されているかどうかを返す。
+constexpr bool isTransitionAllowed(SceneId from, EventResultKind kind,
+                                   SceneId to) {
+  if (kind == EventResultKind::Continue || kind == EventResultKind::Finish) {
+    return true;
+  }
+  if (kind == EventResultKind::PushScene && to == SceneId::Alarming) {
+    return true;
+  }
+  for (const auto &t : SCENE_TRANSITIONS) {
+    if (t.from == from && t.kind == kind && t.to == to) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static_assert(isTransitionAllowed(SceneId::Boot, EventResultKind::ReplaceScene,
+                                  SceneId::Clock),
+              "Boot must be able to hand over to Clock");
+static_assert(!isTransitionAllowed(SceneId::ConfigureAlarm,
+                                   EventResultKind::PushScene,
+                                   SceneId::ConfigureAlarm),
+              "ConfigureAlarm must not nest itself");
+} // namespace scene
+
+#endif
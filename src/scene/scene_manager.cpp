@@ -1,54 +1,87 @@
-#include <memory>
-#include <utility>
+#include <esp_timer.h>
 
-#include "scene_alarming.hpp"
 #include "scene_manager.hpp"
 
 namespace scene {
-size_t SceneManager::processExternalEvents() {
-  size_t num_msgs = uxQueueMessagesWaiting(m_eventReceiver);
-  if (num_msgs > 0) {
-    log_d("SceneManager::processExternalEvent: %zd events to be processed",
-          num_msgs);
+size_t SceneManager::processExternalEvents(TickType_t timeout) {
+  // Block until the first event arrives (or the timeout expires).
+  int64_t waitStart = esp_timer_get_time();
+  bool received = m_lanes.wait(timeout);
+  m_blockedMicros += esp_timer_get_time() - waitStart;
+  serviceProfileRequest();
+  if (!received) {
+    return 0;
   }
+
+  size_t num_msgs = 1 + m_lanes.pending();
+  log_d("SceneManager::processExternalEvent: %zd events to be processed",
+        num_msgs);
   for (size_t i = 0; i < num_msgs; ++i) {
-    Event *qi;
     // This will not block so long, because there should be at least one
     // message rest.
-    xQueueReceive(m_eventReceiver, &qi, portMAX_DELAY);
-    // The item should be created by `new Event(foobar)`,
-    // so that it can be safely `delete`d.
-    auto ev = std::unique_ptr<Event>{qi};
-
-    bool isAlarmEvent = false;
-    {
-      // Pass the event to the top (currently active) scene.
-      auto &currentScene = *m_scenes.back();
-      switch (ev->kind()) {
-      case EventKind::Tick:
-        updateStack(currentScene.tick());
-        break;
-      case EventKind::Button: {
-        auto bte = ev->buttonData();
-        updateStack(currentScene.buttonEventReceived(bte->button, bte->kind));
-      } break;
-      case EventKind::Alarm:
-        // 一応送信しておく。何かに使うかもしれないし。
-        updateStack(currentScene.alarm());
-        // アラーム画面を強制的に有効化するのは、各シーンでなくマネージャの
-        // 責任とする。
-        // ここで `m_scenes.push_back()` すると、 `currentScene` が dangling
-        // してしまうのでアカン
-        isAlarmEvent = true;
-        break;
-      }
-    }
-    if (isAlarmEvent) {
-      auto alarmScene = std::unique_ptr<Scene>(new SceneAlarming(m_hardware));
-      pushScene(std::move(alarmScene));
+    if (i != 0) {
+      m_lanes.wait(portMAX_DELAY);
     }
+    // The highest-priority event is picked each time, so an alarm that
+    // arrives in the middle of a backlog is handled next.
+    dispatchEvent(m_lanes.receive());
   }
 
   return num_msgs;
 }
+
+void SceneManager::dispatchEvent(const Event &ev) {
+  // Pass the event to the top (currently active) scene.
+  switch (ev.kind()) {
+  case EventKind::Tick: {
+    // 合流された周期数をまとめて渡す
+    uint32_t periods = m_lanes.tickCoalescer().take();
+    // 直前の Tick に先取りされていた場合は何もしない
+    if (periods != 0) {
+      updateStack(
+          visitTopTimed(HandlerKind::Tick, [periods](auto &scene) {
+            return scene.tick(periods);
+          }));
+    }
+  } break;
+  case EventKind::Button: {
+    auto bte = ev.buttonData();
+    updateStack(visitTopTimed(HandlerKind::Button, [bte](auto &scene) {
+      return scene.buttonEventReceived(bte);
+    }));
+  } break;
+  case EventKind::Alarm:
+    // 一応送信しておく。何かに使うかもしれないし。
+    updateStack(visitTopTimed(HandlerKind::Alarm,
+                              [](auto &scene) { return scene.alarm(); }));
+    // アラーム画面を強制的に有効化するのは、各シーンでなくマネージャの
+    // 責任とする。既にアラーム画面なら積み直さない。
+    updateStack(EventResult(EventResultKind::PushScene, SceneId::Alarming));
+    break;
+  }
+}
+
+void SceneManager::task() {
+  const TickType_t timeout =
+      m_taskConfig.waitTimeoutMillis / portTICK_PERIOD_MS;
+  const int64_t windowMicros =
+      static_cast<int64_t>(m_taskConfig.idleWindowMillis) * 1000;
+  int64_t windowStart = esp_timer_get_time();
+  m_blockedMicros = 0;
+  while (1) {
+    size_t numEventsProcessed = processExternalEvents(timeout);
+    if (numEventsProcessed != 0) {
+      log_d("Processed %zd external events by scene manager",
+            numEventsProcessed);
+    }
+    // アイドル率の計測窓を更新
+    int64_t elapsed = esp_timer_get_time() - windowStart;
+    if (elapsed >= windowMicros) {
+      m_idlePermille = static_cast<uint32_t>(m_blockedMicros * 1000 / elapsed);
+      m_blockedMicros = 0;
+      windowStart += elapsed;
+    }
+  }
+  vTaskDelete(NULL);
+}
 } // namespace scene
@@ -9,118 +9,249 @@
 #ifdef max
 #undef max
 #endif
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
 #include <stdexcept>
 #include <utility>
-#include <vector>
 
 #include <esp32-hal-log.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
-#include <freertos/queue.h>
+#include <freertos/task.h>
 
 #include "../hardware/button.h"
 #include "../hardware/button_manager.h"
 #include "../hardware/hardware.h"
+#include "../task_registry.hpp"
+#include "event_lanes.hpp"
 #include "scene.hpp"
+#include "scene_graph.hpp"
+#include "scene_profiler.hpp"
 
 using hardware::ButtonEvent;
 
 namespace scene {
+class SceneEventSender;
+
 /// シーン管理機構。
 class SceneManager {
 private:
   /// シーンのスタック。
-  std::vector<std::unique_ptr<Scene>> m_scenes;
+  SceneStack m_scenes;
   /// ハードウェア状態の参照。
   std::shared_ptr<hardware::Hardware> m_hardware;
-  /// `SceneManager` への(外部から送られてくる)イベントを受信するためのキュー。
-  QueueHandle_t m_eventReceiver;
+  /// `SceneManager` への(外部から送られてくる)イベントを受信するレーン群。
+  EventLanes m_lanes;
+  /// イベント待ちでブロックしていた累積時間 [us]。
+  int64_t m_blockedMicros = 0;
+  /// 直近の計測窓におけるアイドル率 [permille]。
+  std::atomic<uint32_t> m_idlePermille{0};
+  /// トップのシーン。他のタスクから読むための写し。
+  std::atomic<SceneId> m_currentScene{SceneId::Boot};
+  /// シーンのハンドラの処理時間。
+  SceneProfiler m_profiler;
+  /// 処理時間の出力を要求されているか否か。
+  std::atomic<bool> m_profileDumpRequested{false};
+  /// 出力後に処理時間の記録を消すか否か。
+  std::atomic<bool> m_profileResetRequested{false};
 
 public:
+  /// 専用タスクで動かすときの設定。
+  struct TaskConfig {
+    /// タスクの優先度。
+    UBaseType_t priority = 1;
+    /// タスクを固定するコア番号。
+    BaseType_t coreId = 1;
+    /// イベント待ちのタイムアウト [ms]。
+    uint32_t waitTimeoutMillis = 1000;
+    /// アイドル率の計測窓 [ms]。
+    uint32_t idleWindowMillis = 1000;
+  };
+
   /// シーン管理機構を初期化。
   void initialize(const std::shared_ptr<hardware::Hardware> &hardware,
-                  QueueHandle_t event_receiver,
-                  std::unique_ptr<Scene> initial_scene) {
+                  SceneId initial_scene) {
     // ハードウェア管理機構を記憶する。
     m_hardware = hardware;
-    // 外部イベント受信キューを記憶する。
-    m_eventReceiver = event_receiver;
+    // 外部イベント受信レーンを作成する。
+    m_lanes.begin();
     // 初期シーンを追加
-    m_scenes.push_back(std::move(initial_scene));
+    m_scenes.push(initial_scene, m_hardware);
+    m_currentScene = initial_scene;
     // 初期シーンを始動
-    updateStack(m_scenes.back()->activated());
+    updateStack(activateTop());
   }
 
-  /// 外部イベント受信キューの内容物をいくつか処理する。
+  /// 外部イベント受信レーンの内容物をいくつか処理する。
   ///
-  /// この関数を呼び出した時点でキューに溜まっていたイベントが処理される。
+  /// 最初のイベントが届くまで最大 `timeout` だけブロックし、その時点で
+  /// レーンに溜まっていたイベントを処理する。
+  /// イベントは1つ取り出すごとに優先度の高いレーンから選ばれるので、
+  /// アラームイベントはボタンや Tick の滞留を待たずに処理される。
+  /// `timeout` が 0 なら従来通りブロックせずに戻る。
   ///
   /// 処理されたイベントの個数を返す。
-  size_t processExternalEvents();
+  size_t processExternalEvents(TickType_t timeout = 0);
+
+  /// シーン管理機構を専用の FreeRTOS タスクとして起動する。
+  ///
+  /// 以降 `processExternalEvents()` はそのタスクからのみ呼ばれるので、
+  /// `loop()` から呼んではならない。
+  void beginTask() { beginTask(TaskConfig{}); }
+  /// シーン管理機構を専用の FreeRTOS タスクとして起動する。
+  void beginTask(const TaskConfig &config) {
+    m_taskConfig = config;
+    const uint32_t stackSize = 8192;
+    sugar::TaskRegistry::instance().create(
+        [](void *this_obj) { static_cast<SceneManager *>(this_obj)->task(); },
+        "SceneManager", stackSize, this, config.priority, NULL,
+        config.coreId);
+  }
+
+  /// `SceneManager` へイベントを送信するための送信器を返す。
+  SceneEventSender eventSender();
+
+  /// トップのシーンの種類を返す。どのタスクから呼んでもよい。
+  SceneId currentScene() const { return m_currentScene; }
+
+  /// 専用タスクのアイドル率を返す。
+  ///
+  /// 直近の計測窓のうち、イベント待ちでブロックしていた時間の割合
+  /// [permille]。専用タスクで動いていない場合は 0 を返す。
+  uint32_t idlePermille() const { return m_idlePermille; }
+
+  /// シーンのハンドラの処理時間の出力を要求する。
+  ///
+  /// 集計はシーン管理機構のタスクが持っているので、出力は次にそのタスクが
+  /// 起きたとき (遅くとも `waitTimeoutMillis` 後) に行われる。
+  /// `reset` なら出力後に記録を消す。
+  void requestProfileDump(bool reset = false) {
+    m_profileResetRequested = reset;
+    m_profileDumpRequested = true;
+  }
+
+  /// イベントレーンの統計情報を返す。
+  EventLaneStats laneStats(EventLane lane) const {
+    return m_lanes.stats(lane);
+  }
 
 private:
+  /// 専用タスクの設定。
+  TaskConfig m_taskConfig;
+
+  /// FreeRTOS によって実行される関数。
+  void task();
+
+  /// イベントを1つ現在のシーンへ渡す。
+  void dispatchEvent(const Event &ev);
+
+  /// 要求されていれば処理時間を出力する。
+  void serviceProfileRequest() {
+    if (!m_profileDumpRequested.exchange(false)) {
+      return;
+    }
+    m_profiler.dump();
+    if (m_profileResetRequested.exchange(false)) {
+      m_profiler.reset();
+    }
+  }
+
+  /// トップのシーンのハンドラを呼び、処理時間を記録する。
+  template <typename Visitor>
+  EventResult visitTopTimed(HandlerKind kind, Visitor &&visitor) {
+    const SceneId id = m_scenes.topId();
+    const int64_t start = esp_timer_get_time();
+    EventResult result = m_scenes.visitTop(std::forward<Visitor>(visitor));
+    m_profiler.record(id, kind,
+                      static_cast<uint32_t>(esp_timer_get_time() - start));
+    return result;
+  }
+
   /// シーンのイベント処理結果を受けてスタックを更新する。
+  ///
+  /// 新たにトップに来たシーンの `activated()` の結果も続けて処理する。
+  /// トップと同じシーンを積む要求は何もしない。
   void updateStack(EventResult result) {
-    switch (result.kind) {
-    case EventResultKind::Continue:
-      // Do nothing.
-      break;
-    case EventResultKind::Finish:
-      m_scenes.pop_back();
-      updateStack(m_scenes.back()->activated());
-      break;
-    case EventResultKind::PushScene: {
-      std::unique_ptr<Scene> scene(static_cast<Scene *>(result.data));
-      pushScene(std::move(scene));
-    } break;
-    case EventResultKind::ReplaceScene: {
-      std::unique_ptr<Scene> scene(static_cast<Scene *>(result.data));
-      m_scenes.pop_back();
-      pushScene(std::move(scene));
-    } break;
+    while (result.kind != EventResultKind::Continue) {
+      const SceneId from = m_scenes.topId();
+      if (result.kind == EventResultKind::PushScene && result.scene == from) {
+        // アラームが続けて届いても、アラーム画面を積み重ねてスタックを
+        // 溢れさせない
+        return;
+      }
+      if (!isTransitionAllowed(from, result.kind, result.scene)) {
+        log_e("SceneManager: transition %d -> %d (%d) is not allowed",
+              static_cast<int>(from), static_cast<int>(result.scene),
+              static_cast<int>(result.kind));
+        return;
+      }
+      switch (result.kind) {
+      case EventResultKind::Continue:
+        break;
+      case EventResultKind::Finish:
+        m_scenes.pop();
+        break;
+      case EventResultKind::PushScene:
+        if (!m_scenes.push(result.scene, m_hardware)) {
+          log_e("SceneManager: failed to push scene %d",
+                static_cast<int>(result.scene));
+          return;
+        }
+        break;
+      case EventResultKind::ReplaceScene:
+        m_scenes.pop();
+        m_scenes.push(result.scene, m_hardware);
+        break;
+      }
+      m_currentScene = m_scenes.topId();
+      result = activateTop();
     }
   }
-  /// シーンをスタックに追加する。
-  void pushScene(std::unique_ptr<Scene> scene) {
-    m_scenes.push_back(std::move(scene));
-    updateStack(m_scenes.back()->activated());
+
+  /// トップのシーンの `activated()` を呼ぶ。
+  EventResult activateTop() {
+    return visitTopTimed(HandlerKind::Activated,
+                         [](auto &scene) { return scene.activated(); });
   }
 };
 
 /// `SceneManager` へイベントを送信するための送信器。
 class SceneEventSender {
 private:
-  QueueHandle_t m_queue;
+  EventLanes *m_lanes = nullptr;
 
 public:
   SceneEventSender() = default;
-  SceneEventSender(QueueHandle_t q) : m_queue{q} {}
+  SceneEventSender(EventLanes *lanes) : m_lanes{lanes} {}
 
   /// 生イベントを送信する。
-  void send(std::unique_ptr<Event> ev) {
-    Event *p = ev.release();
-    xQueueSendToBack(m_queue, &p, 0);
-  }
+  ///
+  /// イベントは値として種類に対応するレーンへコピーされるため、
+  /// ヒープ確保は発生しない。
+  bool send(const Event &ev) { return m_lanes->send(ev); }
 
   /// Tick イベントを送信する。
+  ///
+  /// 未処理の Tick イベントが既にキューにあれば、周期数を数えるだけで
+  /// 新たには積まない。
   void tick() {
-    auto ev = std::make_unique<Event>(EventKind::Tick);
-    send(std::move(ev));
+    auto &coalescer = m_lanes->tickCoalescer();
+    if (coalescer.post() && !send(Event{EventKind::Tick})) {
+      coalescer.cancel();
+    }
   }
 
   /// Button イベントを送信する。
-  void button(ButtonEvent bte) {
-    auto ev = std::make_unique<Event>(
-        EventKind::Button, std::make_unique<ButtonEvent>(bte).release());
-    send(std::move(ev));
-  }
+  void button(ButtonEvent bte) { send(Event{bte}); }
 
   /// Alarm イベントを送信する。
-  void alarm() {
-    auto ev = std::make_unique<Event>(EventKind::Alarm);
-    send(std::move(ev));
-  }
+  void alarm() { send(Event{EventKind::Alarm}); }
 };
+
+inline SceneEventSender SceneManager::eventSender() {
+  return SceneEventSender(&m_lanes);
+}
 } // namespace scene
 
 #endif
@@ -0,0 +1,191 @@
+/**
+ * @file scene_profiler.hpp
+ * @brief シーンのイベント処理にかかった時間を集計するクラスを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_SCENE_PROFILER_HPP_
+#define _INCLUDE_SCENE_PROFILER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <esp32-hal-log.h>
+
+#include "event.hpp"
+
+namespace scene {
+/// 処理時間のヒストグラム。
+///
+/// ビンは 2 の冪ごとに 4 分割した対数スケールで、 0 ~ 4 us は 1 us 刻み、
+/// それ以上は相対誤差 25% 以内で集計する。 4 s 以上は最後のビンに入る。
+/// 大きさは固定で、記録時にヒープ確保は発生しない。
+class LatencyHistogram {
+public:
+  /// ビンの数。
+  static constexpr size_t BUCKET_COUNT = 84;
+
+  /// `micros` が入るビンの番号を返す。
+  static constexpr size_t bucketOf(uint32_t micros) {
+    return micros < 4 ? micros
+                      : micros >= (uint32_t(1) << 22)
+                            ? BUCKET_COUNT - 1
+                            : (msbOf(micros) - 1) * 4 +
+                                  ((micros >> (msbOf(micros) - 2)) & 3);
+  }
+  /// ビン `i` に入る最小の値を返す。
+  static constexpr uint32_t bucketLower(size_t i) {
+    return i < 4 ? i : (4 + i % 4) << (i / 4 - 1);
+  }
+  /// ビン `i` に入る最大の値を返す。
+  static constexpr uint32_t bucketUpper(size_t i) {
+    return i + 1 < BUCKET_COUNT ? bucketLower(i + 1) - 1 : UINT32_MAX;
+  }
+
+  /// 処理時間を記録する。
+  void record(uint32_t micros) {
+    m_buckets[bucketOf(micros)]++;
+    if (m_count == 0 || micros < m_min) {
+      m_min = micros;
+    }
+    if (micros > m_max) {
+      m_max = micros;
+    }
+    m_sum += micros;
+    m_count++;
+  }
+
+  /// 記録をすべて消す。
+  void reset() { *this = LatencyHistogram{}; }
+
+  /// 記録した回数を返す。
+  uint32_t count() const { return m_count; }
+  /// 最小値 [us] を返す。
+  uint32_t min() const { return m_min; }
+  /// 最大値 [us] を返す。
+  uint32_t max() const { return m_max; }
+  /// 平均値 [us] を返す。
+  uint32_t average() const {
+    return m_count == 0 ? 0 : static_cast<uint32_t>(m_sum / m_count);
+  }
+
+  /// `permille` パーセンタイル値 [us] を返す。
+  ///
+  /// 該当するビンの上端を返すので、実際の値より最大 25% 大きくなる。
+  uint32_t percentile(uint32_t permille) const {
+    if (m_count == 0) {
+      return 0;
+    }
+    // 切り上げで順位を求める
+    const uint64_t rank = (uint64_t(m_count) * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+      seen += m_buckets[i];
+      if (seen >= rank) {
+        return bucketUpper(i) < m_max ? bucketUpper(i) : m_max;
+      }
+    }
+    return m_max;
+  }
+
+  /// `micros` を超えたと確実に言える回数を返す。
+  ///
+  /// `micros` を含むビンは数えないので、少なめに見積もる。
+  uint32_t countAbove(uint32_t micros) const {
+    uint32_t n = 0;
+    for (size_t i = bucketOf(micros) + 1; i < BUCKET_COUNT; ++i) {
+      n += m_buckets[i];
+    }
+    return n;
+  }
+
+private:
+  uint32_t m_buckets[BUCKET_COUNT] = {};
+  uint32_t m_count = 0;
+  uint32_t m_min = 0;
+  uint32_t m_max = 0;
+  uint64_t m_sum = 0;
+
+  /// 最上位ビットの位置を返す。
+  static constexpr uint32_t msbOf(uint32_t v) { return 31 - __builtin_clz(v); }
+};
+static_assert(LatencyHistogram::bucketOf(3) == 3, "");
+static_assert(LatencyHistogram::bucketOf(4) == 4, "");
+static_assert(LatencyHistogram::bucketOf(7) == 7, "");
+static_assert(LatencyHistogram::bucketOf(8) == 8, "");
+static_assert(LatencyHistogram::bucketOf(100000) ==
+                  LatencyHistogram::bucketOf(
+                      LatencyHistogram::bucketLower(
+                          LatencyHistogram::bucketOf(100000))),
+              "");
+static_assert(LatencyHistogram::bucketOf((uint32_t(1) << 22) - 1) ==
+                  LatencyHistogram::BUCKET_COUNT - 1,
+              "the last bucket must cover the clamp boundary");
+
+/// シーンのハンドラの種類。
+enum class HandlerKind : uint8_t {
+  /// `Scene::activated()`
+  Activated,
+  /// `Scene::tick()`
+  Tick,
+  /// `Scene::buttonEventReceived()`
+  Button,
+  /// `Scene::alarm()`
+  Alarm,
+};
+/// シーンのハンドラの種類の数。
+constexpr size_t HANDLER_KIND_COUNT = 4;
+
+/// シーンごと、ハンドラの種類ごとの処理時間の集計。
+///
+/// シーン管理機構のタスクからのみ記録・出力すること。
+class SceneProfiler {
+private:
+  LatencyHistogram m_histograms[SCENE_ID_COUNT][HANDLER_KIND_COUNT];
+
+public:
+  /// Tick の処理時間の予算 [us]。
+  static constexpr uint32_t TICK_BUDGET_MICROS = 100000;
+
+  /// 処理時間を記録する。
+  void record(SceneId scene, HandlerKind kind, uint32_t micros) {
+    histogram(scene, kind).record(micros);
+  }
+
+  /// ヒストグラムを返す。
+  LatencyHistogram &histogram(SceneId scene, HandlerKind kind) {
+    return m_histograms[static_cast<size_t>(scene)]
+                       [static_cast<size_t>(kind)];
+  }
+
+  /// 記録をすべて消す。
+  void reset() {
+    for (auto &row : m_histograms) {
+      for (auto &h : row) {
+        h.reset();
+      }
+    }
+  }
+
+  /// 記録のあるヒストグラムをシリアルへ出力する。
+  void dump() {
+    static const char *const kindNames[HANDLER_KIND_COUNT] = {
+        "activated", "tick", "button", "alarm"};
+    log_i("%-14s %-9s %7s %8s %8s %8s %8s %6s", "scene", "handler", "count",
+          "min", "avg", "p99", "max", ">budget");
+    for (size_t s = 0; s < SCENE_ID_COUNT; ++s) {
+      for (size_t k = 0; k < HANDLER_KIND_COUNT; ++k) {
+        const LatencyHistogram &h = m_histograms[s][k];
+        if (h.count() == 0) {
+          continue;
+        }
+        log_i("%-14s %-9s %7u %8u %8u %8u %8u %6u",
+              sceneIdName(static_cast<SceneId>(s)), kindNames[k], h.count(),
+              h.min(), h.average(), h.percentile(990), h.max(),
+              h.countAbove(TICK_BUDGET_MICROS));
+      }
+    }
+  }
+};
+} // namespace scene
+
+#endif
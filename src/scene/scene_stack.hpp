@@ -0,0 +1,243 @@
+#pragma once
+#ifndef _INCLUDE_SCENE_STACK_HPP_
+#define _INCLUDE_SCENE_STACK_HPP_
+
+// コンパイルエラーを防ぐため， Arduino.h で定義されているマクロをundef
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "event.hpp"
+#include "scene.hpp"
+
+namespace hardware {
+// 参照を受け渡すだけなので、定義は読み込まない
+class Hardware;
+} // namespace hardware
+
+namespace scene {
+namespace detail {
+/// 引数の最大値を返す。
+constexpr size_t maxOf(size_t v) { return v; }
+template <typename... Rest>
+constexpr size_t maxOf(size_t v, size_t w, Rest... rest) {
+  return maxOf(v > w ? v : w, rest...);
+}
+
+/// `Id` が `Scenes` のいずれの `ID` とも異なるかどうか。
+template <SceneId Id, typename... Scenes> struct IdNotIn : std::true_type {};
+template <SceneId Id, typename T, typename... Rest>
+struct IdNotIn<Id, T, Rest...>
+    : std::integral_constant<bool,
+                             Id != T::ID && IdNotIn<Id, Rest...>::value> {};
+
+/// `Scenes` の `ID` がすべて異なるかどうか。
+template <typename... Scenes> struct UniqueIds : std::true_type {};
+template <typename T, typename... Rest>
+struct UniqueIds<T, Rest...>
+    : std::integral_constant<bool, IdNotIn<T::ID, Rest...>::value &&
+                                       UniqueIds<Rest...>::value> {};
+} // namespace detail
+
+/// シーンの型の一覧から、 `SceneId` に応じてシーンを生成・破棄・呼び出す。
+///
+/// 各シーンの型は `static constexpr SceneId ID` を持ち、
+/// `std::shared_ptr<hardware::Hardware> &` から構築できること。
+template <typename... Scenes> struct SceneTypeList {
+  static_assert(detail::UniqueIds<Scenes...>::value,
+                "each scene in SceneTypeList must have a distinct ID");
+
+  /// `id` のシーンを `p` に構築する。
+  ///
+  /// `id` が一覧になければ何もせず `false` を返す。
+  static bool construct(SceneId id, void *p,
+                        std::shared_ptr<hardware::Hardware> &hardware) {
+    return constructImpl<Scenes...>(id, p, hardware);
+  }
+
+  /// `id` のシーンをヒープ上に生成する。
+  static std::unique_ptr<Scene>
+  create(SceneId id, std::shared_ptr<hardware::Hardware> &hardware) {
+    return createImpl<Scenes...>(id, hardware);
+  }
+
+  /// `p` にある `id` のシーンを破棄する。
+  static void destroy(SceneId id, void *p) { destroyImpl<Scenes...>(id, p); }
+
+  /// `p` にある `id` のシーンを具象型のまま `f` に渡す。
+  ///
+  /// シーンの型は `final` なので、 `f` の中の呼び出しは仮想関数呼び出しに
+  /// ならない。
+  template <typename F> static EventResult visit(SceneId id, void *p, F &f) {
+    return visitImpl<F, Scenes...>(id, p, f);
+  }
+
+private:
+  template <typename... None>
+  static typename std::enable_if<sizeof...(None) == 0, bool>::type
+  constructImpl(SceneId, void *, std::shared_ptr<hardware::Hardware> &) {
+    return false;
+  }
+  template <typename T, typename... Rest>
+  static bool constructImpl(SceneId id, void *p,
+                            std::shared_ptr<hardware::Hardware> &hardware) {
+    if (id == T::ID) {
+      new (p) T(hardware);
+      return true;
+    }
+    return constructImpl<Rest...>(id, p, hardware);
+  }
+
+  template <typename... None>
+  static typename std::enable_if<sizeof...(None) == 0,
+                                 std::unique_ptr<Scene>>::type
+  createImpl(SceneId, std::shared_ptr<hardware::Hardware> &) {
+    return nullptr;
+  }
+  template <typename T, typename... Rest>
+  static std::unique_ptr<Scene>
+  createImpl(SceneId id, std::shared_ptr<hardware::Hardware> &hardware) {
+    if (id == T::ID) {
+      return std::unique_ptr<Scene>(new T(hardware));
+    }
+    return createImpl<Rest...>(id, hardware);
+  }
+
+  template <typename... None>
+  static typename std::enable_if<sizeof...(None) == 0>::type
+  destroyImpl(SceneId, void *) {}
+  template <typename T, typename... Rest>
+  static void destroyImpl(SceneId id, void *p) {
+    if (id == T::ID) {
+      static_cast<T *>(p)->~T();
+      return;
+    }
+    destroyImpl<Rest...>(id, p);
+  }
+
+  template <typename F, typename... None>
+  static typename std::enable_if<sizeof...(None) == 0, EventResult>::type
+  visitImpl(SceneId, void *, F &) {
+    // Should never come here.
+    return EventResultKind::Continue;
+  }
+  template <typename F, typename T, typename... Rest>
+  static EventResult visitImpl(SceneId id, void *p, F &f) {
+    if (id == T::ID) {
+      return f(*static_cast<T *>(p));
+    }
+    return visitImpl<F, Rest...>(id, p, f);
+  }
+};
+
+/// 静的な領域にシーンを直接構築するシーンスタック。
+///
+/// 各段は全シーンのうち最大のものが入る大きさの領域を持ち、
+/// シーンはそこへ placement new される。
+/// ヒープを使わないのでメモリ使用量は `Depth` だけで決まる。
+template <size_t Depth, typename... Scenes> class StaticSceneStack {
+private:
+  using Types = SceneTypeList<Scenes...>;
+  /// 1段の大きさ。
+  static constexpr size_t SLOT_SIZE = detail::maxOf(sizeof(Scenes)...);
+  /// 1段のアラインメント。
+  static constexpr size_t SLOT_ALIGN = detail::maxOf(alignof(Scenes)...);
+  using Slot = typename std::aligned_storage<SLOT_SIZE, SLOT_ALIGN>::type;
+
+  /// シーンを構築する領域。
+  Slot m_slots[Depth];
+  /// 各段のシーンの種類。
+  SceneId m_ids[Depth];
+  /// 積まれているシーンの数。
+  size_t m_size = 0;
+
+public:
+  StaticSceneStack() = default;
+  StaticSceneStack(const StaticSceneStack &) = delete;
+  StaticSceneStack &operator=(const StaticSceneStack &) = delete;
+  ~StaticSceneStack() {
+    while (!empty()) {
+      pop();
+    }
+  }
+
+  /// シーンが1つも積まれていなければ `true` を返す。
+  bool empty() const { return m_size == 0; }
+
+  /// トップのシーンの種類を返す。
+  SceneId topId() const { return m_ids[m_size - 1]; }
+
+  /// シーンを構築して積む。
+  ///
+  /// スタックが一杯であれば何もせず `false` を返す。
+  bool push(SceneId id, std::shared_ptr<hardware::Hardware> &hardware) {
+    if (m_size >= Depth) {
+      return false;
+    }
+    if (!Types::construct(id, &m_slots[m_size], hardware)) {
+      return false;
+    }
+    m_ids[m_size] = id;
+    ++m_size;
+    return true;
+  }
+
+  /// トップのシーンを破棄する。
+  void pop() {
+    --m_size;
+    Types::destroy(m_ids[m_size], &m_slots[m_size]);
+  }
+
+  /// トップのシーンを具象型のまま `f` に渡す。
+  template <typename F> EventResult visitTop(F &&f) {
+    return Types::visit(m_ids[m_size - 1], &m_slots[m_size - 1], f);
+  }
+};
+
+/// ヒープ上にシーンを生成するシーンスタック。
+///
+/// 深さに制限はないが、遷移のたびにヒープ確保が発生する。
+template <typename... Scenes> class DynamicSceneStack {
+private:
+  using Types = SceneTypeList<Scenes...>;
+
+  /// シーンのスタック。
+  std::vector<std::pair<SceneId, std::unique_ptr<Scene>>> m_scenes;
+
+public:
+  /// シーンが1つも積まれていなければ `true` を返す。
+  bool empty() const { return m_scenes.empty(); }
+
+  /// トップのシーンの種類を返す。
+  SceneId topId() const { return m_scenes.back().first; }
+
+  /// シーンを生成して積む。
+  bool push(SceneId id, std::shared_ptr<hardware::Hardware> &hardware) {
+    auto scene = Types::create(id, hardware);
+    if (!scene) {
+      return false;
+    }
+    m_scenes.emplace_back(id, std::move(scene));
+    return true;
+  }
+
+  /// トップのシーンを破棄する。
+  void pop() { m_scenes.pop_back(); }
+
+  /// トップのシーンを `f` に渡す。
+  template <typename F> EventResult visitTop(F &&f) {
+    return f(*m_scenes.back().second);
+  }
+};
+} // namespace scene
+
+#endif
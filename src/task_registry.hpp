@@ -0,0 +1,168 @@
+/**
+ * @file task_registry.hpp
+ * @brief タスクを登録してスタックの使用量を記録するクラスを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_TASK_REGISTRY_HPP_
+#define _INCLUDE_TASK_REGISTRY_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <Arduino.h>
+#include <esp32-hal-log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#ifdef USE_MEASURED_STACK_SIZES
+#include "task_stack_sizes.hpp"
+#endif
+
+namespace sugar {
+/// 登録したタスクのスタックの記録。
+struct TaskStackRecord {
+  /// タスク名。
+  const char *name;
+  /// 確保したスタックサイズ [byte]。
+  uint32_t stackSize;
+  /// これまでで最も少なかった空き [byte]。未計測なら `stackSize`。
+  uint32_t minFreeBytes;
+  /// `minFreeBytes` が最後に減った時刻 [s]。
+  ///
+  /// 最近まで減り続けているなら、まだ最悪の経路を通っていないかもしれない。
+  uint32_t lastDropSeconds;
+};
+
+/// タスクを作成して登録し、スタックの最高水位を記録する。
+///
+/// ESP-IDF の FreeRTOS ではスタックサイズも最高水位もバイト単位。
+/// `dump()` は推奨サイズの表を `task_stack_sizes.hpp` の形式で出力するので、
+/// 実機で一通り操作した後の出力で置き換え、 `USE_MEASURED_STACK_SIZES` を
+/// 定義してビルドすると、その値でタスクが作られる。
+class TaskRegistry {
+public:
+  /// 登録できるタスクの数。
+  static constexpr size_t MAX_TASKS = 12;
+
+  /// プロセスに1つの登録簿を返す。
+  static TaskRegistry &instance() {
+    static TaskRegistry registry;
+    return registry;
+  }
+
+  /// タスクを作成して登録する。
+  ///
+  /// `defaultStackSize` は計測値を使わないときのスタックサイズ [byte]。
+  /// 引数は `xTaskCreatePinnedToCore()` と同じ。
+  BaseType_t create(TaskFunction_t function, const char *name,
+                    uint32_t defaultStackSize, void *arg,
+                    UBaseType_t priority, TaskHandle_t *handle = NULL,
+                    BaseType_t coreId = tskNO_AFFINITY) {
+    const uint32_t stackSize = configuredStackSize(name, defaultStackSize);
+    TaskHandle_t created = NULL;
+    const BaseType_t result = xTaskCreatePinnedToCore(
+        function, name, stackSize, arg, priority, &created, coreId);
+    if (result != pdPASS) {
+      log_e("TaskRegistry: failed to create %s (%u bytes)", name, stackSize);
+      return result;
+    }
+    if (handle != NULL) {
+      *handle = created;
+    }
+    portENTER_CRITICAL(&m_lock);
+    if (m_count < MAX_TASKS) {
+      m_tasks[m_count] = created;
+      m_records[m_count] = TaskStackRecord{name, stackSize, stackSize, 0};
+      m_count++;
+    }
+    portEXIT_CRITICAL(&m_lock);
+    return result;
+  }
+
+  /// 各タスクの最高水位を読んで記録を更新する。
+  ///
+  /// 定期的に呼ぶ。タスクは削除されない前提。
+  void sample() {
+    const uint32_t now =
+        static_cast<uint32_t>(esp_timer_get_time() / 1000000);
+    for (size_t i = 0; i < count(); ++i) {
+      const uint32_t free = uxTaskGetStackHighWaterMark(m_tasks[i]);
+      if (free < m_records[i].minFreeBytes) {
+        m_records[i].minFreeBytes = free;
+        m_records[i].lastDropSeconds = now;
+      }
+    }
+  }
+
+  /// 登録したタスクの数。
+  size_t count() const { return m_count; }
+  /// 登録したタスクの記録。
+  const TaskStackRecord &record(size_t i) const { return m_records[i]; }
+
+  /// 使用量から推奨スタックサイズ [byte] を求める。
+  ///
+  /// 使用量の 1/4 と 512 byte を余裕として足し、 256 byte に切り上げる。
+  static uint32_t recommendedSize(const TaskStackRecord &r) {
+    const uint32_t used = r.stackSize - r.minFreeBytes;
+    const uint32_t size = used + used / 4 + 512;
+    return (size + 255) / 256 * 256;
+  }
+
+  /// 記録と推奨サイズの表を出力する。
+  ///
+  /// 後半はそのまま `task_stack_sizes.hpp` として使える。
+  void dump() {
+    sample();
+    log_i("%-14s %7s %7s %7s %9s", "task", "stack", "used", "recommend",
+          "lastDrop");
+    uint32_t total = 0, recommendedTotal = 0;
+    for (size_t i = 0; i < count(); ++i) {
+      const TaskStackRecord &r = m_records[i];
+      log_i("%-14s %7u %7u %7u %8us", r.name, r.stackSize,
+            r.stackSize - r.minFreeBytes, recommendedSize(r),
+            r.lastDropSeconds);
+      total += r.stackSize;
+      recommendedTotal += recommendedSize(r);
+    }
+    log_i("total %u bytes, recommended %u bytes", total, recommendedTotal);
+    Serial.printf("// ---- task_stack_sizes.hpp ----\n");
+    Serial.printf("#pragma once\n\n#include <cstdint>\n\n");
+    Serial.printf("namespace sugar {\n");
+    Serial.printf("struct TaskStackSize {\n  const char *name;\n"
+                  "  uint32_t bytes;\n};\n\n");
+    Serial.printf("static const TaskStackSize MEASURED_TASK_STACK_SIZES[] = "
+                  "{\n");
+    for (size_t i = 0; i < count(); ++i) {
+      Serial.printf("    {\"%s\", %u},\n", m_records[i].name,
+                    recommendedSize(m_records[i]));
+    }
+    Serial.printf("};\n} // namespace sugar\n");
+    Serial.printf("// ---- end ----\n");
+  }
+
+private:
+  TaskHandle_t m_tasks[MAX_TASKS] = {};
+  TaskStackRecord m_records[MAX_TASKS] = {};
+  size_t m_count = 0;
+  portMUX_TYPE m_lock = portMUX_INITIALIZER_UNLOCKED;
+
+  TaskRegistry() = default;
+
+  /// ビルドの設定に応じて使うスタックサイズを選ぶ。
+  static uint32_t configuredStackSize(const char *name,
+                                      uint32_t defaultStackSize) {
+#ifdef USE_MEASURED_STACK_SIZES
+    for (const auto &entry : MEASURED_TASK_STACK_SIZES) {
+      if (std::strcmp(entry.name, name) == 0) {
+        return entry.bytes;
+      }
+    }
+#endif
+    return defaultStackSize;
+  }
+};
+} // namespace sugar
+
+#endif
@@ -0,0 +1,23 @@
+// タスクのスタックサイズ [byte] の表。
+//
+// `TaskRegistry::dump()` (シリアルの 's' コマンド) の出力で置き換え、
+// `USE_MEASURED_STACK_SIZES` を定義してビルドすると使われる。
+// 今の値は計測前の既定値と同じ。
+#pragma once
+
+#include <cstdint>
+
+namespace sugar {
+struct TaskStackSize {
+  const char *name;
+  uint32_t bytes;
+};
+
+static const TaskStackSize MEASURED_TASK_STACK_SIZES[] = {
+    {"TimerService", 4096},
+    {"AlarmManager", 4096},
+    {"TweetManager", 4096},
+    {"Display", 4096},
+    {"SceneManager", 8192},
+};
+} // namespace sugar
@@ -12,39 +12,53 @@
 
 #include <chrono>
 #include <cstdint>
+#include <type_traits>
 
 namespace sugar {
 
 /// Time of day.
 ///
 /// タイムゾーン情報は持たない。
+/// 深夜からの経過ミリ秒 (0 ~ 86399999) を 32 ビットで持つので、
+/// 時分秒への分解は 32 ビットの除算で済む。
 class TimeOfDay {
+public:
+  /// 時分秒とミリ秒への分解。
+  struct Hms {
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+    uint16_t millisecond;
+  };
+
 private:
-  /// 深夜からの時間。
-  std::chrono::milliseconds m_timeSinceMidnight;
+  /// 1日のミリ秒数。
+  static constexpr uint32_t MILLIS_PER_DAY = 24UL * 60 * 60 * 1000;
+
+  /// 深夜からの経過ミリ秒。
+  uint32_t m_millisSinceMidnight = 0;
 
   static constexpr auto JST_OFFSET = std::chrono::hours(9);
 
 public:
-  TimeOfDay() = default;
-  TimeOfDay(const TimeOfDay &) = default;
-  TimeOfDay(TimeOfDay &&) = default;
+  constexpr TimeOfDay() = default;
+  constexpr TimeOfDay(const TimeOfDay &) = default;
+  constexpr TimeOfDay(TimeOfDay &&) = default;
   TimeOfDay &operator=(const TimeOfDay &) = default;
   TimeOfDay &operator=(TimeOfDay &&) = default;
 
   /// タイムゾーンを考慮しない素朴な初期化。
   template <typename Clock, typename Duration>
-  TimeOfDay(std::chrono::time_point<Clock, Duration> time)
-      : m_timeSinceMidnight(
-            std::chrono::duration_cast<decltype(m_timeSinceMidnight)>(
-                modulo24h(time.time_since_epoch()))) {}
+  constexpr TimeOfDay(std::chrono::time_point<Clock, Duration> time)
+      : TimeOfDay(time.time_since_epoch()) {}
 
   /// タイムゾーンを考慮しない素朴な初期化。
   template <typename Rep, typename Period>
-  TimeOfDay(std::chrono::duration<Rep, Period> time)
-      : m_timeSinceMidnight(
-            std::chrono::duration_cast<decltype(m_timeSinceMidnight)>(
-                modulo24h(time))) {}
+  constexpr TimeOfDay(std::chrono::duration<Rep, Period> time)
+      : m_millisSinceMidnight(static_cast<uint32_t>(
+            modulo24h(
+                std::chrono::duration_cast<std::chrono::milliseconds>(time))
+                .count())) {}
 
   /// 協定世界時を受け取り、日本標準時で `TimeOfDay` を作成する。
   template <typename Clock, typename Duration>
@@ -53,44 +67,43 @@ public:
   }
 
   /// 時分秒(とミリ秒)から `TimeOfDay` を作成する。
-  static TimeOfDay fromHms(int h = 0, int m = 0, int s = 0, int ms = 0) {
+  static constexpr TimeOfDay fromHms(int h = 0, int m = 0, int s = 0,
+                                     int ms = 0) {
     return TimeOfDay(std::chrono::hours(h) + std::chrono::minutes(m) +
                      std::chrono::seconds(s) + std::chrono::milliseconds(ms));
   }
 
   /// 深夜からの経過時間。
-  decltype(m_timeSinceMidnight) timeSinceMidnight() const {
-    return m_timeSinceMidnight;
+  constexpr std::chrono::milliseconds timeSinceMidnight() const {
+    return std::chrono::milliseconds(m_millisSinceMidnight);
   }
 
-  /// 時の位を返す。
-  int hour() const {
-    return std::chrono::duration_cast<std::chrono::hours>(m_timeSinceMidnight)
-               .count() %
-           24;
+  /// 深夜からの経過ミリ秒。
+  constexpr uint32_t millisSinceMidnight() const {
+    return m_millisSinceMidnight;
   }
 
-  /// 分の位を返す。
-  int minute() const {
-    return std::chrono::duration_cast<std::chrono::minutes>(m_timeSinceMidnight)
-               .count() %
-           60;
+  /// 時分秒とミリ秒へ一度に分解する。
+  ///
+  /// 複数の位を使うときは、個別の関数を呼ぶよりこちらの方が安い。
+  constexpr Hms hms() const {
+    return Hms{static_cast<uint8_t>(m_millisSinceMidnight / 3600000),
+               static_cast<uint8_t>(m_millisSinceMidnight / 60000 % 60),
+               static_cast<uint8_t>(m_millisSinceMidnight / 1000 % 60),
+               static_cast<uint16_t>(m_millisSinceMidnight % 1000)};
   }
 
+  /// 時の位を返す。
+  constexpr int hour() const { return m_millisSinceMidnight / 3600000; }
+
+  /// 分の位を返す。
+  constexpr int minute() const { return m_millisSinceMidnight / 60000 % 60; }
+
   /// 秒の位を返す。
-  int second() const {
-    return std::chrono::duration_cast<std::chrono::seconds>(m_timeSinceMidnight)
-               .count() %
-           60;
-  }
+  constexpr int second() const { return m_millisSinceMidnight / 1000 % 60; }
 
   /// ミリ秒の位を返す。
-  int millisecond() const {
-    return std::chrono::duration_cast<std::chrono::milliseconds>(
-               m_timeSinceMidnight)
-               .count() %
-           1000;
-  }
+  constexpr int millisecond() const { return m_millisSinceMidnight % 1000; }
 
   /// 特定の時刻であるか、或いはそれを過ぎて一定時間以内であるかどうかを返す。
   ///
@@ -100,17 +113,19 @@ public:
   /// `futureDuration` はその名の通り未来方向への範囲であり、 `target` よりも
   /// 前の時間について指定するものではない。
   template <typename Rep, typename Period>
-  bool isAfter(TimeOfDay target,
-               std::chrono::duration<Rep, Period> futureDuration) {
-    auto diff = (timeSinceMidnight() + std::chrono::hours(24) -
-                 target.timeSinceMidnight()) %
-                std::chrono::hours(24);
-    return (diff.count() >= 0 && diff <= futureDuration);
+  constexpr bool
+  isAfter(TimeOfDay target,
+          std::chrono::duration<Rep, Period> futureDuration) const {
+    return std::chrono::milliseconds(
+               (m_millisSinceMidnight + MILLIS_PER_DAY -
+                target.m_millisSinceMidnight) %
+               MILLIS_PER_DAY) <= futureDuration;
   }
 
   template <typename Rep, typename Period>
-  TimeOfDay operator+(const std::chrono::duration<Rep, Period> &rhs) {
-    return TimeOfDay(m_timeSinceMidnight + rhs);
+  constexpr TimeOfDay
+  operator+(const std::chrono::duration<Rep, Period> &rhs) const {
+    return TimeOfDay(timeSinceMidnight() + rhs);
   }
 
   template <typename Rep, typename Period>
@@ -120,8 +135,9 @@ public:
   }
 
   template <typename Rep, typename Period>
-  TimeOfDay operator-(const std::chrono::duration<Rep, Period> &rhs) {
-    return TimeOfDay(m_timeSinceMidnight - rhs);
+  constexpr TimeOfDay
+  operator-(const std::chrono::duration<Rep, Period> &rhs) const {
+    return TimeOfDay(timeSinceMidnight() - rhs);
   }
 
   template <typename Rep, typename Period>
@@ -130,44 +146,71 @@ public:
     return *this;
   }
 
-  bool operator==(const TimeOfDay &rhs) const {
-    return timeSinceMidnight() == rhs.timeSinceMidnight();
+  constexpr bool operator==(const TimeOfDay &rhs) const {
+    return m_millisSinceMidnight == rhs.m_millisSinceMidnight;
   }
 
-  bool operator<(const TimeOfDay &rhs) {
-    return timeSinceMidnight() < rhs.timeSinceMidnight();
+  constexpr bool operator!=(const TimeOfDay &rhs) const {
+    return m_millisSinceMidnight != rhs.m_millisSinceMidnight;
   }
 
-  bool operator<=(const TimeOfDay &rhs) {
-    return timeSinceMidnight() <= rhs.timeSinceMidnight();
+  constexpr bool operator<(const TimeOfDay &rhs) const {
+    return m_millisSinceMidnight < rhs.m_millisSinceMidnight;
   }
 
-  bool operator>(const TimeOfDay &rhs) {
-    return timeSinceMidnight() > rhs.timeSinceMidnight();
+  constexpr bool operator<=(const TimeOfDay &rhs) const {
+    return m_millisSinceMidnight <= rhs.m_millisSinceMidnight;
   }
 
-  bool operator>=(const TimeOfDay &rhs) {
-    return timeSinceMidnight() >= rhs.timeSinceMidnight();
+  constexpr bool operator>(const TimeOfDay &rhs) const {
+    return m_millisSinceMidnight > rhs.m_millisSinceMidnight;
   }
 
-private:
-  template <typename Rep, typename Period>
-  static std::chrono::duration<Rep, Period>
-  durationAbs(const std::chrono::duration<Rep, Period> &d) {
-    return d >= d.zero() ? d : -d;
+  constexpr bool operator>=(const TimeOfDay &rhs) const {
+    return m_millisSinceMidnight >= rhs.m_millisSinceMidnight;
   }
 
-  template <typename Rep, typename Period>
-  static std::chrono::duration<Rep, Period>
-  modulo24h(const std::chrono::duration<Rep, Period> &d) {
-    constexpr auto DAY = std::chrono::hours(24);
-    if (d >= std::chrono::duration<Rep, Period>::zero()) {
-      return d % DAY;
-    } else {
-      auto backward = durationAbs(d) % DAY;
-      return (DAY - backward) % DAY;
-    }
+private:
+  /// `d` を 0 以上 24 時間未満に丸める。
+  static constexpr std::chrono::milliseconds
+  modulo24h(std::chrono::milliseconds d) {
+    return d.count() >= 0
+               ? std::chrono::milliseconds(d.count() % MILLIS_PER_DAY)
+               : std::chrono::milliseconds(
+                     (MILLIS_PER_DAY - (-d.count()) % MILLIS_PER_DAY) %
+                     MILLIS_PER_DAY);
   }
 };
+static_assert(sizeof(TimeOfDay) == sizeof(uint32_t),
+              "TimeOfDay must stay packed in 32 bits");
+static_assert(std::is_trivially_copyable<TimeOfDay>::value,
+              "TimeOfDay must be trivially copyable");
+static_assert(TimeOfDay::fromHms(23, 59, 59, 999).hour() == 23, "");
+static_assert(TimeOfDay::fromHms(23, 59, 59, 999).minute() == 59, "");
+static_assert(TimeOfDay::fromHms(23, 59, 59, 999).second() == 59, "");
+static_assert(TimeOfDay::fromHms(23, 59, 59, 999).millisecond() == 999, "");
+static_assert(TimeOfDay::fromHms(7, 30, 15, 250).hms().hour == 7, "");
+static_assert(TimeOfDay::fromHms(7, 30, 15, 250).hms().minute == 30, "");
+static_assert(TimeOfDay::fromHms(7, 30, 15, 250).hms().second == 15, "");
+static_assert(TimeOfDay::fromHms(7, 30, 15, 250).hms().millisecond == 250,
+              "");
+static_assert(TimeOfDay::fromHms(24) == TimeOfDay::fromHms(0),
+              "24:00 wraps to midnight");
+static_assert(TimeOfDay::fromHms(0, 0, -1) == TimeOfDay::fromHms(23, 59, 59),
+              "negative durations wrap backwards");
+static_assert(TimeOfDay::fromHms(23) + std::chrono::hours(2) ==
+                  TimeOfDay::fromHms(1),
+              "");
+static_assert(TimeOfDay::fromHms(1) - std::chrono::hours(2) ==
+                  TimeOfDay::fromHms(23),
+              "");
+static_assert(TimeOfDay::fromHms(1) < TimeOfDay::fromHms(2), "");
+static_assert(TimeOfDay::fromHms(0, 0, 0, 500).isAfter(
+                  TimeOfDay::fromHms(23, 59, 59, 800),
+                  std::chrono::milliseconds(990)),
+              "isAfter must see across midnight");
+static_assert(!TimeOfDay::fromHms(7).isAfter(TimeOfDay::fromHms(7, 0, 1),
+                                             std::chrono::milliseconds(990)),
+              "isAfter must not look into the past");
 } // namespace sugar
 #endif
@@ -0,0 +1,358 @@
+/**
+ * @file canvas.hpp
+ * @brief 描画先をまとめた薄いラッパクラスを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_CANVAS_HPP_
+#define _INCLUDE_CANVAS_HPP_
+
+// コンパイルエラーを防ぐため， Arduino.h で定義されているマクロをundef
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+#include <cstdint>
+#include <cstring>
+
+#include <M5Stack.h>
+
+#include "draw_command.hpp"
+#include "font_metrics.hpp"
+#include "glyph_atlas.hpp"
+#include "render_queue.hpp"
+
+namespace ui {
+/// 画面上の矩形領域。
+struct Bounds {
+  int16_t x = 0;
+  int16_t y = 0;
+  int16_t w = 0;
+  int16_t h = 0;
+
+  Bounds() = default;
+  Bounds(int16_t x, int16_t y, int16_t w, int16_t h) : x(x), y(y), w(w), h(h) {}
+
+  /// 面積が 0 なら `true` を返す。
+  bool empty() const { return w <= 0 || h <= 0; }
+  /// 右端 (領域に含まれない) の x 座標。
+  int16_t right() const { return x + w; }
+  /// 下端 (領域に含まれない) の y 座標。
+  int16_t bottom() const { return y + h; }
+  /// 画素数。
+  uint32_t area() const { return empty() ? 0 : uint32_t(w) * uint32_t(h); }
+
+  /// 2つの領域を含む最小の領域を返す。
+  Bounds united(const Bounds &o) const {
+    if (empty()) {
+      return o;
+    }
+    if (o.empty()) {
+      return *this;
+    }
+    int16_t l = x < o.x ? x : o.x;
+    int16_t t = y < o.y ? y : o.y;
+    int16_t r = right() > o.right() ? right() : o.right();
+    int16_t b = bottom() > o.bottom() ? bottom() : o.bottom();
+    return Bounds(l, t, r - l, b - t);
+  }
+
+  /// 2つの領域の共通部分を返す。
+  Bounds intersected(const Bounds &o) const {
+    int16_t l = x > o.x ? x : o.x;
+    int16_t t = y > o.y ? y : o.y;
+    int16_t r = right() < o.right() ? right() : o.right();
+    int16_t b = bottom() < o.bottom() ? bottom() : o.bottom();
+    if (r <= l || b <= t) {
+      return Bounds();
+    }
+    return Bounds(l, t, r - l, b - t);
+  }
+
+  bool operator==(const Bounds &o) const {
+    return x == o.x && y == o.y && w == o.w && h == o.h;
+  }
+  bool operator!=(const Bounds &o) const { return !(*this == o); }
+};
+
+/// 文字列の揃え方。
+enum class Align {
+  /// `x` を左端とする。
+  Left,
+  /// `x` を中央とする。
+  Centre,
+  /// `x` を右端とする。
+  Right,
+};
+
+/// 描画先。
+///
+/// LCD (或いは LCD と同じ API を持つスプライト) への描画をまとめ、
+/// 描画した画素数を数える。
+/// 座標はすべて画面座標で受け取り、描画先の原点の分だけずらして描く。
+///
+/// `RenderQueue` を渡して作ったものは自分では描かず、描画命令を記録して
+/// 描画タスクへ送る。この場合 `target` は文字列の寸法を測るためだけに使う。
+/// 描画タスクと LCD を取り合わないよう、寸法は `setFontMetrics()` で渡した
+/// 表があればそちらから求める。
+class Canvas {
+private:
+  /// 描画先。
+  TFT_eSPI &m_target;
+  /// 描画命令の送信先。 `nullptr` なら `m_target` へ直接描く。
+  RenderQueue *m_queue = nullptr;
+  /// 描画命令の描画先。
+  DrawTarget m_drawTarget = DrawTarget::Lcd;
+  /// 描画先の左上の画面座標。
+  int16_t m_originX = 0;
+  int16_t m_originY = 0;
+  /// これまでに描画した画素数。
+  uint32_t m_pixelsDrawn = 0;
+  /// 事前にラスタライズしたグリフ。 `nullptr` なら使わない。
+  GlyphAtlas *m_atlas = nullptr;
+  /// 起動時に測ったフォントの寸法。 `nullptr` なら `m_target` で測る。
+  const FontMetrics *m_metrics = nullptr;
+  /// 描画先が RAM 上の画素列であれば、その先頭と大きさ。
+  uint16_t *m_pixels = nullptr;
+  int16_t m_pixelsWidth = 0;
+  int16_t m_pixelsHeight = 0;
+
+public:
+  explicit Canvas(TFT_eSPI &target) : m_target(target) {}
+  /// 描画命令を `queue` へ送る描画先を作る。
+  Canvas(TFT_eSPI &metrics, RenderQueue &queue, DrawTarget target)
+      : m_target(metrics), m_queue(&queue), m_drawTarget(target) {}
+
+  /// 描画先を返す。
+  TFT_eSPI &target() { return m_target; }
+
+  /// 描画先の左上の画面座標を設定する。
+  ///
+  /// 画面の一部を受け持つスプライトに描くときに使う。
+  void setOrigin(int16_t x, int16_t y) {
+    m_originX = x;
+    m_originY = y;
+  }
+
+  /// 1文字の描画に使うグリフアトラスを設定する。
+  void setGlyphAtlas(GlyphAtlas *atlas) { m_atlas = atlas; }
+
+  /// 文字列の寸法を求める表を設定する。 `nullptr` なら描画先で測る。
+  void setFontMetrics(const FontMetrics *metrics) { m_metrics = metrics; }
+
+  /// 描画先の画素列を設定する。
+  ///
+  /// 描画先がスプライトのとき、グリフをその画素列へ直接書き込むために使う。
+  void setPixelBuffer(uint16_t *pixels, int16_t width, int16_t height) {
+    m_pixels = pixels;
+    m_pixelsWidth = width;
+    m_pixelsHeight = height;
+  }
+
+  /// これまでに描画した画素数を返す。
+  uint32_t pixelsDrawn() const { return m_pixelsDrawn; }
+  /// 描画した画素数をリセットする。
+  void resetStats() { m_pixelsDrawn = 0; }
+
+  /// 全体を塗りつぶす。
+  void clear(uint16_t color = TFT_BLACK) {
+    if (m_queue) {
+      DrawCommand cmd = command(DrawOp::Clear, color);
+      m_queue->push(cmd);
+    } else {
+      m_target.fillScreen(color);
+    }
+    m_pixelsDrawn += uint32_t(m_target.width()) * m_target.height();
+  }
+
+  /// 矩形を塗りつぶす。
+  void fillRect(const Bounds &b, uint16_t color) {
+    if (b.empty()) {
+      return;
+    }
+    if (m_queue) {
+      DrawCommand cmd = command(DrawOp::FillRect, color);
+      cmd.x0 = b.x;
+      cmd.y0 = b.y;
+      cmd.x1 = b.w;
+      cmd.y1 = b.h;
+      m_queue->push(cmd);
+    } else {
+      m_target.fillRect(b.x - m_originX, b.y - m_originY, b.w, b.h, color);
+    }
+    m_pixelsDrawn += b.area();
+  }
+
+  /// `before` のうち `after` に含まれない部分を塗りつぶす。
+  ///
+  /// 移動や縮小したウィジェットの消し残しを、ちらつかせずに消すために使う。
+  void fillDifference(const Bounds &before, const Bounds &after,
+                      uint16_t color) {
+    Bounds common = before.intersected(after);
+    if (common.empty()) {
+      fillRect(before, color);
+      return;
+    }
+    // 上下の帯
+    fillRect(Bounds(before.x, before.y, before.w, common.y - before.y), color);
+    fillRect(Bounds(before.x, common.bottom(), before.w,
+                    before.bottom() - common.bottom()),
+             color);
+    // 左右の帯
+    fillRect(Bounds(before.x, common.y, common.x - before.x, common.h), color);
+    fillRect(Bounds(common.right(), common.y, before.right() - common.right(),
+                    common.h),
+             color);
+  }
+
+  /// 三角形を塗りつぶす。
+  void fillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2,
+                    int16_t y2, uint16_t color) {
+    if (m_queue) {
+      DrawCommand cmd = command(DrawOp::FillTriangle, color);
+      cmd.x0 = x0;
+      cmd.y0 = y0;
+      cmd.x1 = x1;
+      cmd.y1 = y1;
+      cmd.x2 = x2;
+      cmd.y2 = y2;
+      m_queue->push(cmd);
+    } else {
+      m_target.fillTriangle(x0 - m_originX, y0 - m_originY, x1 - m_originX,
+                            y1 - m_originY, x2 - m_originX, y2 - m_originY,
+                            color);
+    }
+    m_pixelsDrawn += triangleBounds(x0, y0, x1, y1, x2, y2).area() / 2;
+  }
+
+  /// 文字列の幅を返す。
+  int16_t textWidth(const char *text, uint8_t font) {
+    if (m_metrics && m_metrics->contains(font)) {
+      return m_metrics->textWidth(text, font);
+    }
+    return m_target.textWidth(text, font);
+  }
+  /// フォントの高さを返す。
+  int16_t fontHeight(uint8_t font) {
+    if (m_metrics && m_metrics->contains(font)) {
+      return m_metrics->fontHeight(font);
+    }
+    return m_target.fontHeight(font);
+  }
+
+  /// 文字列を描画した場合の領域を返す。
+  Bounds textBounds(const char *text, int16_t x, int16_t y, uint8_t font,
+                    Align align) {
+    int16_t w = textWidth(text, font);
+    switch (align) {
+    case Align::Centre:
+      x -= w / 2;
+      break;
+    case Align::Right:
+      x -= w;
+      break;
+    case Align::Left:
+      break;
+    }
+    return Bounds(x, y, w, fontHeight(font));
+  }
+
+  /// 背景色付きで文字列を描画する。
+  void drawText(const char *text, int16_t x, int16_t y, uint8_t font,
+                Align align, uint16_t fg, uint16_t bg) {
+    if (m_queue) {
+      DrawCommand cmd = command(DrawOp::DrawText, fg);
+      cmd.bg = bg;
+      cmd.x0 = x;
+      cmd.y0 = y;
+      cmd.font = font;
+      cmd.align = static_cast<uint8_t>(align);
+      std::strncpy(cmd.text, text, sizeof(cmd.text) - 1);
+      cmd.text[sizeof(cmd.text) - 1] = '\0';
+      m_queue->push(cmd);
+      m_pixelsDrawn += textBounds(text, x, y, font, align).area();
+      return;
+    }
+    const int16_t tx = x - m_originX;
+    const int16_t ty = y - m_originY;
+    // 時計用の大きな数字はアトラスから転送する
+    if (m_atlas && align == Align::Left && text[0] != '\0' &&
+        text[1] == '\0' && drawGlyph(text[0], tx, ty, font, fg, bg)) {
+      m_pixelsDrawn += textBounds(text, x, y, font, align).area();
+      return;
+    }
+    m_target.setTextColor(fg, bg);
+    switch (align) {
+    case Align::Left:
+      m_target.drawString(text, tx, ty, font);
+      break;
+    case Align::Centre:
+      m_target.drawCentreString(text, tx, ty, font);
+      break;
+    case Align::Right:
+      m_target.drawRightString(text, tx, ty, font);
+      break;
+    }
+    m_pixelsDrawn += textBounds(text, x, y, font, align).area();
+  }
+
+  /// アトラスからグリフを転送する。
+  bool drawGlyph(char c, int16_t tx, int16_t ty, uint8_t font, uint16_t fg,
+                 uint16_t bg) {
+    if (m_pixels) {
+      return m_atlas->blit(m_pixels, m_pixelsWidth, m_pixelsHeight, c, tx, ty,
+                           font, fg, bg);
+    }
+    return m_atlas->blit(m_target, c, tx, ty, font, fg, bg);
+  }
+
+  /// 記録した描画命令を直接描く。
+  ///
+  /// 描画タスクが、描画先に対応する `Canvas` へ命令を再生するために使う。
+  void execute(const DrawCommand &cmd) {
+    switch (cmd.op) {
+    case DrawOp::Clear:
+      clear(cmd.fg);
+      break;
+    case DrawOp::FillRect:
+      fillRect(Bounds(cmd.x0, cmd.y0, cmd.x1, cmd.y1), cmd.fg);
+      break;
+    case DrawOp::FillTriangle:
+      fillTriangle(cmd.x0, cmd.y0, cmd.x1, cmd.y1, cmd.x2, cmd.y2, cmd.fg);
+      break;
+    case DrawOp::DrawText:
+      drawText(cmd.text, cmd.x0, cmd.y0, cmd.font,
+               static_cast<Align>(cmd.align), cmd.fg, cmd.bg);
+      break;
+    case DrawOp::AcquireBuffer:
+    case DrawOp::PresentBuffer:
+      // フレームバッファ自体の操作は `Display` が受け持つ
+      break;
+    }
+  }
+
+  /// 3点を含む最小の領域を返す。
+  static Bounds triangleBounds(int16_t x0, int16_t y0, int16_t x1, int16_t y1,
+                               int16_t x2, int16_t y2) {
+    int16_t l = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2);
+    int16_t r = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2);
+    int16_t t = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2);
+    int16_t b = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2);
+    return Bounds(l, t, r - l + 1, b - t + 1);
+  }
+
+private:
+  /// この描画先へ向けた描画命令を作る。
+  DrawCommand command(DrawOp op, uint16_t fg) const {
+    DrawCommand cmd;
+    std::memset(&cmd, 0, sizeof(cmd));
+    cmd.op = op;
+    cmd.target = m_drawTarget;
+    cmd.fg = fg;
+    return cmd;
+  }
+};
+} // namespace ui
+
+#endif
@@ -0,0 +1,257 @@
+/**
+ * @file display.hpp
+ * @brief LCD への描画をまとめ、描画タスクで実行するクラスを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_DISPLAY_HPP_
+#define _INCLUDE_DISPLAY_HPP_
+
+// コンパイルエラーを防ぐため， Arduino.h で定義されているマクロをundef
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+
+#include <M5Stack.h>
+#include <esp32-hal-log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "../task_registry.hpp"
+#include "canvas.hpp"
+#include "draw_command.hpp"
+#include "font_metrics.hpp"
+#include "frame_buffer.hpp"
+#include "glyph_atlas.hpp"
+#include "render_queue.hpp"
+#include "widget.hpp"
+
+namespace ui {
+/// 描画タスクの統計情報。
+struct RenderStats {
+  /// 現在キューに溜まっている描画命令の数。
+  uint32_t queueDepth;
+  /// キュー深さの最大値。
+  uint32_t maxQueueDepth;
+  /// キューが一杯でシーン側が待たされた回数。
+  uint32_t stalls;
+  /// 実行した描画命令の数。
+  uint32_t commands;
+  /// 直前に続けて実行した描画命令の処理時間 [us]。
+  uint32_t lastBatchMicros;
+  /// 続けて実行した描画命令の処理時間の最大値 [us]。
+  uint32_t maxBatchMicros;
+};
+
+/// 画面。
+///
+/// グリフアトラスとフレームバッファを持ち、シーンからの描画を受け付ける。
+/// `beginRenderTask()` の後は、シーンへ渡す `Canvas` は描画命令を記録する
+/// だけになり、 LCD への転送は描画タスクが行う。これによりシーンの
+/// イベント処理が SPI 転送の完了を待たなくなる。
+/// 描画タスクを起動しなければ、従来通り呼び出したタスクで直接描画する。
+class Display {
+private:
+  /// 時計用フォントのグリフアトラス。
+  GlyphAtlas m_glyphAtlas;
+  /// 内蔵フォントの寸法。シーンのタスクが LCD に触れずに測るため。
+  FontMetrics m_fontMetrics;
+  /// LCD のオフスクリーンバッファ。
+  FrameBuffer m_frameBuffer;
+  /// LCD への直接の描画先。
+  Canvas m_lcd{M5.Lcd};
+  /// 描画命令のキュー。
+  RenderQueue m_queue;
+  /// LCD へ向けた描画命令を記録する描画先。
+  Canvas m_lcdRecorder{M5.Lcd, m_queue, DrawTarget::Lcd};
+  /// フレームバッファへ向けた描画命令を記録する描画先。
+  Canvas m_bufferRecorder{M5.Lcd, m_queue, DrawTarget::FrameBuffer};
+  /// 描画タスクが動いているか否か。
+  bool m_renderTaskRunning = false;
+  /// 描画タスクの統計情報。
+  std::atomic<uint32_t> m_commands{0};
+  std::atomic<uint32_t> m_lastBatchMicros{0};
+  std::atomic<uint32_t> m_maxBatchMicros{0};
+
+public:
+  /// 描画タスクの設定。
+  struct RenderTaskConfig {
+    /// タスクの優先度。
+    UBaseType_t priority = 1;
+    /// タスクを固定するコア番号。
+    BaseType_t coreId = 1;
+    /// 描画命令のキューの長さ。
+    UBaseType_t queueLength = 64;
+  };
+
+  /// グリフアトラスとフレームバッファを準備する。
+  ///
+  /// `M5.begin()` の後に呼ぶこと。
+  void begin(int16_t frameBufferHeight) {
+    m_fontMetrics.begin(M5.Lcd);
+    for (Canvas *c : {&m_lcd, &m_lcdRecorder, &m_bufferRecorder,
+                      &m_frameBuffer.canvas()}) {
+      c->setFontMetrics(&m_fontMetrics);
+    }
+    m_glyphAtlas.begin();
+#ifdef GLYPH_ATLAS_BENCHMARK
+    m_glyphAtlas.benchmark(M5.Lcd);
+#endif
+    m_frameBuffer.begin(frameBufferHeight);
+    m_frameBuffer.canvas().setGlyphAtlas(&m_glyphAtlas);
+    m_lcd.setGlyphAtlas(&m_glyphAtlas);
+  }
+
+  /// 描画タスクを起動する。
+  ///
+  /// シーンが描画を始める前に呼ぶこと。
+  void beginRenderTask() { beginRenderTask(RenderTaskConfig{}); }
+  /// 描画タスクを起動する。
+  void beginRenderTask(const RenderTaskConfig &config) {
+    m_queue.begin(config.queueLength);
+    m_renderTaskRunning = true;
+    const uint32_t stackSize = 4096;
+    sugar::TaskRegistry::instance().create(
+        [](void *this_obj) { static_cast<Display *>(this_obj)->task(); },
+        "Display", stackSize, this, config.priority, NULL, config.coreId);
+  }
+
+  /// LCD への描画先を返す。
+  Canvas &canvas() { return m_renderTaskRunning ? m_lcdRecorder : m_lcd; }
+  /// フレームバッファへの描画先を返す。
+  Canvas &bufferCanvas() {
+    return m_renderTaskRunning ? m_bufferRecorder : m_frameBuffer.canvas();
+  }
+
+  /// 画面全体を塗りつぶす。
+  void clear(uint16_t color = TFT_BLACK) { canvas().clear(color); }
+
+  /// `band` をフレームバッファで受け持てるよう原点を合わせる。
+  ///
+  /// `FrameBuffer::acquire()` と同じく、収まらなければ `false` を返す。
+  bool acquireBuffer(const Bounds &band, uint16_t bg = TFT_BLACK) {
+    if (!m_frameBuffer.fits(band)) {
+      return false;
+    }
+    if (!m_renderTaskRunning) {
+      return m_frameBuffer.acquire(band, bg);
+    }
+    DrawCommand cmd = bufferCommand(DrawOp::AcquireBuffer, band);
+    cmd.fg = bg;
+    m_queue.push(cmd);
+    return true;
+  }
+
+  /// フレームバッファのうち `dirty` の部分を LCD へ転送する。
+  void presentBuffer(const Bounds &dirty) {
+    if (dirty.empty()) {
+      return;
+    }
+    if (!m_renderTaskRunning) {
+      m_frameBuffer.present(dirty);
+      return;
+    }
+    m_queue.push(bufferCommand(DrawOp::PresentBuffer, dirty));
+  }
+
+  /// `widget` の変更を描画する。
+  Bounds render(Widget &widget) { return widget.render(canvas()); }
+
+  /// `screen` の変更を描画する。
+  ///
+  /// `buffered` なら、フレームバッファへ描いてから転送する。
+  template <size_t N> Bounds render(Screen<N> &screen, bool buffered = false) {
+    if (!buffered) {
+      return screen.render(canvas());
+    }
+    Bounds dirty = screen.render(bufferCanvas());
+    presentBuffer(dirty);
+    return dirty;
+  }
+
+  /// 描画タスクの統計情報を返す。
+  RenderStats stats() const {
+    if (!m_renderTaskRunning) {
+      return RenderStats{};
+    }
+    return RenderStats{m_queue.depth(),     m_queue.maxDepth(),
+                       m_queue.stalls(),    m_commands,
+                       m_lastBatchMicros,   m_maxBatchMicros};
+  }
+  /// 直前のフレームバッファ転送の統計情報を返す。
+  FrameStats lastFrame() const { return m_frameBuffer.lastFrame(); }
+
+  /// 時計用フォントのグリフアトラスを返す。
+  GlyphAtlas &glyphAtlas() { return m_glyphAtlas; }
+  /// LCD のオフスクリーンバッファを返す。
+  FrameBuffer &frameBuffer() { return m_frameBuffer; }
+
+private:
+  /// FreeRTOS によって実行される関数。
+  ///
+  /// 命令が届いたら、キューが空になるまで続けて実行する。
+  void task() {
+    DrawCommand cmd;
+    while (1) {
+      if (!m_queue.pop(cmd, portMAX_DELAY)) {
+        continue;
+      }
+      const int64_t start = esp_timer_get_time();
+      uint32_t count = 0;
+      do {
+        execute(cmd);
+        count++;
+      } while (m_queue.pop(cmd, 0));
+      const uint32_t elapsed =
+          static_cast<uint32_t>(esp_timer_get_time() - start);
+      m_commands += count;
+      m_lastBatchMicros = elapsed;
+      if (elapsed > m_maxBatchMicros) {
+        m_maxBatchMicros = elapsed;
+      }
+    }
+  }
+
+  /// 描画命令を1つ実行する。
+  void execute(const DrawCommand &cmd) {
+    switch (cmd.op) {
+    case DrawOp::AcquireBuffer:
+      m_frameBuffer.acquire(Bounds(cmd.x0, cmd.y0, cmd.x1, cmd.y1), cmd.fg);
+      break;
+    case DrawOp::PresentBuffer:
+      m_frameBuffer.present(Bounds(cmd.x0, cmd.y0, cmd.x1, cmd.y1));
+      break;
+    default:
+      if (cmd.target == DrawTarget::FrameBuffer) {
+        m_frameBuffer.canvas().execute(cmd);
+      } else {
+        m_lcd.execute(cmd);
+      }
+      break;
+    }
+  }
+
+  /// フレームバッファの領域を操作する描画命令を作る。
+  static DrawCommand bufferCommand(DrawOp op, const Bounds &b) {
+    DrawCommand cmd;
+    std::memset(&cmd, 0, sizeof(cmd));
+    cmd.op = op;
+    cmd.target = DrawTarget::FrameBuffer;
+    cmd.x0 = b.x;
+    cmd.y0 = b.y;
+    cmd.x1 = b.w;
+    cmd.y1 = b.h;
+    return cmd;
+  }
+};
+} // namespace ui
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * @file draw_command.hpp
+ * @brief 描画タスクへ送る描画命令を持つ
+ */
+#pragma once
+#ifndef _INCLUDE_DRAW_COMMAND_HPP_
+#define _INCLUDE_DRAW_COMMAND_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace ui {
+/// 描画先。
+enum class DrawTarget : uint8_t {
+  /// LCD へ直接描く。
+  Lcd,
+  /// オフスクリーンのフレームバッファへ描く。
+  FrameBuffer,
+};
+
+/// 描画命令の種類。
+enum class DrawOp : uint8_t {
+  /// 全体を `fg` で塗りつぶす。
+  Clear,
+  /// `(x0, y0, w, h)` を `fg` で塗りつぶす。
+  FillRect,
+  /// `(x0, y0)`, `(x1, y1)`, `(x2, y2)` の三角形を `fg` で塗りつぶす。
+  FillTriangle,
+  /// `text` を `(x0, y0)` に描く。
+  DrawText,
+  /// フレームバッファの原点を `(x0, y0)` に合わせ、 `fg` で塗りつぶす。
+  AcquireBuffer,
+  /// フレームバッファの `(x0, y0, w, h)` を LCD へ転送する。
+  PresentBuffer,
+};
+
+/// 描画命令。
+///
+/// 値としてキューへコピーされる固定長の型。
+struct DrawCommand {
+  /// 文字列の最大長 (終端を含む)。
+  static constexpr size_t TEXT_CAPACITY = 48;
+
+  DrawOp op;
+  DrawTarget target;
+  /// `DrawText` のフォント番号。
+  uint8_t font;
+  /// `DrawText` の揃え方 (`ui::Align`)。
+  uint8_t align;
+  /// 前景色。
+  uint16_t fg;
+  /// 背景色。
+  uint16_t bg;
+  int16_t x0, y0;
+  /// `FillTriangle` では2点目、それ以外では幅と高さ。
+  int16_t x1, y1;
+  int16_t x2, y2;
+  char text[TEXT_CAPACITY];
+};
+static_assert(std::is_trivially_copyable<DrawCommand>::value,
+              "ui::DrawCommand must be trivially copyable");
+} // namespace ui
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * @file font_metrics.hpp
+ * @brief 内蔵フォントの文字幅と高さを起動時に測っておく表を持つ
+ */
+#pragma once
+#ifndef _INCLUDE_FONT_METRICS_HPP_
+#define _INCLUDE_FONT_METRICS_HPP_
+
+// コンパイルエラーを防ぐため， Arduino.h で定義されているマクロをundef
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+#include <cstddef>
+#include <cstdint>
+
+#include <M5Stack.h>
+
+namespace ui {
+/// 内蔵フォントの寸法の表。
+///
+/// 1 番から 8 番までのフォントについて、印字可能な ASCII 文字の幅と
+/// フォントの高さを起動時に LCD から測っておく。以降は LCD に触れずに
+/// 文字列の寸法を求められるので、描画タスクが LCD を使っている間に
+/// 他のタスクから測ってもよい。
+/// 文字の倍率 (`setTextSize()`) は測ったときの値のまま使うこと。
+class FontMetrics {
+public:
+  /// 表に含める最大のフォント番号。
+  static constexpr uint8_t MAX_FONT = 8;
+  /// 表に含める最初の文字。
+  static constexpr char FIRST_CHAR = ' ';
+  /// 表に含める文字の数。 `FIRST_CHAR` から `~` まで。
+  static constexpr size_t NUM_CHARS = '~' - ' ' + 1;
+
+  /// すべてのフォントの寸法を測る。描画を始める前に呼ぶこと。
+  void begin(TFT_eSPI &lcd) {
+    for (uint8_t f = 1; f <= MAX_FONT; ++f) {
+      m_heights[f] = lcd.fontHeight(f);
+      for (size_t c = 0; c < NUM_CHARS; ++c) {
+        const char str[2] = {static_cast<char>(FIRST_CHAR + c), '\0'};
+        m_widths[f][c] = static_cast<uint8_t>(lcd.textWidth(str, f));
+      }
+    }
+    m_ready = true;
+  }
+
+  /// `font` 番の寸法が表にあれば `true` を返す。
+  bool contains(uint8_t font) const {
+    return m_ready && font >= 1 && font <= MAX_FONT;
+  }
+
+  /// 文字列の幅を返す。表にない文字は幅 0 とする。
+  int16_t textWidth(const char *text, uint8_t font) const {
+    int16_t w = 0;
+    for (; *text != '\0'; ++text) {
+      const size_t c = static_cast<uint8_t>(*text - FIRST_CHAR);
+      if (c < NUM_CHARS) {
+        w += m_widths[font][c];
+      }
+    }
+    return w;
+  }
+
+  /// フォントの高さを返す。
+  int16_t fontHeight(uint8_t font) const { return m_heights[font]; }
+
+private:
+  /// 文字幅。フォント番号で引くので、 0 番の行は使わない。
+  uint8_t m_widths[MAX_FONT + 1][NUM_CHARS] = {};
+  int16_t m_heights[MAX_FONT + 1] = {};
+  bool m_ready = false;
+};
+} // namespace ui
+
+#endif
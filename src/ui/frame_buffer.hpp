@@ -0,0 +1,161 @@
+/**
+ * @file frame_buffer.hpp
+ * @brief 画面の一部を RAM 上で描画してからまとめて転送するバッファを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_FRAME_BUFFER_HPP_
+#define _INCLUDE_FRAME_BUFFER_HPP_
+
+// コンパイルエラーを防ぐため， Arduino.h で定義されているマクロをundef
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <M5Stack.h>
+#include <esp32-hal-log.h>
+#include <esp_timer.h>
+
+#include "canvas.hpp"
+
+namespace ui {
+/// 1フレーム分の転送の統計情報。
+struct FrameStats {
+  /// LCD へ転送したバイト数。
+  uint32_t bytesPushed;
+  /// 転送にかかった時間 [us]。
+  uint32_t transferMicros;
+};
+
+/// オフスクリーンのフレームバッファ。
+///
+/// 画面のうち指定した帯状の領域をスプライトに描画し、変更のあった矩形だけを
+/// LCD へ転送する。描画途中の状態が LCD に出ないので、消してから描き直す
+/// ような描画でもちらつかない。
+///
+/// バッファは起動時に一度だけ確保し、シーンは `acquire()` で原点を
+/// 合わせて使い回す。確保できなかった場合や領域が収まらない場合、
+/// シーンは LCD へ直接描画する。
+class FrameBuffer {
+private:
+  /// 幅いっぱいでない矩形を詰め直して転送する作業領域の画素数。
+  ///
+  /// 画面幅の行を転送し直すより詰め直す方が安い大きさ (4 KB) に留める。
+  static constexpr size_t SCRATCH_PIXELS = 2048;
+
+  /// 描画先のスプライト。
+  TFT_eSprite m_sprite{&M5.Lcd};
+  /// スプライトへの描画先。
+  Canvas m_canvas{m_sprite};
+  /// バッファが受け持つ画面上の領域。
+  Bounds m_region;
+  /// バッファを確保できたか否か。
+  bool m_allocated = false;
+  /// 直前のフレームの統計情報。
+  std::atomic<uint32_t> m_lastBytes{0};
+  std::atomic<uint32_t> m_lastMicros{0};
+  /// 転送前に矩形を詰め直す作業領域。
+  uint16_t m_scratch[SCRATCH_PIXELS];
+
+public:
+  /// バッファを確保する。
+  ///
+  /// 幅は画面幅とし、高さは `maxHeight` から確保できるまで半分にしていく。
+  /// `minHeight` を下回っても確保できなければ `false` を返す。
+  bool begin(int16_t maxHeight = 240, int16_t minHeight = 40) {
+    const int16_t width = M5.Lcd.width();
+    m_sprite.setColorDepth(16);
+    for (int16_t h = maxHeight; h >= minHeight; h /= 2) {
+      if (m_sprite.createSprite(width, h) != nullptr) {
+        m_region = Bounds(0, 0, width, h);
+        m_canvas.setPixelBuffer(static_cast<uint16_t *>(m_sprite.getPointer()),
+                                width, h);
+        m_allocated = true;
+        log_i("FrameBuffer: %dx%d (%u bytes)", width, h,
+              unsigned(width) * h * 2);
+        return true;
+      }
+    }
+    log_w("FrameBuffer: failed to allocate; drawing directly to the LCD");
+    return false;
+  }
+
+  /// バッファが使えるかどうかを返す。
+  bool available() const { return m_allocated; }
+
+  /// `band` がバッファに収まるかどうかを返す。
+  ///
+  /// バッファの大きさは起動後に変わらないので、どのタスクから呼んでもよい。
+  bool fits(const Bounds &band) const {
+    return m_allocated && band.w <= m_region.w && band.h <= m_region.h;
+  }
+
+  /// `band` をバッファで受け持てるよう原点を合わせる。
+  ///
+  /// `band` がバッファに収まらなければ `false` を返す。
+  /// 成功したらバッファは `bg` で塗りつぶされるので、受け持つウィジェットを
+  /// すべて描き直すこと。
+  bool acquire(const Bounds &band, uint16_t bg = TFT_BLACK) {
+    if (!fits(band)) {
+      return false;
+    }
+    m_region.x = band.x;
+    m_region.y = band.y;
+    m_canvas.setOrigin(band.x, band.y);
+    m_sprite.fillSprite(bg);
+    return true;
+  }
+
+  /// バッファへの描画先を返す。
+  Canvas &canvas() { return m_canvas; }
+
+  /// バッファのうち `dirty` の部分を LCD へ転送する。
+  ///
+  /// 転送は1回にまとめる。幅いっぱいの変更はそのまま、小さな矩形は
+  /// 作業領域に詰め直して、どちらでもなければ `dirty` の行を幅いっぱいに
+  /// 転送する。行ごとに転送すると、行の数だけ LCD の窓の設定が要るため。
+  void present(const Bounds &dirty) {
+    Bounds b = dirty.intersected(m_region);
+    if (b.empty()) {
+      return;
+    }
+    const uint16_t *pixels = static_cast<const uint16_t *>(
+        m_sprite.getPointer()); //< バイトスワップ済みの RGB565
+    const int16_t sx = b.x - m_region.x;
+    const int16_t sy = b.y - m_region.y;
+    const int64_t start = esp_timer_get_time();
+    const uint16_t *image;
+    if (b.w != m_region.w && b.area() <= SCRATCH_PIXELS) {
+      uint16_t *dst = m_scratch;
+      for (int16_t row = 0; row < b.h; ++row) {
+        std::memcpy(dst, pixels + (sy + row) * m_region.w + sx,
+                    size_t(b.w) * 2);
+        dst += b.w;
+      }
+      image = m_scratch;
+    } else {
+      b.x = m_region.x;
+      b.w = m_region.w;
+      image = pixels + sy * m_region.w;
+    }
+    // スプライトの画素は転送順に並んでいるので、バイトスワップさせない
+    const bool swap = M5.Lcd.getSwapBytes();
+    M5.Lcd.setSwapBytes(false);
+    M5.Lcd.pushImage(b.x, b.y, b.w, b.h, const_cast<uint16_t *>(image));
+    M5.Lcd.setSwapBytes(swap);
+    m_lastMicros = static_cast<uint32_t>(esp_timer_get_time() - start);
+    m_lastBytes = b.area() * 2;
+  }
+
+  /// 直前のフレームの統計情報を返す。
+  FrameStats lastFrame() const { return FrameStats{m_lastBytes, m_lastMicros}; }
+};
+} // namespace ui
+
+#endif
@@ -0,0 +1,220 @@
+/**
+ * @file glyph_atlas.hpp
+ * @brief 大きな時計用フォントの数字を事前にラスタライズしておくアトラスを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_GLYPH_ATLAS_HPP_
+#define _INCLUDE_GLYPH_ATLAS_HPP_
+
+// コンパイルエラーを防ぐため， Arduino.h で定義されているマクロをundef
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <M5Stack.h>
+#include <esp32-hal-log.h>
+#include <esp_timer.h>
+
+namespace ui {
+/// 事前にラスタライズしたグリフの集まり。
+///
+/// 時計表示で使う大きなフォント (6 番と 8 番) の "0"-"9" と ":" を
+/// 起動時に1ビットのマスクとして描いておき、以降は RLE フォントの展開を
+/// せずにビットマップとして転送する。
+/// 色は転送時にマスクから展開するので、黄色・暗い黄色など任意の前景色と
+/// 背景色の組み合わせに同じマスクを使える。
+class GlyphAtlas {
+public:
+  /// アトラスに含める文字。
+  static constexpr const char *CHARS = "0123456789:";
+  /// アトラスに含める文字の数。
+  static constexpr size_t NUM_CHARS = 11;
+  /// アトラスに含めるフォントの数。
+  static constexpr size_t NUM_FONTS = 2;
+  /// アトラスに含める `f` 番目のフォント。
+  static constexpr uint8_t fontAt(size_t f) { return f == 0 ? 6 : 8; }
+
+private:
+  /// 1文字分のマスク。
+  struct Glyph {
+    int16_t w = 0;
+    int16_t h = 0;
+    /// 1行 `(w + 7) / 8` バイト、 MSB が左端。
+    std::unique_ptr<uint8_t[]> bits;
+  };
+
+  Glyph m_glyphs[NUM_FONTS][NUM_CHARS];
+  /// LCD へ転送するときの展開用バッファ。
+  std::unique_ptr<uint16_t[]> m_scratch;
+  /// 展開用バッファの画素数。
+  size_t m_scratchSize = 0;
+  bool m_ready = false;
+
+public:
+  /// すべてのグリフをラスタライズする。
+  bool begin() {
+    TFT_eSprite sprite(&M5.Lcd);
+    sprite.setColorDepth(1);
+    size_t maxPixels = 0;
+    for (size_t f = 0; f < NUM_FONTS; ++f) {
+      for (size_t c = 0; c < NUM_CHARS; ++c) {
+        const char str[2] = {CHARS[c], '\0'};
+        Glyph &g = m_glyphs[f][c];
+        g.w = M5.Lcd.textWidth(str, fontAt(f));
+        g.h = M5.Lcd.fontHeight(fontAt(f));
+        if (sprite.createSprite(g.w, g.h) == nullptr) {
+          log_e("GlyphAtlas: failed to rasterize '%c' (font %d)", CHARS[c],
+                fontAt(f));
+          return false;
+        }
+        sprite.fillSprite(0);
+        sprite.setTextColor(1, 0);
+        sprite.drawChar(CHARS[c], 0, 0, fontAt(f));
+        const size_t stride = (g.w + 7) / 8;
+        g.bits.reset(new uint8_t[stride * g.h]());
+        for (int16_t y = 0; y < g.h; ++y) {
+          for (int16_t x = 0; x < g.w; ++x) {
+            if (sprite.readPixel(x, y)) {
+              g.bits[y * stride + x / 8] |= 0x80 >> (x % 8);
+            }
+          }
+        }
+        sprite.deleteSprite();
+        const size_t pixels = size_t(g.w) * g.h;
+        maxPixels = pixels > maxPixels ? pixels : maxPixels;
+      }
+    }
+    m_scratch.reset(new uint16_t[maxPixels]);
+    m_scratchSize = maxPixels;
+    m_ready = true;
+    return true;
+  }
+
+  /// `c` (`font` 番) のグリフがあれば `true` を返す。
+  bool contains(char c, uint8_t font) const {
+    return find(c, font) != nullptr;
+  }
+
+  /// LCD へグリフを転送する。
+  ///
+  /// グリフがなければ何もせず `false` を返す。
+  bool blit(TFT_eSPI &lcd, char c, int16_t x, int16_t y, uint8_t font,
+            uint16_t fg, uint16_t bg) {
+    const Glyph *g = find(c, font);
+    if (g == nullptr || size_t(g->w) * g->h > m_scratchSize) {
+      return false;
+    }
+    expand(*g, m_scratch.get(), g->w, swap(fg), swap(bg));
+    // 展開済みの画素は転送順に並んでいるので、バイトスワップさせない
+    const bool swapBytes = lcd.getSwapBytes();
+    lcd.setSwapBytes(false);
+    lcd.pushImage(x, y, g->w, g->h, m_scratch.get());
+    lcd.setSwapBytes(swapBytes);
+    return true;
+  }
+
+  /// RAM 上の画素列 (スプライトの中身) へグリフを書き込む。
+  ///
+  /// `pixels` は幅 `width` 、高さ `height` のバイトスワップ済み RGB565。
+  /// はみ出た部分は切り捨てる。グリフがなければ `false` を返す。
+  bool blit(uint16_t *pixels, int16_t width, int16_t height, char c,
+            int16_t x, int16_t y, uint8_t font, uint16_t fg,
+            uint16_t bg) const {
+    const Glyph *g = find(c, font);
+    if (g == nullptr) {
+      return false;
+    }
+    const uint16_t sfg = swap(fg), sbg = swap(bg);
+    const size_t stride = (g->w + 7) / 8;
+    for (int16_t gy = 0; gy < g->h; ++gy) {
+      const int16_t py = y + gy;
+      if (py < 0 || py >= height) {
+        continue;
+      }
+      const uint8_t *row = &g->bits[gy * stride];
+      uint16_t *dst = pixels + py * width;
+      for (int16_t gx = 0; gx < g->w; ++gx) {
+        const int16_t px = x + gx;
+        if (px < 0 || px >= width) {
+          continue;
+        }
+        dst[px] = (row[gx / 8] & (0x80 >> (gx % 8))) ? sfg : sbg;
+      }
+    }
+    return true;
+  }
+
+  /// 従来の描画とアトラスからの転送の1文字あたりの時間をログに出す。
+  ///
+  /// LCD の左上に実際に描画し、終わったらその部分を黒で塗りつぶす。
+  /// 起動が遅れるので、 `GLYPH_ATLAS_BENCHMARK` を定義したときだけ呼ばれる。
+  void benchmark(TFT_eSPI &lcd, int iterations = 20) {
+    if (!m_ready) {
+      return;
+    }
+    int16_t w = 0, h = 0;
+    for (size_t f = 0; f < NUM_FONTS; ++f) {
+      int64_t start = esp_timer_get_time();
+      for (int i = 0; i < iterations; ++i) {
+        lcd.setTextColor(TFT_YELLOW, TFT_BLACK);
+        lcd.drawChar(CHARS[i % 10], 0, 0, fontAt(f));
+      }
+      const int64_t drawChar = esp_timer_get_time() - start;
+      start = esp_timer_get_time();
+      for (int i = 0; i < iterations; ++i) {
+        blit(lcd, CHARS[i % 10], 0, 0, fontAt(f), TFT_YELLOW, TFT_BLACK);
+      }
+      const int64_t atlas = esp_timer_get_time() - start;
+      log_i("GlyphAtlas: font %d: drawChar %d us/digit, atlas %d us/digit",
+            fontAt(f), int(drawChar / iterations), int(atlas / iterations));
+      for (size_t c = 0; c < NUM_CHARS; ++c) {
+        w = m_glyphs[f][c].w > w ? m_glyphs[f][c].w : w;
+        h = m_glyphs[f][c].h > h ? m_glyphs[f][c].h : h;
+      }
+    }
+    lcd.fillRect(0, 0, w, h, TFT_BLACK);
+  }
+
+private:
+  const Glyph *find(char c, uint8_t font) const {
+    if (!m_ready) {
+      return nullptr;
+    }
+    size_t f = 0;
+    while (f < NUM_FONTS && fontAt(f) != font) {
+      ++f;
+    }
+    size_t i = 0;
+    while (i < NUM_CHARS && CHARS[i] != c) {
+      ++i;
+    }
+    if (f == NUM_FONTS || i == NUM_CHARS) {
+      return nullptr;
+    }
+    return &m_glyphs[f][i];
+  }
+
+  /// マスクを画素列に展開する。
+  static void expand(const Glyph &g, uint16_t *dst, int16_t dstWidth,
+                     uint16_t fg, uint16_t bg) {
+    const size_t stride = (g.w + 7) / 8;
+    for (int16_t y = 0; y < g.h; ++y) {
+      const uint8_t *row = &g.bits[y * stride];
+      for (int16_t x = 0; x < g.w; ++x) {
+        dst[y * dstWidth + x] = (row[x / 8] & (0x80 >> (x % 8))) ? fg : bg;
+      }
+    }
+  }
+
+  /// RGB565 を転送順 (上位バイトが先) に並べ替える。
+  static uint16_t swap(uint16_t c) { return uint16_t((c >> 8) | (c << 8)); }
+};
+} // namespace ui
+
+#endif
@@ -0,0 +1,66 @@
+/**
+ * @file render_queue.hpp
+ * @brief 描画命令をシーンから描画タスクへ渡すキューを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_RENDER_QUEUE_HPP_
+#define _INCLUDE_RENDER_QUEUE_HPP_
+
+#include <atomic>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#include "draw_command.hpp"
+
+namespace ui {
+/// 描画命令のキュー。
+class RenderQueue {
+private:
+  QueueHandle_t m_queue = nullptr;
+  /// 送信した命令の数。
+  std::atomic<uint32_t> m_sent{0};
+  /// キューが一杯で送信側が待たされた回数。
+  std::atomic<uint32_t> m_stalls{0};
+  /// 送信時に観測したキュー深さの最大値。
+  std::atomic<uint32_t> m_maxDepth{0};
+
+public:
+  /// キューを作成する。
+  void begin(UBaseType_t length) {
+    m_queue = xQueueCreate(length, sizeof(DrawCommand));
+  }
+
+  /// 命令を送信する。
+  ///
+  /// 命令を捨てると画面が崩れるので、キューが一杯なら空くまで待つ。
+  void push(const DrawCommand &cmd) {
+    uint32_t depth = uxQueueMessagesWaiting(m_queue) + 1;
+    if (depth > m_maxDepth) {
+      m_maxDepth = depth;
+    }
+    if (xQueueSendToBack(m_queue, &cmd, 0) != pdTRUE) {
+      m_stalls++;
+      xQueueSendToBack(m_queue, &cmd, portMAX_DELAY);
+    }
+    m_sent++;
+  }
+
+  /// 命令を受信する。
+  bool pop(DrawCommand &cmd, TickType_t timeout) {
+    return xQueueReceive(m_queue, &cmd, timeout) == pdTRUE;
+  }
+
+  /// キューに溜まっている命令の数を返す。
+  uint32_t depth() const { return uxQueueMessagesWaiting(m_queue); }
+  /// 送信した命令の数を返す。
+  uint32_t sent() const { return m_sent; }
+  /// 送信側が待たされた回数を返す。
+  uint32_t stalls() const { return m_stalls; }
+  /// キュー深さの最大値を返す。
+  uint32_t maxDepth() const { return m_maxDepth; }
+};
+} // namespace ui
+
+#endif
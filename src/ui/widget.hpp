@@ -0,0 +1,342 @@
+/**
+ * @file widget.hpp
+ * @brief 変更のあった部分だけを再描画する保持型ウィジェットを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_WIDGET_HPP_
+#define _INCLUDE_WIDGET_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "canvas.hpp"
+
+namespace ui {
+/// ウィジェットの基底クラス。
+///
+/// 状態を保持し、状態が変わったときだけ描画する。
+class Widget {
+private:
+  /// 再描画が必要か否か。
+  bool m_dirty = true;
+  /// 全体の再描画が必要か否か。
+  bool m_full = true;
+
+public:
+  // 基底クラスになるので virtual dtor を使う。
+  virtual ~Widget() = default;
+
+  /// 再描画が必要なら `true` を返す。
+  bool isDirty() const { return m_dirty; }
+
+  /// 全体を描き直させる。
+  ///
+  /// 画面をクリアしたあとなどに呼ぶ。
+  void invalidate() { m_dirty = m_full = true; }
+
+  /// 変更があれば描画し、描画した領域を返す。
+  Bounds render(Canvas &canvas) {
+    if (!m_dirty) {
+      return Bounds();
+    }
+    bool full = m_full;
+    m_dirty = m_full = false;
+    return draw(canvas, full);
+  }
+
+protected:
+  /// 状態の変更を記録する。
+  void markDirty() { m_dirty = true; }
+
+  /// 描画し、描画した領域を返す。
+  ///
+  /// `full` が `false` なら、前回から変わった部分だけ描画すればよい。
+  virtual Bounds draw(Canvas &canvas, bool full) = 0;
+};
+
+/// 文字列ラベル。
+class Label : public Widget {
+public:
+  /// 保持できる文字列の長さ。
+  static constexpr size_t CAPACITY = 48;
+
+private:
+  char m_text[CAPACITY] = {};
+  int16_t m_x;
+  int16_t m_y;
+  uint8_t m_font;
+  Align m_align;
+  uint16_t m_fg;
+  uint16_t m_bg;
+  /// 前回描画した領域。
+  Bounds m_drawn;
+
+public:
+  Label(int16_t x, int16_t y, uint8_t font, Align align = Align::Left,
+        uint16_t fg = TFT_WHITE, uint16_t bg = TFT_BLACK)
+      : m_x(x), m_y(y), m_font(font), m_align(align), m_fg(fg), m_bg(bg) {}
+
+  /// 文字列を設定する。
+  void setText(const char *text) {
+    if (std::strncmp(m_text, text, CAPACITY - 1) == 0) {
+      return;
+    }
+    std::strncpy(m_text, text, CAPACITY - 1);
+    m_text[CAPACITY - 1] = '\0';
+    markDirty();
+  }
+
+  /// 位置を設定する。
+  void setPosition(int16_t x, int16_t y) {
+    if (x == m_x && y == m_y) {
+      return;
+    }
+    m_x = x;
+    m_y = y;
+    markDirty();
+  }
+
+  /// 文字色を設定する。
+  void setColor(uint16_t fg) {
+    if (fg == m_fg) {
+      return;
+    }
+    m_fg = fg;
+    markDirty();
+  }
+
+  const char *text() const { return m_text; }
+
+protected:
+  virtual Bounds draw(Canvas &canvas, bool full) override {
+    Bounds b = canvas.textBounds(m_text, m_x, m_y, m_font, m_align);
+    // 前回の文字列のうち、今回覆われない部分を消す
+    canvas.fillDifference(m_drawn, b, m_bg);
+    canvas.drawText(m_text, m_x, m_y, m_font, m_align, m_fg, m_bg);
+    Bounds dirty = m_drawn.united(b);
+    m_drawn = b;
+    return dirty;
+  }
+};
+
+/// 0 埋めした固定桁数の数値。
+///
+/// 桁ごとに変更を追跡し、変わった桁だけを描き直す。
+class NumberField : public Widget {
+public:
+  /// 最大桁数。
+  static constexpr size_t MAX_DIGITS = 4;
+
+private:
+  int16_t m_x;
+  int16_t m_y;
+  uint8_t m_digits;
+  uint8_t m_font;
+  uint16_t m_fg;
+  uint16_t m_bg;
+  int m_value = 0;
+  /// 前回描画した各桁の文字。
+  char m_shown[MAX_DIGITS] = {};
+  /// 1桁の幅。 0 なら未計測。
+  int16_t m_cellWidth = 0;
+
+public:
+  NumberField(int16_t x, int16_t y, uint8_t digits, uint8_t font,
+              uint16_t fg = TFT_WHITE, uint16_t bg = TFT_BLACK)
+      : m_x(x), m_y(y), m_digits(digits < MAX_DIGITS ? digits : MAX_DIGITS),
+        m_font(font), m_fg(fg), m_bg(bg) {}
+
+  /// 値を設定する。
+  void setValue(int value) {
+    if (value == m_value) {
+      return;
+    }
+    m_value = value;
+    markDirty();
+  }
+
+  /// 位置を設定する。
+  void setPosition(int16_t x, int16_t y) {
+    if (x == m_x && y == m_y) {
+      return;
+    }
+    m_x = x;
+    m_y = y;
+    invalidate();
+  }
+
+  /// 全桁の幅を返す。
+  int16_t width(Canvas &canvas) { return cellWidth(canvas) * m_digits; }
+
+protected:
+  virtual Bounds draw(Canvas &canvas, bool full) override {
+    const int16_t cw = cellWidth(canvas);
+    const int16_t h = canvas.fontHeight(m_font);
+    Bounds dirty;
+    int v = m_value;
+    for (int i = m_digits - 1; i >= 0; --i) {
+      char c[2] = {char('0' + v % 10), '\0'};
+      v /= 10;
+      if (!full && m_shown[i] == c[0]) {
+        continue;
+      }
+      m_shown[i] = c[0];
+      int16_t x = m_x + cw * i;
+      canvas.drawText(c, x, m_y, m_font, Align::Left, m_fg, m_bg);
+      dirty = dirty.united(Bounds(x, m_y, cw, h));
+    }
+    return dirty;
+  }
+
+private:
+  int16_t cellWidth(Canvas &canvas) {
+    if (m_cellWidth == 0) {
+      m_cellWidth = canvas.textWidth("0", m_font);
+    }
+    return m_cellWidth;
+  }
+};
+
+/// 塗りつぶした矩形。
+class FilledRect : public Widget {
+private:
+  Bounds m_bounds;
+  uint16_t m_color;
+
+public:
+  FilledRect(const Bounds &bounds, uint16_t color)
+      : m_bounds(bounds), m_color(color) {}
+
+  /// 色を設定する。
+  void setColor(uint16_t color) {
+    if (color == m_color) {
+      return;
+    }
+    m_color = color;
+    markDirty();
+  }
+
+protected:
+  virtual Bounds draw(Canvas &canvas, bool full) override {
+    canvas.fillRect(m_bounds, m_color);
+    return m_bounds;
+  }
+};
+
+/// 選択中の項目を上下から挟む三角形のカーソル。
+class TriangleCursor : public Widget {
+public:
+  /// カーソルを置ける位置。
+  struct Slot {
+    /// 左端の x 座標。
+    int16_t x;
+    /// 上側の三角形の底辺の y 座標。
+    int16_t yTop;
+    /// 下側の三角形の底辺の y 座標。
+    int16_t yBottom;
+  };
+  /// カーソルを置ける位置の最大数。
+  static constexpr size_t MAX_SLOTS = 4;
+
+private:
+  Slot m_slots[MAX_SLOTS];
+  size_t m_numSlots;
+  uint16_t m_color;
+  uint16_t m_bg;
+  /// 選択中の位置。
+  size_t m_index = 0;
+  /// 前回描画した位置。 `m_numSlots` なら未描画。
+  size_t m_drawnIndex;
+
+  /// 三角形の頂点のオフセット。
+  static constexpr int16_t V1X = 5, V1Y = 7;
+  static constexpr int16_t V2X = 10, V2Y = 0;
+
+public:
+  TriangleCursor(const Slot *slots, size_t numSlots, uint16_t color,
+                 uint16_t bg = TFT_BLACK)
+      : m_numSlots(numSlots < MAX_SLOTS ? numSlots : MAX_SLOTS),
+        m_color(color), m_bg(bg), m_drawnIndex(m_numSlots) {
+    for (size_t i = 0; i < m_numSlots; ++i) {
+      m_slots[i] = slots[i];
+    }
+  }
+
+  /// 選択位置を設定する。
+  ///
+  /// 位置の数と同じ値を渡すとカーソルを消す。
+  void select(size_t index) {
+    if (index == m_index || index > m_numSlots) {
+      return;
+    }
+    m_index = index;
+    markDirty();
+  }
+
+protected:
+  virtual Bounds draw(Canvas &canvas, bool full) override {
+    Bounds dirty;
+    // 前回描画していた三角形を消す
+    if (!full && m_drawnIndex < m_numSlots && m_drawnIndex != m_index) {
+      dirty = dirty.united(drawSlot(canvas, m_slots[m_drawnIndex], m_bg));
+    }
+    // 今回の三角形を描く
+    if (m_index < m_numSlots) {
+      dirty = dirty.united(drawSlot(canvas, m_slots[m_index], m_color));
+    }
+    m_drawnIndex = m_index;
+    return dirty;
+  }
+
+private:
+  static Bounds drawSlot(Canvas &canvas, const Slot &s, uint16_t color) {
+    canvas.fillTriangle(s.x, s.yTop, s.x + V1X, s.yTop - V1Y, s.x + V2X,
+                        s.yTop - V2Y, color);
+    canvas.fillTriangle(s.x, s.yBottom, s.x + V1X, s.yBottom + V1Y, s.x + V2X,
+                        s.yBottom + V2Y, color);
+    return Canvas::triangleBounds(s.x, s.yTop, s.x + V1X, s.yTop - V1Y,
+                                  s.x + V2X, s.yTop - V2Y)
+        .united(Canvas::triangleBounds(s.x, s.yBottom, s.x + V1X,
+                                       s.yBottom + V1Y, s.x + V2X,
+                                       s.yBottom + V2Y));
+  }
+};
+
+/// ウィジェットの集まり。
+///
+/// ウィジェットの実体は持たず、参照だけを固定長の配列に保持する。
+template <size_t N> class Screen {
+private:
+  Widget *m_widgets[N] = {};
+  size_t m_count = 0;
+
+public:
+  /// ウィジェットを追加する。
+  ///
+  /// 追加順に描画されるので、重なるものは後ろに追加すること。
+  void add(Widget &widget) {
+    if (m_count < N) {
+      m_widgets[m_count++] = &widget;
+    }
+  }
+
+  /// 全ウィジェットを描き直させる。
+  void invalidateAll() {
+    for (size_t i = 0; i < m_count; ++i) {
+      m_widgets[i]->invalidate();
+    }
+  }
+
+  /// 変更のあったウィジェットだけを描画し、描画した領域の和を返す。
+  Bounds render(Canvas &canvas) {
+    Bounds dirty;
+    for (size_t i = 0; i < m_count; ++i) {
+      dirty = dirty.united(m_widgets[i]->render(canvas));
+    }
+    return dirty;
+  }
+};
+} // namespace ui
+
+#endif
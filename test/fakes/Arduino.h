@@ -0,0 +1,25 @@
+/**
+ * @file Arduino.h
+ * @brief ホストのテストで使う Arduino の代わり
+ */
+#pragma once
+#ifndef _INCLUDE_FAKE_ARDUINO_H_
+#define _INCLUDE_FAKE_ARDUINO_H_
+
+#include <cstdarg>
+#include <cstdio>
+
+/// 標準出力に書くシリアルポート。
+struct FakeSerial {
+  int printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    const int written = std::vprintf(format, args);
+    va_end(args);
+    return written;
+  }
+};
+
+static FakeSerial Serial;
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * @file FS.h
+ * @brief ホストのテストで使うファイルシステムの代わり
+ *
+ * ファイルの中身は RAM に置き、同じパスを開き直すと同じ中身が見える。
+ */
+#pragma once
+#ifndef _INCLUDE_FAKE_FS_H_
+#define _INCLUDE_FAKE_FS_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs {
+enum SeekMode { SeekSet, SeekCur, SeekEnd };
+
+/// 開いたファイル。中身はファイルシステムと共有する。
+class File {
+public:
+  File() = default;
+  explicit File(std::shared_ptr<std::vector<uint8_t>> data)
+      : m_data(data) {}
+
+  explicit operator bool() const { return m_data != nullptr; }
+
+  size_t read(uint8_t *buf, size_t size) {
+    if (!m_data || m_position >= m_data->size()) {
+      return 0;
+    }
+    const size_t n = std::min(size, m_data->size() - m_position);
+    std::memcpy(buf, m_data->data() + m_position, n);
+    m_position += n;
+    return n;
+  }
+  size_t write(const uint8_t *buf, size_t size) {
+    if (!m_data) {
+      return 0;
+    }
+    if (m_data->size() < m_position + size) {
+      m_data->resize(m_position + size);
+    }
+    std::memcpy(m_data->data() + m_position, buf, size);
+    m_position += size;
+    return size;
+  }
+  bool seek(uint32_t position, SeekMode mode = SeekSet) {
+    if (!m_data || mode != SeekSet) {
+      return false;
+    }
+    m_position = position;
+    return true;
+  }
+  void flush() {}
+  void close() { m_data.reset(); }
+
+private:
+  std::shared_ptr<std::vector<uint8_t>> m_data;
+  size_t m_position = 0;
+};
+
+/// RAM に中身を置くファイルシステム。
+class FS {
+public:
+  bool exists(const char *path) { return m_files.count(path) > 0; }
+
+  /// `"r+"` は既存のファイルを、 `"w+"` は空のファイルを開く。
+  File open(const char *path, const char *mode) {
+    auto &data = m_files[path];
+    if (std::strcmp(mode, "r+") == 0 && !data) {
+      m_files.erase(path);
+      return File();
+    }
+    if (!data || std::strcmp(mode, "w+") == 0) {
+      data = std::make_shared<std::vector<uint8_t>>();
+    }
+    return File(data);
+  }
+
+  /// ファイルの中身。テストが読む。
+  std::vector<uint8_t> &contents(const char *path) {
+    auto &data = m_files[path];
+    if (!data) {
+      data = std::make_shared<std::vector<uint8_t>>();
+    }
+    return *data;
+  }
+
+private:
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> m_files;
+};
+} // namespace fs
+
+#endif
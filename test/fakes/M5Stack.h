@@ -0,0 +1,78 @@
+/**
+ * @file M5Stack.h
+ * @brief ホストのテストで使う GPIO の代わり
+ *
+ * ピンの値はテストが `fake::setPin()` で決め、エッジ割り込みはその場で
+ * 呼ぶ。時刻は仮想の時計を読む。
+ */
+#pragma once
+#ifndef _INCLUDE_FAKE_M5STACK_H_
+#define _INCLUDE_FAKE_M5STACK_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "esp32-hal-log.h"
+#include "fake_clock.hpp"
+
+#define IRAM_ATTR
+
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x01
+#define CHANGE 0x03
+
+#define BUTTON_A_PIN 39
+#define BUTTON_B_PIN 38
+#define BUTTON_C_PIN 37
+
+namespace fake {
+/// ピンの数。
+constexpr size_t PIN_COUNT = 40;
+
+/// 1本のピンの状態。
+struct Pin {
+  /// 押されていないボタンはプルアップで HIGH 。
+  int level = HIGH;
+  void (*handler)(void *) = nullptr;
+  void *arg = nullptr;
+};
+
+inline Pin *pins() {
+  static Pin pins[PIN_COUNT];
+  return pins;
+}
+
+/// ピンの値を変え、エッジ割り込みが登録されていれば呼ぶ。
+inline void setPin(uint8_t pin, int level) {
+  Pin &p = pins()[pin];
+  if (p.level == level) {
+    return;
+  }
+  p.level = level;
+  if (p.handler) {
+    p.handler(p.arg);
+  }
+}
+} // namespace fake
+
+inline void pinMode(uint8_t, uint8_t) {}
+
+inline int digitalRead(uint8_t pin) { return fake::pins()[pin].level; }
+
+inline void attachInterruptArg(uint8_t pin, void (*handler)(void *),
+                               void *arg, int) {
+  fake::pins()[pin].handler = handler;
+  fake::pins()[pin].arg = arg;
+}
+
+inline void detachInterrupt(uint8_t pin) {
+  fake::pins()[pin].handler = nullptr;
+}
+
+/// 仮想の時計を返す。
+inline unsigned long millis() {
+  return static_cast<unsigned long>(fake::nowMicros() / 1000);
+}
+
+#endif
@@ -0,0 +1,20 @@
+/**
+ * @file esp32-hal-log.h
+ * @brief ホストのテストで使うログ出力の代わり。何も出さない
+ */
+#pragma once
+#ifndef _INCLUDE_FAKE_ESP32_HAL_LOG_H_
+#define _INCLUDE_FAKE_ESP32_HAL_LOG_H_
+
+namespace fake {
+/// 引数を使ったことにして捨てる。ログにだけ使う変数で警告を出さないため。
+template <typename... Args> inline void discardLog(const Args &...) {}
+} // namespace fake
+
+#define log_e(...) fake::discardLog(__VA_ARGS__)
+#define log_w(...) fake::discardLog(__VA_ARGS__)
+#define log_i(...) fake::discardLog(__VA_ARGS__)
+#define log_d(...) fake::discardLog(__VA_ARGS__)
+#define log_v(...) fake::discardLog(__VA_ARGS__)
+
+#endif
@@ -0,0 +1,16 @@
+/**
+ * @file esp_timer.h
+ * @brief ホストのテストで使う esp_timer の代わり
+ */
+#pragma once
+#ifndef _INCLUDE_FAKE_ESP_TIMER_H_
+#define _INCLUDE_FAKE_ESP_TIMER_H_
+
+#include <cstdint>
+
+#include "fake_clock.hpp"
+
+/// 仮想の時計を返す。
+inline int64_t esp_timer_get_time() { return fake::nowMicros(); }
+
+#endif
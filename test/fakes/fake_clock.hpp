@@ -0,0 +1,87 @@
+/**
+ * @file fake_clock.hpp
+ * @brief ホストのテストで使う仮想の時計とタイマーを持つ
+ */
+#pragma once
+#ifndef _INCLUDE_FAKE_CLOCK_HPP_
+#define _INCLUDE_FAKE_CLOCK_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace fake {
+/// 仮想の単調増加時計 [us]。
+///
+/// `esp_timer_get_time()` や `xTaskGetTickCount()` はこれを読む。
+/// テストが進めない限り進まない。
+inline int64_t &nowMicros() {
+  static int64_t now = 0;
+  return now;
+}
+
+/// 仮想の時計で満了するタイマー。
+///
+/// FreeRTOS のタイマーやタイマーサービスの代わりはこれを継承し、
+/// `advanceMicros()` が時刻の順に `fire()` を呼ぶ。
+class ClockTimer {
+public:
+  /// 満了する時刻 [us]。止まっていれば負。
+  int64_t dueMicros = -1;
+
+  ClockTimer() { all().push_back(this); }
+  ClockTimer(const ClockTimer &) = delete;
+  ClockTimer &operator=(const ClockTimer &) = delete;
+  virtual ~ClockTimer() {
+    auto &timers = all();
+    timers.erase(std::remove(timers.begin(), timers.end(), this),
+                 timers.end());
+  }
+
+  /// 満了したときに呼ばれる。 `dueMicros` は止まった状態で呼ばれる。
+  virtual void fire() = 0;
+
+  /// 生きているタイマーの一覧。
+  static std::vector<ClockTimer *> &all() {
+    static std::vector<ClockTimer *> timers;
+    return timers;
+  }
+
+  /// これまでに満了したタイマーの数。タスクが起きた回数に当たる。
+  static uint32_t &fired() {
+    static uint32_t count = 0;
+    return count;
+  }
+};
+
+/// 時計を `micros` だけ進め、その間に満了するタイマーを時刻の順に呼ぶ。
+inline void advanceMicros(int64_t micros) {
+  const int64_t end = nowMicros() + micros;
+  while (true) {
+    ClockTimer *next = nullptr;
+    for (ClockTimer *t : ClockTimer::all()) {
+      if (t->dueMicros >= 0 && t->dueMicros <= end &&
+          (next == nullptr || t->dueMicros < next->dueMicros)) {
+        next = t;
+      }
+    }
+    if (next == nullptr) {
+      break;
+    }
+    if (next->dueMicros > nowMicros()) {
+      nowMicros() = next->dueMicros;
+    }
+    next->dueMicros = -1;
+    ClockTimer::fired()++;
+    next->fire();
+  }
+  nowMicros() = end;
+}
+
+/// 時計を `millis` だけ進める。
+inline void advanceMillis(uint32_t millis) {
+  advanceMicros(int64_t(millis) * 1000);
+}
+} // namespace fake
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * @file fake_timer_service.hpp
+ * @brief ホストのテストで使うタイマーサービスの定義
+ *
+ * `hardware::TimerService` のホイールの代わりに、処理ごとに仮想の時計の
+ * タイマーを持つ。 `timer_service.cpp` の代わりに1つの翻訳単位でだけ
+ * 読み込む。
+ */
+#pragma once
+#ifndef _INCLUDE_FAKE_TIMER_SERVICE_HPP_
+#define _INCLUDE_FAKE_TIMER_SERVICE_HPP_
+
+#include <map>
+#include <memory>
+
+#include <hardware/timer_service.hpp>
+
+#include "fake_clock.hpp"
+
+namespace fake {
+/// 1つの処理を実行する仮想の時計のタイマー。
+class ServiceTimer : public ClockTimer {
+public:
+  hardware::TimerJob::Callback callback;
+  /// 周期 [ms]。 0 なら単発。
+  uint32_t periodMillis = 0;
+
+  virtual void fire() override {
+    if (periodMillis > 0) {
+      dueMicros = nowMicros() + int64_t(periodMillis) * 1000;
+    }
+    callback();
+  }
+};
+
+inline std::map<const hardware::TimerJob *, std::unique_ptr<ServiceTimer>> &
+serviceTimers() {
+  static std::map<const hardware::TimerJob *, std::unique_ptr<ServiceTimer>>
+      timers;
+  return timers;
+}
+} // namespace fake
+
+namespace hardware {
+void TimerService::begin(const TaskConfig &) {}
+
+void TimerService::start(TimerJob &job, uint32_t delayMillis,
+                         uint32_t period) {
+  auto &timer = fake::serviceTimers()[&job];
+  if (!timer) {
+    timer.reset(new fake::ServiceTimer);
+  }
+  timer->callback = job.m_callback;
+  timer->periodMillis = period * RESOLUTION_MILLIS;
+  const int64_t now = fake::nowMicros();
+  if (period > 0) {
+    // 実機と同じく、周期の倍数にそろえる
+    const int64_t p = int64_t(timer->periodMillis) * 1000;
+    timer->dueMicros = (now / p + 1) * p;
+  } else {
+    timer->dueMicros = now + int64_t(delayMillis) * 1000;
+  }
+}
+
+void TimerService::stop(TimerJob &job) { fake::serviceTimers().erase(&job); }
+} // namespace hardware
+
+#endif
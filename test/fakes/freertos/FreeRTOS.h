@@ -0,0 +1,44 @@
+/**
+ * @file FreeRTOS.h
+ * @brief ホストのテストで使う FreeRTOS の型とマクロの代わり
+ */
+#pragma once
+#ifndef _INCLUDE_FAKE_FREERTOS_H_
+#define _INCLUDE_FAKE_FREERTOS_H_
+
+#include <cstdint>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY UINT32_MAX
+/// 仮想の時計では 1 tick を 1 ms とする。
+#define portTICK_PERIOD_MS 1
+
+/// クリティカルセクションの代わりのスピンロック。
+///
+/// 実機と同じく波括弧で初期化できるよう、集成体にする。
+struct portMUX_TYPE {
+  int locked;
+};
+#define portMUX_INITIALIZER_UNLOCKED                                           \
+  { 0 }
+
+inline void fakeEnterCritical(portMUX_TYPE *mux) {
+  while (__atomic_exchange_n(&mux->locked, 1, __ATOMIC_ACQUIRE)) {
+  }
+}
+inline void fakeExitCritical(portMUX_TYPE *mux) {
+  __atomic_store_n(&mux->locked, 0, __ATOMIC_RELEASE);
+}
+#define portENTER_CRITICAL(mux) fakeEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) fakeExitCritical(mux)
+/// 割り込みはテストのスレッドで呼ばれるので、切り替えるタスクはない。
+#define portYIELD_FROM_ISR()
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * @file queue.h
+ * @brief ホストのテストで使う FreeRTOS のキューの代わり
+ *
+ * 1つのスレッドから使う前提で、待つ代わりにすぐ失敗する。
+ * 領域は作成時にだけ確保し、送受信ではヒープを使わない。
+ */
+#pragma once
+#ifndef _INCLUDE_FAKE_QUEUE_H_
+#define _INCLUDE_FAKE_QUEUE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "FreeRTOS.h"
+
+struct QueueDefinition {
+  size_t itemSize;
+  size_t length;
+  std::vector<uint8_t> storage;
+  /// 先頭の要素の位置。
+  size_t head;
+  /// 積まれている要素の数。
+  size_t count;
+};
+typedef QueueDefinition *QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  return new QueueDefinition{itemSize, length,
+                             std::vector<uint8_t>(length * itemSize), 0, 0};
+}
+
+inline BaseType_t xQueueSendToBack(QueueHandle_t q, const void *item,
+                                   TickType_t) {
+  if (q->count == q->length) {
+    return pdFALSE;
+  }
+  const size_t tail = (q->head + q->count) % q->length;
+  std::memcpy(&q->storage[tail * q->itemSize], item, q->itemSize);
+  q->count++;
+  return pdTRUE;
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t q, const void *item,
+                             TickType_t wait) {
+  return xQueueSendToBack(q, item, wait);
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t) {
+  if (q->count == 0) {
+    return pdFALSE;
+  }
+  std::memcpy(item, &q->storage[q->head * q->itemSize], q->itemSize);
+  q->head = (q->head + 1) % q->length;
+  q->count--;
+  return pdTRUE;
+}
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+  return static_cast<UBaseType_t>(q->count);
+}
+
+#endif
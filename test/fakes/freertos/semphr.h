@@ -0,0 +1,44 @@
+/**
+ * @file semphr.h
+ * @brief ホストのテストで使う FreeRTOS の計数セマフォの代わり
+ *
+ * 1つのスレッドから使う前提で、待つ代わりにすぐ失敗する。
+ */
+#pragma once
+#ifndef _INCLUDE_FAKE_SEMPHR_H_
+#define _INCLUDE_FAKE_SEMPHR_H_
+
+#include "FreeRTOS.h"
+
+struct SemaphoreDefinition {
+  UBaseType_t max;
+  UBaseType_t count;
+};
+typedef SemaphoreDefinition *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max,
+                                                  UBaseType_t initial) {
+  return new SemaphoreDefinition{max, initial};
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+  if (s->count == s->max) {
+    return pdFALSE;
+  }
+  s->count++;
+  return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t) {
+  if (s->count == 0) {
+    return pdFALSE;
+  }
+  s->count--;
+  return pdTRUE;
+}
+
+inline UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t s) {
+  return s->count;
+}
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * @file task.h
+ * @brief ホストのテストで使う FreeRTOS のタスクの代わり
+ */
+#pragma once
+#ifndef _INCLUDE_FAKE_TASK_H_
+#define _INCLUDE_FAKE_TASK_H_
+
+#include <functional>
+#include <vector>
+
+#include "../fake_clock.hpp"
+#include "FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+namespace fake {
+/// 作成されたタスク。テストが `function(arg)` を呼んで動かす。
+struct Task {
+  TaskFunction_t function;
+  void *arg;
+  const char *name;
+};
+
+/// 作成されたタスクの一覧。ハンドルは添字 + 1 。
+inline std::vector<Task> &tasks() {
+  static std::vector<Task> created;
+  return created;
+}
+
+/// 実行中のタスクのハンドル。テストのスレッドなら NULL 。
+inline TaskHandle_t &currentTask() {
+  static TaskHandle_t current = NULL;
+  return current;
+}
+
+/// 届いてまだ受け取られていない通知の数。
+inline uint32_t &pendingNotifications() {
+  static uint32_t count = 0;
+  return count;
+}
+
+/// `ulTaskNotifyTake()` の中身。待つ tick 数を受け取り、受け取った通知の数を
+/// 返す。テストが仮想の時計を進めて差し替える。
+inline std::function<uint32_t(TickType_t)> &notifyTake() {
+  static std::function<uint32_t(TickType_t)> take;
+  return take;
+}
+} // namespace fake
+
+/// 仮想の時計を tick で返す。
+inline TickType_t xTaskGetTickCount() {
+  return static_cast<TickType_t>(fake::nowMicros() / 1000 /
+                                 portTICK_PERIOD_MS);
+}
+
+/// タスクを記録するだけで、実行はしない。
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function,
+                                          const char *name, uint32_t,
+                                          void *arg, UBaseType_t,
+                                          TaskHandle_t *handle, BaseType_t) {
+  fake::tasks().push_back(fake::Task{function, arg, name});
+  if (handle != NULL) {
+    *handle = reinterpret_cast<TaskHandle_t>(fake::tasks().size());
+  }
+  return pdPASS;
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return fake::currentTask(); }
+
+inline void xTaskNotifyGive(TaskHandle_t) { fake::pendingNotifications()++; }
+
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t wait) {
+  return fake::notifyTake()(wait);
+}
+
+inline void vTaskDelete(TaskHandle_t) {}
+
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 0; }
+
+#endif
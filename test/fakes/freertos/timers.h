@@ -0,0 +1,103 @@
+/**
+ * @file timers.h
+ * @brief ホストのテストで使う FreeRTOS のソフトウェアタイマーの代わり
+ *
+ * 仮想の時計で満了し、 `fake::advanceMicros()` の中でコールバックが呼ばれる。
+ */
+#pragma once
+#ifndef _INCLUDE_FAKE_TIMERS_H_
+#define _INCLUDE_FAKE_TIMERS_H_
+
+#include "../fake_clock.hpp"
+#include "FreeRTOS.h"
+
+struct tmrTimerControl;
+typedef tmrTimerControl *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+typedef void (*PendedFunction_t)(void *arg1, uint32_t arg2);
+
+struct tmrTimerControl : public fake::ClockTimer {
+  TickType_t period;
+  bool autoReload;
+  void *id;
+  TimerCallbackFunction_t callback;
+
+  tmrTimerControl(TickType_t period, bool autoReload, void *id,
+                  TimerCallbackFunction_t callback)
+      : period(period), autoReload(autoReload), id(id), callback(callback) {}
+
+  void start() {
+    dueMicros =
+        fake::nowMicros() + int64_t(period) * portTICK_PERIOD_MS * 1000;
+  }
+
+  virtual void fire() override {
+    if (autoReload) {
+      start();
+    }
+    callback(this);
+  }
+};
+
+namespace fake {
+/// `true` なら `xTimerCreate()` が失敗する。
+inline bool &failTimerCreate() {
+  static bool fail = false;
+  return fail;
+}
+} // namespace fake
+
+inline TimerHandle_t xTimerCreate(const char *, TickType_t period,
+                                  UBaseType_t autoReload, void *id,
+                                  TimerCallbackFunction_t callback) {
+  if (fake::failTimerCreate()) {
+    return NULL;
+  }
+  return new tmrTimerControl(period, autoReload != pdFALSE, id, callback);
+}
+
+inline BaseType_t xTimerStart(TimerHandle_t timer, TickType_t) {
+  timer->start();
+  return pdPASS;
+}
+
+inline BaseType_t xTimerReset(TimerHandle_t timer, TickType_t) {
+  timer->start();
+  return pdPASS;
+}
+
+inline BaseType_t xTimerResetFromISR(TimerHandle_t timer, BaseType_t *woken) {
+  timer->start();
+  if (woken) {
+    *woken = pdFALSE;
+  }
+  return pdPASS;
+}
+
+inline BaseType_t xTimerStop(TimerHandle_t timer, TickType_t) {
+  timer->dueMicros = -1;
+  return pdPASS;
+}
+
+inline BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period,
+                                     TickType_t) {
+  timer->period = period;
+  timer->start();
+  return pdPASS;
+}
+
+inline void *pvTimerGetTimerID(TimerHandle_t timer) { return timer->id; }
+
+/// 割り込みはテストのスレッドで呼ばれるので、タイマーデーモンに任せずに
+/// その場で呼ぶ。
+inline BaseType_t xTimerPendFunctionCallFromISR(PendedFunction_t function,
+                                                void *arg1, uint32_t arg2,
+                                                BaseType_t *woken) {
+  function(arg1, arg2);
+  if (woken) {
+    *woken = pdFALSE;
+  }
+  return pdPASS;
+}
+
+#endif
@@ -0,0 +1,13 @@
+/**
+ * @file MPU9250.h
+ * @brief ホストのテストで使う MPU9250 の代わり
+ *
+ * テストは `hardware::ImuPort` の代わりを使うので、型だけがあればよい。
+ */
+#pragma once
+#ifndef _INCLUDE_FAKE_MPU9250_H_
+#define _INCLUDE_FAKE_MPU9250_H_
+
+class MPU9250 {};
+
+#endif
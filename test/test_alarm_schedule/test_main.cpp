@@ -0,0 +1,173 @@
+/**
+ * @file test_main.cpp
+ * @brief `sugar::AlarmSchedule` を1年分鳴らして確かめる
+ */
+#include <unity.h>
+
+#include <alarm_schedule.hpp>
+
+using sugar::AlarmRule;
+using sugar::AlarmSchedule;
+using sugar::TimeOfDay;
+using Millis = AlarmSchedule::Millis;
+
+namespace {
+/// 2021-01-01 (金曜日)
+constexpr int32_t FIRST_DAY = 18628;
+constexpr int32_t DAYS_IN_YEAR = 365;
+constexpr Millis YEAR_BEGIN = FIRST_DAY * AlarmSchedule::MILLIS_PER_DAY;
+constexpr Millis YEAR_END =
+    YEAR_BEGIN + DAYS_IN_YEAR * AlarmSchedule::MILLIS_PER_DAY;
+/// 鳴動を取り出すまでの遅れ [ms]
+constexpr Millis LATENCY = 5;
+
+/// 1年分の鳴動の結果。
+struct YearRun {
+  int count = 0;
+  /// 期限の前に取り出せた、期限に取り出せなかった、期限の順でなかった回数。
+  int errors = 0;
+};
+
+/// 1年分の鳴動を期限の少し後に取り出し、 `onFiring` に渡す。
+template <typename F> YearRun runYear(AlarmSchedule &schedule, F onFiring) {
+  YearRun run;
+  Millis previous = YEAR_BEGIN;
+  while (schedule.nextDeadline() < YEAR_END) {
+    const Millis deadline = schedule.nextDeadline();
+    AlarmSchedule::Firing firing;
+    if (schedule.pop(deadline - 1, firing)) {
+      run.errors++;
+    }
+    if (!schedule.pop(deadline + LATENCY, firing)) {
+      run.errors++;
+      break;
+    }
+    if (firing.deadline != deadline || firing.deadline < previous) {
+      run.errors++;
+    }
+    previous = firing.deadline;
+    onFiring(firing);
+    run.count++;
+  }
+  return run;
+}
+
+int countWeekdays(uint8_t weekdays) {
+  int count = 0;
+  for (int32_t day = FIRST_DAY; day < FIRST_DAY + DAYS_IN_YEAR; ++day) {
+    if (weekdays & (1 << AlarmSchedule::weekdayOf(day))) {
+      ++count;
+    }
+  }
+  return count;
+}
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_weekly_alarm_fires_on_every_selected_day() {
+  AlarmSchedule schedule;
+  const auto time = TimeOfDay::fromHms(7, 30);
+  schedule.set(0, AlarmRule::weekly(time, sugar::WORKDAYS), YEAR_BEGIN);
+  bool wrongDay = false;
+  bool wrongTime = false;
+  const YearRun run = runYear(schedule, [&](const AlarmSchedule::Firing &f) {
+    const int wd = AlarmSchedule::weekdayOf(AlarmSchedule::dayOf(f.deadline));
+    wrongDay |= !(sugar::WORKDAYS & (1 << wd));
+    wrongTime |= f.deadline % AlarmSchedule::MILLIS_PER_DAY !=
+                 time.millisSinceMidnight();
+  });
+  TEST_ASSERT_EQUAL(0, run.errors);
+  TEST_ASSERT_FALSE(wrongDay);
+  TEST_ASSERT_FALSE(wrongTime);
+  TEST_ASSERT_EQUAL(261, run.count);
+  TEST_ASSERT_EQUAL(countWeekdays(sugar::WORKDAYS), run.count);
+  // 繰り返しの予定は年をまたいでも残る
+  TEST_ASSERT_EQUAL(1, schedule.size());
+}
+
+void test_alarms_fire_in_deadline_order() {
+  AlarmSchedule schedule;
+  schedule.set(0, AlarmRule::weekly(TimeOfDay::fromHms(7), sugar::WORKDAYS),
+               YEAR_BEGIN);
+  schedule.set(1, AlarmRule::weekly(TimeOfDay::fromHms(9), sugar::WEEKENDS),
+               YEAR_BEGIN);
+  schedule.set(2, AlarmRule::weekly(TimeOfDay::fromHms(6, 59), sugar::MONDAY),
+               YEAR_BEGIN);
+  schedule.set(3, AlarmRule::once(TimeOfDay::fromHms(12), FIRST_DAY + 100),
+               YEAR_BEGIN);
+  int perId[4] = {};
+  const YearRun run = runYear(
+      schedule, [&](const AlarmSchedule::Firing &f) { perId[f.id]++; });
+  TEST_ASSERT_EQUAL(0, run.errors);
+  TEST_ASSERT_EQUAL(countWeekdays(sugar::WORKDAYS), perId[0]);
+  TEST_ASSERT_EQUAL(countWeekdays(sugar::WEEKENDS), perId[1]);
+  TEST_ASSERT_EQUAL(countWeekdays(sugar::MONDAY), perId[2]);
+  TEST_ASSERT_EQUAL(1, perId[3]);
+  TEST_ASSERT_EQUAL(perId[0] + perId[1] + perId[2] + perId[3], run.count);
+  // 1回だけの予定は鳴ったら消える
+  TEST_ASSERT_NULL(schedule.rule(3));
+  TEST_ASSERT_EQUAL(3, schedule.size());
+}
+
+void test_skipping_more_days_than_the_table_holds() {
+  AlarmSchedule schedule;
+  schedule.set(0, AlarmRule::weekly(TimeOfDay::fromHms(7), sugar::EVERY_DAY),
+               YEAR_BEGIN);
+  // 毎週月曜日を休むので、1年で鳴らさない日の枠の何倍も使う
+  int skipped = 0;
+  bool skipFailed = false;
+  const YearRun run = runYear(schedule, [&](const AlarmSchedule::Firing &f) {
+    const int32_t tomorrow = AlarmSchedule::dayOf(f.deadline) + 1;
+    if (AlarmSchedule::weekdayOf(tomorrow) == 1 &&
+        tomorrow < FIRST_DAY + DAYS_IN_YEAR) {
+      skipFailed |= !schedule.skip(tomorrow, f.deadline + LATENCY);
+      ++skipped;
+    }
+  });
+  TEST_ASSERT_EQUAL(0, run.errors);
+  TEST_ASSERT_FALSE(skipFailed);
+  TEST_ASSERT_GREATER_THAN(static_cast<int>(AlarmSchedule::MAX_SKIP_DATES),
+                           skipped);
+  TEST_ASSERT_EQUAL(DAYS_IN_YEAR - skipped, run.count);
+}
+
+void test_skip_dates_in_the_future_are_kept() {
+  AlarmSchedule schedule;
+  schedule.set(0, AlarmRule::weekly(TimeOfDay::fromHms(7), sugar::EVERY_DAY),
+               YEAR_BEGIN);
+  // 年の後半の日を先に全部の枠まで予約しておく
+  for (size_t i = 0; i < AlarmSchedule::MAX_SKIP_DATES; ++i) {
+    TEST_ASSERT_TRUE(schedule.skip(FIRST_DAY + 200 + i, YEAR_BEGIN));
+  }
+  TEST_ASSERT_FALSE(schedule.skip(FIRST_DAY + 300, YEAR_BEGIN));
+  const YearRun run = runYear(schedule, [](const AlarmSchedule::Firing &) {});
+  TEST_ASSERT_EQUAL(0, run.errors);
+  TEST_ASSERT_EQUAL(DAYS_IN_YEAR - AlarmSchedule::MAX_SKIP_DATES, run.count);
+  // 過ぎた日は消えているので、また予約できる
+  TEST_ASSERT_TRUE(schedule.skip(FIRST_DAY + DAYS_IN_YEAR + 1, YEAR_END));
+}
+
+void test_late_pop_schedules_the_next_firing_after_now() {
+  AlarmSchedule schedule;
+  schedule.set(0, AlarmRule::weekly(TimeOfDay::fromHms(7), sugar::EVERY_DAY),
+               YEAR_BEGIN);
+  // 時計が10日進んでも、鳴るのは1回だけ
+  const Millis now = YEAR_BEGIN + 10 * AlarmSchedule::MILLIS_PER_DAY;
+  AlarmSchedule::Firing firing;
+  TEST_ASSERT_TRUE(schedule.pop(now, firing));
+  TEST_ASSERT_EQUAL(YEAR_BEGIN + 7 * 3600 * 1000, firing.deadline);
+  TEST_ASSERT_FALSE(schedule.pop(now, firing));
+  TEST_ASSERT_GREATER_OR_EQUAL(now, schedule.nextDeadline());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_weekly_alarm_fires_on_every_selected_day);
+  RUN_TEST(test_alarms_fire_in_deadline_order);
+  RUN_TEST(test_skipping_more_days_than_the_table_holds);
+  RUN_TEST(test_skip_dates_in_the_future_are_kept);
+  RUN_TEST(test_late_pop_schedules_the_next_firing_after_now);
+  return UNITY_END();
+}
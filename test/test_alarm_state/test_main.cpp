@@ -0,0 +1,184 @@
+/**
+ * @file test_main.cpp
+ * @brief 複数のスレッドから `hardware::SharedAlarmState` を読み書きし、
+ * 途中まで書き換えられた値を読まないことを確かめる
+ */
+#include <unity.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <hardware/alarm_state.hpp>
+
+using hardware::AlarmSnapshot;
+using hardware::SharedAlarmState;
+using sugar::TimeOfDay;
+
+namespace {
+constexpr uint32_t WRITES = 1000000;
+constexpr int READERS = 3;
+/// この回数書くごとに、読み手へ CPU を譲る。
+///
+/// コアが1つのマシンでも、読み手が書き込みの合間に読めるようにする。
+constexpr uint32_t YIELD_EVERY = 1024;
+
+/// 書き込みの番号 `k` から決まる状態。
+///
+/// 時刻と曜日と有効か否かがすべて `k` から決まるので、別々の書き込みの
+/// 値が混ざると食い違う。
+bool enabledOf(uint32_t k) { return (k >> 7) & 1; }
+uint8_t weekdaysOf(uint32_t k) { return k & 0x7F; }
+uint32_t millisOf(uint32_t k) { return (k * 2654435761u) % 86400000u; }
+
+void storeKey(SharedAlarmState &state, uint32_t k) {
+  state.store(enabledOf(k), TimeOfDay(std::chrono::milliseconds(millisOf(k))),
+              weekdaysOf(k));
+}
+
+/// 読んだ値が書き込み番号 `k` の状態と一致するかどうか。
+bool matches(const AlarmSnapshot &s, uint32_t k) {
+  return s.enabled == enabledOf(k) && s.weekdays == weekdaysOf(k) &&
+         s.time.millisSinceMidnight() == millisOf(k);
+}
+
+/// 読み手の結果。
+struct ReaderResult {
+  uint32_t reads = 0;
+  /// 食い違った値を読んだ回数。
+  uint32_t torn = 0;
+  /// 世代番号が戻った回数。
+  uint32_t backwards = 0;
+  /// 読めた異なる世代の数。
+  uint32_t generations = 0;
+};
+
+/// 書き手が終わるまで読み続ける。
+///
+/// 書き手が1つで世代番号 `g` の状態は書き込み番号 `g` のもの、という前提。
+void readUntil(const SharedAlarmState &state, std::atomic<int> &started,
+               const std::atomic<bool> &done, ReaderResult &result) {
+  started++;
+  uint32_t last = 0;
+  while (!done.load(std::memory_order_acquire)) {
+    const AlarmSnapshot s = state.load();
+    result.reads++;
+    if (s.generation != 0 && !matches(s, s.generation)) {
+      result.torn++;
+    }
+    if (s.generation < last) {
+      result.backwards++;
+    }
+    if (s.generation != last) {
+      result.generations++;
+    }
+    last = s.generation;
+  }
+}
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_concurrent_reads_are_never_torn() {
+  SharedAlarmState state;
+  std::atomic<int> started{0};
+  std::atomic<bool> done{false};
+  ReaderResult results[READERS];
+  std::vector<std::thread> readers;
+  for (int i = 0; i < READERS; ++i) {
+    readers.emplace_back(readUntil, std::cref(state), std::ref(started),
+                         std::cref(done), std::ref(results[i]));
+  }
+  // 読み手がそろってから書き始める
+  while (started < READERS) {
+    std::this_thread::yield();
+  }
+  for (uint32_t k = 1; k <= WRITES; ++k) {
+    storeKey(state, k);
+    if (k % YIELD_EVERY == 0) {
+      std::this_thread::yield();
+    }
+  }
+  done = true;
+  for (auto &t : readers) {
+    t.join();
+  }
+  uint32_t reads = 0;
+  uint32_t generations = 0;
+  for (const auto &r : results) {
+    TEST_ASSERT_EQUAL(0, r.torn);
+    TEST_ASSERT_EQUAL(0, r.backwards);
+    reads += r.reads;
+    generations += r.generations;
+  }
+  char line[96];
+  std::snprintf(line, sizeof(line),
+                "%u reads saw %u distinct generations out of %u writes",
+                reads, generations, WRITES);
+  TEST_MESSAGE(line);
+  // 書き込みと読み出しが実際に重なったこと
+  TEST_ASSERT_GREATER_THAN(READERS, generations);
+  TEST_ASSERT_EQUAL(WRITES, state.generation());
+  TEST_ASSERT_TRUE(matches(state.load(), WRITES));
+}
+
+void test_concurrent_writers_are_serialized() {
+  SharedAlarmState state;
+  std::atomic<bool> started{false};
+  std::atomic<bool> done{false};
+  std::atomic<uint32_t> torn{0};
+  std::atomic<uint32_t> conditionalWrites{0};
+  // 書き手が2つあると世代番号から書き込み番号は決まらないので、
+  // 時刻に書き込み番号を埋め込んで確かめる
+  std::thread reader([&] {
+    started = true;
+    while (!done.load(std::memory_order_acquire)) {
+      const AlarmSnapshot s = state.load();
+      const uint32_t k = s.time.millisSinceMidnight() / 64;
+      if (s.generation != 0 &&
+          (s.enabled != enabledOf(k) || s.weekdays != weekdaysOf(k))) {
+        torn++;
+      }
+    }
+  });
+  auto timeOfKey = [](uint32_t k) {
+    return TimeOfDay(std::chrono::milliseconds(k * 64));
+  };
+  std::thread conditional([&] {
+    for (uint32_t k = 1; k <= WRITES; k += 2) {
+      // 読んだ世代のまま書ければ上書きし、間に書かれていれば諦める
+      const uint32_t g = state.generation();
+      if (state.compareAndStore(g, enabledOf(k), timeOfKey(k), weekdaysOf(k))) {
+        conditionalWrites++;
+      }
+      if (k % YIELD_EVERY == 1) {
+        std::this_thread::yield();
+      }
+    }
+  });
+  while (!started) {
+    std::this_thread::yield();
+  }
+  for (uint32_t k = 2; k <= WRITES; k += 2) {
+    state.store(enabledOf(k), timeOfKey(k), weekdaysOf(k));
+    if (k % YIELD_EVERY == 0) {
+      std::this_thread::yield();
+    }
+  }
+  conditional.join();
+  done = true;
+  reader.join();
+  TEST_ASSERT_EQUAL(0, torn);
+  // 書き込みはどれも失われず、世代番号は書いた回数だけ進む
+  TEST_ASSERT_EQUAL(WRITES / 2 + conditionalWrites, state.generation());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_concurrent_reads_are_never_torn);
+  RUN_TEST(test_concurrent_writers_are_serialized);
+  return UNITY_END();
+}
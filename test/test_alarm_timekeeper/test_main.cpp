@@ -0,0 +1,243 @@
+/**
+ * @file test_main.cpp
+ * @brief 仮想の時計で `hardware::AlarmTimekeeper` の鳴動の誤差を確かめる
+ */
+#include <unity.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include <hardware/alarm_timekeeper.hpp>
+
+using hardware::AlarmTimekeeper;
+using sugar::AlarmRule;
+using sugar::AlarmSchedule;
+using sugar::TimeOfDay;
+
+namespace {
+constexpr int64_t MICROS_PER_DAY = AlarmSchedule::MILLIS_PER_DAY * 1000;
+constexpr int64_t CHECK_PERIOD_MICROS =
+    int64_t(AlarmTimekeeper::CLOCK_CHECK_PERIOD_MILLIS) * 1000;
+/// 2021-01-01 00:00 (日本標準時) [us]
+constexpr int64_t EPOCH = 18628 * MICROS_PER_DAY;
+/// タイマーの満了からタスクが起きるまでの遅れ [us]
+constexpr int64_t TIMER_LATENCY_MICROS = 300;
+
+/// 壁時計の飛び。
+struct ClockJump {
+  /// 飛ぶ時刻 (単調増加時計) [us]。
+  int64_t at;
+  /// 壁時計の変化 [us]。
+  int64_t by;
+};
+
+/// `AlarmManager::task()` と同じ順に計時を進める仮想の環境。
+///
+/// タスクはタイマーの満了か、時計の確認周期のどちらか早い方で起きる。
+/// 壁時計は単調増加時計に差を足したもので、飛びはその差を変える。
+class Simulation {
+public:
+  AlarmSchedule schedule;
+  std::vector<ClockJump> jumps;
+  /// 鳴らした予定の遅れ [us]。
+  std::vector<int64_t> errors;
+  int missed = 0;
+  int clockJumps = 0;
+  /// タスクが起きた回数。
+  int wakeups = 0;
+
+  int64_t wall() const { return m_monotonic + m_offset; }
+
+  /// 単調増加時計で `duration` だけ動かす。
+  void run(int64_t duration) {
+    const int64_t end = m_monotonic + duration;
+    if (!m_started) {
+      m_keeper.start(wall(), m_monotonic);
+      arm();
+      m_started = true;
+    }
+    while (true) {
+      int64_t wake = m_monotonic + CHECK_PERIOD_MICROS;
+      if (m_timerAt >= 0 && m_timerAt + TIMER_LATENCY_MICROS < wake) {
+        wake = m_timerAt + TIMER_LATENCY_MICROS;
+      }
+      if (wake > end) {
+        advanceTo(end);
+        return;
+      }
+      advanceTo(wake);
+      step();
+    }
+  }
+
+private:
+  AlarmTimekeeper m_keeper;
+  int64_t m_monotonic = 0;
+  int64_t m_offset = EPOCH;
+  /// タイマーが満了する時刻 (単調増加時計)。止まっていれば負。
+  int64_t m_timerAt = -1;
+  size_t m_nextJump = 0;
+  bool m_started = false;
+
+  void advanceTo(int64_t t) {
+    while (m_nextJump < jumps.size() && jumps[m_nextJump].at <= t) {
+      m_offset += jumps[m_nextJump].by;
+      m_nextJump++;
+    }
+    m_monotonic = t;
+    if (m_timerAt >= 0 && m_timerAt <= t) {
+      m_timerAt = -1;
+    }
+  }
+
+  void step() {
+    wakeups++;
+    const int64_t now = wall();
+    if (m_keeper.detectClockJump(now, m_monotonic)) {
+      clockJumps++;
+    }
+    AlarmTimekeeper::fireDue(
+        schedule, now,
+        [this](const AlarmSchedule::Firing &, int64_t late, bool isMissed) {
+          if (isMissed) {
+            missed++;
+          } else {
+            errors.push_back(late);
+          }
+        });
+    arm();
+  }
+
+  void arm() {
+    const int64_t delay = AlarmTimekeeper::timerDelayMicros(schedule, wall());
+    m_timerAt = delay > 0 ? m_monotonic + delay : -1;
+  }
+};
+
+/// 鳴動の誤差を出力し、最大値 [us] を返す。
+int64_t reportErrors(const char *name, const std::vector<int64_t> &errors) {
+  int64_t worst = 0;
+  int64_t sum = 0;
+  for (int64_t e : errors) {
+    worst = e > worst ? e : worst;
+    sum += e;
+  }
+  char line[128];
+  std::snprintf(line, sizeof(line),
+                "%s: %u firings, mean error %.3f ms, max error %.3f ms", name,
+                static_cast<unsigned>(errors.size()),
+                errors.empty() ? 0.0 : sum / 1000.0 / errors.size(),
+                worst / 1000.0);
+  TEST_MESSAGE(line);
+  return worst;
+}
+
+/// 毎日 7:00 の予定を入れる。
+void setDaily(Simulation &sim) {
+  sim.schedule.set(
+      0, AlarmRule::weekly(TimeOfDay::fromHms(7), sugar::EVERY_DAY),
+      sim.wall() / 1000);
+}
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_fires_within_timer_latency() {
+  Simulation sim;
+  setDaily(sim);
+  sim.schedule.set(1, AlarmRule::weekly(TimeOfDay::fromHms(6, 59, 59, 999),
+                                        sugar::WORKDAYS),
+                   sim.wall() / 1000);
+  sim.run(30 * MICROS_PER_DAY);
+  const int64_t worst = reportErrors("steady clock", sim.errors);
+  // 1/1 (金) から 30 日の平日は 21 日
+  TEST_ASSERT_EQUAL(30 + 21, sim.errors.size());
+  TEST_ASSERT_LESS_OR_EQUAL(TIMER_LATENCY_MICROS, worst);
+  TEST_ASSERT_EQUAL(0, sim.missed);
+  TEST_ASSERT_EQUAL(0, sim.clockJumps);
+}
+
+void test_small_drift_is_not_a_jump() {
+  Simulation sim;
+  setDaily(sim);
+  // NTP の細かい補正は飛びとみなさない
+  for (int i = 0; i < 48; ++i) {
+    sim.jumps.push_back(
+        ClockJump{i * MICROS_PER_DAY / 24, i % 2 ? 50 * 1000 : -50 * 1000});
+  }
+  sim.run(2 * MICROS_PER_DAY);
+  const int64_t worst = reportErrors("small drift", sim.errors);
+  TEST_ASSERT_EQUAL(2, sim.errors.size());
+  TEST_ASSERT_EQUAL(0, sim.clockJumps);
+  TEST_ASSERT_LESS_OR_EQUAL(50 * 1000 + TIMER_LATENCY_MICROS, worst);
+}
+
+void test_forward_jump_rearms_the_timer() {
+  Simulation sim;
+  setDaily(sim);
+  // 3:00 に壁時計が 30 分進む
+  sim.jumps.push_back(ClockJump{3 * 3600 * 1000000LL, 30 * 60 * 1000000LL});
+  sim.run(MICROS_PER_DAY);
+  const int64_t worst = reportErrors("forward jump", sim.errors);
+  TEST_ASSERT_EQUAL(1, sim.errors.size());
+  TEST_ASSERT_EQUAL(1, sim.clockJumps);
+  TEST_ASSERT_LESS_OR_EQUAL(TIMER_LATENCY_MICROS, worst);
+}
+
+void test_backward_jump_does_not_fire_early() {
+  Simulation sim;
+  setDaily(sim);
+  // 6:30 に壁時計が 1 時間戻る。単調増加時計のタイマーのままだと、
+  // 壁時計の 6:00 に早く鳴ってしまう
+  sim.jumps.push_back(ClockJump{6 * 3600 * 1000000LL + 30 * 60 * 1000000LL,
+                                -3600 * 1000000LL});
+  sim.run(MICROS_PER_DAY);
+  const int64_t worst = reportErrors("backward jump", sim.errors);
+  TEST_ASSERT_EQUAL(1, sim.errors.size());
+  TEST_ASSERT_EQUAL(1, sim.clockJumps);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, sim.errors[0]);
+  TEST_ASSERT_LESS_OR_EQUAL(TIMER_LATENCY_MICROS, worst);
+}
+
+void test_jump_past_the_deadline() {
+  Simulation sim;
+  setDaily(sim);
+  // 6:59:50 に 30 秒進むと、許容範囲内の遅れで鳴る
+  sim.jumps.push_back(
+      ClockJump{(6 * 3600 + 59 * 60 + 50) * 1000000LL, 30 * 1000000LL});
+  // 翌日の 6:30 に 2 時間進むと、遅れすぎなので鳴らさない
+  sim.jumps.push_back(ClockJump{MICROS_PER_DAY - 30 * 1000000LL +
+                                    (6 * 3600 + 30 * 60) * 1000000LL,
+                                2 * 3600 * 1000000LL});
+  sim.run(2 * MICROS_PER_DAY);
+  reportErrors("jump past the deadline", sim.errors);
+  TEST_ASSERT_EQUAL(1, sim.errors.size());
+  TEST_ASSERT_EQUAL(1, sim.missed);
+  TEST_ASSERT_EQUAL(2, sim.clockJumps);
+  // 飛んだ時点で 20 秒過ぎており、起きるまでに高々確認周期だけ遅れる
+  TEST_ASSERT_GREATER_OR_EQUAL(20 * 1000000LL, sim.errors[0]);
+  TEST_ASSERT_LESS_OR_EQUAL(20 * 1000000LL + CHECK_PERIOD_MICROS,
+                            sim.errors[0]);
+}
+
+void test_idle_wakeups_are_bounded_by_the_check_period() {
+  Simulation sim;
+  setDaily(sim);
+  sim.run(MICROS_PER_DAY);
+  // 確認周期ごとと、期限に1回ずつ
+  TEST_ASSERT_LESS_OR_EQUAL(MICROS_PER_DAY / CHECK_PERIOD_MICROS + 2,
+                            sim.wakeups);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_fires_within_timer_latency);
+  RUN_TEST(test_small_drift_is_not_a_jump);
+  RUN_TEST(test_forward_jump_rearms_the_timer);
+  RUN_TEST(test_backward_jump_does_not_fire_early);
+  RUN_TEST(test_jump_past_the_deadline);
+  RUN_TEST(test_idle_wakeups_are_bounded_by_the_check_period);
+  return UNITY_END();
+}
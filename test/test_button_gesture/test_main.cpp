@@ -0,0 +1,255 @@
+/**
+ * @file test_main.cpp
+ * @brief 押下と解放の時刻列から `hardware::GestureRecognizer` の出力を確かめる
+ */
+#include <unity.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <hardware/button_gesture.hpp>
+
+using hardware::ButtonEventKind;
+using hardware::GestureConfig;
+using hardware::GestureRecognizer;
+
+namespace {
+/// 記録したイベント。
+struct Recorded {
+  ButtonEventKind kind;
+  uint16_t count;
+  /// 発生した時刻 [ms]
+  uint32_t at;
+};
+
+/// 押し方の時刻列を与えて、出たイベントを記録する。
+///
+/// `ButtonManager` の割り込みの方式と同じく、 `nextDeadline()` の時刻に
+/// だけ `expire()` を呼ぶ。
+class Timeline {
+public:
+  GestureRecognizer gesture;
+  std::vector<Recorded> events;
+
+  explicit Timeline(uint32_t start = 0) : m_now(start) {}
+
+  uint32_t now() const { return m_now; }
+
+  /// `millis` 後に押す。
+  void pressAfter(uint32_t millis) {
+    runFor(millis);
+    gesture.press(m_now, recorder());
+  }
+  /// `millis` 後に離す。
+  void releaseAfter(uint32_t millis) {
+    runFor(millis);
+    gesture.release(m_now, recorder());
+  }
+  /// 期限ごとに `expire()` を呼びながら `millis` だけ進める。
+  void runFor(uint32_t millis) {
+    const uint32_t end = m_now + millis;
+    uint32_t deadline;
+    while (gesture.nextDeadline(deadline) &&
+           static_cast<int32_t>(end - deadline) >= 0) {
+      m_now = deadline;
+      gesture.expire(m_now, recorder());
+    }
+    m_now = end;
+  }
+
+  size_t count(ButtonEventKind kind) const {
+    size_t n = 0;
+    for (const auto &e : events) {
+      n += e.kind == kind;
+    }
+    return n;
+  }
+
+  /// `kind` のイベントの時刻を並べて返す。
+  std::vector<uint32_t> times(ButtonEventKind kind) const {
+    std::vector<uint32_t> result;
+    for (const auto &e : events) {
+      if (e.kind == kind) {
+        result.push_back(e.at);
+      }
+    }
+    return result;
+  }
+
+private:
+  uint32_t m_now;
+
+  /// イベントを記録する関数を返す。
+  std::function<void(ButtonEventKind, uint16_t)> recorder() {
+    return [this](ButtonEventKind kind, uint16_t count) {
+      events.push_back(Recorded{kind, count, m_now});
+    };
+  }
+};
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_short_press() {
+  Timeline t;
+  t.pressAfter(0);
+  t.releaseAfter(100);
+  t.runFor(5000);
+  TEST_ASSERT_EQUAL(2, t.events.size());
+  TEST_ASSERT_TRUE(t.events[0].kind == ButtonEventKind::Pressed);
+  TEST_ASSERT_EQUAL(0, t.events[0].at);
+  TEST_ASSERT_TRUE(t.events[1].kind == ButtonEventKind::Released);
+  TEST_ASSERT_EQUAL(100, t.events[1].at);
+  uint32_t deadline;
+  TEST_ASSERT_FALSE(t.gesture.nextDeadline(deadline));
+}
+
+void test_double_press_follows_the_second_pressed() {
+  Timeline t;
+  t.pressAfter(0);
+  t.releaseAfter(100);
+  t.pressAfter(300);
+  TEST_ASSERT_EQUAL(4, t.events.size());
+  TEST_ASSERT_TRUE(t.events[2].kind == ButtonEventKind::Pressed);
+  TEST_ASSERT_TRUE(t.events[3].kind == ButtonEventKind::DoublePress);
+  TEST_ASSERT_EQUAL(400, t.events[3].at);
+}
+
+void test_slow_second_press_is_not_double() {
+  Timeline t;
+  t.pressAfter(0);
+  t.releaseAfter(100);
+  t.pressAfter(301);
+  TEST_ASSERT_EQUAL(0, t.count(ButtonEventKind::DoublePress));
+  TEST_ASSERT_EQUAL(2, t.count(ButtonEventKind::Pressed));
+}
+
+void test_triple_press_is_one_double_press() {
+  Timeline t;
+  t.pressAfter(0);
+  for (int i = 0; i < 2; ++i) {
+    t.releaseAfter(80);
+    t.pressAfter(80);
+  }
+  t.releaseAfter(80);
+  TEST_ASSERT_EQUAL(3, t.count(ButtonEventKind::Pressed));
+  TEST_ASSERT_EQUAL(1, t.count(ButtonEventKind::DoublePress));
+  // 4回目で2回目の DoublePress
+  t.pressAfter(80);
+  TEST_ASSERT_EQUAL(2, t.count(ButtonEventKind::DoublePress));
+}
+
+void test_long_press_once_per_press() {
+  Timeline t;
+  t.pressAfter(0);
+  t.runFor(999);
+  TEST_ASSERT_EQUAL(0, t.count(ButtonEventKind::LongPress));
+  t.runFor(1);
+  TEST_ASSERT_EQUAL(1, t.count(ButtonEventKind::LongPress));
+  TEST_ASSERT_EQUAL(1000, t.times(ButtonEventKind::LongPress)[0]);
+  t.releaseAfter(2000);
+  TEST_ASSERT_EQUAL(1, t.count(ButtonEventKind::LongPress));
+  // 長押しの直後に押しても DoublePress にならない
+  t.pressAfter(100);
+  TEST_ASSERT_EQUAL(0, t.count(ButtonEventKind::DoublePress));
+}
+
+void test_released_before_long_press() {
+  Timeline t;
+  t.pressAfter(0);
+  t.releaseAfter(999);
+  t.runFor(5000);
+  TEST_ASSERT_EQUAL(0, t.count(ButtonEventKind::LongPress));
+  // 離した後には Repeated も出ない
+  TEST_ASSERT_EQUAL(4, t.count(ButtonEventKind::Repeated));
+  TEST_ASSERT_LESS_THAN(999, t.times(ButtonEventKind::Repeated).back());
+}
+
+void test_repeat_accelerates_then_doubles_steps() {
+  Timeline t;
+  t.pressAfter(0);
+  t.runFor(5000);
+  const auto times = t.times(ButtonEventKind::Repeated);
+  TEST_ASSERT_GREATER_OR_EQUAL(4, times.size());
+  // 間隔を 200, 150, 112 と縮め、下限の 100 で止める
+  TEST_ASSERT_EQUAL(500, times[0]);
+  TEST_ASSERT_EQUAL(700, times[1]);
+  TEST_ASSERT_EQUAL(850, times[2]);
+  TEST_ASSERT_EQUAL(962, times[3]);
+  for (size_t i = 4; i < times.size(); ++i) {
+    TEST_ASSERT_EQUAL(100, times[i] - times[i - 1]);
+  }
+  // 下限に達してから 8 回ごとに歩数を倍にし、 8 で止める
+  uint16_t expected = 1;
+  int atFloor = 0;
+  uint32_t total = 0;
+  for (const auto &e : t.events) {
+    if (e.kind != ButtonEventKind::Repeated) {
+      continue;
+    }
+    TEST_ASSERT_EQUAL(expected, e.count);
+    total += e.count;
+    if (e.at >= 962 && ++atFloor % 8 == 0 && expected < 8) {
+      expected *= 2;
+    }
+  }
+  TEST_ASSERT_EQUAL(8, expected);
+  // 押し続けた 5 秒で進む歩数
+  TEST_ASSERT_GREATER_THAN(100, total);
+}
+
+void test_late_expire_does_not_burst() {
+  Timeline t;
+  t.pressAfter(0);
+  // 処理が 2 秒遅れても、 Repeated は1回だけ出る
+  t.gesture.expire(2000, [&t](ButtonEventKind kind, uint16_t count) {
+    t.events.push_back(Recorded{kind, count, 2000});
+  });
+  TEST_ASSERT_EQUAL(1, t.count(ButtonEventKind::Repeated));
+  TEST_ASSERT_EQUAL(1, t.count(ButtonEventKind::LongPress));
+  uint32_t deadline;
+  TEST_ASSERT_TRUE(t.gesture.nextDeadline(deadline));
+  TEST_ASSERT_GREATER_THAN(2000, deadline);
+}
+
+void test_millis_wraparound() {
+  Timeline t(UINT32_MAX - 400);
+  t.pressAfter(0);
+  t.runFor(1000);
+  TEST_ASSERT_EQUAL(1, t.count(ButtonEventKind::LongPress));
+  TEST_ASSERT_EQUAL(599, t.times(ButtonEventKind::LongPress)[0]);
+  TEST_ASSERT_EQUAL(99, t.times(ButtonEventKind::Repeated)[0]);
+}
+
+void test_custom_config() {
+  GestureConfig config;
+  config.repeatDelayMillis = 300;
+  config.longPressMillis = 2000;
+  config.doublePressMillis = 150;
+  Timeline t;
+  t.gesture.setConfig(config);
+  t.pressAfter(0);
+  t.runFor(1999);
+  TEST_ASSERT_EQUAL(0, t.count(ButtonEventKind::LongPress));
+  TEST_ASSERT_EQUAL(300, t.times(ButtonEventKind::Repeated)[0]);
+  t.runFor(1);
+  TEST_ASSERT_EQUAL(1, t.count(ButtonEventKind::LongPress));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_short_press);
+  RUN_TEST(test_double_press_follows_the_second_pressed);
+  RUN_TEST(test_slow_second_press_is_not_double);
+  RUN_TEST(test_triple_press_is_one_double_press);
+  RUN_TEST(test_long_press_once_per_press);
+  RUN_TEST(test_released_before_long_press);
+  RUN_TEST(test_repeat_accelerates_then_doubles_steps);
+  RUN_TEST(test_late_expire_does_not_burst);
+  RUN_TEST(test_millis_wraparound);
+  RUN_TEST(test_custom_config);
+  return UNITY_END();
+}
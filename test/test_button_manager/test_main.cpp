@@ -0,0 +1,267 @@
+/**
+ * @file test_main.cpp
+ * @brief GPIO の代わりで `hardware::ButtonManager` のチャタリング除去を確かめる
+ *
+ * ピンの値とエッジ割り込みは test/fakes/M5Stack.h が、タイマーは仮想の
+ * 時計が受け持つ。ポーリングと割り込みの両方の監視方式で同じ押し方を試す。
+ */
+#include <unity.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <fake_timer_service.hpp>
+#include <hardware/button_manager.h>
+
+using hardware::Button;
+using hardware::ButtonEvent;
+using hardware::ButtonEventKind;
+using hardware::ButtonInputMode;
+using hardware::ButtonManager;
+using hardware::M5ButtonPort;
+using hardware::TimerService;
+
+namespace {
+/// チャタリングを除いてイベントを出すまでの遅れの上限 [ms]
+///
+/// 割り込みは最後のエッジから 20 ms 、ポーリングは 10 ms 周期で2回読む。
+constexpr uint32_t SETTLE_MILLIS = 20;
+
+/// 記録したイベント。
+struct Recorded {
+  Button button;
+  ButtonEventKind kind;
+  uint16_t count;
+  /// 発生した時刻 [ms]
+  uint32_t at;
+};
+
+/// ボタンの監視を仮想の GPIO とタイマーにつないだもの。
+class Bench {
+public:
+  M5ButtonPort port;
+  TimerService timers;
+  ButtonManager manager{port, timers};
+  std::vector<Recorded> events;
+
+  explicit Bench(ButtonInputMode mode) {
+    manager.onEvent([this](const ButtonEvent &e) {
+      const uint32_t now = millis();
+      events.push_back(Recorded{e.button, e.kind, e.count, now});
+    });
+    manager.begin(mode);
+  }
+
+  size_t count(ButtonEventKind kind) const {
+    size_t n = 0;
+    for (const auto &e : events) {
+      n += e.kind == kind;
+    }
+    return n;
+  }
+
+  /// 最初の `kind` のイベントを返す。なければ nullptr 。
+  const Recorded *first(ButtonEventKind kind) const {
+    for (const auto &e : events) {
+      if (e.kind == kind) {
+        return &e;
+      }
+    }
+    return nullptr;
+  }
+};
+
+/// `edges` 回跳ねてから `level` に落ち着く。跳ねる間隔は 1 ms 。
+void bounceTo(uint8_t pin, int level, int edges) {
+  for (int i = 0; i < edges; ++i) {
+    fake::setPin(pin, (i % 2 == 0) ? level : !level);
+    fake::advanceMillis(1);
+  }
+  fake::setPin(pin, level);
+}
+
+void testCleanPress(ButtonInputMode mode) {
+  Bench bench(mode);
+  fake::advanceMillis(3);
+  const uint32_t pressedAt = millis();
+  fake::setPin(BUTTON_A_PIN, LOW);
+  fake::advanceMillis(100);
+  TEST_ASSERT_TRUE(bench.manager.isPressed(Button::A));
+  const uint32_t releasedAt = millis();
+  fake::setPin(BUTTON_A_PIN, HIGH);
+  fake::advanceMillis(100);
+  TEST_ASSERT_FALSE(bench.manager.isPressed(Button::A));
+
+  TEST_ASSERT_EQUAL(2, bench.events.size());
+  TEST_ASSERT_TRUE(bench.events[0].button == Button::A);
+  TEST_ASSERT_TRUE(bench.events[0].kind == ButtonEventKind::Pressed);
+  TEST_ASSERT_TRUE(bench.events[1].kind == ButtonEventKind::Released);
+  TEST_ASSERT_LESS_OR_EQUAL(pressedAt + SETTLE_MILLIS, bench.events[0].at);
+  TEST_ASSERT_LESS_OR_EQUAL(releasedAt + SETTLE_MILLIS, bench.events[1].at);
+}
+
+void testBouncingPress(ButtonInputMode mode) {
+  Bench bench(mode);
+  bounceTo(BUTTON_B_PIN, LOW, 7);
+  fake::advanceMillis(200);
+  bounceTo(BUTTON_B_PIN, HIGH, 9);
+  fake::advanceMillis(200);
+
+  TEST_ASSERT_EQUAL(2, bench.events.size());
+  TEST_ASSERT_TRUE(bench.events[0].button == Button::B);
+  TEST_ASSERT_EQUAL(1, bench.count(ButtonEventKind::Pressed));
+  TEST_ASSERT_EQUAL(1, bench.count(ButtonEventKind::Released));
+}
+
+void testShortGlitch(ButtonInputMode mode) {
+  Bench bench(mode);
+  // ポーリングの周期に対してどこで跳ねても拾わない
+  for (int phase = 0; phase < 10; ++phase) {
+    fake::advanceMillis(100 + phase);
+    fake::setPin(BUTTON_A_PIN, LOW);
+    fake::advanceMillis(2);
+    fake::setPin(BUTTON_A_PIN, HIGH);
+  }
+  fake::advanceMillis(100);
+  TEST_ASSERT_EQUAL(0, bench.events.size());
+}
+
+void testHeldAtBoot(ButtonInputMode mode) {
+  fake::setPin(BUTTON_C_PIN, LOW);
+  Bench bench(mode);
+  fake::advanceMillis(2000);
+  TEST_ASSERT_EQUAL(0, bench.events.size());
+  fake::setPin(BUTTON_C_PIN, HIGH);
+  fake::advanceMillis(100);
+  TEST_ASSERT_EQUAL(1, bench.events.size());
+  TEST_ASSERT_TRUE(bench.events[0].button == Button::C);
+  TEST_ASSERT_TRUE(bench.events[0].kind == ButtonEventKind::Released);
+}
+
+void testLongPress(ButtonInputMode mode) {
+  Bench bench(mode);
+  fake::setPin(BUTTON_A_PIN, LOW);
+  fake::advanceMillis(1500);
+  fake::setPin(BUTTON_A_PIN, HIGH);
+  fake::advanceMillis(100);
+
+  const Recorded *pressed = bench.first(ButtonEventKind::Pressed);
+  const Recorded *repeated = bench.first(ButtonEventKind::Repeated);
+  const Recorded *longPress = bench.first(ButtonEventKind::LongPress);
+  TEST_ASSERT_NOT_NULL(pressed);
+  TEST_ASSERT_NOT_NULL(repeated);
+  TEST_ASSERT_NOT_NULL(longPress);
+  TEST_ASSERT_EQUAL(1, bench.count(ButtonEventKind::LongPress));
+  TEST_ASSERT_EQUAL(1, bench.count(ButtonEventKind::Released));
+  // 期限からの遅れはポーリングの1周期まで
+  TEST_ASSERT_UINT32_WITHIN(10, pressed->at + 505, repeated->at);
+  TEST_ASSERT_UINT32_WITHIN(10, pressed->at + 1005, longPress->at);
+}
+} // namespace
+
+void setUp() {
+  // 前のテストのタイマーとピンを止める
+  for (fake::ClockTimer *t : fake::ClockTimer::all()) {
+    t->dueMicros = -1;
+  }
+  fake::serviceTimers().clear();
+  for (size_t i = 0; i < fake::PIN_COUNT; ++i) {
+    fake::pins()[i] = fake::Pin{};
+  }
+  fake::failTimerCreate() = false;
+  fake::nowMicros() = 1000 * 1000;
+}
+
+void tearDown() {}
+
+void test_clean_press_polling() { testCleanPress(ButtonInputMode::Polling); }
+void test_clean_press_interrupt() {
+  testCleanPress(ButtonInputMode::Interrupt);
+}
+
+void test_bouncing_press_polling() {
+  testBouncingPress(ButtonInputMode::Polling);
+}
+void test_bouncing_press_interrupt() {
+  testBouncingPress(ButtonInputMode::Interrupt);
+}
+
+void test_short_glitch_polling() { testShortGlitch(ButtonInputMode::Polling); }
+void test_short_glitch_interrupt() {
+  testShortGlitch(ButtonInputMode::Interrupt);
+}
+
+void test_held_at_boot_polling() { testHeldAtBoot(ButtonInputMode::Polling); }
+void test_held_at_boot_interrupt() {
+  testHeldAtBoot(ButtonInputMode::Interrupt);
+}
+
+void test_long_press_polling() { testLongPress(ButtonInputMode::Polling); }
+void test_long_press_interrupt() { testLongPress(ButtonInputMode::Interrupt); }
+
+void test_interrupt_mode_sleeps_while_idle() {
+  Bench bench(ButtonInputMode::Interrupt);
+  TEST_ASSERT_TRUE(bench.manager.mode() == ButtonInputMode::Interrupt);
+  const uint32_t before = fake::ClockTimer::fired();
+  fake::advanceMillis(10 * 1000);
+  TEST_ASSERT_EQUAL(0, fake::ClockTimer::fired() - before);
+
+  // 押して離すと、チャタリング除去と長押しの期限の分だけ起きる
+  bounceTo(BUTTON_A_PIN, LOW, 5);
+  fake::advanceMillis(100);
+  bounceTo(BUTTON_A_PIN, HIGH, 5);
+  fake::advanceMillis(10 * 1000);
+  TEST_ASSERT_LESS_OR_EQUAL(4, fake::ClockTimer::fired() - before);
+}
+
+void test_polling_mode_wakes_every_period() {
+  Bench bench(ButtonInputMode::Polling);
+  const uint32_t before = fake::ClockTimer::fired();
+  fake::advanceMillis(10 * 1000);
+  TEST_ASSERT_EQUAL(1000, fake::ClockTimer::fired() - before);
+}
+
+void test_falls_back_to_polling_without_timers() {
+  fake::failTimerCreate() = true;
+  Bench bench(ButtonInputMode::Interrupt);
+  TEST_ASSERT_TRUE(bench.manager.mode() == ButtonInputMode::Polling);
+  fake::setPin(BUTTON_A_PIN, LOW);
+  fake::advanceMillis(100);
+  TEST_ASSERT_EQUAL(1, bench.count(ButtonEventKind::Pressed));
+}
+
+void test_buttons_are_independent() {
+  Bench bench(ButtonInputMode::Interrupt);
+  bounceTo(BUTTON_A_PIN, LOW, 3);
+  bounceTo(BUTTON_C_PIN, LOW, 3);
+  fake::advanceMillis(100);
+  bounceTo(BUTTON_A_PIN, HIGH, 3);
+  fake::advanceMillis(100);
+  TEST_ASSERT_FALSE(bench.manager.isPressed(Button::A));
+  TEST_ASSERT_FALSE(bench.manager.isPressed(Button::B));
+  TEST_ASSERT_TRUE(bench.manager.isPressed(Button::C));
+  TEST_ASSERT_EQUAL(3, bench.events.size());
+  TEST_ASSERT_TRUE(bench.events[0].button == Button::A);
+  TEST_ASSERT_TRUE(bench.events[1].button == Button::C);
+  TEST_ASSERT_TRUE(bench.events[2].button == Button::A);
+  TEST_ASSERT_TRUE(bench.events[2].kind == ButtonEventKind::Released);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_clean_press_polling);
+  RUN_TEST(test_clean_press_interrupt);
+  RUN_TEST(test_bouncing_press_polling);
+  RUN_TEST(test_bouncing_press_interrupt);
+  RUN_TEST(test_short_glitch_polling);
+  RUN_TEST(test_short_glitch_interrupt);
+  RUN_TEST(test_held_at_boot_polling);
+  RUN_TEST(test_held_at_boot_interrupt);
+  RUN_TEST(test_long_press_polling);
+  RUN_TEST(test_long_press_interrupt);
+  RUN_TEST(test_interrupt_mode_sleeps_while_idle);
+  RUN_TEST(test_polling_mode_wakes_every_period);
+  RUN_TEST(test_falls_back_to_polling_without_timers);
+  RUN_TEST(test_buttons_are_independent);
+  return UNITY_END();
+}
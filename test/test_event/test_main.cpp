@@ -0,0 +1,121 @@
+/**
+ * @file test_main.cpp
+ * @brief イベントの経路でヒープ確保が起きないことを確かめる
+ */
+#include <unity.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include <scene/event.hpp>
+#include <scene/event_lanes.hpp>
+
+using hardware::Button;
+using hardware::ButtonEvent;
+using hardware::ButtonEventKind;
+using scene::Event;
+using scene::EventKind;
+using scene::EventLanes;
+
+namespace {
+/// プログラム全体のヒープ確保の回数。
+std::atomic<size_t> s_allocations{0};
+} // namespace
+
+// 数えるだけで、確保は malloc に任せる
+void *operator new(size_t size) {
+  s_allocations++;
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+void setUp() {}
+void tearDown() {}
+
+void test_counting_allocator_counts() {
+  const size_t before = s_allocations;
+  // new 式は最適化で消えることがあるので、関数を直接呼ぶ
+  ::operator delete(::operator new(1));
+  TEST_ASSERT_EQUAL(before + 1, s_allocations);
+}
+
+void test_event_is_a_small_value() {
+  // キューへは `sizeof(Event)` だけコピーされる
+  TEST_ASSERT_TRUE(std::is_trivially_copyable<Event>::value);
+  TEST_ASSERT_LESS_OR_EQUAL(16, sizeof(Event));
+}
+
+void test_events_are_built_and_copied_without_allocating() {
+  const size_t before = s_allocations;
+  Event events[] = {
+      Event{EventKind::Tick},
+      Event{EventKind::Alarm},
+      Event{ButtonEvent{Button::B, ButtonEventKind::Repeated, 4}},
+  };
+  Event copy = events[2];
+  events[0] = copy;
+  TEST_ASSERT_EQUAL(before, s_allocations);
+  TEST_ASSERT_TRUE(events[0].kind() == EventKind::Button);
+  TEST_ASSERT_TRUE(events[0].buttonData().button == Button::B);
+  TEST_ASSERT_EQUAL(4, events[0].buttonData().count);
+}
+
+void test_lanes_send_and_receive_without_allocating() {
+  EventLanes lanes;
+  // キューの作成時の確保は数えない
+  lanes.begin();
+  const size_t before = s_allocations;
+  size_t received = 0;
+  for (int i = 0; i < 1000; ++i) {
+    if (lanes.tickCoalescer().post()) {
+      lanes.send(Event{EventKind::Tick});
+    }
+    lanes.send(Event{ButtonEvent{Button::A, ButtonEventKind::Pressed}});
+    if (i % 100 == 0) {
+      lanes.send(Event{EventKind::Alarm});
+    }
+    while (lanes.wait(0)) {
+      const Event ev = lanes.receive();
+      if (ev.kind() == EventKind::Tick) {
+        lanes.tickCoalescer().take();
+      }
+      received++;
+    }
+  }
+  TEST_ASSERT_EQUAL(before, s_allocations);
+  TEST_ASSERT_EQUAL(1000 + 1000 + 10, received);
+}
+
+void test_lanes_deliver_alarms_first() {
+  EventLanes lanes;
+  lanes.begin();
+  lanes.tickCoalescer().post();
+  lanes.send(Event{EventKind::Tick});
+  lanes.send(Event{ButtonEvent{Button::C, ButtonEventKind::Released}});
+  lanes.send(Event{EventKind::Alarm});
+  const EventKind expected[] = {EventKind::Alarm, EventKind::Button,
+                                EventKind::Tick};
+  for (EventKind kind : expected) {
+    TEST_ASSERT_TRUE(lanes.wait(0));
+    TEST_ASSERT_TRUE(lanes.receive().kind() == kind);
+  }
+  TEST_ASSERT_FALSE(lanes.wait(0));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_counting_allocator_counts);
+  RUN_TEST(test_event_is_a_small_value);
+  RUN_TEST(test_events_are_built_and_copied_without_allocating);
+  RUN_TEST(test_lanes_send_and_receive_without_allocating);
+  RUN_TEST(test_lanes_deliver_alarms_first);
+  return UNITY_END();
+}
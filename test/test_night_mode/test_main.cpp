@@ -0,0 +1,192 @@
+/**
+ * @file test_main.cpp
+ * @brief deep sleep の代わりで夜間モードの眠る判断と復帰を確かめる
+ */
+#include <unity.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <hardware/night_mode.hpp>
+
+using hardware::NightMode;
+using hardware::NightModeConfig;
+using hardware::NightModePlanner;
+using hardware::NightModeRtcState;
+using hardware::SleepPort;
+using hardware::WakeCause;
+
+namespace {
+constexpr int64_t SECOND = 1000;
+constexpr int64_t MINUTE = 60 * SECOND;
+constexpr int64_t HOUR = 60 * MINUTE;
+
+/// deep sleep の代わり。眠る要求を記録して戻る。
+class FakeSleepPort final : public SleepPort {
+public:
+  WakeCause cause = WakeCause::PowerOn;
+  /// 要求された眠る時間 [us]。
+  std::vector<uint64_t> sleeps;
+
+  virtual WakeCause wakeCause() override { return cause; }
+  virtual void deepSleep(uint64_t micros) override {
+    sleeps.push_back(micros);
+  }
+};
+
+/// RTC メモリの代わり。 deep sleep を挟んでも残る。
+NightModeRtcState s_rtc;
+
+void advanceMillis(int64_t millis) { fake::nowMicros() += millis * 1000; }
+} // namespace
+
+namespace hardware {
+NightModeRtcState &NightMode::rtcState() { return s_rtc; }
+} // namespace hardware
+
+void setUp() {
+  s_rtc = NightModeRtcState{};
+  fake::nowMicros() = 42 * 1000 * 1000;
+}
+
+void tearDown() {}
+
+void test_idle_threshold() {
+  NightModePlanner planner;
+  const int64_t alarm = 8 * HOUR;
+  TEST_ASSERT_EQUAL(0, planner.sleepMicros(10 * MINUTE - 1, alarm));
+  TEST_ASSERT_NOT_EQUAL(0, planner.sleepMicros(10 * MINUTE, alarm));
+}
+
+void test_no_alarm_means_no_sleep() {
+  NightModePlanner planner;
+  TEST_ASSERT_EQUAL(0, planner.sleepMicros(HOUR, -1));
+}
+
+void test_min_sleep() {
+  NightModePlanner planner;
+  const int64_t lead = planner.config().wakeLeadMillis;
+  const int64_t min = planner.config().minSleepMillis;
+  TEST_ASSERT_EQUAL(0, planner.sleepMicros(HOUR, lead + min - 1));
+  TEST_ASSERT_EQUAL_INT64(min * 1000, planner.sleepMicros(HOUR, lead + min));
+  // 期限を過ぎたアラームでも眠らない
+  TEST_ASSERT_EQUAL(0, planner.sleepMicros(HOUR, 0));
+}
+
+void test_wakes_lead_time_before_alarm() {
+  NightModePlanner planner;
+  TEST_ASSERT_EQUAL_INT64((8 * HOUR - 5 * SECOND) * 1000,
+                          planner.sleepMicros(HOUR, 8 * HOUR));
+  NightModeConfig config;
+  config.wakeLeadMillis = 30 * 1000;
+  NightModePlanner custom(config);
+  TEST_ASSERT_EQUAL_INT64((8 * HOUR - 30 * SECOND) * 1000,
+                          custom.sleepMicros(HOUR, 8 * HOUR));
+}
+
+void test_only_sleeps_before_the_coming_alarm() {
+  NightModePlanner planner;
+  // 朝のアラームの直後は、次のアラームが丸1日先なので眠らない
+  TEST_ASSERT_EQUAL(0, planner.sleepMicros(HOUR, 24 * HOUR - MINUTE));
+  TEST_ASSERT_EQUAL(0, planner.sleepMicros(HOUR, 12 * HOUR + 1));
+  TEST_ASSERT_NOT_EQUAL(0, planner.sleepMicros(HOUR, 12 * HOUR));
+}
+
+void test_sleeps_after_idle_and_saves_rtc_state() {
+  FakeSleepPort port;
+  NightMode night(port);
+  night.begin();
+  TEST_ASSERT_FALSE(night.resumedFromSleep());
+  night.poll(8 * HOUR, 3);
+  TEST_ASSERT_EQUAL(0, port.sleeps.size());
+
+  advanceMillis(9 * MINUTE);
+  night.notifyActivity();
+  advanceMillis(9 * MINUTE);
+  night.poll(8 * HOUR, 3);
+  TEST_ASSERT_EQUAL(0, port.sleeps.size());
+  TEST_ASSERT_EQUAL(0, s_rtc.magic);
+
+  advanceMillis(MINUTE);
+  night.poll(8 * HOUR, 3);
+  TEST_ASSERT_EQUAL(1, port.sleeps.size());
+  TEST_ASSERT_EQUAL_INT64((8 * HOUR - 5 * SECOND) * 1000, port.sleeps[0]);
+  TEST_ASSERT_NOT_EQUAL(0, s_rtc.magic);
+  TEST_ASSERT_EQUAL(3, s_rtc.scene);
+}
+
+void test_resumes_after_timer_or_button_wakeup() {
+  const WakeCause causes[] = {WakeCause::Timer, WakeCause::Button};
+  for (WakeCause cause : causes) {
+    FakeSleepPort port;
+    {
+      NightMode night(port);
+      night.begin();
+      advanceMillis(HOUR);
+      night.poll(8 * HOUR, 3);
+    }
+    TEST_ASSERT_EQUAL(1, port.sleeps.size());
+
+    // 復帰はリセットとして、新しい NightMode で起動し直す
+    port.cause = cause;
+    NightMode resumed(port);
+    resumed.begin();
+    TEST_ASSERT_TRUE(resumed.resumedFromSleep());
+    TEST_ASSERT_EQUAL(3, resumed.resumedScene());
+    TEST_ASSERT_TRUE(resumed.wakeCause() == cause);
+    // 次に眠るまで RTC メモリの状態は使わない
+    TEST_ASSERT_EQUAL(0, s_rtc.magic);
+
+    NightMode again(port);
+    again.begin();
+    TEST_ASSERT_FALSE(again.resumedFromSleep());
+  }
+}
+
+void test_power_on_ignores_stale_rtc_state() {
+  FakeSleepPort port;
+  {
+    NightMode night(port);
+    night.begin();
+    advanceMillis(HOUR);
+    night.poll(8 * HOUR, 3);
+  }
+  TEST_ASSERT_NOT_EQUAL(0, s_rtc.magic);
+  NightMode night(port);
+  night.begin();
+  TEST_ASSERT_FALSE(night.resumedFromSleep());
+  TEST_ASSERT_EQUAL(0, s_rtc.magic);
+}
+
+void test_timer_wakeup_without_rtc_state_is_not_a_resume() {
+  FakeSleepPort port;
+  port.cause = WakeCause::Timer;
+  NightMode night(port);
+  night.begin();
+  TEST_ASSERT_FALSE(night.resumedFromSleep());
+}
+
+void test_idle_counts_from_begin() {
+  FakeSleepPort port;
+  NightMode night(port);
+  advanceMillis(HOUR);
+  night.begin();
+  advanceMillis(MINUTE);
+  night.poll(MINUTE * 30, 3);
+  TEST_ASSERT_EQUAL(0, port.sleeps.size());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_idle_threshold);
+  RUN_TEST(test_no_alarm_means_no_sleep);
+  RUN_TEST(test_min_sleep);
+  RUN_TEST(test_wakes_lead_time_before_alarm);
+  RUN_TEST(test_only_sleeps_before_the_coming_alarm);
+  RUN_TEST(test_sleeps_after_idle_and_saves_rtc_state);
+  RUN_TEST(test_resumes_after_timer_or_button_wakeup);
+  RUN_TEST(test_power_on_ignores_stale_rtc_state);
+  RUN_TEST(test_timer_wakeup_without_rtc_state_is_not_a_resume);
+  RUN_TEST(test_idle_counts_from_begin);
+  return UNITY_END();
+}
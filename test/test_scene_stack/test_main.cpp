@@ -0,0 +1,159 @@
+/**
+ * @file test_main.cpp
+ * @brief 静的なシーンスタックの遷移でヒープ確保が起きないことを確かめる
+ */
+#include <unity.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+#include <scene/scene_stack.hpp>
+
+using scene::EventResult;
+using scene::EventResultKind;
+using scene::SceneId;
+
+namespace {
+/// プログラム全体のヒープ確保の回数。
+std::atomic<size_t> s_allocations{0};
+/// 生きているシーンの数。
+int s_liveScenes = 0;
+
+/// 大きさの異なるシーン。
+template <SceneId Id, size_t Size> class TestScene final : public scene::Scene {
+public:
+  static constexpr SceneId ID = Id;
+
+  explicit TestScene(std::shared_ptr<hardware::Hardware> &) { s_liveScenes++; }
+  ~TestScene() { s_liveScenes--; }
+
+  virtual EventResult activated() override { return EventResultKind::Continue; }
+
+  /// 具象型のまま呼ばれたことを確かめるための、仮想でない関数。
+  SceneId id() const { return ID; }
+
+private:
+  char m_payload[Size] = {};
+};
+
+using Boot = TestScene<SceneId::Boot, 8>;
+using Clock = TestScene<SceneId::Clock, 64>;
+using ConfigureAlarm = TestScene<SceneId::ConfigureAlarm, 200>;
+using Alarming = TestScene<SceneId::Alarming, 32>;
+
+constexpr size_t DEPTH = 4;
+using StaticStack =
+    scene::StaticSceneStack<DEPTH, Boot, Clock, ConfigureAlarm, Alarming>;
+using DynamicStack =
+    scene::DynamicSceneStack<Boot, Clock, ConfigureAlarm, Alarming>;
+
+/// 起動から、アラームの設定中に鳴って止めるまでを1周する。
+///
+/// 遷移が期待通りでなかった回数を返す。
+template <typename Stack>
+int runDay(Stack &stack, std::shared_ptr<hardware::Hardware> &hw) {
+  int errors = 0;
+  errors += !stack.push(SceneId::Boot, hw);
+  // Boot -> Clock は入れ替え
+  stack.pop();
+  errors += !stack.push(SceneId::Clock, hw);
+  errors += !stack.push(SceneId::ConfigureAlarm, hw);
+  errors += !stack.push(SceneId::Alarming, hw);
+  errors += stack.topId() != SceneId::Alarming;
+  stack.pop();
+  errors += stack.topId() != SceneId::ConfigureAlarm;
+  stack.pop();
+  errors += stack.topId() != SceneId::Clock;
+  stack.pop();
+  errors += !stack.empty();
+  return errors;
+}
+} // namespace
+
+// 数えるだけで、確保は malloc に任せる
+void *operator new(size_t size) {
+  s_allocations++;
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+void setUp() { s_liveScenes = 0; }
+void tearDown() {}
+
+void test_static_stack_transitions_do_not_allocate() {
+  std::shared_ptr<hardware::Hardware> hw;
+  StaticStack stack;
+  const size_t before = s_allocations;
+  int errors = 0;
+  for (int i = 0; i < 100; ++i) {
+    errors += runDay(stack, hw);
+  }
+  TEST_ASSERT_EQUAL(0, errors);
+  TEST_ASSERT_EQUAL(before, s_allocations);
+  TEST_ASSERT_EQUAL(0, s_liveScenes);
+}
+
+void test_static_stack_visits_the_concrete_scene() {
+  std::shared_ptr<hardware::Hardware> hw;
+  StaticStack stack;
+  stack.push(SceneId::Clock, hw);
+  stack.push(SceneId::ConfigureAlarm, hw);
+  // `id()` は仮想関数でないので、具象型で渡されなければ呼べない
+  SceneId visited = SceneId::Boot;
+  stack.visitTop([&visited](auto &scene) {
+    visited = scene.id();
+    return scene.activated();
+  });
+  TEST_ASSERT_TRUE(visited == SceneId::ConfigureAlarm);
+}
+
+void test_dynamic_stack_allocates_on_every_push() {
+  std::shared_ptr<hardware::Hardware> hw;
+  DynamicStack stack;
+  const size_t before = s_allocations;
+  TEST_ASSERT_EQUAL(0, runDay(stack, hw));
+  // 比べるために、従来のスタックが確保することも確かめておく
+  TEST_ASSERT_GREATER_OR_EQUAL(before + 4, s_allocations);
+  TEST_ASSERT_EQUAL(0, s_liveScenes);
+}
+
+void test_static_stack_refuses_to_overflow() {
+  std::shared_ptr<hardware::Hardware> hw;
+  StaticStack stack;
+  for (size_t i = 0; i < DEPTH; ++i) {
+    TEST_ASSERT_TRUE(stack.push(SceneId::Clock, hw));
+  }
+  TEST_ASSERT_FALSE(stack.push(SceneId::Alarming, hw));
+  TEST_ASSERT_TRUE(stack.topId() == SceneId::Clock);
+  TEST_ASSERT_EQUAL(DEPTH, s_liveScenes);
+}
+
+void test_static_stack_destroys_remaining_scenes() {
+  std::shared_ptr<hardware::Hardware> hw;
+  {
+    StaticStack stack;
+    stack.push(SceneId::Clock, hw);
+    stack.push(SceneId::ConfigureAlarm, hw);
+    TEST_ASSERT_EQUAL(2, s_liveScenes);
+  }
+  TEST_ASSERT_EQUAL(0, s_liveScenes);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_static_stack_transitions_do_not_allocate);
+  RUN_TEST(test_static_stack_visits_the_concrete_scene);
+  RUN_TEST(test_dynamic_stack_allocates_on_every_push);
+  RUN_TEST(test_static_stack_refuses_to_overflow);
+  RUN_TEST(test_static_stack_destroys_remaining_scenes);
+  return UNITY_END();
+}
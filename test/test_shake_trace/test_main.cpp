@@ -0,0 +1,324 @@
+/**
+ * @file test_main.cpp
+ * @brief 加速度の記録の形式と、一周したリングファイルからの再生を確かめる
+ *
+ * ファイルは test/fakes/FS.h の RAM 上のファイルシステムに置き、
+ * 書き出しタスクは `ulTaskNotifyTake()` の代わりで1回ずつ回す。
+ */
+#include <unity.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// native 環境は src をビルドしないので、実装をここで読み込む
+#include <hardware/shake_trace_recorder.cpp>
+
+using hardware::AccelSample;
+using hardware::ShakeTraceDecoder;
+using hardware::ShakeTraceEvent;
+using hardware::ShakeTraceHeader;
+using hardware::ShakeTraceItem;
+using hardware::ShakeTraceRecord;
+using hardware::ShakeTraceRecorder;
+
+namespace {
+/// 書き出しタスクを止めるときに `ulTaskNotifyTake()` から投げる。
+struct Stopped {};
+
+/// 書き出しタスクを1周だけ回し、溜まった記録をファイルへ書かせる。
+void flushOnce() {
+  int calls = 0;
+  fake::notifyTake() = [&calls](TickType_t) -> uint32_t {
+    if (calls++ > 0) {
+      throw Stopped();
+    }
+    return 0;
+  };
+  const fake::Task task = fake::tasks().back();
+  try {
+    task.function(task.arg);
+  } catch (const Stopped &) {
+  }
+}
+
+/// レコードの列を古い順に読み、項目に戻す。
+std::vector<ShakeTraceItem> decodeAll(const ShakeTraceRecord *records,
+                                      size_t n) {
+  ShakeTraceDecoder decoder;
+  std::vector<ShakeTraceItem> items;
+  ShakeTraceItem item;
+  for (size_t i = 0; i < n; ++i) {
+    if (decoder.decode(records[i], item)) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+/// 1バッチをレコードの列の後ろに足す。
+void appendBatch(std::vector<ShakeTraceRecord> &records,
+                 const AccelSample *samples, size_t n, uint16_t odrHz,
+                 uint64_t end) {
+  hardware::encodeTraceBatch(
+      samples, n, odrHz, end,
+      [&records](const ShakeTraceRecord &r) { records.push_back(r); });
+}
+
+/// 再生で期待する項目と、その元のレコードの位置。
+struct Expected {
+  /// 元のレコードの位置。
+  uint32_t index;
+  /// サンプルなら、その前の時刻のイベントの位置。イベントなら `index` 。
+  uint32_t syncIndex;
+  uint64_t time;
+  bool isSample;
+  ShakeTraceEvent event;
+  int16_t x;
+};
+
+/// `i` 番目のバッチの `j` 番目のサンプル。
+AccelSample batchSample(int i, int j) {
+  return AccelSample{0.01f * (i * 10 + j), -0.5f, 1.0f};
+}
+} // namespace
+
+void setUp() {
+  fake::nowMicros() = 0;
+  fake::tasks().clear();
+  fake::pendingNotifications() = 0;
+}
+
+void tearDown() {}
+
+void test_batch_round_trip() {
+  const AccelSample samples[] = {
+      {0.0004f, -0.0006f, 1.0f},
+      {-1.2345f, 2.0005f, 0.999f},
+      {40.0f, -40.0f, 0},
+      {0.1f, 0.2f, 0.3f},
+  };
+  std::vector<ShakeTraceRecord> records;
+  appendBatch(records, samples, 4, 200, 123456);
+  // 時刻のイベントに続けてサンプルが並ぶ
+  TEST_ASSERT_EQUAL_size_t(5, records.size());
+  TEST_ASSERT_TRUE(records[0].tag & hardware::SHAKE_TRACE_EVENT_BIT);
+  const std::vector<ShakeTraceItem> items = decodeAll(records.data(), 5);
+  TEST_ASSERT_EQUAL_size_t(4, items.size());
+  for (size_t i = 0; i < 4; ++i) {
+    TEST_ASSERT_TRUE(items[i].isSample);
+    // 最後のサンプルが `end` で、それ以前は 200 Hz の間隔 (50 x 0.1 ms)
+    TEST_ASSERT_EQUAL_UINT32(123456 - 50 * (3 - i), items[i].time);
+  }
+  // mg に丸め、 16 bit に収まらない値は飽和させる
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, items[0].sample.x);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, -0.001f, items[0].sample.y);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, -1.235f, items[1].sample.x);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 2.001f, items[1].sample.y);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.999f, items[1].sample.z);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 32.767f, items[2].sample.x);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, -32.768f, items[2].sample.y);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.3f, items[3].sample.z);
+}
+
+void test_event_round_trip() {
+  // 時刻は 48 bit まで残る
+  const uint64_t time = 0x123456789ABCull;
+  const ShakeTraceRecord records[] = {
+      hardware::makeTraceEvent(ShakeTraceEvent::StopCount, time),
+      hardware::makeTraceEvent(ShakeTraceEvent::ResetCount, 7),
+  };
+  TEST_ASSERT_TRUE(hardware::traceEventTime(records[0]) == time);
+  const std::vector<ShakeTraceItem> items = decodeAll(records, 2);
+  TEST_ASSERT_EQUAL_size_t(2, items.size());
+  TEST_ASSERT_FALSE(items[0].isSample);
+  TEST_ASSERT_TRUE(items[0].event == ShakeTraceEvent::StopCount);
+  TEST_ASSERT_TRUE(items[0].time == time);
+  TEST_ASSERT_TRUE(items[1].event == ShakeTraceEvent::ResetCount);
+  TEST_ASSERT_TRUE(items[1].time == 7);
+}
+
+void test_ring_span() {
+  ShakeTraceHeader header = {};
+  header.capacity = 10;
+  const uint32_t heads[] = {0, 7, 10, 11, 23, 40};
+  const uint32_t counts[] = {0, 7, 10, 10, 10, 10};
+  const uint32_t firsts[] = {0, 0, 0, 1, 3, 0};
+  for (size_t i = 0; i < 6; ++i) {
+    header.head = heads[i];
+    TEST_ASSERT_EQUAL_UINT32(counts[i], hardware::traceRingCount(header));
+    TEST_ASSERT_EQUAL_UINT32(firsts[i], hardware::traceRingFirst(header));
+  }
+}
+
+void test_resync_from_time_record() {
+  // 5 サンプルのバッチを2つ、イベント、さらに2つで 25 レコード。
+  // 16 レコードのリングには 9 番目から残り、2つ目のバッチの途中から始まる
+  std::vector<ShakeTraceRecord> stream;
+  AccelSample batch[5];
+  for (int i = 0; i < 4; ++i) {
+    if (i == 2) {
+      stream.push_back(
+          hardware::makeTraceEvent(ShakeTraceEvent::StartCount, 4000));
+    }
+    for (int j = 0; j < 5; ++j) {
+      batch[j] = batchSample(i, j);
+    }
+    appendBatch(stream, batch, 5, 100, 1000 * (i + 1));
+  }
+  TEST_ASSERT_EQUAL_size_t(25, stream.size());
+  const uint32_t capacity = 16;
+  std::vector<ShakeTraceRecord> ring(capacity);
+  for (uint32_t i = 0; i < stream.size(); ++i) {
+    ring[i % capacity] = stream[i];
+  }
+  ShakeTraceHeader header = {};
+  header.capacity = capacity;
+  header.head = stream.size();
+  const uint32_t first = hardware::traceRingFirst(header);
+  std::vector<ShakeTraceRecord> ordered;
+  for (uint32_t i = 0; i < hardware::traceRingCount(header); ++i) {
+    ordered.push_back(ring[(first + i) % capacity]);
+  }
+  const std::vector<ShakeTraceItem> items =
+      decodeAll(ordered.data(), ordered.size());
+  // 時刻のわからない2つ目のバッチの残り3つは捨て、イベントから読み直す
+  TEST_ASSERT_EQUAL_size_t(11, items.size());
+  TEST_ASSERT_FALSE(items[0].isSample);
+  TEST_ASSERT_TRUE(items[0].event == ShakeTraceEvent::StartCount);
+  for (int i = 2; i < 4; ++i) {
+    for (int j = 0; j < 5; ++j) {
+      const ShakeTraceItem &item = items[1 + (i - 2) * 5 + j];
+      TEST_ASSERT_TRUE(item.isSample);
+      // 100 Hz なので 100 x 0.1 ms 間隔
+      TEST_ASSERT_EQUAL_UINT32(1000 * (i + 1) - 100 * (4 - j), item.time);
+      TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.01f * (i * 10 + j), item.sample.x);
+    }
+  }
+}
+
+void test_replay_wrapped_recording() {
+  fs::FS fs;
+  const uint32_t capacity = 40;
+  ShakeTraceRecorder recorder;
+  TEST_ASSERT_TRUE(recorder.begin(fs, "/shake.trc", capacity));
+
+  // 期待する項目を、元のレコードの位置と一緒に作っておく
+  std::vector<Expected> expected;
+  uint32_t index = 0;
+  AccelSample batch[6];
+  for (int i = 0; i < 12; ++i) {
+    fake::nowMicros() += 30 * 1000;
+    if (i == 7) {
+      recorder.recordEvent(ShakeTraceEvent::StartCount);
+      expected.push_back(Expected{index, index,
+                                  uint64_t(fake::nowMicros() / 100), false,
+                                  ShakeTraceEvent::StartCount, 0});
+      index++;
+    }
+    for (int j = 0; j < 6; ++j) {
+      batch[j] = batchSample(i, j);
+    }
+    recorder.recordSamples(batch, 6, 200);
+    const uint32_t sync = index++;
+    const uint64_t end = fake::nowMicros() / 100;
+    for (int j = 0; j < 6; ++j) {
+      expected.push_back(Expected{index++, sync, end - 50 * (5 - j), true,
+                                  ShakeTraceEvent::Time,
+                                  hardware::toTraceMilliG(batch[j].x)});
+    }
+    // 何バッチかおきに書き出し、ファイルのリングの終わりをまたがせる
+    if (i % 3 == 2) {
+      flushOnce();
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(index, recorder.written());
+  TEST_ASSERT_EQUAL_UINT32(0, recorder.dropped());
+
+  const std::vector<uint8_t> &file = fs.contents("/shake.trc");
+  TEST_ASSERT_EQUAL_size_t(sizeof(ShakeTraceHeader) +
+                               capacity * sizeof(ShakeTraceRecord),
+                           file.size());
+  ShakeTraceHeader header;
+  std::memcpy(&header, file.data(), sizeof(header));
+  TEST_ASSERT_EQUAL_UINT32(hardware::SHAKE_TRACE_MAGIC, header.magic);
+  TEST_ASSERT_EQUAL_UINT32(capacity, header.capacity);
+  TEST_ASSERT_EQUAL_UINT32(index, header.head);
+  TEST_ASSERT_EQUAL_UINT32(200, header.odrHz);
+
+  // 再生ツールと同じく、最も古いレコードから読む
+  std::vector<ShakeTraceRecord> ring(capacity);
+  std::memcpy(ring.data(), file.data() + sizeof(header),
+              capacity * sizeof(ShakeTraceRecord));
+  const uint32_t first = hardware::traceRingFirst(header);
+  ShakeTraceDecoder decoder;
+  std::vector<ShakeTraceItem> items;
+  ShakeTraceItem item;
+  for (uint32_t i = 0; i < hardware::traceRingCount(header); ++i) {
+    if (decoder.decode(ring[(first + i) % capacity], item)) {
+      items.push_back(item);
+    }
+  }
+
+  // リングに残ったレコードのうち、時刻のイベントも残っているものが読める
+  const uint32_t oldest = index - capacity;
+  std::vector<Expected> survived;
+  for (const Expected &e : expected) {
+    if (e.index >= oldest && e.syncIndex >= oldest) {
+      survived.push_back(e);
+    }
+  }
+  TEST_ASSERT_EQUAL_size_t(survived.size(), items.size());
+  for (size_t i = 0; i < items.size(); ++i) {
+    TEST_ASSERT_EQUAL(survived[i].isSample, items[i].isSample);
+    TEST_ASSERT_TRUE(survived[i].time == items[i].time);
+    if (items[i].isSample) {
+      TEST_ASSERT_FLOAT_WITHIN(1e-6f, survived[i].x / 1000.0f,
+                               items[i].sample.x);
+    } else {
+      TEST_ASSERT_TRUE(survived[i].event == items[i].event);
+    }
+  }
+}
+
+void test_recording_resumes_after_reopen() {
+  fs::FS fs;
+  const AccelSample batch[3] = {{0, 0, 1}, {0, 0, 1}, {0, 0, 1}};
+  {
+    ShakeTraceRecorder recorder;
+    TEST_ASSERT_TRUE(recorder.begin(fs, "/shake.trc", 64));
+    recorder.recordSamples(batch, 3, 100);
+    flushOnce();
+  }
+  ShakeTraceHeader header;
+  {
+    ShakeTraceRecorder recorder;
+    TEST_ASSERT_TRUE(recorder.begin(fs, "/shake.trc", 64));
+    recorder.recordSamples(batch, 3, 100);
+    flushOnce();
+    std::memcpy(&header, fs.contents("/shake.trc").data(), sizeof(header));
+  }
+  // 同じ大きさの記録には続きから書く
+  TEST_ASSERT_EQUAL_UINT32(8, header.head);
+  {
+    ShakeTraceRecorder recorder;
+    TEST_ASSERT_TRUE(recorder.begin(fs, "/shake.trc", 32));
+    recorder.recordSamples(batch, 3, 100);
+    flushOnce();
+    std::memcpy(&header, fs.contents("/shake.trc").data(), sizeof(header));
+  }
+  // 大きさが違えば作り直す
+  TEST_ASSERT_EQUAL_UINT32(32, header.capacity);
+  TEST_ASSERT_EQUAL_UINT32(4, header.head);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_batch_round_trip);
+  RUN_TEST(test_event_round_trip);
+  RUN_TEST(test_ring_span);
+  RUN_TEST(test_resync_from_time_record);
+  RUN_TEST(test_replay_wrapped_recording);
+  RUN_TEST(test_recording_resumes_after_reopen);
+  return UNITY_END();
+}
@@ -0,0 +1,340 @@
+/**
+ * @file test_main.cpp
+ * @brief IMU の代わりで `hardware::ShakingManager` の状態遷移を確かめる
+ *
+ * IMU は操作を記録し、 FIFO には時刻から作った加速度を溜める。
+ * タイマーサービスは仮想の時計のタイマーで置き換える。
+ */
+#include <unity.h>
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <fake_timer_service.hpp>
+// native 環境は src をビルドしないので、実装をここで読み込む
+#include <hardware/shaking_manager.cpp>
+
+using hardware::AccelSample;
+using hardware::ImuPort;
+using hardware::ImuPower;
+using hardware::ShakingConfig;
+using hardware::ShakingManager;
+using hardware::TimerService;
+
+namespace hardware {
+// このテストは記録を使わない
+void ShakeTraceRecorder::recordSamples(const AccelSample *, size_t,
+                                       uint16_t) {}
+void ShakeTraceRecorder::recordEvent(ShakeTraceEvent) {}
+} // namespace hardware
+
+namespace {
+/// IMU の操作。
+enum class ImuCall { Begin, Sleep, StartFifo, StartRegisters, WatchMotion };
+
+/// 静止して重力だけがかかっている。
+AccelSample still(int64_t) { return AccelSample{0, 0, 1}; }
+
+/// `untilMicros` まで 3 Hz 、 2.5 g で左右に振る。
+std::function<AccelSample(int64_t)> shakeUntil(int64_t untilMicros) {
+  return [untilMicros](int64_t micros) {
+    if (micros >= untilMicros) {
+      return still(micros);
+    }
+    const float x = 2.5f * std::sin(2 * 3.14159265f * 3 * micros / 1e6f);
+    return AccelSample{x, 0, 1};
+  };
+}
+
+/// IMU の代わり。操作を記録し、 FIFO には `signal` の加速度を溜める。
+class FakeImu final : public ImuPort {
+public:
+  std::vector<ImuCall> calls;
+  /// 割り込みピンがつながっているか否か。
+  bool hasInterruptPin = true;
+  /// 時刻 [us] の加速度 [g]。
+  std::function<AccelSample(int64_t)> signal = still;
+  /// `drain()` で取り出したサンプル数。
+  size_t drained = 0;
+
+  virtual void begin() override { calls.push_back(ImuCall::Begin); }
+  virtual void sleep() override {
+    calls.push_back(ImuCall::Sleep);
+    m_fifoRunning = false;
+  }
+  virtual uint16_t startFifo(uint16_t odrHz) override {
+    calls.push_back(ImuCall::StartFifo);
+    m_odrHz = odrHz;
+    m_fifoRunning = true;
+    m_nextMicros = fake::nowMicros();
+    return odrHz;
+  }
+  virtual size_t drain(AccelSample *out, size_t capacity) override {
+    size_t n = 0;
+    while (m_fifoRunning && m_nextMicros <= fake::nowMicros() &&
+           n < capacity) {
+      out[n++] = signal(m_nextMicros);
+      m_nextMicros += 1000000 / m_odrHz;
+    }
+    drained += n;
+    return n;
+  }
+  virtual void startRegisters() override {
+    calls.push_back(ImuCall::StartRegisters);
+    m_fifoRunning = false;
+  }
+  virtual bool read(AccelSample &out) override {
+    out = signal(fake::nowMicros());
+    return true;
+  }
+  virtual void watchMotion(uint16_t) override {
+    calls.push_back(ImuCall::WatchMotion);
+    m_fifoRunning = false;
+  }
+  virtual bool attachMotionInterrupt(MotionHandler handler,
+                                     void *arg) override {
+    if (!hasInterruptPin) {
+      return false;
+    }
+    m_handler = handler;
+    m_arg = arg;
+    return true;
+  }
+  virtual void detachMotionInterrupt() override { m_handler = nullptr; }
+
+  /// 動き検知の割り込みを上げる。
+  void raiseMotion() {
+    if (m_handler != nullptr) {
+      m_handler(m_arg);
+    }
+  }
+
+  size_t count(ImuCall call) const {
+    size_t n = 0;
+    for (const auto c : calls) {
+      n += c == call;
+    }
+    return n;
+  }
+
+private:
+  MotionHandler m_handler = nullptr;
+  void *m_arg = nullptr;
+  uint16_t m_odrHz = 0;
+  bool m_fifoRunning = false;
+  /// 次に溜まるサンプルの時刻 [us]。
+  int64_t m_nextMicros = 0;
+};
+
+/// 振動検知を仮想の IMU とタイマーにつないだもの。
+class Bench {
+public:
+  FakeImu imu;
+  TimerService timers;
+  ShakingManager manager{imu, timers};
+
+  explicit Bench(const ShakingConfig &config, bool hasInterruptPin = true) {
+    imu.hasInterruptPin = hasInterruptPin;
+    manager.begin(config);
+  }
+};
+
+/// 数えている間も動き検知で待つ設定。
+ShakingConfig wakeOnMotion() {
+  ShakingConfig config;
+  config.wakeOnMotion = true;
+  return config;
+}
+
+/// 周期的な読み出しが登録されているか否か。
+bool samplingRegistered() {
+  for (const auto &entry : fake::serviceTimers()) {
+    if (entry.second->periodMillis > 0 && entry.second->dueMicros >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+} // namespace
+
+void setUp() {
+  fake::nowMicros() = 0;
+  fake::serviceTimers().clear();
+}
+
+void tearDown() { fake::serviceTimers().clear(); }
+
+void test_motion_while_stopped_is_ignored() {
+  // 数えていない間も動きを待つ設定でも、止まっている間の動きでは読まない
+  ShakingConfig config = wakeOnMotion();
+  config.sleepWhenStopped = false;
+  Bench bench(config);
+  fake::advanceMillis(10);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::MotionWatch);
+  bench.imu.raiseMotion();
+  fake::advanceMillis(500);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::MotionWatch);
+  TEST_ASSERT_FALSE(samplingRegistered());
+  TEST_ASSERT_EQUAL_size_t(0, bench.imu.drained);
+  // 数え始めても、止まっている間の動きは残っていない
+  bench.manager.startCount();
+  fake::advanceMillis(500);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::MotionWatch);
+  TEST_ASSERT_FALSE(samplingRegistered());
+}
+
+void test_motion_while_counting_starts_sampling() {
+  Bench bench(wakeOnMotion());
+  bench.manager.startCount();
+  fake::advanceMillis(10);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::MotionWatch);
+  TEST_ASSERT_FALSE(samplingRegistered());
+  bench.imu.signal = shakeUntil(fake::nowMicros() + 2000 * 1000);
+  bench.imu.raiseMotion();
+  fake::advanceMillis(10);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::Accel);
+  TEST_ASSERT_TRUE(samplingRegistered());
+  // 3 Hz で 2 秒振れば、読み始めの重力の測り直しを除いて5往復は数える
+  fake::advanceMillis(2000);
+  TEST_ASSERT_GREATER_OR_EQUAL(5, bench.manager.getCount());
+  TEST_ASSERT_LESS_OR_EQUAL(6, bench.manager.getCount());
+}
+
+void test_idle_returns_to_watching() {
+  const ShakingConfig config = wakeOnMotion();
+  Bench bench(config);
+  bench.manager.startCount();
+  fake::advanceMillis(10);
+  const int64_t shakeEnd = fake::nowMicros() + 1000 * 1000;
+  bench.imu.signal = shakeUntil(shakeEnd);
+  bench.imu.raiseMotion();
+  fake::advanceMillis(1000);
+  const size_t watches = bench.imu.count(ImuCall::WatchMotion);
+  // 振りが途切れてから `idleMillis` の間は読み続ける
+  fake::advanceMillis(config.idleMillis - 500);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::Accel);
+  fake::advanceMillis(1000);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::MotionWatch);
+  TEST_ASSERT_FALSE(samplingRegistered());
+  TEST_ASSERT_EQUAL_size_t(watches + 1, bench.imu.count(ImuCall::WatchMotion));
+  // 読むのをやめている
+  const size_t drained = bench.imu.drained;
+  fake::advanceMillis(1000);
+  TEST_ASSERT_EQUAL_size_t(drained, bench.imu.drained);
+}
+
+void test_start_watching_rearms_latch() {
+  ShakingConfig config = wakeOnMotion();
+  config.sleepWhenStopped = false;
+  Bench bench(config);
+  bench.manager.startCount();
+  fake::advanceMillis(10);
+  bench.imu.raiseMotion();
+  fake::advanceMillis(config.idleMillis + 500);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::MotionWatch);
+  // 動き検知に戻るときに検知済みの印を下ろすので、止めてモードを選び直しても
+  // 読み始めない。上がったままの割り込みを下げるために設定し直す
+  const size_t watches = bench.imu.count(ImuCall::WatchMotion);
+  bench.manager.stopCount();
+  fake::advanceMillis(1000);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::MotionWatch);
+  TEST_ASSERT_FALSE(samplingRegistered());
+  TEST_ASSERT_EQUAL_size_t(watches + 1, bench.imu.count(ImuCall::WatchMotion));
+  // 数え直せば、次の動きで再び読み始める
+  bench.manager.startCount();
+  fake::advanceMillis(10);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::MotionWatch);
+  bench.imu.raiseMotion();
+  fake::advanceMillis(10);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::Accel);
+  TEST_ASSERT_TRUE(samplingRegistered());
+}
+
+void test_no_interrupt_pin_samples_while_counting() {
+  Bench bench(wakeOnMotion(), false);
+  bench.manager.startCount();
+  fake::advanceMillis(10);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::Accel);
+  TEST_ASSERT_TRUE(samplingRegistered());
+  // 静止していても動き検知には戻らない
+  fake::advanceMillis(10000);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::Accel);
+  TEST_ASSERT_EQUAL_size_t(0, bench.imu.count(ImuCall::WatchMotion));
+}
+
+void test_sleep_on_stop_count() {
+  Bench bench(ShakingConfig{});
+  bench.manager.startCount();
+  fake::advanceMillis(500);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::Accel);
+  TEST_ASSERT_TRUE(samplingRegistered());
+  const size_t sleeps = bench.imu.count(ImuCall::Sleep);
+  bench.manager.stopCount();
+  fake::advanceMillis(10);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::Sleep);
+  TEST_ASSERT_EQUAL_size_t(sleeps + 1, bench.imu.count(ImuCall::Sleep));
+  // 読む処理の登録を解くので、眠っている間は読まない
+  TEST_ASSERT_FALSE(samplingRegistered());
+  const size_t drained = bench.imu.drained;
+  fake::advanceMillis(10000);
+  TEST_ASSERT_EQUAL_size_t(drained, bench.imu.drained);
+}
+
+void test_accel_only_on_start_count() {
+  Bench bench(ShakingConfig{});
+  // 出力レートを知るために起動時に1回だけ FIFO を動かし、すぐ眠らせる
+  TEST_ASSERT_EQUAL_size_t(1, bench.imu.count(ImuCall::StartFifo));
+  fake::advanceMillis(10000);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::Sleep);
+  TEST_ASSERT_EQUAL_size_t(1, bench.imu.count(ImuCall::StartFifo));
+  TEST_ASSERT_FALSE(samplingRegistered());
+  TEST_ASSERT_EQUAL_size_t(0, bench.imu.drained);
+  // 回数の消去では起きない
+  bench.manager.resetCount();
+  fake::advanceMillis(1000);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::Sleep);
+  bench.manager.startCount();
+  fake::advanceMillis(10);
+  TEST_ASSERT_TRUE(bench.manager.imuPower() == ImuPower::Accel);
+  TEST_ASSERT_EQUAL_size_t(2, bench.imu.count(ImuCall::StartFifo));
+  TEST_ASSERT_TRUE(samplingRegistered());
+}
+
+void test_power_stats() {
+  fake::nowMicros() = 1000 * 1000;
+  Bench bench(wakeOnMotion());
+  fake::advanceMillis(1000);
+  bench.manager.startCount();
+  fake::advanceMillis(2000);
+  bench.imu.raiseMotion();
+  fake::advanceMillis(3000);
+  bench.manager.stopCount();
+  fake::advanceMillis(500);
+  const hardware::ImuPowerStats stats = bench.manager.powerStats();
+  TEST_ASSERT_TRUE(stats.state == ImuPower::Sleep);
+  // 眠る -> 動き検知 -> 読む -> 眠る
+  TEST_ASSERT_EQUAL_UINT32(3, stats.transitions);
+  TEST_ASSERT_EQUAL_UINT32(1500, stats.millis[size_t(ImuPower::Sleep)]);
+  TEST_ASSERT_EQUAL_UINT32(2000, stats.millis[size_t(ImuPower::MotionWatch)]);
+  TEST_ASSERT_EQUAL_UINT32(3000, stats.millis[size_t(ImuPower::Accel)]);
+  // 今の状態の時間は呼んだ時点まで数える
+  fake::advanceMillis(250);
+  const hardware::ImuPowerStats later = bench.manager.powerStats();
+  TEST_ASSERT_EQUAL_UINT32(1750, later.millis[size_t(ImuPower::Sleep)]);
+  TEST_ASSERT_EQUAL_UINT32(3, later.transitions);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_motion_while_stopped_is_ignored);
+  RUN_TEST(test_motion_while_counting_starts_sampling);
+  RUN_TEST(test_idle_returns_to_watching);
+  RUN_TEST(test_start_watching_rearms_latch);
+  RUN_TEST(test_no_interrupt_pin_samples_while_counting);
+  RUN_TEST(test_sleep_on_stop_count);
+  RUN_TEST(test_accel_only_on_start_count);
+  RUN_TEST(test_power_stats);
+  return UNITY_END();
+}
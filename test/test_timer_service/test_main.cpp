@@ -0,0 +1,368 @@
+/**
+ * @file test_main.cpp
+ * @brief 階層型タイマーホイールの期限を仮想の時計で確かめる
+ *
+ * サービスのタスクは `ulTaskNotifyTake()` の代わりで眠り、その間に
+ * 予定した登録を実行して時計を進める。 tick カウントの折り返し (49.7 日) と
+ * 刻みの折り返し (497 日) をまたいでも期限がずれないことを見る。
+ */
+#include <unity.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// native 環境は src をビルドしないので、ホイールの実装をここで読み込む
+#include <hardware/timer_service.cpp>
+
+using hardware::TimerJob;
+using hardware::TimerService;
+
+namespace {
+constexpr int64_t SECOND = 1000;
+constexpr int64_t MINUTE = 60 * SECOND;
+constexpr int64_t HOUR = 60 * MINUTE;
+constexpr int64_t DAY = 24 * HOUR;
+/// tick カウントが折り返す時刻 [ms]。
+constexpr int64_t TICK_WRAP = int64_t(1) << 32;
+/// 刻みが折り返す時刻 [ms]。
+constexpr int64_t STEP_WRAP = TICK_WRAP * TimerService::RESOLUTION_MILLIS;
+
+/// テストを終えるときに `ulTaskNotifyTake()` から投げる。
+struct Finished {};
+
+/// サービスのタスクが眠っている間に、ほかのタスクから行う操作。
+std::multimap<int64_t, std::function<void()>> s_schedule;
+/// この時刻 [ms] を過ぎて眠ろうとしたらタスクを止める。
+int64_t s_endMillis = 0;
+
+int64_t nowMillis() { return fake::nowMicros() / 1000; }
+
+/// `delayMillis` 後の単発処理が実行されるべき時刻 [ms]。
+int64_t expectedFire(int64_t registeredMillis, uint32_t delayMillis) {
+  const int64_t r = TimerService::RESOLUTION_MILLIS;
+  const int64_t steps = std::max<int64_t>(1, (delayMillis + r - 1) / r);
+  return (registeredMillis / r + steps) * r;
+}
+
+/// 予定した操作を実行するか、期限まで時計を進める。
+uint32_t takeNotification(TickType_t wait) {
+  if (fake::pendingNotifications() == 0) {
+    const int64_t deadline =
+        wait == portMAX_DELAY ? INT64_MAX : nowMillis() + wait;
+    const auto next = s_schedule.begin();
+    if (next != s_schedule.end() && next->first <= deadline) {
+      if (next->first > nowMillis()) {
+        fake::nowMicros() = next->first * 1000;
+      }
+      const std::function<void()> action = next->second;
+      s_schedule.erase(next);
+      // ほかのタスクからの操作として実行する
+      const TaskHandle_t self = fake::currentTask();
+      fake::currentTask() = NULL;
+      action();
+      fake::currentTask() = self;
+    } else if (deadline > s_endMillis) {
+      throw Finished();
+    } else {
+      fake::nowMicros() = deadline * 1000;
+    }
+  }
+  const uint32_t taken = fake::pendingNotifications();
+  fake::pendingNotifications() = 0;
+  return taken;
+}
+
+/// 最後に起動したサービスのタスクを `endMillis` まで動かす。
+void runUntil(int64_t endMillis) {
+  s_endMillis = endMillis;
+  const fake::Task task = fake::tasks().back();
+  fake::currentTask() = reinterpret_cast<TaskHandle_t>(fake::tasks().size());
+  try {
+    task.function(task.arg);
+  } catch (const Finished &) {
+  }
+  fake::currentTask() = NULL;
+}
+
+/// 実行された時刻を記録する処理。
+struct Probe {
+  std::vector<int64_t> fires;
+  TimerJob job;
+
+  explicit Probe(const char *name)
+      : job(name, [this]() { fires.push_back(nowMillis()); }) {}
+};
+} // namespace
+
+void setUp() {
+  fake::nowMicros() = 0;
+  fake::tasks().clear();
+  fake::currentTask() = NULL;
+  fake::pendingNotifications() = 0;
+  fake::notifyTake() = takeNotification;
+  s_schedule.clear();
+}
+
+void tearDown() {}
+
+void test_one_shot_on_every_level() {
+  // 1段目、2段目、3段目、溢れリストとそれぞれの境界をまたぐ遅れ
+  const uint32_t delays[] = {
+      0,       1,       10,      11,      630,     640,      641,
+      6399,    40950,   40960,   40970,   300000,  2621430,  2621440,
+      2621450, 3 * HOUR, 10 * HOUR, 30 * HOUR, 40 * DAY,
+  };
+  const size_t count = sizeof(delays) / sizeof(delays[0]);
+  TimerService service;
+  service.begin();
+  std::vector<std::unique_ptr<Probe>> probes;
+  std::vector<int64_t> registered;
+  for (size_t i = 0; i < count; ++i) {
+    probes.emplace_back(new Probe("probe"));
+    // 刻みの途中で登録する
+    const int64_t at = 12345 + 7 * i;
+    registered.push_back(at);
+    Probe *probe = probes.back().get();
+    const uint32_t delay = delays[i];
+    s_schedule.emplace(at, [&service, probe, delay]() {
+      service.startOnce(probe->job, delay);
+    });
+  }
+  runUntil(41 * DAY);
+  for (size_t i = 0; i < count; ++i) {
+    TEST_ASSERT_EQUAL_size_t(1, probes[i]->fires.size());
+    TEST_ASSERT_EQUAL_INT64(expectedFire(registered[i], delays[i]),
+                            probes[i]->fires[0]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, service.stats().activeJobs);
+  TEST_ASSERT_EQUAL_UINT32(count, service.stats().runs);
+}
+
+void test_registered_before_begin() {
+  TimerService service;
+  Probe probe("early");
+  fake::nowMicros() = 5000 * 1000;
+  service.startOnce(probe.job, 100);
+  service.begin();
+  runUntil(20 * SECOND);
+  TEST_ASSERT_EQUAL_size_t(1, probe.fires.size());
+  TEST_ASSERT_EQUAL_INT64(5100, probe.fires[0]);
+}
+
+void test_registration_while_lagging() {
+  TimerService service;
+  service.begin();
+  Probe late("late");
+  Probe nested("nested");
+  Probe outside("outside");
+  int64_t nestedAt = 0;
+  // 500 ms かかる処理。その間に期限の来た処理は、戻ってから順に実行される
+  TimerJob slow("slow", [&]() {
+    fake::nowMicros() += 500 * 1000;
+    nestedAt = nowMillis();
+    service.startOnce(nested.job, 100);
+  });
+  s_schedule.emplace(1003, [&]() {
+    service.startOnce(slow, 1000);
+    service.startOnce(late.job, 1200);
+  });
+  // サービスが眠ったまま時計が大きく進んでから登録する
+  s_schedule.emplace(3 * HOUR + 7,
+                     [&]() { service.startOnce(outside.job, 20); });
+  runUntil(4 * HOUR);
+  TEST_ASSERT_EQUAL_size_t(1, late.fires.size());
+  TEST_ASSERT_EQUAL_INT64(2500, late.fires[0]);
+  TEST_ASSERT_EQUAL_INT64(2500, nestedAt);
+  TEST_ASSERT_EQUAL_size_t(1, nested.fires.size());
+  TEST_ASSERT_EQUAL_INT64(expectedFire(nestedAt, 100), nested.fires[0]);
+  TEST_ASSERT_EQUAL_size_t(1, outside.fires.size());
+  TEST_ASSERT_EQUAL_INT64(expectedFire(3 * HOUR + 7, 20), outside.fires[0]);
+}
+
+void test_periodic_alignment() {
+  TimerService service;
+  service.begin();
+  Probe probe("periodic");
+  s_schedule.emplace(1234, [&]() { service.startPeriodic(probe.job, 1000); });
+  s_schedule.emplace(5500, [&]() { service.stop(probe.job); });
+  runUntil(10 * SECOND);
+  const std::vector<int64_t> expected = {2000, 3000, 4000, 5000};
+  TEST_ASSERT_EQUAL_size_t(expected.size(), probe.fires.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    TEST_ASSERT_EQUAL_INT64(expected[i], probe.fires[i]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, service.stats().activeJobs);
+}
+
+void test_tick_wrap() {
+  // 起動時の tick カウントは折り返す直前
+  fake::nowMicros() = (TICK_WRAP - 3 * SECOND) * 1000;
+  TimerService service;
+  service.begin();
+  const uint32_t delays[] = {10, 2990, 3000, 3010, 50000, 3 * HOUR};
+  const size_t count = sizeof(delays) / sizeof(delays[0]);
+  std::vector<std::unique_ptr<Probe>> probes;
+  const int64_t at = TICK_WRAP - 3 * SECOND + 3;
+  for (size_t i = 0; i < count; ++i) {
+    probes.emplace_back(new Probe("probe"));
+    Probe *probe = probes.back().get();
+    const uint32_t delay = delays[i];
+    s_schedule.emplace(at, [&service, probe, delay]() {
+      service.startOnce(probe->job, delay);
+    });
+  }
+  runUntil(TICK_WRAP + 4 * HOUR);
+  for (size_t i = 0; i < count; ++i) {
+    TEST_ASSERT_EQUAL_size_t(1, probes[i]->fires.size());
+    TEST_ASSERT_EQUAL_INT64(expectedFire(at, delays[i]), probes[i]->fires[0]);
+  }
+}
+
+void test_step_wrap() {
+  // 刻みを折り返させるため、起動から 497 日動かす
+  TimerService service;
+  service.begin();
+  Probe hourly("hourly");
+  service.startPeriodic(hourly.job, HOUR);
+  const uint32_t delays[] = {10, 4990, 5000, 5010, 100000, 3 * HOUR};
+  const size_t count = sizeof(delays) / sizeof(delays[0]);
+  std::vector<std::unique_ptr<Probe>> probes;
+  const int64_t at = STEP_WRAP - 5 * SECOND + 4;
+  for (size_t i = 0; i < count; ++i) {
+    probes.emplace_back(new Probe("probe"));
+    Probe *probe = probes.back().get();
+    const uint32_t delay = delays[i];
+    s_schedule.emplace(at, [&service, probe, delay]() {
+      service.startOnce(probe->job, delay);
+    });
+  }
+  runUntil(STEP_WRAP + 4 * HOUR);
+  for (size_t i = 0; i < count; ++i) {
+    TEST_ASSERT_EQUAL_size_t(1, probes[i]->fires.size());
+    TEST_ASSERT_EQUAL_INT64(expectedFire(at, delays[i]), probes[i]->fires[0]);
+  }
+  // 周期処理も折り返しをまたいで同じ間隔で実行される
+  TEST_ASSERT_EQUAL_INT64(HOUR, hourly.fires[0]);
+  for (size_t i = 1; i < hourly.fires.size(); ++i) {
+    TEST_ASSERT_EQUAL_INT64(HOUR, hourly.fires[i] - hourly.fires[i - 1]);
+  }
+  TEST_ASSERT_GREATER_THAN(STEP_WRAP + 3 * HOUR, hourly.fires.back());
+}
+
+void test_randomized_across_wraps() {
+  // 起動から刻みの折り返しの後まで、単発処理の登録と解除を乱数で繰り返す。
+  // 時刻の 1/3 は tick カウントの折り返しの前後、 1/3 は刻みの折り返しの
+  // 前後に集める
+  std::mt19937 random(20240601);
+  const int64_t end = STEP_WRAP + 2 * DAY;
+  TimerService service;
+  service.begin();
+
+  /// 単発処理。実行された時刻を、その時点で期待していた時刻と比べる。
+  struct OneShot {
+    /// 実行されるべき時刻 [ms]。登録されていなければ負。
+    int64_t expected = -1;
+    size_t fires = 0;
+    TimerJob job;
+
+    explicit OneShot(std::vector<std::string> &errors)
+        : job("shot", [this, &errors]() {
+            const int64_t now = nowMillis();
+            if (now != expected) {
+              char message[64];
+              std::snprintf(message, sizeof(message),
+                            "fired at %lld, expected %lld",
+                            static_cast<long long>(now),
+                            static_cast<long long>(expected));
+              errors.push_back(message);
+            }
+            fires++;
+            expected = -1;
+          }) {}
+  };
+  std::vector<std::string> errors;
+  std::vector<std::unique_ptr<OneShot>> shots;
+  for (int i = 0; i < 48; ++i) {
+    shots.emplace_back(new OneShot(errors));
+  }
+
+  // 周期処理は間隔が変わらないことだけを見る
+  std::vector<std::unique_ptr<Probe>> periodics;
+  std::vector<int64_t> periods;
+  for (int i = 0; i < 4; ++i) {
+    periods.push_back(std::uniform_int_distribution<int64_t>(6, 720)(random) *
+                      10 * SECOND);
+    periodics.emplace_back(new Probe("periodic"));
+    service.startPeriodic(periodics.back()->job,
+                          static_cast<uint32_t>(periods.back()));
+  }
+
+  std::uniform_int_distribution<int64_t> anywhere(0, end - 7 * HOUR);
+  std::uniform_int_distribution<int64_t> nearWrap(-HOUR, HOUR);
+  std::uniform_real_distribution<double> logDelay(0, std::log(6.0 * HOUR));
+  for (int i = 0; i < 3000; ++i) {
+    int64_t at = anywhere(random);
+    if (i % 3 == 1) {
+      at = TICK_WRAP + nearWrap(random);
+    } else if (i % 3 == 2) {
+      at = STEP_WRAP + nearWrap(random);
+    }
+    OneShot *shot = shots[random() % shots.size()].get();
+    if (random() % 10 == 0) {
+      s_schedule.emplace(at, [&service, shot]() {
+        service.stop(shot->job);
+        shot->expected = -1;
+      });
+      continue;
+    }
+    const uint32_t delay =
+        static_cast<uint32_t>(std::exp(logDelay(random))) - 1;
+    s_schedule.emplace(at, [&service, shot, delay]() {
+      service.startOnce(shot->job, delay);
+      shot->expected = expectedFire(nowMillis(), delay);
+    });
+  }
+  runUntil(end);
+  if (!errors.empty()) {
+    TEST_FAIL_MESSAGE(errors.front().c_str());
+  }
+  uint32_t pending = 0;
+  size_t fires = 0;
+  for (const auto &shot : shots) {
+    // 期限を過ぎたのに実行されていない処理はない
+    TEST_ASSERT_TRUE(shot->expected < 0 || shot->expected > end);
+    pending += shot->expected >= 0 ? 1 : 0;
+    fires += shot->fires;
+  }
+  TEST_ASSERT_GREATER_THAN(1000, fires);
+  TEST_ASSERT_EQUAL_UINT32(pending + periodics.size(),
+                           service.stats().activeJobs);
+  for (size_t i = 0; i < periodics.size(); ++i) {
+    const std::vector<int64_t> &f = periodics[i]->fires;
+    TEST_ASSERT_GREATER_THAN(0, f.front());
+    TEST_ASSERT_LESS_OR_EQUAL(periods[i], f.front());
+    for (size_t j = 1; j < f.size(); ++j) {
+      TEST_ASSERT_EQUAL_INT64(periods[i], f[j] - f[j - 1]);
+    }
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_one_shot_on_every_level);
+  RUN_TEST(test_registered_before_begin);
+  RUN_TEST(test_registration_while_lagging);
+  RUN_TEST(test_periodic_alignment);
+  RUN_TEST(test_tick_wrap);
+  RUN_TEST(test_step_wrap);
+  RUN_TEST(test_randomized_across_wraps);
+  return UNITY_END();
+}
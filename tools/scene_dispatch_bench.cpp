@@ -0,0 +1,205 @@
+/**
+ * @file scene_dispatch_bench.cpp
+ * @brief シーンのボタンイベントの振り分けの時間を測るホスト用のツール
+ *
+ * 今の `scene::Scene::buttonEventReceived()` の処理関数の表と、以前の
+ * (ボタン, 押され方) を整数に詰めて switch で振り分ける方式を、同じ
+ * イベント列で比べる。以前の方式は押され方が増えた今の列挙に合わせて
+ * case を足してある。どちらも処理関数は仮想関数として呼ぶ。
+ *
+ * ビルドと実行:
+ *
+ *     g++ -std=c++14 -O2 -Isrc tools/scene_dispatch_bench.cpp \
+ *         -o scene_dispatch_bench
+ *     ./scene_dispatch_bench [events]
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "scene/scene.hpp"
+
+using hardware::Button;
+using hardware::ButtonEvent;
+using hardware::ButtonEventKind;
+using scene::EventResult;
+using scene::EventResultKind;
+using scene::Scene;
+
+namespace {
+/// 処理関数がそれぞれ別の重みで数えるシーン。
+///
+/// 呼ばれた処理関数を取り違えると合計が合わなくなる。
+class CountingScene final : public Scene {
+public:
+  uint64_t sum = 0;
+
+#define COUNTING_HANDLERS(B, W)                                                \
+  virtual EventResult button##B##Pressed() override { return add(W + 1); }     \
+  virtual EventResult button##B##Released() override { return add(W + 2); }    \
+  virtual EventResult button##B##Repeated(uint16_t steps) override {           \
+    return add(W * steps + 3);                                                 \
+  }                                                                            \
+  virtual EventResult button##B##LongPressed() override { return add(W + 4); } \
+  virtual EventResult button##B##DoublePressed() override {                    \
+    return add(W + 5);                                                         \
+  }
+  COUNTING_HANDLERS(A, 10)
+  COUNTING_HANDLERS(B, 20)
+  COUNTING_HANDLERS(C, 30)
+#undef COUNTING_HANDLERS
+
+private:
+  EventResult add(uint64_t n) {
+    sum += n;
+    return EventResultKind::Continue;
+  }
+};
+
+/// 以前の振り分け。
+EventResult legacyDispatch(Scene &scene, const ButtonEvent &event) {
+  int button_n = 0;
+  switch (event.button) {
+  case Button::A:
+    button_n = 1;
+    break;
+  case Button::B:
+    button_n = 2;
+    break;
+  case Button::C:
+    button_n = 3;
+    break;
+  }
+  int event_n = 0;
+  switch (event.kind) {
+  case ButtonEventKind::Pressed:
+    event_n = 1;
+    break;
+  case ButtonEventKind::Released:
+    event_n = 2;
+    break;
+  case ButtonEventKind::Repeated:
+    event_n = 3;
+    break;
+  case ButtonEventKind::LongPress:
+    event_n = 4;
+    break;
+  case ButtonEventKind::DoublePress:
+    event_n = 5;
+    break;
+  }
+  int n = (event_n << 4) | button_n;
+  switch (n) {
+  case 0x11:
+    return scene.buttonAPressed();
+  case 0x21:
+    return scene.buttonAReleased();
+  case 0x31:
+    return scene.buttonARepeated(event.count);
+  case 0x41:
+    return scene.buttonALongPressed();
+  case 0x51:
+    return scene.buttonADoublePressed();
+  case 0x12:
+    return scene.buttonBPressed();
+  case 0x22:
+    return scene.buttonBReleased();
+  case 0x32:
+    return scene.buttonBRepeated(event.count);
+  case 0x42:
+    return scene.buttonBLongPressed();
+  case 0x52:
+    return scene.buttonBDoublePressed();
+  case 0x13:
+    return scene.buttonCPressed();
+  case 0x23:
+    return scene.buttonCReleased();
+  case 0x33:
+    return scene.buttonCRepeated(event.count);
+  case 0x43:
+    return scene.buttonCLongPressed();
+  case 0x53:
+    return scene.buttonCDoublePressed();
+  default:
+    // Should never come here.
+    return EventResultKind::Continue;
+  }
+}
+
+/// 再現できるよう固定の種から、一様に散らばったイベント列を作る。
+std::vector<ButtonEvent> makeEvents(size_t n) {
+  std::vector<ButtonEvent> events;
+  events.reserve(n);
+  uint32_t x = 2463534242u;
+  for (size_t i = 0; i < n; ++i) {
+    // xorshift32
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    events.emplace_back(
+        static_cast<Button>(x % hardware::BUTTON_COUNT),
+        static_cast<ButtonEventKind>(x / 3 %
+                                     hardware::BUTTON_EVENT_KIND_COUNT),
+        static_cast<uint16_t>(1 << (x / 15 % 4)));
+  }
+  return events;
+}
+
+/// 1イベントあたりの処理時間 [ns] を測る。
+template <typename F> double nanosPerEvent(size_t events, F run) {
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  size_t repeats = 0;
+  do {
+    run();
+    repeats++;
+  } while (Clock::now() - start < std::chrono::milliseconds(500));
+  const std::chrono::duration<double, std::nano> elapsed =
+      Clock::now() - start;
+  return elapsed.count() / (double(repeats) * events);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 4096;
+  if (n == 0) {
+    std::fprintf(stderr, "usage: %s [events]\n", argv[0]);
+    return 1;
+  }
+  const std::vector<ButtonEvent> events = makeEvents(n);
+
+  // 具体的な型が見えないよう、基底クラスの参照から呼ぶ
+  CountingScene legacyScene, tableScene;
+  Scene &legacy = legacyScene;
+  Scene &table = tableScene;
+  const double legacyNanos = nanosPerEvent(n, [&]() {
+    for (const auto &e : events) {
+      legacyDispatch(legacy, e);
+    }
+  });
+  const double tableNanos = nanosPerEvent(n, [&]() {
+    for (const auto &e : events) {
+      table.buttonEventReceived(e);
+    }
+  });
+
+  // 同じ処理関数が同じ回数だけ呼ばれたかを、1巡あたりの合計で確かめる
+  legacyScene.sum = tableScene.sum = 0;
+  for (const auto &e : events) {
+    legacyDispatch(legacy, e);
+    table.buttonEventReceived(e);
+  }
+  if (legacyScene.sum != tableScene.sum) {
+    std::fprintf(stderr, "dispatch mismatch: legacy %llu, table %llu\n",
+                 static_cast<unsigned long long>(legacyScene.sum),
+                 static_cast<unsigned long long>(tableScene.sum));
+    return 1;
+  }
+  std::printf("%zu events, checksum %llu\n", n,
+              static_cast<unsigned long long>(tableScene.sum));
+  std::printf("  legacy switch: %6.2f ns/event\n", legacyNanos);
+  std::printf("  handler table: %6.2f ns/event\n", tableNanos);
+  return 0;
+}
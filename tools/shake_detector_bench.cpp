@@ -0,0 +1,185 @@
+/**
+ * @file shake_detector_bench.cpp
+ * @brief 合成した加速度で振動検知の回数と処理時間を確かめるホスト用のツール
+ *
+ * 実機の記録がなくても `hardware::ShakeDetector` を試せるよう、決まった
+ * 振り方の加速度を作って通す。5回の往復を 1.2, 3, 6, 8 Hz で振ったもの、
+ * 傾けて振った後にゆっくり 90 度回したもの、片道だけの衝撃について、
+ * 数えた回数と期待する回数を並べる。 FIFO の1回分のサンプル数での
+ * 1サンプルあたりの処理時間も測る。
+ *
+ * ビルドと実行:
+ *
+ *     g++ -std=c++14 -O2 -Isrc tools/shake_detector_bench.cpp \
+ *         -o shake_detector_bench
+ *     ./shake_detector_bench [rate-hz]
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "hardware/shake_detector.hpp"
+
+using namespace hardware;
+
+namespace {
+constexpr float PI = 3.14159265f;
+/// 振りの加速度の振幅 [g]
+constexpr float SHAKE_G = 2.5f;
+/// FIFO に溜まるサンプル数の上限 (`Mpu9250Fifo::CAPACITY`)
+constexpr size_t FIFO_CAPACITY = 512 / 6;
+
+/// 合成した加速度の列。
+class Signal {
+public:
+  explicit Signal(float rateHz) : m_rateHz(rateHz) {}
+
+  std::vector<AccelSample> samples;
+
+  /// 重力の向き (単位ベクトル) を決める。
+  void setGravity(float x, float y, float z) {
+    m_gx = x;
+    m_gy = y;
+    m_gz = z;
+  }
+  /// 静止したまま `seconds` だけ置く。
+  void rest(float seconds) {
+    for (size_t i = 0, n = count(seconds); i < n; ++i) {
+      push(0, 0, 0);
+    }
+  }
+  /// x 軸に沿って `hz` で `cycles` 回往復させる。
+  void shake(float hz, int cycles) {
+    const size_t n = count(cycles / hz);
+    for (size_t i = 0; i < n; ++i) {
+      const float a = SHAKE_G * std::sin(2 * PI * hz * i / m_rateHz);
+      push(a, 0, 0);
+    }
+  }
+  /// x 軸の正の向きに、 `seconds` の半波の衝撃を1回だけ与える。
+  void jolt(float seconds) {
+    const size_t n = count(seconds);
+    for (size_t i = 0; i < n; ++i) {
+      push(SHAKE_G * std::sin(PI * i / n), 0, 0);
+    }
+  }
+  /// 重力の向きを x 軸の周りに `seconds` かけて 90 度回す。
+  void rotate(float seconds) {
+    const float y = m_gy, z = m_gz;
+    const size_t n = count(seconds);
+    for (size_t i = 0; i < n; ++i) {
+      const float t = 0.5f * PI * i / n;
+      m_gy = y * std::cos(t) - z * std::sin(t);
+      m_gz = y * std::sin(t) + z * std::cos(t);
+      push(0, 0, 0);
+    }
+  }
+
+private:
+  float m_rateHz;
+  float m_gx = 0, m_gy = 0, m_gz = 1;
+
+  size_t count(float seconds) const {
+    return static_cast<size_t>(seconds * m_rateHz + 0.5f);
+  }
+  void push(float x, float y, float z) {
+    samples.push_back(AccelSample{m_gx + x, m_gy + y, m_gz + z});
+  }
+};
+
+/// 1つの振り方。
+struct Scenario {
+  std::string name;
+  int expected;
+  Signal signal;
+};
+
+std::vector<Scenario> makeScenarios(float rateHz) {
+  std::vector<Scenario> scenarios;
+  const float rates[] = {1.2f, 3, 6, 8};
+  for (size_t i = 0; i < 4; ++i) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "5 shakes at %.1f Hz", rates[i]);
+    Signal s(rateHz);
+    s.rest(2);
+    s.shake(rates[i], 5);
+    s.rest(2);
+    scenarios.push_back(Scenario{name, 5, s});
+  }
+  {
+    const float c = std::cos(PI / 4);
+    Signal s(rateHz);
+    s.setGravity(0, c, c);
+    s.rest(2);
+    s.shake(3, 5);
+    s.rest(1);
+    s.rotate(2);
+    s.rest(2);
+    scenarios.push_back(Scenario{"tilted, then rotated", 5, s});
+  }
+  {
+    Signal s(rateHz);
+    s.rest(2);
+    s.jolt(0.1f);
+    s.rest(2);
+    scenarios.push_back(Scenario{"one-way jolt", 0, s});
+  }
+  return scenarios;
+}
+
+/// FIFO の1回分ずつ処理し、1サンプルあたりの処理時間 [ns] を測る。
+double nanosPerSample(ShakeDetector &detector,
+                      const std::vector<AccelSample> &samples) {
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  size_t repeats = 0;
+  do {
+    detector.reset();
+    for (size_t i = 0; i < samples.size(); i += FIFO_CAPACITY) {
+      const size_t n = samples.size() - i < FIFO_CAPACITY
+                           ? samples.size() - i
+                           : FIFO_CAPACITY;
+      detector.process(&samples[i], n);
+    }
+    repeats++;
+  } while (Clock::now() - start < std::chrono::milliseconds(500));
+  const std::chrono::duration<double, std::nano> elapsed =
+      Clock::now() - start;
+  return elapsed.count() / (double(repeats) * samples.size());
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const float rateHz = argc > 1 ? std::strtof(argv[1], nullptr) : 200;
+  if (!(rateHz > 0)) {
+    std::fprintf(stderr, "usage: %s [rate-hz]\n", argv[0]);
+    return 1;
+  }
+  std::printf("ShakeDetector: %zu bytes of state, %.0f Hz\n",
+              sizeof(ShakeDetector), rateHz);
+  std::printf("  %-24s %8s %7s %9s\n", "scenario", "expected", "count",
+              "intensity");
+  int failures = 0;
+  std::vector<AccelSample> all;
+  for (const auto &s : makeScenarios(rateHz)) {
+    ShakeDetector detector;
+    detector.configure(ShakeDetectorConfig{}, rateHz);
+    detector.process(s.signal.samples.data(), s.signal.samples.size());
+    const bool ok = int(detector.count()) == s.expected;
+    failures += !ok;
+    std::printf("  %-24s %8d %7u %8.2fg%s\n", s.name.c_str(), s.expected,
+                detector.count(), detector.lastIntensity(), ok ? "" : " NG");
+    all.insert(all.end(), s.signal.samples.begin(), s.signal.samples.end());
+  }
+
+  ShakeDetector detector;
+  detector.configure(ShakeDetectorConfig{}, rateHz);
+  const double nanos = nanosPerSample(detector, all);
+  std::printf("  cost: %.1f ns/sample, %.2f us per %zu-sample FIFO batch\n",
+              nanos, nanos * FIFO_CAPACITY / 1000, FIFO_CAPACITY);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,415 @@
+/**
+ * @file shake_replay.cpp
+ * @brief 加速度の記録を振動検知に通して結果を比べるホスト用のツール
+ *
+ * 実機で -DSHAKE_TRACE を付けて記録した SD カードの /shake.trc を、
+ * 以前の軸ごとの閾値による検知と、今の `hardware::ShakeDetector` に通す。
+ * `startCount()` から `stopCount()` までを1回のアラームとして、回数と
+ * 目標の回数に届くまでの時間を出し、それ以外の時間に数えたものを
+ * 誤検知として出す。1サンプルあたりの処理時間も測る。
+ *
+ * ビルドと実行:
+ *
+ *     g++ -std=c++14 -O2 -Isrc tools/shake_replay.cpp -o shake_replay
+ *     ./shake_replay [options] trace.trc...
+ *
+ * options:
+ *
+ *     --legacy-threshold G  以前の検知の閾値 [g] (1.6)
+ *     --legacy-rate HZ      以前の検知に与えるサンプリング周波数 [Hz] (10)
+ *     --cutoff HZ           ShakeDetectorConfig::cutoffHz
+ *     --trigger G           ShakeDetectorConfig::triggerG
+ *     --release G           ShakeDetectorConfig::releaseG
+ *     --refractory MS       ShakeDetectorConfig::refractoryMillis
+ *     --pair-window MS      ShakeDetectorConfig::pairWindowMillis
+ *     --max-count N         アラームを止める回数 (SceneAlarming::max_count, 5)
+ *     --expect N            1回のアラームで実際に振った回数
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "hardware/shake_detector.hpp"
+#include "hardware/shake_trace_format.hpp"
+
+using namespace hardware;
+
+namespace {
+/// 以前の ShakingManager の検知。
+///
+/// `updateCount()` と `dirStateChange()` をそのまま写したもの。
+/// 加速度の軸ごとに閾値を上下に越えたら1回と数え、3軸の最大を取る。
+/// 実機では 100 ms ごとにレジスタを読んで与えていた。
+class LegacyCounter {
+public:
+  explicit LegacyCounter(float threshold)
+      : threshold_swing_angle_axis(threshold) {}
+
+  void resetCount() {
+    count = 0;
+    dir_x_state.count = 0;
+    dir_y_state.count = 0;
+    dir_z_state.count = 0;
+  }
+  int getCount() const { return count; }
+
+  void updateCount(const AccelSample &sample) {
+    auto swing_angle_velocity_x = sample.x;
+    auto swing_angle_velocity_y = sample.y;
+    auto swing_angle_velocity_z = sample.z;
+
+    dir_x_state = dirStateChange(swing_angle_velocity_x, dir_x_state);
+    dir_y_state = dirStateChange(swing_angle_velocity_y, dir_y_state);
+    dir_z_state = dirStateChange(swing_angle_velocity_z, dir_z_state);
+
+    count = std::max(count, dir_x_state.count);
+    count = std::max(count, dir_y_state.count);
+    count = std::max(count, dir_z_state.count);
+
+    dir_x_state.count = count;
+    dir_y_state.count = count;
+    dir_z_state.count = count;
+  }
+
+private:
+  enum class OneDirection { UpperSwing, LowerSwing };
+  struct OneDirectionState {
+    int count = 0;
+    OneDirection state = OneDirection::UpperSwing;
+  };
+
+  const float threshold_swing_angle_axis;
+  int count = 0;
+  OneDirectionState dir_x_state;
+  OneDirectionState dir_y_state;
+  OneDirectionState dir_z_state;
+
+  OneDirectionState dirStateChange(float swing_axis,
+                                   OneDirectionState dir_state) {
+    OneDirectionState next_state = dir_state;
+    switch (dir_state.state) {
+
+    case OneDirection::UpperSwing:
+      if (swing_axis > threshold_swing_angle_axis) {
+        next_state.count++;
+        next_state.state = OneDirection::LowerSwing;
+      }
+      break;
+
+    case OneDirection::LowerSwing:
+      if (swing_axis < -threshold_swing_angle_axis) {
+        next_state.state = OneDirection::UpperSwing;
+      }
+      break;
+    }
+
+    return next_state;
+  }
+};
+
+/// 1回のアラームの結果。
+struct Session {
+  uint64_t start = 0;
+  uint64_t end = 0;
+  int legacy = 0;
+  int detector = 0;
+  /// 目標の回数に届いた時刻 [0.1 ms] 。届かなければ 0
+  uint64_t legacyReached = 0;
+  uint64_t detectorReached = 0;
+};
+
+struct Options {
+  float legacyThreshold = 1.6f;
+  float legacyRateHz = 10;
+  ShakeDetectorConfig detector;
+  int maxCount = 5;
+  int expect = -1;
+};
+
+/// サンプルの間がこれより空いたら、途切れたとみなす [0.1 ms]
+constexpr uint64_t GAP_TICKS = 10000;
+
+bool load(const char *path, std::vector<ShakeTraceItem> &items,
+          uint16_t &odrHz) {
+  FILE *fp = std::fopen(path, "rb");
+  if (fp == nullptr) {
+    std::fprintf(stderr, "%s: cannot open\n", path);
+    return false;
+  }
+  ShakeTraceHeader header;
+  if (std::fread(&header, sizeof(header), 1, fp) != 1 ||
+      header.magic != SHAKE_TRACE_MAGIC ||
+      header.version != SHAKE_TRACE_VERSION ||
+      header.recordSize != sizeof(ShakeTraceRecord) || header.capacity == 0) {
+    std::fprintf(stderr, "%s: not a shake trace\n", path);
+    std::fclose(fp);
+    return false;
+  }
+  odrHz = header.odrHz;
+  std::vector<ShakeTraceRecord> ring(header.capacity);
+  const size_t stored =
+      std::fread(ring.data(), sizeof(ShakeTraceRecord), ring.size(), fp);
+  std::fclose(fp);
+  const uint32_t count = traceRingCount(header);
+  if (stored < count) {
+    std::fprintf(stderr, "%s: truncated (%zu of %u records)\n", path, stored,
+                 count);
+    return false;
+  }
+  const uint32_t first = traceRingFirst(header);
+  ShakeTraceDecoder decoder;
+  ShakeTraceItem item;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (decoder.decode(ring[(first + i) % header.capacity], item)) {
+      items.push_back(item);
+    }
+  }
+  return true;
+}
+
+/// 記録を両方の検知に通し、アラームごとの結果と誤検知の数を求める。
+void replay(const std::vector<ShakeTraceItem> &items, float sampleRateHz,
+            const Options &options, std::vector<Session> &sessions,
+            int &legacyFalse, int &detectorFalse) {
+  // 実機と同じく、数えている間だけ与える
+  LegacyCounter legacy(options.legacyThreshold);
+  // 誤検知を調べるため、数えていない間も与え続ける
+  LegacyCounter legacyShadow(options.legacyThreshold);
+  ShakeDetector detector;
+  detector.configure(options.detector, sampleRateHz);
+  const uint64_t legacyInterval =
+      static_cast<uint64_t>(10000 / options.legacyRateHz);
+  uint64_t legacyNext = 0;
+  uint64_t lastSample = 0;
+  bool counting = false;
+  legacyFalse = detectorFalse = 0;
+  for (const ShakeTraceItem &item : items) {
+    if (!item.isSample) {
+      switch (item.event) {
+      case ShakeTraceEvent::StartCount:
+        if (!counting) {
+          sessions.push_back(Session{});
+          sessions.back().start = item.time;
+        }
+        counting = true;
+        break;
+      case ShakeTraceEvent::StopCount:
+        if (counting) {
+          sessions.back().end = item.time;
+        }
+        counting = false;
+        break;
+      case ShakeTraceEvent::ResetCount:
+        legacy.resetCount();
+        if (counting) {
+          sessions.back().legacy = sessions.back().detector = 0;
+        }
+        break;
+      default:
+        break;
+      }
+      continue;
+    }
+    // 動き検知から読み始めたときと同じく、途切れたら重力を測り直す
+    if (lastSample != 0 && item.time - lastSample > GAP_TICKS) {
+      detector.restart();
+    }
+    lastSample = item.time;
+    const uint32_t before = detector.count();
+    detector.process(&item.sample, 1);
+    const int detected = static_cast<int>(detector.count() - before);
+    // 以前の検知は 100 ms ごとに1回読んでいたので、間引いて与える
+    int legacyDetected = 0;
+    if (item.time >= legacyNext) {
+      legacyNext = item.time + legacyInterval;
+      if (counting) {
+        const int c = legacy.getCount();
+        legacy.updateCount(item.sample);
+        legacyDetected = legacy.getCount() - c;
+      } else {
+        const int c = legacyShadow.getCount();
+        legacyShadow.updateCount(item.sample);
+        legacyFalse += legacyShadow.getCount() - c;
+      }
+    }
+    if (!counting) {
+      detectorFalse += detected;
+      continue;
+    }
+    Session &s = sessions.back();
+    s.legacy += legacyDetected;
+    s.detector += detected;
+    s.end = item.time;
+    if (s.legacyReached == 0 && s.legacy >= options.maxCount) {
+      s.legacyReached = item.time;
+    }
+    if (s.detectorReached == 0 && s.detector >= options.maxCount) {
+      s.detectorReached = item.time;
+    }
+  }
+}
+
+/// 検知の1サンプルあたりの処理時間 [ns] を測る。
+template <typename F> double nanosPerSample(size_t samples, F run) {
+  if (samples == 0) {
+    return 0;
+  }
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  size_t repeats = 0;
+  do {
+    run();
+    repeats++;
+  } while (Clock::now() - start < std::chrono::milliseconds(200));
+  const std::chrono::duration<double, std::nano> elapsed =
+      Clock::now() - start;
+  return elapsed.count() / (double(repeats) * samples);
+}
+
+double seconds(uint64_t ticks) { return ticks / 10000.0; }
+
+void printReached(uint64_t reached, uint64_t start) {
+  if (reached == 0) {
+    std::printf("%8s", "-");
+  } else {
+    std::printf("%7.1fs", seconds(reached - start));
+  }
+}
+
+bool parseOptions(int argc, char **argv, Options &options,
+                  std::vector<const char *> &files) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.compare(0, 2, "--") != 0) {
+      files.push_back(argv[i]);
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::fprintf(stderr, "%s needs a value\n", arg.c_str());
+      return false;
+    }
+    const char *value = argv[++i];
+    if (arg == "--legacy-threshold") {
+      options.legacyThreshold = std::strtof(value, nullptr);
+    } else if (arg == "--legacy-rate") {
+      options.legacyRateHz = std::strtof(value, nullptr);
+    } else if (arg == "--cutoff") {
+      options.detector.cutoffHz = std::strtof(value, nullptr);
+    } else if (arg == "--trigger") {
+      options.detector.triggerG = std::strtof(value, nullptr);
+    } else if (arg == "--release") {
+      options.detector.releaseG = std::strtof(value, nullptr);
+    } else if (arg == "--refractory") {
+      options.detector.refractoryMillis = std::strtoul(value, nullptr, 10);
+    } else if (arg == "--pair-window") {
+      options.detector.pairWindowMillis = std::strtoul(value, nullptr, 10);
+    } else if (arg == "--max-count") {
+      options.maxCount = std::atoi(value);
+    } else if (arg == "--expect") {
+      options.expect = std::atoi(value);
+    } else {
+      std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+      return false;
+    }
+  }
+  return !files.empty() && options.legacyRateHz > 0;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  std::vector<const char *> files;
+  if (!parseOptions(argc, argv, options, files)) {
+    std::fprintf(stderr, "usage: %s [options] trace.trc...\n", argv[0]);
+    return 2;
+  }
+  int totalMissed[2] = {0, 0}, totalExtra[2] = {0, 0};
+  int totalFalse[2] = {0, 0};
+  for (const char *path : files) {
+    std::vector<ShakeTraceItem> items;
+    uint16_t odrHz = 0;
+    if (!load(path, items, odrHz)) {
+      return 1;
+    }
+    std::vector<AccelSample> samples;
+    for (const ShakeTraceItem &item : items) {
+      if (item.isSample) {
+        samples.push_back(item.sample);
+      }
+    }
+    if (samples.empty()) {
+      std::printf("%s: no samples\n", path);
+      continue;
+    }
+    // レジスタ読みの記録は 100 ms ごと
+    const float sampleRateHz = odrHz > 0 ? odrHz : 10;
+    std::vector<Session> sessions;
+    int legacyFalse = 0, detectorFalse = 0;
+    replay(items, sampleRateHz, options, sessions, legacyFalse,
+           detectorFalse);
+
+    const double span = seconds(items.back().time - items.front().time);
+    std::printf("%s: %zu samples at %.0f Hz over %.1f s, %zu alarms\n", path,
+                samples.size(), sampleRateHz, span, sessions.size());
+    std::printf("  %-4s %9s %7s %7s %8s %8s\n", "#", "start", "legacy",
+                "filter", "legacy", "filter");
+    std::printf("  %-4s %9s %7s %7s %8s %8s\n", "", "[s]", "count", "count",
+                "to max", "to max");
+    for (size_t i = 0; i < sessions.size(); ++i) {
+      const Session &s = sessions[i];
+      std::printf("  %-4zu %9.1f %7d %7d ", i, seconds(s.start), s.legacy,
+                  s.detector);
+      printReached(s.legacyReached, s.start);
+      std::printf(" ");
+      printReached(s.detectorReached, s.start);
+      std::printf("\n");
+      if (options.expect >= 0) {
+        const int counts[2] = {s.legacy, s.detector};
+        for (int d = 0; d < 2; ++d) {
+          const int diff = counts[d] - options.expect;
+          totalMissed[d] += diff < 0 ? -diff : 0;
+          totalExtra[d] += diff > 0 ? diff : 0;
+        }
+      }
+    }
+    std::printf("  false positives outside alarms: legacy %d, filter %d\n",
+                legacyFalse, detectorFalse);
+    totalFalse[0] += legacyFalse;
+    totalFalse[1] += detectorFalse;
+
+    // 処理時間は全サンプルを通して測る。以前の検知も間引かずに与える
+    const double legacyNs = nanosPerSample(samples.size(), [&]() {
+      LegacyCounter legacy(options.legacyThreshold);
+      for (const AccelSample &s : samples) {
+        legacy.updateCount(s);
+      }
+      if (legacy.getCount() < 0) {
+        std::puts("");
+      }
+    });
+    const double detectorNs = nanosPerSample(samples.size(), [&]() {
+      ShakeDetector detector;
+      detector.configure(options.detector, sampleRateHz);
+      detector.process(samples.data(), samples.size());
+      if (detector.count() == UINT32_MAX) {
+        std::puts("");
+      }
+    });
+    std::printf("  cost: legacy %.1f ns/sample, filter %.1f ns/sample\n",
+                legacyNs, detectorNs);
+  }
+  std::printf("total false positives: legacy %d, filter %d\n", totalFalse[0],
+              totalFalse[1]);
+  if (options.expect >= 0) {
+    std::printf("total vs. --expect %d: legacy %d missed %d extra, "
+                "filter %d missed %d extra\n",
+                options.expect, totalMissed[0], totalExtra[0], totalMissed[1],
+                totalExtra[1]);
+  }
+  return 0;
+}
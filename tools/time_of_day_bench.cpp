@@ -0,0 +1,146 @@
+/**
+ * @file time_of_day_bench.cpp
+ * @brief `sugar::TimeOfDay` の時分秒への分解の時間を測るホスト用のツール
+ *
+ * 今の 32 ビットの `TimeOfDay` の `hms()` と位ごとの関数を、以前の
+ * 64 ビットの `std::chrono::milliseconds` で持っていた版と、同じ時刻の列で
+ * 比べる。時計の画面のように、1つの時刻から4つの位をすべて取り出す。
+ *
+ * ビルドと実行:
+ *
+ *     g++ -std=c++14 -O2 -Isrc tools/time_of_day_bench.cpp \
+ *         -o time_of_day_bench
+ *     ./time_of_day_bench [values]
+ *
+ * 実機に近い 32 ビットの除算の差を見るには、 -m32 を付けてビルドする。
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "time_of_day.hpp"
+
+using sugar::TimeOfDay;
+
+namespace {
+/// 以前の `TimeOfDay` の分解。深夜からの時間を 64 ビットで持つ。
+class LegacyTimeOfDay {
+public:
+  explicit LegacyTimeOfDay(std::chrono::milliseconds timeSinceMidnight)
+      : m_timeSinceMidnight(timeSinceMidnight) {}
+
+  int hour() const {
+    return std::chrono::duration_cast<std::chrono::hours>(m_timeSinceMidnight)
+               .count() %
+           24;
+  }
+  int minute() const {
+    return std::chrono::duration_cast<std::chrono::minutes>(m_timeSinceMidnight)
+               .count() %
+           60;
+  }
+  int second() const {
+    return std::chrono::duration_cast<std::chrono::seconds>(m_timeSinceMidnight)
+               .count() %
+           60;
+  }
+  int millisecond() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               m_timeSinceMidnight)
+               .count() %
+           1000;
+  }
+
+private:
+  std::chrono::milliseconds m_timeSinceMidnight;
+};
+
+/// 再現できるよう固定の種から、1日の中に一様に散らばった時刻の列を作る。
+std::vector<uint32_t> makeMillis(size_t n) {
+  std::vector<uint32_t> millis;
+  millis.reserve(n);
+  uint32_t x = 2463534242u;
+  for (size_t i = 0; i < n; ++i) {
+    // xorshift32
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    millis.push_back(x % (24UL * 60 * 60 * 1000));
+  }
+  return millis;
+}
+
+/// 4つの位をまとめて検査用の値にする。
+inline uint64_t fold(int h, int m, int s, int ms) {
+  return uint64_t(h) * 1000000000 + m * 10000000 + s * 100000 + ms;
+}
+
+/// 1つの時刻あたりの処理時間 [ns] を測る。
+///
+/// `run()` は検査用の値の合計を返し、最後の1回の値を `checksum` に入れる。
+template <typename F>
+double nanosPerValue(size_t values, uint64_t &checksum, F run) {
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  size_t repeats = 0;
+  do {
+    checksum = run();
+    repeats++;
+  } while (Clock::now() - start < std::chrono::milliseconds(500));
+  const std::chrono::duration<double, std::nano> elapsed =
+      Clock::now() - start;
+  return elapsed.count() / (double(repeats) * values);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 4096;
+  if (n == 0) {
+    std::fprintf(stderr, "usage: %s [values]\n", argv[0]);
+    return 1;
+  }
+  const std::vector<uint32_t> millis = makeMillis(n);
+  std::vector<LegacyTimeOfDay> legacy;
+  std::vector<TimeOfDay> current;
+  for (uint32_t ms : millis) {
+    legacy.emplace_back(std::chrono::milliseconds(ms));
+    current.emplace_back(std::chrono::milliseconds(ms));
+  }
+
+  uint64_t legacySum, fieldsSum, hmsSum;
+  const double legacyNanos = nanosPerValue(n, legacySum, [&]() {
+    uint64_t sum = 0;
+    for (const auto &t : legacy) {
+      sum += fold(t.hour(), t.minute(), t.second(), t.millisecond());
+    }
+    return sum;
+  });
+  const double fieldsNanos = nanosPerValue(n, fieldsSum, [&]() {
+    uint64_t sum = 0;
+    for (const auto &t : current) {
+      sum += fold(t.hour(), t.minute(), t.second(), t.millisecond());
+    }
+    return sum;
+  });
+  const double hmsNanos = nanosPerValue(n, hmsSum, [&]() {
+    uint64_t sum = 0;
+    for (const auto &t : current) {
+      const TimeOfDay::Hms hms = t.hms();
+      sum += fold(hms.hour, hms.minute, hms.second, hms.millisecond);
+    }
+    return sum;
+  });
+
+  if (legacySum != fieldsSum || legacySum != hmsSum) {
+    std::fprintf(stderr, "decomposition mismatch\n");
+    return 1;
+  }
+  std::printf("%zu values, %zu-bit build, checksum %llu\n", n,
+              sizeof(void *) * 8, static_cast<unsigned long long>(hmsSum));
+  std::printf("  legacy 64-bit fields: %6.2f ns/value\n", legacyNanos);
+  std::printf("  32-bit fields:        %6.2f ns/value\n", fieldsNanos);
+  std::printf("  32-bit hms():         %6.2f ns/value\n", hmsNanos);
+  return 0;
+}